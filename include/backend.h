@@ -25,8 +25,11 @@ typedef struct {
     
     /* Register management */
     X86Register allocated_regs[MAX_X86_REGS];  /* Allocated registers */
-    Bool reg_in_use[MAX_X86_REGS];   /* Register usage tracking */
+    Bool reg_in_use[MAX_X86_REGS + 1];   /* Register usage tracking, indexed by X86Register */
     I64 reg_count;                   /* Number of allocated registers */
+    U32 callee_saved_used;           /* Win64 non-volatile registers handed out (bit per X86Register) */
+    I64 spill_slot_of[MAX_X86_REGS + 1];  /* Spill slot holding a register's old value, -1 if none */
+    U64 spill_slots_used;            /* Occupied spill slots (bit per slot) */
     
     /* Stack management */
     I64 stack_offset;                /* Current stack offset */
@@ -74,6 +77,7 @@ X86Register asm_allocate_register(AssemblyContext *ctx, I64 size);
 void asm_free_register(AssemblyContext *ctx, X86Register reg);
 Bool asm_is_register_allocated(AssemblyContext *ctx, X86Register reg);
 X86Register asm_spill_register(AssemblyContext *ctx, X86Register reg);
+Bool asm_reload_register(AssemblyContext *ctx, X86Register reg);
 
 /* Assembly Instruction Generation */
 Bool asm_generate_mov(AssemblyContext *ctx, CAsmArg *dst, CAsmArg *src);
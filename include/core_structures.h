@@ -64,6 +64,9 @@ typedef bool Bool;
 /* Intermediate Code Flags */
 #define ICF_AOT_COMPILE 0x01
 #define ICF_RES_NOT_USED 0x02
+#define ICF_LABEL_USED 0x04
+#define ICF_LOOP_UNROLLED 0x08
+#define ICF_PROFILED 0x10
 
 /* Constants */
 #define IC_BODY_SIZE 32
@@ -381,6 +384,10 @@ typedef struct CIntermediateCode {
     Bool regs_allocated;     /* Whether registers are allocated */
     Bool regs_spilled;       /* Whether registers were spilled */
     
+    /* Control flow info */
+    void *ic_block;          /* Owning basic block (ICBasicBlock, see intermediate.h) */
+    U64 ic_exec_count;       /* Executions from --profile-use, valid with ICF_PROFILED */
+    
     /* Memory layout info */
     I64 stack_offset;        /* Stack offset for local variables */
     I64 memory_operand_size; /* Size of memory operands */
@@ -10,19 +10,23 @@
 #include "core_structures.h"
 #include "lexer.h"
 #include "parser.h"
+#include "profile.h"
 
 /* Intermediate Code Operation Types */
 typedef enum {
     IC_NOP = 0,
     IC_ADD, IC_SUB, IC_MUL, IC_DIV, IC_MOD,
     IC_AND, IC_OR, IC_XOR, IC_NOT,
+    IC_UNARY_MINUS, IC_UNARY_BITNOT,
     IC_SHL, IC_SHR,
     IC_EQU, IC_NOT_EQU, IC_LESS, IC_GREATER, IC_LESS_EQU, IC_GREATER_EQU,
     IC_ASSIGN, IC_ADD_ASSIGN, IC_SUB_ASSIGN, IC_MUL_ASSIGN, IC_DIV_ASSIGN,
     IC_CALL, IC_RETURN, IC_RETURN_VAL,
-    IC_JUMP, IC_JUMP_TRUE, IC_JUMP_FALSE,
+    IC_ENTER, IC_LEAVE, IC_PARAM,
+    IC_JUMP, IC_JUMP_TRUE, IC_JUMP_FALSE, IC_LABEL,
+    IC_PHI,
     IC_PUSH, IC_POP,
-    IC_LOAD, IC_STORE,
+    IC_LOAD, IC_STORE, IC_ADDR,
     IC_CAST,
     IC_PRINT, IC_PRINTF,
     IC_MALLOC, IC_FREE,
@@ -44,9 +48,143 @@ typedef enum {
     /* AOT compilation operations */
     IC_AOT_STORE,       /* AOT code storage */
     IC_AOT_RESOLVE,     /* AOT symbol resolution */
-    IC_AOT_PATCH        /* AOT code patching */
+    IC_AOT_PATCH,       /* AOT code patching */
+    
+    /* Vector operations (vectorize.c) */
+    IC_VEC_LOAD,        /* Unaligned vector load */
+    IC_VEC_STORE,       /* Unaligned vector store */
+    IC_VEC_SPLAT,       /* Scalar broadcast to every lane */
+    IC_VEC_ADD, IC_VEC_SUB, IC_VEC_MUL,
+    IC_VEC_AND, IC_VEC_OR, IC_VEC_XOR,
+    IC_VEC_REDUCE       /* Horizontal reduction to a scalar */
 } ICOperation;
 
+/*
+ * IC Argument Kinds (CICArg.type)
+ *
+ * Operand conventions used by the AST-to-IC generator and the passes:
+ *   IC_ADD..IC_GREATER_EQU   res = arg1 op arg2
+ *   IC_NOT, IC_UNARY_*       res = op arg1
+ *   IC_ASSIGN                res = arg1
+ *   IC_LOAD                  res = [arg1], memory_operand_size bytes
+ *   IC_STORE                 [arg1] = arg2, memory_operand_size bytes
+ *   IC_ADDR                  res = address of variable arg1
+ *   IC_PUSH                  outgoing call argument arg1 (in order)
+ *   IC_CALL                  res = call arg1 (symbol), ic_data = argument count
+ *   IC_MALLOC                res = MAlloc(arg1), a runtime call
+ *   IC_FREE                  Free(arg1), a runtime call
+ *   IC_RETURN_VAL            return arg1
+ *   IC_JUMP                  goto arg1 (label)
+ *   IC_JUMP_TRUE/FALSE       if (arg1) / if (!arg1) goto arg2 (label)
+ *   IC_LABEL                 branch target, ic_data = label number
+ *   IC_ENTER/IC_LEAVE        function boundaries, arg1 = function symbol
+ *   IC_PARAM                 res = incoming argument number ic_data
+ *   IC_PHI                   res = phi of variable arg2; arg1 (IC_ARG_OWNED) holds
+ *                            ic_data CICArgs, one per block predecessor (SSA only)
+ *   IC_VEC_*                 ic_data = vector width in bytes (16 SSE2, 32 AVX2),
+ *                            memory_operand_size = lane size in bytes
+ *   IC_VEC_LOAD/STORE        like IC_LOAD/IC_STORE, one vector at a time
+ *   IC_VEC_SPLAT             res = scalar arg1 in every lane
+ *   IC_VEC_ADD..IC_VEC_XOR   res = arg1 op arg2 lane by lane
+ *   IC_VEC_REDUCE            res = lanes of arg1 combined by scalar operation arg2 (constant)
+ */
+#define IC_ARG_CONST    0   /* Immediate value in i64_val */
+#define IC_ARG_ASM      1   /* CAsmArg pointer in ptr_val */
+#define IC_ARG_TEMP     2   /* Virtual register number in i64_val */
+#define IC_ARG_OWNED    3   /* Heap pointer owned by the IC (released by ic_free) */
+#define IC_ARG_VAR      4   /* Index into ICGenContext.vars in i64_val */
+#define IC_ARG_LABEL    5   /* IC_LABEL instruction in ic_ptr */
+#define IC_ARG_SYMBOL   6   /* Function or global name in ptr_val */
+#define IC_ARG_STRING   7   /* String literal text in ptr_val */
+#define IC_ARG_FCONST   8   /* Floating-point immediate in f64_val */
+
+/* Variable tracked by the IC generator (locals, parameters, globals, hidden temporaries) */
+typedef struct {
+    U8 *name;                        /* Source name (NULL for compiler temporaries) */
+    I64 func_index;                  /* Owning function (IC_ENTER ordinal) */
+    I64 size;                        /* Size in bytes */
+    I64 param_index;                 /* Parameter index, -1 for non-parameters */
+    I64 stack_offset;                /* Frame slot offset */
+    Bool is_global;                  /* Lives in global data (visible to calls) */
+    Bool is_parameter;               /* Incoming function argument */
+    Bool is_array;                   /* Aggregate, always lives in memory */
+    Bool address_taken;              /* Address escapes via & or sub-int access */
+    Bool is_volatile;                /* Accessed by inline assembly */
+} ICVar;
+
+/*
+ * Control Flow Graph
+ * Basic blocks are contiguous ranges of the IC chain; see cfg.c
+ */
+typedef struct ICBasicBlock {
+    I64 id;                          /* Index in ICCfg.blocks (layout order) */
+    CIntermediateCode *first;        /* First IC of block (inclusive) */
+    CIntermediateCode *last;         /* Last IC of block (inclusive) */
+    struct ICBasicBlock *succ[2];    /* [0] fall-through or jump target, [1] branch taken */
+    I64 succ_count;                  /* Number of successors (0-2) */
+    struct ICBasicBlock **preds;     /* Predecessor blocks */
+    I64 pred_count;                  /* Number of predecessors */
+    I64 pred_capacity;               /* Allocated predecessor slots */
+    I64 rpo_number;                  /* Reverse post-order number, -1 if unreachable */
+    struct ICBasicBlock *idom;       /* Immediate dominator */
+    struct ICBasicBlock *dom_child;  /* First child in dominator tree */
+    struct ICBasicBlock *dom_sibling; /* Next sibling in dominator tree */
+    I64 dom_depth;                   /* Depth in dominator tree */
+    struct ICLoop *loop;             /* Innermost containing loop */
+} ICBasicBlock;
+
+typedef struct ICLoop {
+    ICBasicBlock *header;            /* Loop header (dominates all blocks) */
+    ICBasicBlock **blocks;           /* Member blocks including nested loops */
+    I64 block_count;                 /* Number of member blocks */
+    ICBasicBlock **latches;          /* Sources of back edges */
+    I64 latch_count;                 /* Number of back edges */
+    struct ICLoop *parent;           /* Enclosing loop */
+    struct ICLoop *first_child;      /* First nested loop */
+    struct ICLoop *next_sibling;     /* Next loop with the same parent */
+    I64 depth;                       /* Nesting depth (1 = outermost) */
+} ICLoop;
+
+typedef struct {
+    CIntermediateCode *enter;        /* IC_ENTER of the function */
+    CIntermediateCode *leave;        /* IC_LEAVE of the function */
+    ICBasicBlock **blocks;           /* Blocks in layout order */
+    I64 block_count;                 /* Number of blocks */
+    ICBasicBlock **rpo;              /* Reachable blocks in reverse post-order */
+    I64 rpo_count;                   /* Number of reachable blocks */
+    ICLoop **loops;                  /* Loop nesting forest, outermost loops first */
+    I64 loop_count;                  /* Number of loops */
+} ICCfg;
+
+/*
+ * Liveness sets per basic block; see liveness.c
+ * Value indices: temps 0..temp_count-1, variable v at temp_count+v
+ */
+typedef struct {
+    I64 value_count;                 /* Number of tracked values */
+    I64 temp_count;                  /* Temps tracked before variables */
+    I64 words;                       /* U64 words per set */
+    I64 block_count;                 /* Number of blocks with sets */
+    U64 *live_in;                    /* block_count sets, indexed by block id */
+    U64 *live_out;                   /* block_count sets, indexed by block id */
+    U64 *call_mask;                  /* Variables a call may read */
+    U64 *asm_mask;                   /* Variables inline assembly may read */
+    U64 *load_mask;                  /* Variables a load may read */
+    U64 *exit_mask;                  /* Variables live at function exit */
+} ICLiveness;
+
+/*
+ * Where register allocation placed a value; see regalloc.c
+ * Indexed like ICLiveness: temps first, then variables
+ */
+typedef struct {
+    X86Register reg;                 /* Register, X86_REG_NONE if always in memory */
+    CIntermediateCode *split_at;     /* Stored to its spill slot before this IC, NULL if never */
+    I64 spill_offset;                /* Offset in the function's spill area, -1 if none */
+    Bool remat;                      /* Reloaded by rematerializing remat_value instead */
+    I64 remat_value;                 /* Constant to rematerialize */
+} ICValueLoc;
+
 /* Intermediate Code Generation Context */
 typedef struct {
     CCmpCtrl *cc;                    /* Compiler control */
@@ -60,12 +198,29 @@ typedef struct {
     I64 stack_offset;                /* Current stack offset */
     I64 instruction_pointer;         /* Current instruction pointer */
     
+    /* AST-to-IC generation state */
+    CICArg last_result;              /* Value of the last generated expression */
+    I64 temp_count;                  /* Virtual registers handed out */
+    I64 label_count;                 /* Labels handed out */
+    I64 func_count;                  /* Functions (IC_ENTER) generated */
+    I64 func_var_base;               /* First vars[] entry of the current function */
+    ICVar *vars;                     /* Variable table */
+    I64 var_count;                   /* Number of variables */
+    I64 var_capacity;                /* Allocated variable slots */
+    CIntermediateCode *break_label;  /* Target of break in the innermost loop */
+    CIntermediateCode *continue_label; /* Target of continue in the innermost loop */
+    
     /* Optimization state */
     Bool optimization_enabled;       /* Whether optimizations are enabled */
     I64 optimization_level;          /* Optimization level (0-9) */
     Bool dead_code_elimination;      /* Dead code elimination enabled */
     Bool constant_folding;           /* Constant folding enabled */
     Bool register_optimization;      /* Register optimization enabled */
+    Bool instruction_scheduling;     /* List scheduling of basic blocks enabled */
+    I64 opt_changes;                 /* Transformations applied so far (fixed-point detection) */
+    ICValueLoc *value_locs;          /* Register allocation result per value */
+    I64 value_loc_count;             /* Number of value_locs entries */
+    ProfileData *profile;            /* Counts from --profile-use, NULL without */
 } ICGenContext;
 
 /* Optimization Pass Functions */
@@ -104,6 +259,9 @@ Bool opt_memory_access_optimization(ICGenContext *ctx);
 Bool opt_constant_folding(ICGenContext *ctx);
 Bool opt_constant_propagation(ICGenContext *ctx);
 
+/* Redundancy elimination */
+Bool opt_value_numbering(ICGenContext *ctx);
+
 /* Dead code elimination */
 Bool opt_dead_code_elimination(ICGenContext *ctx);
 Bool opt_unreachable_code_elimination(ICGenContext *ctx);
@@ -111,11 +269,81 @@ Bool opt_unreachable_code_elimination(ICGenContext *ctx);
 /* Control flow optimization */
 Bool opt_branch_optimization(ICGenContext *ctx);
 Bool opt_loop_optimization(ICGenContext *ctx);
+Bool opt_function_inlining(ICGenContext *ctx);
+Bool opt_induction_variables(ICGenContext *ctx);
+Bool opt_loop_unrolling(ICGenContext *ctx);
+Bool opt_loop_vectorization(ICGenContext *ctx);
+
+/* Heap to stack promotion */
+Bool opt_escape_analysis(ICGenContext *ctx);
 
 /* Utility functions */
 CIntermediateCode* ic_find_next_use(CIntermediateCode *start, X86Register reg);
 Bool ic_is_dead(CIntermediateCode *ic);
 I64 ic_calculate_cost(CIntermediateCode *ic);
+Bool ic_fold_is_binary(U16 code);
+Bool ic_fold_constant(U16 code, I64 a, I64 b, I64 *result);
+
+/* IC building and editing helpers */
+CICArg ic_arg_const(I64 value);
+CICArg ic_arg_temp(ICGenContext *ctx);
+CICArg ic_arg_var(I64 index);
+CICArg ic_arg_label(CIntermediateCode *label);
+CICArg ic_arg_symbol(U8 *name);
+Bool ic_arg_equal(CICArg *a, CICArg *b);
+Bool ic_arg_is_value(CICArg *arg);
+CIntermediateCode* ic_gen_emit(ICGenContext *ctx, ICOperation op, CICArg *arg1, CICArg *arg2, CICArg *res);
+CIntermediateCode* ic_gen_new_label(ICGenContext *ctx);
+void ic_gen_place_label(ICGenContext *ctx, CIntermediateCode *label);
+void ic_insert_before(ICGenContext *ctx, CIntermediateCode *pos, CIntermediateCode *ic);
+void ic_insert_after(ICGenContext *ctx, CIntermediateCode *pos, CIntermediateCode *ic);
+void ic_unlink(ICGenContext *ctx, CIntermediateCode *ic);
+void ic_remove(ICGenContext *ctx, CIntermediateCode *ic);
+CIntermediateCode* ic_clone(CIntermediateCode *ic);
+Bool ic_is_branch(CIntermediateCode *ic);
+Bool ic_is_terminator(CIntermediateCode *ic);
+Bool ic_has_side_effects(CIntermediateCode *ic);
+I64 ic_get_uses(CIntermediateCode *ic, CICArg **uses);
+CICArg* ic_get_def(CIntermediateCode *ic);
+CIntermediateCode* ic_branch_target(CIntermediateCode *ic);
+void ic_set_branch_target(CIntermediateCode *ic, CIntermediateCode *label);
+CIntermediateCode* ic_next_function(CIntermediateCode *ic);
+I64 ic_var_lookup(ICGenContext *ctx, U8 *name);
+I64 ic_var_add(ICGenContext *ctx, U8 *name, I64 size);
+void ic_dump(ICGenContext *ctx);
+
+/* Control flow graph (cfg.c) */
+ICCfg* ic_cfg_build(ICGenContext *ctx, CIntermediateCode *enter);
+void ic_cfg_free(ICCfg *cfg);
+Bool ic_cfg_compute_dominators(ICCfg *cfg);
+Bool ic_cfg_find_loops(ICCfg *cfg);
+Bool ic_cfg_dominates(ICBasicBlock *a, ICBasicBlock *b);
+Bool ic_loop_contains(ICLoop *loop, ICBasicBlock *bb);
+ICBasicBlock* ic_cfg_block_of(CIntermediateCode *ic);
+CIntermediateCode* ic_cfg_block_label(ICGenContext *ctx, ICBasicBlock *bb);
+void ic_cfg_dump(ICCfg *cfg);
+
+/* SSA form (ssa.c) */
+Bool ic_ssa_construct(ICGenContext *ctx, ICCfg *cfg);
+Bool ic_ssa_destruct(ICGenContext *ctx, ICCfg *cfg);
+Bool ic_ssa_is_promotable(ICGenContext *ctx, I64 var);
+
+/* Loop transformation helpers (licm.c) */
+CIntermediateCode* ic_loop_preheader(ICGenContext *ctx, ICLoop *loop);
+
+/* Vector operations (vectorize.c) */
+Bool ic_is_vector_op(U16 code);
+Bool ic_defines_vector(CIntermediateCode *ic);
+void ic_vec_mnemonic(CIntermediateCode *ic, char *buf, I64 size);
+
+/* Register allocation (regalloc.c) */
+const char* ic_reg_name(X86Register reg);
+
+/* Liveness (liveness.c) */
+ICLiveness* ic_liveness_compute(ICGenContext *ctx, ICCfg *cfg);
+void ic_liveness_free(ICLiveness *lv);
+I64 ic_liveness_index(ICLiveness *lv, CICArg *arg);
+void ic_liveness_transfer(ICLiveness *lv, CIntermediateCode *ic, U64 *live);
 
 /* Assembly generation from intermediate code */
 U8* ic_generate_assembly(ICGenContext *ctx, I64 *size);
@@ -142,6 +370,12 @@ Bool ic_gen_integer_literal(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_float_literal(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_char_literal(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_identifier(ICGenContext *ctx, ASTNode *node);
+Bool ic_gen_expression(ICGenContext *ctx, ASTNode *node, CICArg *result);
+Bool ic_gen_condition_jump(ICGenContext *ctx, ASTNode *node, Bool jump_if, CIntermediateCode *label);
+Bool ic_gen_address_of(ICGenContext *ctx, ASTNode *node, CICArg *result);
+Bool ic_gen_memory_access(ICGenContext *ctx, ASTNode *node);
+Bool ic_gen_conditional(ICGenContext *ctx, ASTNode *node);
+Bool ic_gen_range_comparison(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_binary_operation(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_unary_operation(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_function_call(ICGenContext *ctx, ASTNode *node);
@@ -151,6 +385,7 @@ Bool ic_gen_function_declaration(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_if_statement(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_while_statement(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_for_statement(ICGenContext *ctx, ASTNode *node);
+Bool ic_gen_do_while_statement(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_return_statement(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_block_statement(ICGenContext *ctx, ASTNode *node);
 Bool ic_gen_assembly_block(ICGenContext *ctx, ASTNode *node);
@@ -0,0 +1,52 @@
+/*
+ * Interprocedural Optimization Header
+ * Whole-program passes over the AST: a call graph of the user functions,
+ * interprocedural constant propagation, specialization of functions for
+ * constant arguments and removal of functions nothing can call
+ */
+
+#ifndef IPA_H
+#define IPA_H
+
+#include "core_structures.h"
+#include "parser.h"
+
+#define IPA_MAX_CLONES       4       /* Specializations made of one function */
+#define IPA_CLONE_MAX_NODES  256     /* Larger bodies are not specialized */
+
+/* A user function, with the calls to it found in the program */
+typedef struct {
+    ASTNode *node;                   /* NODE_FUNCTION */
+    I64 param_count;
+    ASTNode **params;                /* NODE_VARIABLE of each parameter */
+    ASTNode **defaults;              /* Default value of each parameter, or NULL */
+    Bool *written;                   /* Parameter assigned or address taken in the body */
+    ASTNode **sites;                 /* Direct NODE_CALLs to the function */
+    I64 site_count;
+    I64 site_capacity;
+    I64 size;                        /* AST nodes in the body */
+    I64 clone_count;
+    Bool variadic;                   /* Takes ... arguments */
+    Bool opaque;                     /* Parameters cannot be rewritten */
+    Bool address_taken;              /* Named other than as a direct call */
+    Bool reachable;
+} IPAFunction;
+
+typedef struct {
+    ParserState *parser;             /* Symbol table the specializations join */
+    ASTNode *program;
+    IPAFunction *functions;
+    I64 function_count;
+    I64 function_capacity;           /* Entries allocated, clones included */
+    Bool complete;                   /* Every call in the program was seen */
+    I64 propagated;                  /* Parameters replaced by their constant */
+    I64 defaults_filled;             /* Default arguments written into calls */
+    I64 specialized;                 /* Clones made for constant arguments */
+    I64 removed;                     /* Unreachable functions dropped */
+} CallGraph;
+
+CallGraph* ipa_call_graph_new(ASTNode *program);
+void ipa_call_graph_free(CallGraph *graph);
+I64 ipa_optimize(ParserState *parser, ASTNode *program);
+
+#endif /* IPA_H */
@@ -8,6 +8,34 @@
 
 #include "core_structures.h"
 #include "backend.h"
+#include "profile.h"
+
+/* One emitted line of a PROC held back for the peephole optimizer */
+typedef enum {
+    MASM_LINE_TEXT,              /* Blank or comment-only line */
+    MASM_LINE_LABEL,             /* name: */
+    MASM_LINE_INSTR              /* Instruction or directive */
+} MASMLineKind;
+
+typedef struct {
+    MASMLineKind kind;
+    char *text;                  /* Line as emitted, written out while unchanged */
+    char op[16];                 /* Lower-case mnemonic, or the label name */
+    char dst[64];                /* First operand, empty when absent */
+    char src[64];                /* Second operand, empty when absent */
+    char comment[96];            /* Trailing comment without the ';' */
+    Bool changed;                /* Rewritten: render from op/dst/src */
+    Bool deleted;
+} MASMLine;
+
+typedef struct {
+    MASMLine *lines;
+    size_t count;
+    size_t capacity;
+} MASMLineList;
+
+/* Callee-saved registers that can hold a function's locals */
+#define MASM_PROMOTE_REGISTERS 5
 
 /* MASM Assembly Context */
 typedef struct {
@@ -17,6 +45,16 @@ typedef struct {
     size_t output_size;          /* Current buffer size */
     int indent_level;            /* Current indentation level */
     int string_counter;          /* Counter for string literal labels */
+    int label_counter;           /* Counter for short-circuit condition labels */
+    ASTNode *current_function;   /* Function being generated, NULL in main */
+    const char *break_label;     /* Target of break, NULL outside switches and loops */
+    MASMLineList *peephole;      /* Lines of the PROC being generated, NULL outside one */
+    MASMLineList *cold;          /* Cold blocks of that PROC, placed after its epilogue */
+    ProfileData *profile;        /* --profile-generate/--profile-use state, NULL without */
+    U8 *promoted[MASM_PROMOTE_REGISTERS]; /* Variables of current_function kept in registers */
+    U8 **locals;                 /* Variables with a frame slot below rbp and the saved registers */
+    I64 local_count;             /* Slots in locals */
+    I64 stack_depth;             /* Bytes the code being generated has pushed below the frame */
 } MASMContext;
 
 /* MASM Context Management */
@@ -40,6 +78,24 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node);
 Bool masm_generate_assembly(MASMContext *ctx, const char *filename);
 Bool masm_generate_assembly_from_ast(MASMContext *ctx, ASTNode *ast, const char *filename);
 
+/* Peephole Optimizer (masm_peephole.c) */
+MASMLineList* masm_lines_new(void);
+void masm_lines_free(MASMLineList *list);
+Bool masm_lines_add(MASMLineList *list, const char *text);
+size_t masm_line_render(const MASMLine *line, char *buffer, size_t size);
+void masm_peephole_optimize(MASMLineList *list, const char *function_name);
+
+/* Division by Constants (masm_divide.c) */
+typedef struct {
+    U64 multiplier;                      /* Magic number, width bits */
+    I64 shift;                           /* Post-shift of the high half */
+    Bool add;                            /* Unsigned: multiplier needs width+1 bits */
+} MASMDivMagic;
+
+void masm_div_magic_signed(I64 d, I64 width, MASMDivMagic *magic);
+void masm_div_magic_unsigned(U64 d, I64 width, MASMDivMagic *magic);
+I64 masm_div_log2(U64 value);
+
 /* Utility Functions */
 void masm_print_debug_info(MASMContext *ctx);
 
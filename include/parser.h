@@ -643,6 +643,9 @@ typedef struct ASTNode {
     I64 assembly_size;        /* Assembly code size */
     CIntermediateCode *intermediate; /* Intermediate code */
     
+    /* Profile-guided optimization */
+    I64 profile_id;           /* First profile counter, 0 when the node has none */
+    
 } ASTNode;
 
 /* Scope level structure for variable scope management */
@@ -0,0 +1,46 @@
+/*
+ * Profile-Guided Optimization Header
+ * Execution counters numbered over the AST: --profile-generate emits them
+ * into the program, which writes them to a profile file when it exits, and
+ * --profile-use reads that file back for layout and inlining decisions
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "core_structures.h"
+#include "parser.h"
+
+#define PROFILE_MAGIC        0x31464F5250484353ULL   /* "SCHPROF1" */
+#define PROFILE_DEFAULT_FILE "schismc.profdata"
+#define PROFILE_COLD_RATIO   64      /* Paths taken under 1/64 of the time are cold */
+
+typedef enum {
+    PROFILE_NONE,
+    PROFILE_GENERATE,                /* Count executions and write them at exit */
+    PROFILE_USE                      /* Optimize with the counts of an earlier run */
+} ProfileMode;
+
+/*
+ * Profile file: PROFILE_MAGIC, checksum, counter count, then one count per
+ * counter, all 64-bit little endian. The checksum covers the kind and
+ * position of every counter, so a profile of a different program is
+ * rejected instead of misapplied.
+ */
+typedef struct {
+    ProfileMode mode;
+    char *path;                      /* Profile file */
+    I64 counter_count;               /* Counters numbered by profile_annotate */
+    U64 checksum;                    /* Hash of the counted program shape */
+    U64 *counts;                     /* counter_count counts once loaded */
+} ProfileData;
+
+ProfileData* profile_new(ProfileMode mode, const char *path);
+void profile_free(ProfileData *profile);
+I64 profile_annotate(ProfileData *profile, ASTNode *ast);
+Bool profile_load(ProfileData *profile);
+Bool profile_has_counts(ProfileData *profile);
+U64 profile_count(ProfileData *profile, ASTNode *node, I64 slot);
+Bool profile_is_cold(U64 count, U64 total);
+
+#endif /* PROFILE_H */
@@ -833,56 +833,93 @@ Bool ast_to_assembly_function_declaration(AssemblyContext *ctx, ASTNode *node) {
     return true;
 }
 
+/*
+ * Condition Jumps
+ * A comparison that decides a jump is a CMP followed right away by the
+ * Jcc that reads its flags, a pair the core fuses into one uop; anything
+ * else is tested against zero the same way. The condition codes of x86
+ * come in pairs that differ in the low bit, so negating one is an xor.
+ */
+
+/* Condition code (the low nibble of Jcc/SETcc) of a comparison, -1 for anything else */
+static I64 ast_to_assembly_condition_code(ASTNode *cond) {
+    if (!cond || cond->type != NODE_BINARY_OP) return -1;
+    switch (cond->data.binary_op.op) {
+        case BINOP_EQ: return 0x4;   /* E */
+        case BINOP_NE: return 0x5;   /* NE */
+        case BINOP_LT: return 0xC;   /* L */
+        case BINOP_GE: return 0xD;   /* GE */
+        case BINOP_LE: return 0xE;   /* LE */
+        case BINOP_GT: return 0xF;   /* G */
+        default:       return -1;
+    }
+}
+
+/* Jcc rel32 taken when cond is jump_if; address_pos gets the offset to patch */
+static Bool ast_to_assembly_condition_jump(AssemblyContext *ctx, ASTNode *cond, Bool jump_if, I64 *address_pos) {
+    I64 cc = ast_to_assembly_condition_code(cond);
+    
+    if (cc >= 0) {
+        if (!ast_to_assembly_node(ctx, cond->data.binary_op.left) ||
+            !ast_to_assembly_node(ctx, cond->data.binary_op.right)) {
+            printf("ERROR: Failed to generate assembly for comparison operands\n");
+            return false;
+        }
+    } else if (!ast_to_assembly_node(ctx, cond)) {
+        printf("ERROR: Failed to generate assembly for condition\n");
+        return false;
+    }
+    
+    if (ctx->instruction_pointer + 9 > ctx->buffer_capacity) {
+        printf("ERROR: Not enough space for conditional jump instruction\n");
+        return false;
+    }
+    
+    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x48; /* REX.W prefix for 64-bit */
+    if (cc >= 0) {
+        ctx->assembly_buffer[ctx->instruction_pointer++] = 0x39; /* CMP r/m64, r64 */
+    } else {
+        ctx->assembly_buffer[ctx->instruction_pointer++] = 0x85; /* TEST r/m64, r64 */
+        cc = 0x5;                                                /* NE: the value is non-zero */
+    }
+    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0;
+    
+    if (!jump_if) cc ^= 1;
+    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x0F; /* Two-byte instruction prefix */
+    ctx->assembly_buffer[ctx->instruction_pointer++] = (U8)(0x80 | cc); /* Jcc rel32 */
+    
+    /* Store placeholder for jump address (will be filled later) */
+    *address_pos = ctx->instruction_pointer;
+    *(I32*)(&ctx->assembly_buffer[ctx->instruction_pointer]) = 0x00000000;
+    ctx->instruction_pointer += 4;
+    return true;
+}
+
 Bool ast_to_assembly_if_statement(AssemblyContext *ctx, ASTNode *node) {
     if (!ctx || !node || node->type != NODE_IF_STMT) return false;
     
     printf("DEBUG: Generating assembly for if statement\n");
     
     /* Generate assembly for if statement:
-     * 1. Evaluate condition expression
-     * 2. Generate conditional jump to else branch (if exists) or end
+     * 1. Compare the condition (CMP for comparisons, TEST otherwise)
+     * 2. Generate the fused Jcc to else branch (if exists) or end
      * 3. Generate then branch
      * 4. Generate unconditional jump to end (if else exists)
      * 5. Generate else branch (if exists)
      * 6. Generate end label
      */
     
-    /* Step 1: Evaluate condition expression */
-    if (node->data.if_stmt.condition) {
-        if (!ast_to_assembly_node(ctx, node->data.if_stmt.condition)) {
-            printf("ERROR: Failed to generate assembly for if condition\n");
-            return false;
-        }
-    } else {
+    /* Steps 1 and 2: Compare and jump past the then branch when the condition fails */
+    if (!node->data.if_stmt.condition) {
         printf("ERROR: If statement missing condition\n");
         return false;
     }
-    
-    /* Step 2: Generate conditional jump
-     * For now, we'll assume the condition evaluates to a boolean in RAX
-     * JZ (Jump if Zero) - jump to else branch if condition is false (0)
-     * JE (Jump if Equal) - same as JZ
-     */
-    
-    /* Reserve space for conditional jump instruction */
-    I64 jump_instruction_size = 6; /* 0F 84 <32-bit relative address> (JZ rel32) */
-    
-    if (ctx->instruction_pointer + jump_instruction_size > ctx->buffer_capacity) {
-        printf("ERROR: Not enough space for conditional jump instruction\n");
+    I64 jump_address_pos;
+    if (!ast_to_assembly_condition_jump(ctx, node->data.if_stmt.condition, false, &jump_address_pos)) {
+        printf("ERROR: Failed to generate assembly for if condition\n");
         return false;
     }
     
-    /* Generate conditional jump instruction */
-    ctx->assembly_buffer[ctx->instruction_pointer] = 0x0F; /* Two-byte instruction prefix */
-    ctx->instruction_pointer++;
-    ctx->assembly_buffer[ctx->instruction_pointer] = 0x84; /* JZ (Jump if Zero) opcode */
-    ctx->instruction_pointer++;
-    
-    /* Store placeholder for jump address (will be filled later) */
-    I64 jump_address_pos = ctx->instruction_pointer;
-    *(I32*)(&ctx->assembly_buffer[ctx->instruction_pointer]) = 0x00000000;
-    ctx->instruction_pointer += 4;
-    
     /* Step 3: Generate then branch */
     if (node->data.if_stmt.then_stmt) {
         if (!ast_to_assembly_node(ctx, node->data.if_stmt.then_stmt)) {
@@ -939,88 +976,100 @@ Bool ast_to_assembly_if_statement(AssemblyContext *ctx, ASTNode *node) {
     return true;
 }
 
-Bool ast_to_assembly_while_statement(AssemblyContext *ctx, ASTNode *node) {
-    if (!ctx || !node || node->type != NODE_WHILE_STMT) return false;
-    
-    printf("DEBUG: Generating assembly for while statement\n");
-    
-    /* Generate assembly for while statement:
-     * 1. Generate loop start label
-     * 2. Evaluate condition expression
-     * 3. Generate conditional jump to loop end (if condition is false)
-     * 4. Generate loop body
-     * 5. Generate unconditional jump back to loop start
-     * 6. Generate loop end label
-     */
-    
-    /* Step 1: Remember loop start position */
-    I64 loop_start_pos = ctx->instruction_pointer;
-    
-    /* Step 2: Evaluate condition expression */
-    if (node->data.while_stmt.condition) {
-        if (!ast_to_assembly_node(ctx, node->data.while_stmt.condition)) {
-            printf("ERROR: Failed to generate assembly for while condition\n");
-            return false;
-        }
-    } else {
-        printf("ERROR: While statement missing condition\n");
+/*
+ * Loop Rotation
+ * Loops are emitted as a guarded do-while:
+ *
+ *       cmp/test <condition>
+ *       jncc end            guard, taken once
+ *       (NOP padding)
+ *   top:                    16-byte aligned
+ *       <body>
+ *       cmp/test <condition>
+ *       jcc  top            one branch per iteration
+ *   end:
+ */
+
+/* Pad with multi-byte NOPs up to the next alignment boundary */
+static Bool ast_to_assembly_align(AssemblyContext *ctx, I64 alignment) {
+    static const U8 nops[9][9] = {
+        { 0x90 },
+        { 0x66, 0x90 },
+        { 0x0F, 0x1F, 0x00 },
+        { 0x0F, 0x1F, 0x40, 0x00 },
+        { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 }
+    };
+    
+    I64 pad = (alignment - ctx->instruction_pointer % alignment) % alignment;
+    if (ctx->instruction_pointer + pad > ctx->buffer_capacity) {
+        printf("ERROR: Not enough space for loop alignment padding\n");
         return false;
     }
     
-    /* Step 3: Generate conditional jump to loop end
-     * JZ (Jump if Zero) - jump to end if condition is false (0)
-     */
-    
-    /* Reserve space for conditional jump instruction */
-    I64 jump_instruction_size = 6; /* 0F 84 <32-bit relative address> (JZ rel32) */
-    
-    if (ctx->instruction_pointer + jump_instruction_size > ctx->buffer_capacity) {
-        printf("ERROR: Not enough space for conditional jump instruction\n");
+    while (pad > 0) {
+        I64 size = pad > 9 ? 9 : pad;
+        memcpy(&ctx->assembly_buffer[ctx->instruction_pointer], nops[size - 1], size);
+        ctx->instruction_pointer += size;
+        pad -= size;
+    }
+    return true;
+}
+
+static Bool ast_to_assembly_rotated_loop(AssemblyContext *ctx, ASTNode *condition, ASTNode *body, const char *kind) {
+    /* Step 1: Guard - evaluate the condition once and skip the loop if false */
+    I64 guard_address_pos;
+    if (!ast_to_assembly_condition_jump(ctx, condition, false, &guard_address_pos)) {
+        printf("ERROR: Failed to generate assembly for %s condition\n", kind);
         return false;
     }
     
-    /* Generate conditional jump instruction */
-    ctx->assembly_buffer[ctx->instruction_pointer] = 0x0F; /* Two-byte instruction prefix */
-    ctx->instruction_pointer++;
-    ctx->assembly_buffer[ctx->instruction_pointer] = 0x84; /* JZ (Jump if Zero) opcode */
-    ctx->instruction_pointer++;
+    /* Step 2: Align the loop top */
+    if (!ast_to_assembly_align(ctx, 16)) return false;
+    I64 loop_top_pos = ctx->instruction_pointer;
     
-    /* Store placeholder for jump address (will be filled later) */
-    I64 jump_address_pos = ctx->instruction_pointer;
-    *(I32*)(&ctx->assembly_buffer[ctx->instruction_pointer]) = 0x00000000;
-    ctx->instruction_pointer += 4;
-    
-    /* Step 4: Generate loop body */
-    if (node->data.while_stmt.body_stmt) {
-        if (!ast_to_assembly_node(ctx, node->data.while_stmt.body_stmt)) {
-            printf("ERROR: Failed to generate assembly for while body\n");
+    /* Step 3: Generate loop body */
+    if (body) {
+        if (!ast_to_assembly_node(ctx, body)) {
+            printf("ERROR: Failed to generate assembly for %s body\n", kind);
             return false;
         }
     }
     
-    /* Step 5: Generate unconditional jump back to loop start */
-    /* Reserve space for unconditional jump instruction */
-    I64 jmp_instruction_size = 5; /* E9 <32-bit relative address> (JMP rel32) */
-    
-    if (ctx->instruction_pointer + jmp_instruction_size > ctx->buffer_capacity) {
-        printf("ERROR: Not enough space for unconditional jump instruction\n");
+    /* Step 4: Re-evaluate the condition and branch back while it holds */
+    I64 back_address_pos;
+    if (!ast_to_assembly_condition_jump(ctx, condition, true, &back_address_pos)) {
+        printf("ERROR: Failed to generate assembly for %s condition\n", kind);
         return false;
     }
+    I64 backward_jump_offset = loop_top_pos - (back_address_pos + 4);
+    *(I32*)(&ctx->assembly_buffer[back_address_pos]) = (I32)backward_jump_offset;
     
-    /* Generate unconditional jump instruction */
-    ctx->assembly_buffer[ctx->instruction_pointer] = 0xE9; /* JMP opcode */
-    ctx->instruction_pointer++;
+    /* Step 5: Fix up the guard to point to loop end */
+    I64 loop_end_pos = ctx->instruction_pointer;
+    I64 guard_jump_offset = loop_end_pos - (guard_address_pos + 4);
+    *(I32*)(&ctx->assembly_buffer[guard_address_pos]) = (I32)guard_jump_offset;
+    return true;
+}
+
+Bool ast_to_assembly_while_statement(AssemblyContext *ctx, ASTNode *node) {
+    if (!ctx || !node || node->type != NODE_WHILE_STMT) return false;
     
-    /* Calculate backward jump to loop start */
-    I64 current_pos = ctx->instruction_pointer;
-    I64 backward_jump_offset = loop_start_pos - (current_pos + 4);
-    *(I32*)(&ctx->assembly_buffer[ctx->instruction_pointer]) = (I32)backward_jump_offset;
-    ctx->instruction_pointer += 4;
+    printf("DEBUG: Generating assembly for while statement\n");
     
-    /* Step 6: Fix up conditional jump address to point to loop end */
-    I64 loop_end_pos = ctx->instruction_pointer;
-    I64 conditional_jump_offset = loop_end_pos - (jump_address_pos + 4);
-    *(I32*)(&ctx->assembly_buffer[jump_address_pos]) = (I32)conditional_jump_offset;
+    if (!node->data.while_stmt.condition) {
+        printf("ERROR: While statement missing condition\n");
+        return false;
+    }
+    
+    /* Rotated into a guarded do-while, see Loop Rotation above */
+    if (!ast_to_assembly_rotated_loop(ctx, node->data.while_stmt.condition,
+                                      node->data.while_stmt.body_stmt, "while")) {
+        return false;
+    }
     
     printf("DEBUG: While statement assembly generated successfully\n");
     return true;
@@ -1031,78 +1080,17 @@ Bool ast_to_assembly_for_statement(AssemblyContext *ctx, ASTNode *node) {
     
     printf("DEBUG: Generating assembly for for statement\n");
     
-    /* Generate assembly for for statement:
-     * 1. Generate initialization code (if exists)
-     * 2. Generate loop start label
-     * 3. Evaluate condition expression (if exists)
-     * 4. Generate conditional jump to loop end (if condition is false)
-     * 5. Generate loop body
-     * 6. Generate increment code (if exists)
-     * 7. Generate unconditional jump back to loop start
-     * 8. Generate loop end label
-     */
-    
     /* For now, for statements are not fully implemented in the parser,
      * so this is a placeholder implementation */
     
     /* TODO: Implement proper for loop assembly generation when parser supports it */
-    /* For now, treat it similar to a while loop */
+    /* For now, treat it like a while loop (rotated the same way) */
     
     if (node->data.control.condition) {
-        /* Generate loop start position */
-        I64 loop_start_pos = ctx->instruction_pointer;
-        
-        /* Evaluate condition */
-        if (!ast_to_assembly_node(ctx, node->data.control.condition)) {
-            printf("ERROR: Failed to generate assembly for for condition\n");
+        if (!ast_to_assembly_rotated_loop(ctx, node->data.control.condition,
+                                          node->data.control.then_body, "for")) {
             return false;
         }
-        
-        /* Generate conditional jump to end */
-        I64 jump_instruction_size = 6; /* 0F 84 <32-bit relative address> (JZ rel32) */
-        
-        if (ctx->instruction_pointer + jump_instruction_size > ctx->buffer_capacity) {
-            printf("ERROR: Not enough space for conditional jump instruction\n");
-            return false;
-        }
-        
-        ctx->assembly_buffer[ctx->instruction_pointer] = 0x0F;
-        ctx->instruction_pointer++;
-        ctx->assembly_buffer[ctx->instruction_pointer] = 0x84;
-        ctx->instruction_pointer++;
-        
-        I64 jump_address_pos = ctx->instruction_pointer;
-        *(I32*)(&ctx->assembly_buffer[ctx->instruction_pointer]) = 0x00000000;
-        ctx->instruction_pointer += 4;
-        
-        /* Generate body */
-        if (node->data.control.then_body) {
-            if (!ast_to_assembly_node(ctx, node->data.control.then_body)) {
-                printf("ERROR: Failed to generate assembly for for body\n");
-                return false;
-            }
-        }
-        
-        /* Generate jump back to start */
-        I64 jmp_instruction_size = 5; /* E9 <32-bit relative address> (JMP rel32) */
-        
-        if (ctx->instruction_pointer + jmp_instruction_size > ctx->buffer_capacity) {
-            printf("ERROR: Not enough space for unconditional jump instruction\n");
-            return false;
-        }
-        
-        ctx->assembly_buffer[ctx->instruction_pointer] = 0xE9;
-        ctx->instruction_pointer++;
-        
-        I64 current_pos = ctx->instruction_pointer;
-        I64 backward_jump_offset = loop_start_pos - (current_pos + 4);
-        *(I32*)(&ctx->assembly_buffer[ctx->instruction_pointer]) = (I32)backward_jump_offset;
-        ctx->instruction_pointer += 4;
-        
-        /* Fix up conditional jump address */
-        I64 loop_end_pos = ctx->instruction_pointer;
-        I64 conditional_jump_offset = loop_end_pos - (jump_address_pos + 4);
-        *(I32*)(&ctx->assembly_buffer[jump_address_pos]) = (I32)conditional_jump_offset;
     }
     
     printf("DEBUG: For statement assembly generated successfully (placeholder)\n");
@@ -1218,42 +1206,45 @@ Bool ast_to_assembly_inline_assembly(AssemblyContext *ctx, ASTNode *node) {
  * Relational and Logical Operation Assembly Generation
  */
 
-Bool asm_generate_cmp_eq(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, CAsmArg *right) {
-    if (!ctx || !result || !left || !right) return false;
-    
-    printf("DEBUG: Generating assembly for equality comparison (==)\n");
-    
-    /* Generate CMP instruction to compare left and right operands */
+/*
+ * CMP left, right, then SETcc and MOVZX for the 0/1 value. Conditions of
+ * if and loops never come through here: they jump on the CMP flags
+ * directly (see Condition Jumps), so the value is only built when it is
+ * stored or passed on.
+ */
+static Bool asm_generate_compare_value(AssemblyContext *ctx, U8 setcc) {
     /* CMP left, right */
     ctx->assembly_buffer[ctx->instruction_pointer++] = 0x48; /* REX.W prefix for 64-bit */
     ctx->assembly_buffer[ctx->instruction_pointer++] = 0x39; /* CMP r/m64, r64 */
     ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=right, r/m=left */
     
-    /* Generate SETE instruction to set result based on zero flag */
-    /* SETE result */
+    /* SETcc result */
     ctx->assembly_buffer[ctx->instruction_pointer++] = 0x0F; /* Two-byte opcode prefix */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x94; /* SETE */
+    ctx->assembly_buffer[ctx->instruction_pointer++] = setcc;
     ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=result */
     
+    /* MOVZX result, result8: clear the upper bits */
+    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x0F;
+    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xB6; /* MOVZX r32, r/m8 */
+    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0;
+    
     return true;
 }
 
-Bool asm_generate_cmp_ne(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, CAsmArg *right) {
+Bool asm_generate_cmp_eq(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, CAsmArg *right) {
     if (!ctx || !result || !left || !right) return false;
     
-    printf("DEBUG: Generating assembly for inequality comparison (!=)\n");
+    printf("DEBUG: Generating assembly for equality comparison (==)\n");
     
-    /* Generate CMP instruction to compare left and right operands */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x48; /* REX.W prefix for 64-bit */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x39; /* CMP r/m64, r64 */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=right, r/m=left */
+    return asm_generate_compare_value(ctx, 0x94); /* SETE */
+}
+
+Bool asm_generate_cmp_ne(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, CAsmArg *right) {
+    if (!ctx || !result || !left || !right) return false;
     
-    /* Generate SETNE instruction to set result based on zero flag */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x0F; /* Two-byte opcode prefix */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x95; /* SETNE */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=result */
+    printf("DEBUG: Generating assembly for inequality comparison (!=)\n");
     
-    return true;
+    return asm_generate_compare_value(ctx, 0x95); /* SETNE */
 }
 
 Bool asm_generate_cmp_lt(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, CAsmArg *right) {
@@ -1261,17 +1252,7 @@ Bool asm_generate_cmp_lt(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, C
     
     printf("DEBUG: Generating assembly for less-than comparison (<)\n");
     
-    /* Generate CMP instruction to compare left and right operands */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x48; /* REX.W prefix for 64-bit */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x39; /* CMP r/m64, r64 */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=right, r/m=left */
-    
-    /* Generate SETL instruction to set result based on sign flag */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x0F; /* Two-byte opcode prefix */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x9C; /* SETL */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=result */
-    
-    return true;
+    return asm_generate_compare_value(ctx, 0x9C); /* SETL */
 }
 
 Bool asm_generate_cmp_le(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, CAsmArg *right) {
@@ -1279,17 +1260,7 @@ Bool asm_generate_cmp_le(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, C
     
     printf("DEBUG: Generating assembly for less-than-or-equal comparison (<=)\n");
     
-    /* Generate CMP instruction to compare left and right operands */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x48; /* REX.W prefix for 64-bit */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x39; /* CMP r/m64, r64 */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=right, r/m=left */
-    
-    /* Generate SETLE instruction to set result based on flags */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x0F; /* Two-byte opcode prefix */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x9E; /* SETLE */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=result */
-    
-    return true;
+    return asm_generate_compare_value(ctx, 0x9E); /* SETLE */
 }
 
 Bool asm_generate_cmp_gt(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, CAsmArg *right) {
@@ -1297,17 +1268,7 @@ Bool asm_generate_cmp_gt(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, C
     
     printf("DEBUG: Generating assembly for greater-than comparison (>)\n");
     
-    /* Generate CMP instruction to compare left and right operands */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x48; /* REX.W prefix for 64-bit */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x39; /* CMP r/m64, r64 */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=right, r/m=left */
-    
-    /* Generate SETG instruction to set result based on flags */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x0F; /* Two-byte opcode prefix */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x9F; /* SETG */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=result */
-    
-    return true;
+    return asm_generate_compare_value(ctx, 0x9F); /* SETG */
 }
 
 Bool asm_generate_cmp_ge(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, CAsmArg *right) {
@@ -1315,17 +1276,7 @@ Bool asm_generate_cmp_ge(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, C
     
     printf("DEBUG: Generating assembly for greater-than-or-equal comparison (>=)\n");
     
-    /* Generate CMP instruction to compare left and right operands */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x48; /* REX.W prefix for 64-bit */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x39; /* CMP r/m64, r64 */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=right, r/m=left */
-    
-    /* Generate SETGE instruction to set result based on flags */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x0F; /* Two-byte opcode prefix */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0x9D; /* SETGE */
-    ctx->assembly_buffer[ctx->instruction_pointer++] = 0xC0; /* ModR/M: reg=result */
-    
-    return true;
+    return asm_generate_compare_value(ctx, 0x9D); /* SETGE */
 }
 
 Bool asm_generate_logical_and(AssemblyContext *ctx, CAsmArg *result, CAsmArg *left, CAsmArg *right) {
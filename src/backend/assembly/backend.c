@@ -50,6 +50,9 @@ AssemblyContext* assembly_context_new(CCmpCtrl *cc, ICGenContext *ic_ctx, Parser
     
     /* Initialize register tracking */
     memset(ctx->reg_in_use, false, sizeof(ctx->reg_in_use));
+    for (I64 i = 0; i <= MAX_X86_REGS; i++) {
+        ctx->spill_slot_of[i] = -1;
+    }
     
     return ctx;
 }
@@ -204,22 +207,30 @@ Bool asm_emit_immediate(AssemblyContext *ctx, I64 imm, I64 size) {
 X86Register asm_allocate_register(AssemblyContext *ctx, I64 size) {
     if (!ctx) return X86_REG_NONE;
     
-    /* Simple register allocation - find first available register */
-    X86Register regs[] = {X86_REG_RAX, X86_REG_RCX, X86_REG_RDX, X86_REG_RBX, X86_REG_RSI, X86_REG_RDI, X86_REG_R8, X86_REG_R9, X86_REG_R10, X86_REG_R11};
+    /*
+     * Win64 volatile registers first: they need no save in the prologue.
+     * Non-volatile ones follow and are recorded so the function saves them.
+     * RSP/RBP hold the frame.
+     */
+    X86Register regs[] = {X86_REG_RAX, X86_REG_RCX, X86_REG_RDX, X86_REG_R8, X86_REG_R9, X86_REG_R10, X86_REG_R11,
+                          X86_REG_RBX, X86_REG_RSI, X86_REG_RDI, X86_REG_R12, X86_REG_R13, X86_REG_R14, X86_REG_R15};
     I64 reg_count = sizeof(regs) / sizeof(regs[0]);
     
     for (I64 i = 0; i < reg_count; i++) {
-        if (!ctx->reg_in_use[regs[i]]) {
+        if (!ctx->reg_in_use[regs[i]] && ctx->spill_slot_of[regs[i]] < 0) {
             ctx->reg_in_use[regs[i]] = true;
             ctx->allocated_regs[ctx->reg_count++] = regs[i];
+            if (i >= 7) ctx->callee_saved_used |= (U32)1 << regs[i];
             return regs[i];
         }
     }
     
-    /* If no registers available, spill the first one */
+    /* If no registers available, spill the oldest one; its owner reloads it with asm_reload_register */
     if (ctx->reg_count > 0) {
         X86Register spilled = ctx->allocated_regs[0];
-        asm_spill_register(ctx, spilled);
+        if (asm_spill_register(ctx, spilled) == X86_REG_NONE) return X86_REG_NONE;
+        ctx->reg_in_use[spilled] = true;
+        ctx->allocated_regs[ctx->reg_count++] = spilled;
         return spilled;
     }
     
@@ -227,7 +238,7 @@ X86Register asm_allocate_register(AssemblyContext *ctx, I64 size) {
 }
 
 void asm_free_register(AssemblyContext *ctx, X86Register reg) {
-    if (!ctx || reg == X86_REG_NONE || reg >= MAX_X86_REGS) return;
+    if (!ctx || reg == X86_REG_NONE || reg > MAX_X86_REGS) return;
     
     ctx->reg_in_use[reg] = false;
     
@@ -241,19 +252,35 @@ void asm_free_register(AssemblyContext *ctx, X86Register reg) {
             break;
         }
     }
+    
+    /* The previous owner gets its value back once the borrower is done */
+    if (ctx->spill_slot_of[reg] >= 0) {
+        asm_reload_register(ctx, reg);
+    }
 }
 
 Bool asm_is_register_allocated(AssemblyContext *ctx, X86Register reg) {
-    if (!ctx || reg == X86_REG_NONE || reg >= MAX_X86_REGS) return false;
+    if (!ctx || reg == X86_REG_NONE || reg > MAX_X86_REGS) return false;
     return ctx->reg_in_use[reg];
 }
 
 X86Register asm_spill_register(AssemblyContext *ctx, X86Register reg) {
     if (!ctx || !asm_is_register_allocated(ctx, reg)) return X86_REG_NONE;
     
-    /* Spill register to stack */
-    I64 stack_offset = ctx->stack_offset;
-    ctx->stack_offset += 8;  /* 64-bit alignment */
+    /* A register can only be borrowed once; a second spill would lose its first value */
+    if (ctx->spill_slot_of[reg] >= 0) return X86_REG_NONE;
+    
+    /* Lowest free spill slot; slots are reused once reloaded */
+    I64 slot = 0;
+    while (slot < 64 && (ctx->spill_slots_used & ((U64)1 << slot))) slot++;
+    if (slot >= 64) return X86_REG_NONE;
+    ctx->spill_slots_used |= (U64)1 << slot;
+    ctx->spill_slot_of[reg] = slot;
+    
+    I64 stack_offset = ctx->stack_offset + slot * 8;
+    if (stack_offset + 8 > ctx->max_stack_depth) {
+        ctx->max_stack_depth = stack_offset + 8;
+    }
     
     /* Generate MOV [RSP + offset], reg */
     CAsmArg stack_arg = {0};
@@ -264,10 +291,42 @@ X86Register asm_spill_register(AssemblyContext *ctx, X86Register reg) {
     
     asm_generate_mov(ctx, &stack_arg, &reg_arg);
     
-    asm_free_register(ctx, reg);
+    /* Drop it from the allocation list without triggering a reload */
+    ctx->reg_in_use[reg] = false;
+    for (I64 i = 0; i < ctx->reg_count; i++) {
+        if (ctx->allocated_regs[i] == reg) {
+            for (I64 j = i; j < ctx->reg_count - 1; j++) {
+                ctx->allocated_regs[j] = ctx->allocated_regs[j + 1];
+            }
+            ctx->reg_count--;
+            break;
+        }
+    }
     return reg;
 }
 
+Bool asm_reload_register(AssemblyContext *ctx, X86Register reg) {
+    if (!ctx || reg == X86_REG_NONE || reg > MAX_X86_REGS) return false;
+    
+    I64 slot = ctx->spill_slot_of[reg];
+    if (slot < 0) return false;
+    
+    /* Generate MOV reg, [RSP + offset] */
+    CAsmArg stack_arg = {0};
+    CAsmArg reg_arg = {0};
+    
+    asm_setup_memory_arg(ctx, &stack_arg, X86_REG_RSP, ctx->stack_offset + slot * 8);
+    asm_setup_register_arg(ctx, &reg_arg, reg);
+    
+    asm_generate_mov(ctx, &reg_arg, &stack_arg);
+    
+    ctx->spill_slot_of[reg] = -1;
+    ctx->spill_slots_used &= ~((U64)1 << slot);
+    ctx->reg_in_use[reg] = true;
+    ctx->allocated_regs[ctx->reg_count++] = reg;
+    return true;
+}
+
 /*
  * Assembly Instruction Generation
  */
@@ -0,0 +1,90 @@
+/*
+ * MASM Division by Constants
+ * Magic numbers that turn x / d with a constant d into a multiply by a
+ * fixed-point reciprocal (Hacker's Delight, chapter 10); the sequences
+ * using them are emitted by masm_output.c
+ */
+
+#include "masm_output.h"
+
+/* Magic number for signed division by d, |d| >= 2 */
+void masm_div_magic_signed(I64 d, I64 width, MASMDivMagic *magic) {
+    U64 mask = width == 64 ? ~0ULL : 0xFFFFFFFFULL;
+    U64 sign = 1ULL << (width - 1);
+    U64 ad = (U64)(d < 0 ? -d : d) & mask;
+    U64 t = sign + (((U64)d & mask) >> (width - 1));
+    U64 anc = t - 1 - t % ad;
+    U64 q1 = sign / anc, r1 = sign - q1 * anc;
+    U64 q2 = sign / ad, r2 = sign - q2 * ad;
+    U64 delta;
+    I64 p = width - 1;
+
+    do {
+        p++;
+        q1 = (q1 << 1) & mask;
+        r1 = (r1 << 1) & mask;
+        if (r1 >= anc) {
+            q1 = (q1 + 1) & mask;
+            r1 = (r1 - anc) & mask;
+        }
+        q2 = (q2 << 1) & mask;
+        r2 = (r2 << 1) & mask;
+        if (r2 >= ad) {
+            q2 = (q2 + 1) & mask;
+            r2 = (r2 - ad) & mask;
+        }
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    magic->multiplier = (q2 + 1) & mask;
+    if (d < 0) magic->multiplier = (0 - magic->multiplier) & mask;
+    magic->shift = p - width;
+    magic->add = false;
+}
+
+/* Magic number for unsigned division by d, d >= 2 and not a power of two */
+void masm_div_magic_unsigned(U64 d, I64 width, MASMDivMagic *magic) {
+    U64 mask = width == 64 ? ~0ULL : 0xFFFFFFFFULL;
+    U64 sign = 1ULL << (width - 1);
+    U64 nc = (mask - ((0 - d) & mask) % d) & mask;
+    U64 q1 = sign / nc, r1 = sign - q1 * nc;
+    U64 q2 = (sign - 1) / d, r2 = (sign - 1) - q2 * d;
+    U64 delta;
+    I64 p = width - 1;
+
+    magic->add = false;
+    do {
+        p++;
+        if (r1 >= ((nc - r1) & mask)) {
+            q1 = ((q1 << 1) + 1) & mask;
+            r1 = ((r1 << 1) - nc) & mask;
+        } else {
+            q1 = (q1 << 1) & mask;
+            r1 = (r1 << 1) & mask;
+        }
+        if (((r2 + 1) & mask) >= d - r2) {
+            if (q2 >= sign - 1) magic->add = true;
+            q2 = ((q2 << 1) + 1) & mask;
+            r2 = ((r2 << 1) + 1 - d) & mask;
+        } else {
+            if (q2 >= sign) magic->add = true;
+            q2 = (q2 << 1) & mask;
+            r2 = ((r2 << 1) + 1) & mask;
+        }
+        delta = d - 1 - r2;
+    } while (p < 2 * width && (q1 < delta || (q1 == delta && r1 == 0)));
+
+    magic->multiplier = (q2 + 1) & mask;
+    magic->shift = p - width;
+}
+
+/* log2 of a power of two, -1 for anything else */
+I64 masm_div_log2(U64 value) {
+    if (value == 0 || (value & (value - 1)) != 0) return -1;
+    I64 k = 0;
+    while (value > 1) {
+        value >>= 1;
+        k++;
+    }
+    return k;
+}
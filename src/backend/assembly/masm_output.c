@@ -8,6 +8,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* The entry PROC is main, so a main the program defines is emitted under this name */
+#define MASM_USER_MAIN "user_main"
+
 /*
  * MASM Assembly Context
  */
@@ -30,6 +33,7 @@ MASMContext* masm_context_new(AssemblyContext *asm_ctx) {
     ctx->output_size = 0;
     ctx->indent_level = 0;
     ctx->string_counter = 0;
+    ctx->label_counter = 0;
     
     return ctx;
 }
@@ -38,6 +42,9 @@ void masm_context_free(MASMContext *ctx) {
     if (!ctx) return;
     
     if (ctx->output_buffer) free(ctx->output_buffer);
+    masm_lines_free(ctx->peephole);
+    masm_lines_free(ctx->cold);
+    free(ctx->locals);
     free(ctx);
 }
 
@@ -75,6 +82,19 @@ static Bool masm_append_string(MASMContext *ctx, const char *str) {
 }
 
 static Bool masm_append_line(MASMContext *ctx, const char *line) {
+    /* Inside a PROC the line is held for the peephole optimizer */
+    if (ctx->peephole) {
+        size_t len = strlen(line) + 4 * (size_t)ctx->indent_level + 1;
+        char *text = malloc(len);
+        if (!text) return false;
+        text[0] = '\0';
+        for (int i = 0; i < ctx->indent_level; i++) strcat(text, "    ");
+        strcat(text, line);
+        Bool ok = masm_lines_add(ctx->peephole, text);
+        free(text);
+        return ok;
+    }
+    
     /* Add indentation */
     for (int i = 0; i < ctx->indent_level; i++) {
         if (!masm_append_string(ctx, "    ")) return false;
@@ -89,6 +109,157 @@ static Bool masm_append_line(MASMContext *ctx, const char *line) {
     return true;
 }
 
+/* Hold the lines of a PROC until masm_end_proc; nested PROCs join the outer one */
+static Bool masm_begin_proc(MASMContext *ctx) {
+    if (ctx->peephole) return false;
+    ctx->peephole = masm_lines_new();
+    return ctx->peephole != NULL;
+}
+
+/* Run the peephole optimizer over the held lines and write them out */
+static Bool masm_end_proc(MASMContext *ctx, Bool started, const char *name) {
+    if (!started) return true;
+    MASMLineList *list = ctx->peephole;
+    ctx->peephole = NULL;
+    masm_peephole_optimize(list, name);
+    
+    Bool ok = true;
+    char line[512];
+    int indent_level = ctx->indent_level;
+    ctx->indent_level = 0;
+    for (size_t i = 0; ok && i < list->count; i++) {
+        if (list->lines[i].deleted) continue;
+        masm_line_render(&list->lines[i], line, sizeof(line));
+        ok = masm_append_line(ctx, line);
+    }
+    ctx->indent_level = indent_level;
+    masm_lines_free(list);
+    return ok;
+}
+
+/*
+ * Profiling
+ * With --profile-generate every counted node (see profile.c) gets a QWORD
+ * in profile_counters, bumped where its code starts, and main writes the
+ * counters out on its way back to the system. With --profile-use the
+ * counts steer branch layout and switch dispatch, and cold arms move
+ * behind the epilogue of their PROC.
+ */
+
+static Bool masm_profile_generating(MASMContext *ctx) {
+    return ctx->profile && ctx->profile->mode == PROFILE_GENERATE;
+}
+
+/* Count one execution of the slot'th counter of node */
+static void masm_profile_count(MASMContext *ctx, ASTNode *node, I64 slot) {
+    if (!masm_profile_generating(ctx) || !node || node->profile_id <= 0) return;
+    
+    char line[128];
+    I64 counter = node->profile_id - 1 + slot;
+    snprintf(line, sizeof(line), "    inc QWORD PTR [profile_counters+%lld]    ; Profile counter %lld",
+             counter * 8, counter);
+    masm_append_line(ctx, line);
+}
+
+/* Cold code can only be set aside inside a PROC, and not from cold code itself */
+static Bool masm_can_defer(MASMContext *ctx) {
+    return ctx->peephole && ctx->peephole != ctx->cold;
+}
+
+/* Generate node as label: ... jmp resume in the cold section of the PROC */
+static Bool masm_generate_cold(MASMContext *ctx, ASTNode *node, const char *label, const char *resume) {
+    if (!ctx->cold && !(ctx->cold = masm_lines_new())) return false;
+    
+    char line[128];                      /* Labels come from 64-byte buffers */
+    MASMLineList *hot = ctx->peephole;
+    ctx->peephole = ctx->cold;
+    snprintf(line, sizeof(line), "%s:", label);
+    masm_append_line(ctx, line);
+    Bool ok = masm_generate_ast_node(ctx, node);
+    snprintf(line, sizeof(line), "    jmp %s         ; Back to the hot path", resume);
+    masm_append_line(ctx, line);
+    ctx->peephole = hot;
+    return ok;
+}
+
+/* Place the cold section after the epilogue, before ENDP */
+static Bool masm_flush_cold(MASMContext *ctx) {
+    MASMLineList *cold = ctx->cold;
+    ctx->cold = NULL;
+    if (!cold) return true;
+    
+    Bool ok = masm_append_line(ctx, "; Cold code");
+    for (size_t i = 0; ok && i < cold->count; i++) {
+        ok = masm_lines_add(ctx->peephole, cold->lines[i].text);
+    }
+    masm_lines_free(cold);
+    return ok;
+}
+
+/* Counter storage and the routine that writes it to the profile file */
+static Bool masm_generate_profile_runtime(MASMContext *ctx) {
+    if (!masm_profile_generating(ctx)) return true;
+    
+    ProfileData *profile = ctx->profile;
+    char line[640];
+    masm_append_line(ctx, "");
+    masm_append_line(ctx, "; Profile counters (--profile-generate)");
+    masm_append_line(ctx, ".data");
+    masm_append_line(ctx, "ALIGN 8");
+    snprintf(line, sizeof(line), "profile_data DQ 0%016llXh, 0%016llXh, %lld",
+             (unsigned long long)PROFILE_MAGIC, (unsigned long long)profile->checksum, profile->counter_count);
+    masm_append_line(ctx, line);
+    snprintf(line, sizeof(line), "profile_counters DQ %lld DUP (0)",
+             profile->counter_count > 0 ? profile->counter_count : 1);
+    masm_append_line(ctx, line);
+    
+    /* Quotes inside a MASM string are doubled */
+    size_t n = snprintf(line, sizeof(line), "profile_path DB \"");
+    for (const char *c = profile->path; *c && n < sizeof(line) - 8; c++) {
+        if (*c == '"') line[n++] = '"';
+        line[n++] = *c;
+    }
+    snprintf(line + n, sizeof(line) - n, "\", 0");
+    masm_append_line(ctx, line);
+    masm_append_line(ctx, ".code");
+    
+    masm_append_line(ctx, "");
+    masm_append_line(ctx, "profile_write PROC");
+    masm_append_line(ctx, "    push rbp");
+    masm_append_line(ctx, "    mov rbp, rsp");
+    masm_append_line(ctx, "    and rsp, -16    ; Calls below need an aligned stack");
+    masm_append_line(ctx, "    sub rsp, 50h    ; Shadow space, 3 stack arguments, handle, bytes written");
+    masm_append_line(ctx, "    lea rcx, [profile_path]");
+    masm_append_line(ctx, "    mov edx, 40000000h    ; GENERIC_WRITE");
+    masm_append_line(ctx, "    xor r8d, r8d    ; No sharing");
+    masm_append_line(ctx, "    xor r9d, r9d    ; Default security");
+    masm_append_line(ctx, "    mov QWORD PTR [rsp+20h], 2      ; CREATE_ALWAYS");
+    masm_append_line(ctx, "    mov QWORD PTR [rsp+28h], 80h    ; FILE_ATTRIBUTE_NORMAL");
+    masm_append_line(ctx, "    mov QWORD PTR [rsp+30h], 0      ; No template");
+    masm_append_line(ctx, "    call CreateFileA");
+    masm_append_line(ctx, "    cmp rax, -1     ; INVALID_HANDLE_VALUE");
+    masm_append_line(ctx, "    je profile_write_done");
+    masm_append_line(ctx, "    mov [rsp+38h], rax");
+    masm_append_line(ctx, "    mov rcx, rax");
+    masm_append_line(ctx, "    lea rdx, [profile_data]");
+    snprintf(line, sizeof(line), "    mov r8d, %lld    ; Header and counters",
+             (3 + profile->counter_count) * 8);
+    masm_append_line(ctx, line);
+    masm_append_line(ctx, "    lea r9, [rsp+40h]");
+    masm_append_line(ctx, "    mov QWORD PTR [rsp+20h], 0      ; Not overlapped");
+    masm_append_line(ctx, "    call WriteFile");
+    masm_append_line(ctx, "    mov rcx, [rsp+38h]");
+    masm_append_line(ctx, "    call CloseHandle");
+    masm_append_line(ctx, "profile_write_done:");
+    masm_append_line(ctx, "    mov rsp, rbp");
+    masm_append_line(ctx, "    pop rbp");
+    masm_append_line(ctx, "    ret");
+    masm_append_line(ctx, "profile_write ENDP");
+    return true;
+}
+
+static I64 masm_layout_frame(MASMContext *ctx, ASTNode *func, ASTNode *program);
+
 /*
  * MASM Assembly Generation
  */
@@ -98,24 +269,32 @@ Bool masm_generate_user_main_function(MASMContext *ctx, ASTNode *ast) {
     
     /* Generate main function that contains all global statements */
     masm_append_line(ctx, "; Main function");
+    Bool main_proc = masm_begin_proc(ctx);
     masm_append_line(ctx, "main PROC");
     ctx->indent_level++;
     
     /* Function prologue */
     masm_append_line(ctx, "push rbp        ; Save caller's frame pointer");
     masm_append_line(ctx, "mov rbp, rsp    ; Set up new frame pointer");
-    masm_append_line(ctx, "sub rsp, 32h    ; Allocate local space");
+    masm_append_line(ctx, "push rbx        ; Save scratch register");
+    I64 local_space = masm_layout_frame(ctx, NULL, ast);
+    if (local_space > 0) {
+        char sub_instr[64];
+        snprintf(sub_instr, sizeof(sub_instr), "sub rsp, %lld    ; %s", local_space,
+                 ctx->local_count ? "Local variables" : "Keep the stack alignment");
+        masm_append_line(ctx, sub_instr);
+    }
+    masm_append_line(ctx, "sub rsp, 20h    ; Allocate local space");
     
-    /* Process all global statements - but skip function declarations */
+    /* Process all global statements - functions get their own PROC below */
+    ASTNode *user_main = NULL;
     ASTNode *child = ast->children;
     while (child) {
         if (child->type == NODE_FUNCTION) {
-            /* For function nodes, only process the body, not the declaration */
-            if (child->data.function.body) {
-                if (!masm_generate_ast_node(ctx, child->data.function.body)) {
-                    printf("ERROR: Failed to generate MASM for function body\n");
-                    return false;
-                }
+            /* Emitted after main so calls and tail jumps have a target */
+            if (child->data.function.body && child->data.function.name &&
+                strcmp((char*)child->data.function.name, "main") == 0) {
+                user_main = child;
             }
         } else {
             /* Process other global statements normally */
@@ -127,13 +306,44 @@ Bool masm_generate_user_main_function(MASMContext *ctx, ASTNode *ast) {
         child = child->next;
     }
     
+    /* A main the program defines runs after the global statements */
+    if (user_main) {
+        masm_append_line(ctx, "sub rsp, 20h    ; 32 bytes shadow space");
+        masm_append_line(ctx, "call " MASM_USER_MAIN);
+        masm_append_line(ctx, "add rsp, 20h    ; Restore shadow space");
+    }
+    
+    /* Write the profile before the program ends */
+    if (masm_profile_generating(ctx)) {
+        masm_append_line(ctx, "push rax        ; Keep the exit code");
+        masm_append_line(ctx, "call profile_write");
+        masm_append_line(ctx, "pop rax");
+    }
+    
     /* Function epilogue */
-    masm_append_line(ctx, "mov rsp, rbp    ; Restore stack pointer");
+    masm_append_line(ctx, "lea rsp, [rbp-8]    ; Restore stack pointer");
+    masm_append_line(ctx, "pop rbx         ; Restore scratch register");
     masm_append_line(ctx, "pop rbp         ; Restore caller's frame pointer");
     masm_append_line(ctx, "ret             ; Return to caller");
+    free(ctx->locals);
+    ctx->locals = NULL;
+    ctx->local_count = 0;
+    if (!masm_flush_cold(ctx)) return false;
     
     ctx->indent_level--;
     masm_append_line(ctx, "main ENDP");
+    if (!masm_end_proc(ctx, main_proc, "main")) return false;
+    
+    /* Function definitions */
+    for (child = ast->children; child; child = child->next) {
+        if (child->type == NODE_FUNCTION && child->data.function.body) {
+            if (!masm_generate_function_declaration(ctx, child)) {
+                printf("ERROR: Failed to generate MASM for function %s\n",
+                       child->data.function.name ? (char*)child->data.function.name : "unknown");
+                return false;
+            }
+        }
+    }
     
     return true;
 }
@@ -150,6 +360,11 @@ Bool masm_generate_header(MASMContext *ctx) {
     masm_append_line(ctx, "extrn GetStdHandle:PROC");
     masm_append_line(ctx, "extrn WriteConsoleA:PROC");
     masm_append_line(ctx, "extrn ExitProcess:PROC");
+    if (masm_profile_generating(ctx)) {
+        masm_append_line(ctx, "extrn CreateFileA:PROC");
+        masm_append_line(ctx, "extrn WriteFile:PROC");
+        masm_append_line(ctx, "extrn CloseHandle:PROC");
+    }
     masm_append_line(ctx, "");
     
     /* Data section for string literals */
@@ -217,178 +432,2013 @@ Bool masm_generate_assembly(MASMContext *ctx, const char *filename) {
 }
 
 /*
- * Function-related MASM Generation
+ * Function Frame Helpers
+ * Register parameters are homed into the caller's shadow space on entry,
+ * so parameter i lives at [rbp+16+8*i] whether it arrived in a register
+ * or on the stack, unless it is kept in a register of its own.
+ */
+
+static const char *masm_argument_registers[] = {"rcx", "rdx", "r8", "r9"};
+
+static I64 masm_parameter_count(ASTNode *func) {
+    if (!func || !func->data.function.parameters) return 0;
+    return func->data.function.parameters->data.block.local_var_count;
+}
+
+/* Index of the named parameter of func, -1 if it is not one */
+static I64 masm_parameter_index(ASTNode *func, U8 *name) {
+    if (!func || !func->data.function.parameters || !name) return -1;
+    
+    ASTNode *param = func->data.function.parameters->children;
+    for (I64 index = 0; param; param = param->next, index++) {
+        ASTNode *var = param->type == NODE_DEFAULT_ARG ? param->data.default_arg.parameter : param;
+        if (var && var->data.variable.name && strcmp((char*)var->data.variable.name, (char*)name) == 0) {
+            return index;
+        }
+    }
+    return -1;
+}
+
+/* Label of a user function; a user main is renamed, main is the entry PROC */
+static const char* masm_symbol(U8 *name) {
+    if (!name) return "unknown_func";
+    return strcmp((char*)name, "main") == 0 ? MASM_USER_MAIN : (char*)name;
+}
+
+static const char* masm_function_name(ASTNode *func) {
+    return masm_symbol(func ? func->data.function.name : NULL);
+}
+
+/*
+ * Frame Layout and Register Promotion
+ * Parameters are homed above rbp, in the area their caller reserved.
+ * Every other variable a function or the top-level statements declare
+ * gets a slot of its own below rbp and the saved registers. Parameters and
+ * locals that are only ever used as whole values (never as an array, or
+ * through sub-int, union or member access) live in callee-saved registers
+ * instead. The most used ones, each use weighted by the loops
+ * around it, get rsi and r12-r15. rbx, the scratch register of the
+ * generated code, is callee-saved too, so every prologue saves it first
+ * and every epilogue restores it. A function
+ * containing anything the scan does not know, & or a unary operator the
+ * backend cannot emit among them, keeps all of its variables in memory.
+ */
+
+static const char *masm_promote_registers[MASM_PROMOTE_REGISTERS] = {"rsi", "r12", "r13", "r14", "r15"};
+
+#define MASM_PROMOTE_MIN_WEIGHT  3    /* Uses that pay for saving and restoring the register */
+#define MASM_PROMOTE_MAX_DEPTH   4    /* Loop nesting beyond which uses weigh no more */
+
+typedef struct {
+    U8 *name;
+    I64 weight;                  /* Uses, times 4 per enclosing loop */
+    Bool declared;               /* Parameter, declared or assigned in the function */
+    Bool parameter;              /* Homed above rbp rather than given a slot */
+    Bool excluded;               /* Needs a memory slot */
+} MASMPromoteName;
+
+typedef struct {
+    MASMPromoteName *names;
+    I64 count;
+    I64 capacity;
+    Bool complete;               /* Every node was understood */
+} MASMPromoteScan;
+
+/* Entry of a name, added on first sight; NULL when out of memory */
+static MASMPromoteName* masm_promote_entry(MASMPromoteScan *scan, U8 *name) {
+    for (I64 i = 0; i < scan->count; i++) {
+        if (strcmp((char*)scan->names[i].name, (char*)name) == 0) return &scan->names[i];
+    }
+    if (scan->count == scan->capacity) {
+        I64 capacity = scan->capacity ? scan->capacity * 2 : 16;
+        MASMPromoteName *names = realloc(scan->names, capacity * sizeof(MASMPromoteName));
+        if (!names) {
+            scan->complete = false;
+            return NULL;
+        }
+        scan->names = names;
+        scan->capacity = capacity;
+    }
+
+    MASMPromoteName *entry = &scan->names[scan->count++];
+    memset(entry, 0, sizeof(MASMPromoteName));
+    entry->name = name;
+    return entry;
+}
+
+static void masm_promote_scan(MASMPromoteScan *scan, ASTNode *node, I64 depth);
+static Bool masm_constant_value(ASTNode *node, I64 *value);
+static Bool masm_is_comparison(ASTNode *node);
+
+static void masm_promote_scan_list(MASMPromoteScan *scan, ASTNode *node, I64 depth) {
+    for (; node; node = node->next) masm_promote_scan(scan, node, depth);
+}
+
+/* A use of a whole variable; declares is set for the target of an assignment */
+static void masm_promote_use(MASMPromoteScan *scan, ASTNode *node, I64 depth, Bool declares) {
+    if (!node->data.identifier.name) return;
+    MASMPromoteName *entry = masm_promote_entry(scan, node->data.identifier.name);
+    if (!entry) return;
+
+    entry->weight += (I64)1 << (2 * (depth < MASM_PROMOTE_MAX_DEPTH ? depth : MASM_PROMOTE_MAX_DEPTH));
+    if (declares) entry->declared = true;
+    if (node->data.identifier.is_array) entry->excluded = true;
+}
+
+/* An object accessed in parts or by address keeps its memory slot */
+static void masm_promote_exclude(MASMPromoteScan *scan, ASTNode *object, I64 depth) {
+    if (!object || (object->type != NODE_IDENTIFIER && object->type != NODE_VARIABLE)) {
+        masm_promote_scan(scan, object, depth);
+        return;
+    }
+    if (!object->data.identifier.name) return;
+    MASMPromoteName *entry = masm_promote_entry(scan, object->data.identifier.name);
+    if (entry) entry->excluded = true;
+}
+
+/*
+ * The condition of an if, while or ?: is lowered to flags, which also
+ * takes ! and a constant right operand of a comparison, including a
+ * negative one; anywhere else the backend cannot emit a unary operator
+ */
+static void masm_promote_scan_condition(MASMPromoteScan *scan, ASTNode *cond, I64 depth) {
+    I64 value;
+    while (cond && cond->type == NODE_UNARY_OP && cond->data.unary_op.op == UNOP_NOT) {
+        cond = cond->data.unary_op.operand;
+    }
+    if (masm_is_comparison(cond) && masm_constant_value(cond->data.binary_op.right, &value)) {
+        masm_promote_scan(scan, cond->data.binary_op.left, depth);
+        return;
+    }
+    masm_promote_scan(scan, cond, depth);
+}
+
+/* Record the variables node uses; clears scan->complete on anything not understood */
+static void masm_promote_scan(MASMPromoteScan *scan, ASTNode *node, I64 depth) {
+    if (!node) return;
+
+    switch (node->type) {
+        case NODE_INTEGER:
+        case NODE_STRING:
+        case NODE_BREAK:
+        case NODE_TYPE_PREFIXED_UNION:
+        case NODE_FUNCTION:              /* Nested functions are laid out on their own */
+            break;
+        case NODE_IDENTIFIER:
+            masm_promote_use(scan, node, depth, false);
+            break;
+        case NODE_VARIABLE:
+            masm_promote_use(scan, node, depth, true);
+            break;
+        case NODE_BLOCK:
+            masm_promote_scan_list(scan, node->data.block.statements, depth);
+            break;
+        case NODE_ASSIGNMENT:
+            masm_promote_scan(scan, node->data.assignment.left, depth);
+            masm_promote_scan(scan, node->data.assignment.right, depth);
+            break;
+        case NODE_BINARY_OP:
+            masm_promote_scan(scan, node->data.binary_op.left, depth);
+            masm_promote_scan(scan, node->data.binary_op.right, depth);
+            break;
+        case NODE_SUB_INT_ACCESS:
+            masm_promote_exclude(scan, node->data.sub_int_access.base_object, depth);
+            masm_promote_scan(scan, node->data.sub_int_access.index, depth);
+            break;
+        case NODE_UNION_MEMBER_ACCESS:
+            masm_promote_exclude(scan, node->data.union_member_access.union_object, depth);
+            masm_promote_scan(scan, node->data.union_member_access.index, depth);
+            break;
+        case NODE_CALL:
+            if (node->data.call.arguments) {
+                masm_promote_scan_list(scan, node->data.call.arguments->data.block.statements, depth);
+            }
+            break;
+        case NODE_RETURN:
+            masm_promote_scan(scan, node->data.return_stmt.expression, depth);
+            break;
+        case NODE_IF_STMT:
+            masm_promote_scan_condition(scan, node->data.if_stmt.condition, depth);
+            masm_promote_scan(scan, node->data.if_stmt.then_stmt, depth);
+            masm_promote_scan(scan, node->data.if_stmt.else_stmt, depth);
+            break;
+        case NODE_WHILE_STMT:
+            masm_promote_scan_condition(scan, node->data.while_stmt.condition, depth + 1);
+            masm_promote_scan(scan, node->data.while_stmt.body_stmt, depth + 1);
+            break;
+        case NODE_CONDITIONAL:
+            masm_promote_scan_condition(scan, node->data.conditional.condition, depth);
+            masm_promote_scan(scan, node->data.conditional.true_expr, depth);
+            masm_promote_scan(scan, node->data.conditional.false_expr, depth);
+            break;
+        case NODE_RANGE_COMPARISON:
+            masm_promote_scan_list(scan, node->data.range_comparison.expressions, depth);
+            break;
+        case NODE_SWITCH:
+            masm_promote_scan(scan, node->data.switch_stmt.expression, depth);
+            for (ASTNode *item = node->data.switch_stmt.cases; item; item = item->next) {
+                if (item->type == NODE_START_BLOCK || item->type == NODE_END_BLOCK) {
+                    masm_promote_scan_list(scan, item->data.start_end_block.statements, depth);
+                } else if (item->type == NODE_CASE) {
+                    if (!item->data.case_stmt.is_default) masm_promote_scan_list(scan, item->data.case_stmt.body, depth);
+                } else {
+                    scan->complete = false;
+                }
+            }
+            if (node->data.switch_stmt.default_case) {
+                masm_promote_scan_list(scan, node->data.switch_stmt.default_case->data.case_stmt.body, depth);
+            }
+            break;
+        default:
+            scan->complete = false;
+            break;
+    }
+}
+
+/*
+ * Lay out the frame of func, or of the top-level statements of program
+ * when func is NULL: the variables going into registers in ctx->promoted,
+ * the ones declared there in ctx->locals. Returns the bytes to reserve
+ * below the saved registers, keeping rsp 16-byte aligned.
+ */
+static I64 masm_layout_frame(MASMContext *ctx, ASTNode *func, ASTNode *program) {
+    memset(ctx->promoted, 0, sizeof(ctx->promoted));
+    ctx->locals = NULL;
+    ctx->local_count = 0;
+    ctx->stack_depth = 0;
+
+    MASMPromoteScan scan = {NULL, 0, 0, true};
+    if (func && func->data.function.parameters) {
+        for (ASTNode *param = func->data.function.parameters->children; param; param = param->next) {
+            ASTNode *var = param->type == NODE_DEFAULT_ARG ? param->data.default_arg.parameter : param;
+            if (!var || !var->data.variable.name) continue;
+            MASMPromoteName *entry = masm_promote_entry(&scan, var->data.variable.name);
+            if (entry) entry->declared = entry->parameter = true;
+        }
+    }
+    if (func) masm_promote_scan(&scan, func->data.function.body, 0);
+    else masm_promote_scan_list(&scan, program->children, 0);
+
+    /* Only whole functions are promoted; the top-level statements run once */
+    I64 saved = 0;
+    for (; func && scan.complete && saved < MASM_PROMOTE_REGISTERS; saved++) {
+        MASMPromoteName *best = NULL;
+        for (I64 i = 0; i < scan.count; i++) {
+            MASMPromoteName *entry = &scan.names[i];
+            if (!entry->declared || entry->excluded || entry->weight < MASM_PROMOTE_MIN_WEIGHT) continue;
+            if (!best || entry->weight > best->weight) best = entry;
+        }
+        if (!best) break;
+
+        ctx->promoted[saved] = best->name;
+        best->declared = false;    /* Taken */
+        printf("DEBUG: Register promotion - %s in %s (weight %lld)\n",
+               (char*)best->name, masm_promote_registers[saved], best->weight);
+    }
+
+    if (scan.count > 0) ctx->locals = malloc(scan.count * sizeof(U8*));
+    for (I64 i = 0; ctx->locals && i < scan.count; i++) {
+        if (scan.names[i].declared && !scan.names[i].parameter) ctx->locals[ctx->local_count++] = scan.names[i].name;
+    }
+    free(scan.names);
+
+    return 8 * (ctx->local_count + (saved + 1 + ctx->local_count) % 2);    /* rbx is saved as well */
+}
+
+/* Register holding the named variable of the current function, NULL if it is in memory */
+static const char* masm_promoted_register(MASMContext *ctx, U8 *name) {
+    if (!ctx->current_function || !name) return NULL;
+    for (I64 r = 0; r < MASM_PROMOTE_REGISTERS && ctx->promoted[r]; r++) {
+        if (strcmp((char*)ctx->promoted[r], (char*)name) == 0) return masm_promote_registers[r];
+    }
+    return NULL;
+}
+
+static I64 masm_promoted_count(MASMContext *ctx) {
+    I64 count = 0;
+    while (count < MASM_PROMOTE_REGISTERS && ctx->promoted[count]) count++;
+    return count;
+}
+
+/* Registers the prologue pushes below rbp: rbx, then the promoted ones */
+static I64 masm_saved_count(MASMContext *ctx) {
+    return 1 + masm_promoted_count(ctx);
+}
+
+/* Offset from rbp of the slot of a local, 0 if it has none */
+static I64 masm_local_offset(MASMContext *ctx, U8 *name) {
+    if (!name) return 0;
+    for (I64 i = 0; i < ctx->local_count; i++) {
+        if (strcmp((char*)ctx->locals[i], (char*)name) == 0) return -8 * (masm_saved_count(ctx) + i + 1);
+    }
+    return 0;
+}
+
+/* Temporaries pushed inside a body move rsp off the 16-byte alignment of the frame */
+static void masm_stack_push(MASMContext *ctx, const char *instr) {
+    masm_append_line(ctx, instr);
+    ctx->stack_depth += 8;
+}
+
+static void masm_stack_pop(MASMContext *ctx, const char *instr) {
+    masm_append_line(ctx, instr);
+    ctx->stack_depth -= 8;
+}
+
+/* Undo the prologue: rsp back to the saved registers, which are restored, then rbp */
+static void masm_release_frame(MASMContext *ctx, const char *reason) {
+    char line[96];
+    snprintf(line, sizeof(line), "    lea rsp, [rbp-%lld]    ; %s", masm_saved_count(ctx) * 8, reason);
+    masm_append_line(ctx, line);
+    for (I64 r = masm_promoted_count(ctx) - 1; r >= 0; r--) {
+        snprintf(line, sizeof(line), "    pop %s    ; Restore callee-saved register", masm_promote_registers[r]);
+        masm_append_line(ctx, line);
+    }
+    masm_append_line(ctx, "    pop rbx         ; Restore scratch register");
+    masm_append_line(ctx, "    pop rbp         ; Restore caller's frame pointer");
+}
+
+/*
+ * Tail Calls
+ * A call whose value is returned directly does not need a frame of its
+ * own. Self recursion becomes a jump back to the top of the body with the
+ * parameters replaced; other calls tear down the frame and jump, provided
+ * the callee's stack arguments fit into the area the caller was given.
+ * Returns false, emitting nothing, when the call has to stay a call.
+ */
+static Bool masm_generate_tail_call(MASMContext *ctx, ASTNode *call) {
+    ASTNode *func = ctx->current_function;
+    if (!func || !call || call->type != NODE_CALL || !call->data.call.name) return false;
+    
+    I64 arg_count = call->data.call.arg_count;
+    I64 param_count = masm_parameter_count(func);
+    Bool self = func->data.function.name &&
+                strcmp((char*)call->data.call.name, (char*)func->data.function.name) == 0;
+    
+    if (self ? arg_count != param_count : (arg_count > 4 && arg_count > param_count)) return false;
+    
+    ASTNode *arg = NULL;
+    if (arg_count > 0) {
+        if (!call->data.call.arguments) return false;
+        arg = call->data.call.arguments->data.block.statements;
+    }
+    
+    printf("DEBUG: Generating MASM %s tail call: %s\n", self ? "self" : "sibling", (char*)call->data.call.name);
+    masm_profile_count(ctx, call, 0);
+    
+    /* Evaluate every argument before any parameter slot is overwritten */
+    masm_append_line(ctx, "; Tail call arguments");
+    for (I64 arg_index = 0; arg_index < arg_count; arg_index++, arg = arg->next) {
+        if (!arg || !masm_generate_ast_node(ctx, arg)) {
+            printf("ERROR: Failed to generate MASM for tail call argument %lld\n", arg_index);
+            return false;
+        }
+        masm_stack_push(ctx, "    push rax        ; Save argument");
+    }
+    
+    for (I64 arg_index = arg_count - 1; arg_index >= 0; arg_index--) {
+        char pop_instr[96];
+        if (arg_index < 4) {
+            snprintf(pop_instr, sizeof(pop_instr), "    pop %s    ; Argument %lld",
+                     masm_argument_registers[arg_index], arg_index);
+            masm_stack_pop(ctx, pop_instr);
+        } else {
+            masm_stack_pop(ctx, "    pop rax         ; Stack argument");
+            snprintf(pop_instr, sizeof(pop_instr), "    mov [rbp+%lld], rax    ; Into the incoming argument area",
+                     16 + arg_index * 8);
+            masm_append_line(ctx, pop_instr);
+        }
+    }
+    
+    char jmp_instr[160];
+    if (self) {
+        /* Self recursion: loop back, rehoming the new parameter values, with what enclosing switches keep dropped */
+        if (ctx->stack_depth > 0) {
+            snprintf(jmp_instr, sizeof(jmp_instr), "    add rsp, %lld    ; Drop the enclosing switch values", ctx->stack_depth);
+            masm_append_line(ctx, jmp_instr);
+        }
+        snprintf(jmp_instr, sizeof(jmp_instr), "    jmp %s_tail    ; Self tail call as a loop", masm_function_name(func));
+        masm_append_line(ctx, jmp_instr);
+    } else {
+        /* The callee returns straight to our caller */
+        masm_release_frame(ctx, "Release the frame for the callee");
+        snprintf(jmp_instr, sizeof(jmp_instr), "    jmp %s    ; Tail call", masm_symbol(call->data.call.name));
+        masm_append_line(ctx, jmp_instr);
+    }
+    return true;
+}
+
+/*
+ * Function-related MASM Generation
+ */
+
+Bool masm_generate_function_declaration(MASMContext *ctx, ASTNode *node) {
+    if (!ctx || !node || node->type != NODE_FUNCTION) return false;
+    
+    printf("DEBUG: Generating MASM function declaration: %s\n", 
+           node->data.function.name ? (char*)node->data.function.name : "unknown");
+    
+    /* Generate function signature */
+    char func_sig[256];
+    snprintf(func_sig, sizeof(func_sig), "%s PROC", masm_function_name(node));
+    
+    masm_append_line(ctx, "");
+    Bool proc = masm_begin_proc(ctx);
+    masm_append_line(ctx, func_sig);
+    ctx->indent_level++;
+    
+    /* Generate function prologue */
+    ASTNode *enclosing_function = ctx->current_function;
+    U8 *enclosing_promoted[MASM_PROMOTE_REGISTERS];
+    memcpy(enclosing_promoted, ctx->promoted, sizeof(enclosing_promoted));
+    U8 **enclosing_locals = ctx->locals;
+    I64 enclosing_local_count = ctx->local_count;
+    I64 enclosing_stack_depth = ctx->stack_depth;
+    ctx->current_function = node;
+    I64 local_space = masm_layout_frame(ctx, node, NULL);
+    
+    masm_append_line(ctx, "; Function prologue");
+    masm_append_line(ctx, "    push rbp        ; Save caller's frame pointer");
+    masm_append_line(ctx, "    mov rbp, rsp    ; Set up new frame pointer");
+    
+    /* rbx and the registers holding variables are saved just below rbp, the other locals below them */
+    masm_append_line(ctx, "    push rbx        ; Save scratch register");
+    I64 saved = masm_promoted_count(ctx);
+    for (I64 r = 0; r < saved; r++) {
+        char push_instr[96];
+        snprintf(push_instr, sizeof(push_instr), "    push %s    ; Save callee-saved register", masm_promote_registers[r]);
+        masm_append_line(ctx, push_instr);
+    }
+    char sub_instr[64];
+    if (local_space > 0) {
+        snprintf(sub_instr, sizeof(sub_instr), "    sub rsp, %lld    ; %s", local_space,
+                 ctx->local_count ? "Local variables" : "Keep the stack alignment");
+        masm_append_line(ctx, sub_instr);
+    }
+    
+    /* Shadow space for the calls the body makes */
+    I64 shadow_space = 32;
+    snprintf(sub_instr, sizeof(sub_instr), "    sub rsp, %lld    ; Allocate local space", shadow_space);
+    masm_append_line(ctx, sub_instr);
+    masm_profile_count(ctx, node, 0);
+    
+    /* Self tail calls re-enter here with new arguments in registers */
+    char tail_label[256];
+    snprintf(tail_label, sizeof(tail_label), "%s_tail:", masm_function_name(node));
+    masm_append_line(ctx, tail_label);
+    
+    I64 param_count = masm_parameter_count(node);
+    ASTNode *param = node->data.function.parameters ? node->data.function.parameters->children : NULL;
+    for (I64 i = 0; i < param_count; i++, param = param ? param->next : NULL) {
+        ASTNode *var = param && param->type == NODE_DEFAULT_ARG ? param->data.default_arg.parameter : param;
+        const char *reg = var ? masm_promoted_register(ctx, var->data.variable.name) : NULL;
+        char home_instr[128];
+        if (reg && i < 4) {
+            snprintf(home_instr, sizeof(home_instr), "    mov %s, %s    ; Parameter %s",
+                     reg, masm_argument_registers[i], (char*)var->data.variable.name);
+        } else if (reg) {
+            snprintf(home_instr, sizeof(home_instr), "    mov %s, [rbp+%lld]    ; Parameter %s",
+                     reg, 16 + i * 8, (char*)var->data.variable.name);
+        } else if (i < 4) {
+            snprintf(home_instr, sizeof(home_instr), "    mov [rbp+%lld], %s    ; Home parameter %lld",
+                     16 + i * 8, masm_argument_registers[i], i);
+        } else {
+            continue;
+        }
+        masm_append_line(ctx, home_instr);
+    }
+    masm_append_line(ctx, "");
+    
+    /* Generate function body */
+    if (node->data.function.body) {
+        masm_append_line(ctx, "; Function body");
+        if (!masm_generate_ast_node(ctx, node->data.function.body)) {
+            printf("ERROR: Failed to generate MASM for function body\n");
+            return false;
+        }
+    }
+    
+    /* Generate function epilogue */
+    masm_append_line(ctx, "");
+    char return_label[256];
+    snprintf(return_label, sizeof(return_label), "%s_return:", masm_function_name(node));
+    masm_append_line(ctx, return_label);
+    masm_append_line(ctx, "; Function epilogue");
+    masm_release_frame(ctx, "Restore stack pointer");
+    masm_append_line(ctx, "    ret             ; Return to caller");
+    
+    ctx->current_function = enclosing_function;
+    memcpy(ctx->promoted, enclosing_promoted, sizeof(enclosing_promoted));
+    free(ctx->locals);
+    ctx->locals = enclosing_locals;
+    ctx->local_count = enclosing_local_count;
+    ctx->stack_depth = enclosing_stack_depth;
+    if (!masm_flush_cold(ctx)) return false;
+    
+    ctx->indent_level--;
+    
+    /* Generate function end */
+    char func_end[256];
+    snprintf(func_end, sizeof(func_end), "%s ENDP", masm_function_name(node));
+    masm_append_line(ctx, func_end);
+    if (!masm_end_proc(ctx, proc, masm_function_name(node))) return false;
+    
+    printf("DEBUG: Generated MASM function declaration successfully\n");
+    return true;
+}
+
+Bool masm_generate_function_call(MASMContext *ctx, ASTNode *node) {
+    if (!ctx || !node || node->type != NODE_CALL) return false;
+    
+    printf("DEBUG: Generating MASM function call: %s\n", 
+           node->data.call.name ? (char*)node->data.call.name : "unknown");
+    
+    I64 arg_count = node->data.call.arg_count;
+    masm_profile_count(ctx, node, 0);
+    
+    /*
+     * Every argument is evaluated and pushed before any register is loaded,
+     * since evaluating one may clobber the registers of the ones before it
+     */
+    ASTNode *arg = NULL;
+    if (arg_count > 0) {
+        if (!node->data.call.arguments) return false;
+        arg = node->data.call.arguments->data.block.statements;
+        masm_append_line(ctx, "; Evaluate arguments");
+    }
+    for (I64 arg_index = 0; arg_index < arg_count; arg_index++, arg = arg->next) {
+        if (!arg || !masm_generate_ast_node(ctx, arg)) {
+            printf("ERROR: Failed to generate MASM for argument %lld\n", arg_index);
+            return false;
+        }
+        masm_stack_push(ctx, "    push rax        ; Save argument");
+    }
+    
+    /*
+     * Register arguments come off the stack; stack arguments are copied above
+     * the shadow space. A call with arguments or below pushed temporaries
+     * gets shadow space of its own, padded to keep rsp 16-byte aligned; the
+     * one the frame reserves serves the others.
+     */
+    I64 stack_args = arg_count > 4 ? arg_count - 4 : 0;
+    I64 outgoing = 32 + stack_args * 8;
+    if (arg_count > 0) masm_append_line(ctx, "; Pass arguments");
+    if (stack_args == 0) {
+        for (I64 arg_index = arg_count - 1; arg_index >= 0; arg_index--) {
+            char pop_instr[64];
+            snprintf(pop_instr, sizeof(pop_instr), "    pop %s    ; Argument %lld",
+                     masm_argument_registers[arg_index], arg_index);
+            masm_stack_pop(ctx, pop_instr);
+        }
+        if (ctx->stack_depth % 16 != 0) {
+            outgoing += 8;
+            masm_append_line(ctx, "; Allocate shadow space");
+            masm_append_line(ctx, "    sub rsp, 28h    ; 32 bytes shadow space, 8 to keep the stack aligned");
+        } else if (arg_count > 0 || ctx->stack_depth > 0) {
+            masm_append_line(ctx, "; Allocate shadow space");
+            masm_append_line(ctx, "    sub rsp, 20h    ; 32 bytes shadow space");
+        }
+    } else {
+        if ((ctx->stack_depth + outgoing) % 16 != 0) outgoing += 8;
+        char instr[96];
+        snprintf(instr, sizeof(instr), "    sub rsp, %lld    ; Shadow space and stack arguments", outgoing);
+        masm_append_line(ctx, instr);
+        for (I64 arg_index = 0; arg_index < arg_count; arg_index++) {
+            I64 saved = outgoing + (arg_count - 1 - arg_index) * 8;
+            if (arg_index < 4) {
+                snprintf(instr, sizeof(instr), "    mov %s, [rsp+%lld]    ; Argument %lld",
+                         masm_argument_registers[arg_index], saved, arg_index);
+                masm_append_line(ctx, instr);
+            } else {
+                snprintf(instr, sizeof(instr), "    mov rax, [rsp+%lld]    ; Stack argument %lld", saved, arg_index);
+                masm_append_line(ctx, instr);
+                snprintf(instr, sizeof(instr), "    mov [rsp+%lld], rax", 32 + (arg_index - 4) * 8);
+                masm_append_line(ctx, instr);
+            }
+        }
+    }
+    
+    /* Generate function call */
+    masm_append_line(ctx, "");
+    masm_append_line(ctx, "; Call function");
+    char call_instr[128];
+    snprintf(call_instr, sizeof(call_instr), "    call %s", masm_symbol(node->data.call.name));
+    masm_append_line(ctx, call_instr);
+    
+    /* Release the shadow space, and with stack arguments the saved values as well */
+    if (stack_args > 0) {
+        char cleanup_instr[64];
+        snprintf(cleanup_instr, sizeof(cleanup_instr), "    add rsp, %lld    ; Clean up arguments",
+                 outgoing + arg_count * 8);
+        masm_append_line(ctx, cleanup_instr);
+        ctx->stack_depth -= arg_count * 8;
+    } else if (outgoing > 32) {
+        masm_append_line(ctx, "    add rsp, 28h    ; Restore shadow space");
+    } else if (arg_count > 0 || ctx->stack_depth > 0) {
+        masm_append_line(ctx, "    add rsp, 20h    ; Restore shadow space");
+    }
+    
+    printf("DEBUG: Generated MASM function call successfully\n");
+    return true;
+}
+
+Bool masm_generate_return_statement(MASMContext *ctx, ASTNode *node) {
+    if (!ctx || !node || node->type != NODE_RETURN) return false;
+    
+    printf("DEBUG: Generating MASM return statement\n");
+    
+    /* Check if we have a return value or expression */
+    if (node->data.return_stmt.return_value != 0) {
+        /* Simple return value (integer literal) */
+        I64 return_value = node->data.return_stmt.return_value;
+        
+        char mov_instr[64];
+        snprintf(mov_instr, sizeof(mov_instr), "    mov rax, %ld    ; Return value", return_value);
+        masm_append_line(ctx, mov_instr);
+        
+    } else if (node->data.return_stmt.expression &&
+               masm_generate_tail_call(ctx, node->data.return_stmt.expression)) {
+        /* Call in tail position became a jump */
+        printf("DEBUG: Generated MASM return statement successfully\n");
+        return true;
+        
+    } else if (node->data.return_stmt.expression) {
+        /* Complex return expression */
+        masm_append_line(ctx, "; Evaluate return expression");
+        if (!masm_generate_ast_node(ctx, node->data.return_stmt.expression)) {
+            printf("ERROR: Failed to generate MASM for return expression\n");
+            return false;
+        }
+        masm_append_line(ctx, "; Result is in rax");
+        
+    } else {
+        /* No return value - just return */
+        masm_append_line(ctx, "; Return void");
+    }
+    
+    /* Leave through the shared epilogue (statements in main fall through) */
+    if (ctx->current_function) {
+        char jmp_instr[256];
+        snprintf(jmp_instr, sizeof(jmp_instr), "    jmp %s_return", masm_function_name(ctx->current_function));
+        masm_append_line(ctx, jmp_instr);
+    }
+    
+    printf("DEBUG: Generated MASM return statement successfully\n");
+    return true;
+}
+
+/*
+ * Switch Lowering
+ * Case values become sorted ranges, dispatched by density: a RIP-relative
+ * jump table for dense sets, bit tests for a few targets within 64 values,
+ * and a balanced compare tree otherwise. Ranges (case 4...7:) are tested
+ * with one unsigned compare and fill table entries like single values.
+ * With a profile, linear tests go hottest first, compare trees split the
+ * executions rather than the cases in half, and a case taking most of
+ * the executions is tested before the dispatch proper.
+ */
+
+#define MASM_SWITCH_LINEAR_MAX    3      /* Ranges tested one by one */
+#define MASM_SWITCH_BIT_TEST_MAX  3      /* Targets one bit test dispatch handles */
+#define MASM_SWITCH_TABLE_MAX     1024   /* Jump table entries */
+#define MASM_SWITCH_DENSITY       40     /* Percent of table entries that must be cases */
+
+typedef struct {
+    I64 lo, hi;                          /* Case values lo..hi */
+    char target[48];                     /* Label to jump to */
+    U64 count;                           /* Profiled arrivals at the target, 0 without */
+} MASMSwitchRange;
+
+typedef struct {
+    I64 id;                              /* Numbers the labels of one switch */
+    I64 node_count;                      /* Compare tree labels so far */
+    I64 table_count;
+    const char *default_label;
+    Bool profiled;                       /* Ranges carry profile counts */
+} MASMSwitch;
+
+/* Value of a constant case expression */
+static Bool masm_constant_value(ASTNode *node, I64 *value) {
+    if (!node) return false;
+    switch (node->type) {
+        case NODE_INTEGER:
+            *value = node->data.literal.i64_value;
+            return true;
+        case NODE_CHAR:
+            *value = node->data.literal.char_value;
+            return true;
+        case NODE_UNARY_OP:
+            if (node->data.unary_op.op == UNOP_MINUS && masm_constant_value(node->data.unary_op.operand, value)) {
+                *value = -*value;
+                return true;
+            }
+            if (node->data.unary_op.op == UNOP_PLUS) return masm_constant_value(node->data.unary_op.operand, value);
+            return false;
+        default:
+            return false;
+    }
+}
+
+/* cmp reg, value; values beyond 32 bits go through r10, which no argument uses */
+static void masm_switch_compare(MASMContext *ctx, const char *reg, I64 value) {
+    char line[128];
+    if (value >= -2147483647LL - 1 && value <= 2147483647LL) {
+        snprintf(line, sizeof(line), "    cmp %s, %lld", reg, value);
+    } else {
+        snprintf(line, sizeof(line), "    mov r10, %lld", value);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    cmp %s, r10", reg);
+    }
+    masm_append_line(ctx, line);
+}
+
+/* r11 = rax - base, so one unsigned compare checks a whole range */
+static void masm_switch_offset(MASMContext *ctx, I64 base) {
+    char line[128];
+    masm_append_line(ctx, "    mov r11, rax");
+    if (base == 0) return;
+    if (base >= -2147483647LL - 1 && base <= 2147483647LL) {
+        snprintf(line, sizeof(line), "    sub r11, %lld", base);
+    } else {
+        snprintf(line, sizeof(line), "    mov r10, %lld", base);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    sub r11, r10");
+    }
+    masm_append_line(ctx, line);
+}
+
+static void masm_switch_jump(MASMContext *ctx, const char *jcc, const char *label) {
+    char line[128];
+    snprintf(line, sizeof(line), "    %s %s", jcc, label);
+    masm_append_line(ctx, line);
+}
+
+static int masm_switch_compare_ranges(const void *a, const void *b) {
+    const MASMSwitchRange *ra = a, *rb = b;
+    return ra->lo < rb->lo ? -1 : ra->lo > rb->lo;
+}
+
+/* Sort, reject overlapping cases and merge neighbours with the same target */
+static Bool masm_switch_prepare(MASMSwitchRange *ranges, I64 *count) {
+    qsort(ranges, *count, sizeof(MASMSwitchRange), masm_switch_compare_ranges);
+    I64 kept = 0;
+    for (I64 i = 0; i < *count; i++) {
+        if (kept > 0 && ranges[i].lo <= ranges[kept - 1].hi) {
+            printf("ERROR: Duplicate case value %lld in switch statement\n", ranges[i].lo);
+            return false;
+        }
+        if (kept > 0 && ranges[i].lo == ranges[kept - 1].hi + 1 &&
+            strcmp(ranges[i].target, ranges[kept - 1].target) == 0) {
+            ranges[kept - 1].hi = ranges[i].hi;
+            ranges[kept - 1].count += ranges[i].count;
+        } else {
+            ranges[kept++] = ranges[i];
+        }
+    }
+    *count = kept;
+    return true;
+}
+
+/* Jump to the target of r when rax is in it */
+static void masm_switch_test(MASMContext *ctx, MASMSwitchRange *r) {
+    if (r->lo == r->hi) {
+        masm_switch_compare(ctx, "rax", r->lo);
+        masm_switch_jump(ctx, "je", r->target);
+    } else {
+        masm_switch_offset(ctx, r->lo);
+        masm_switch_compare(ctx, "r11", (I64)((U64)r->hi - (U64)r->lo));
+        masm_switch_jump(ctx, "jbe", r->target);
+    }
+}
+
+static void masm_switch_linear(MASMContext *ctx, MASMSwitch *sw, MASMSwitchRange *r, I64 count) {
+    /* The ranges are disjoint, so they can be tested hottest first */
+    for (I64 i = 1; sw->profiled && i < count; i++) {
+        MASMSwitchRange range = r[i];
+        I64 j = i - 1;
+        while (j >= 0 && r[j].count < range.count) {
+            r[j + 1] = r[j];
+            j--;
+        }
+        r[j + 1] = range;
+    }
+    for (I64 i = 0; i < count; i++) {
+        masm_switch_test(ctx, &r[i]);
+    }
+    masm_switch_jump(ctx, "jmp", sw->default_label);
+}
+
+/* Up to three targets within 64 values: one mask and bt per target */
+static Bool masm_switch_bit_test(MASMContext *ctx, MASMSwitch *sw, MASMSwitchRange *r, I64 count, U64 span) {
+    const char *targets[MASM_SWITCH_BIT_TEST_MAX];
+    I64 target_count = 0;
+    if (span > 64) return false;
+    for (I64 i = 0; i < count; i++) {
+        I64 t = 0;
+        while (t < target_count && strcmp(targets[t], r[i].target) != 0) t++;
+        if (t == target_count) {
+            if (target_count == MASM_SWITCH_BIT_TEST_MAX) return false;
+            targets[target_count++] = r[i].target;
+        }
+    }
+
+    char line[128];
+    masm_append_line(ctx, "; Switch dispatch: bit test");
+    masm_switch_offset(ctx, r[0].lo);
+    masm_switch_compare(ctx, "r11", (I64)(span - 1));
+    masm_switch_jump(ctx, "ja", sw->default_label);
+    for (I64 t = 0; t < target_count; t++) {
+        U64 mask = 0;
+        for (I64 i = 0; i < count; i++) {
+            if (strcmp(r[i].target, targets[t]) != 0) continue;
+            for (U64 v = (U64)r[i].lo - (U64)r[0].lo; v <= (U64)r[i].hi - (U64)r[0].lo; v++) {
+                mask |= (U64)1 << v;
+            }
+        }
+        snprintf(line, sizeof(line), "    mov rdx, 0%016llXh", (unsigned long long)mask);
+        masm_append_line(ctx, line);
+        masm_append_line(ctx, "    bt rdx, r11");
+        masm_switch_jump(ctx, "jc", targets[t]);
+    }
+    masm_switch_jump(ctx, "jmp", sw->default_label);
+    return true;
+}
+
+/* Table of 32-bit offsets from the table itself, so it needs no relocations */
+static void masm_switch_table(MASMContext *ctx, MASMSwitch *sw, MASMSwitchRange *r, I64 count, U64 span,
+                              Bool nobounds) {
+    char table[64], line[160];
+    snprintf(table, sizeof(table), "sw%lld_table%lld", sw->id, sw->table_count++);
+
+    masm_append_line(ctx, "; Switch dispatch: jump table");
+    masm_switch_offset(ctx, r[0].lo);
+    if (!nobounds) {
+        masm_switch_compare(ctx, "r11", (I64)(span - 1));
+        masm_switch_jump(ctx, "ja", sw->default_label);
+    }
+    snprintf(line, sizeof(line), "    lea rdx, [%s]", table);
+    masm_append_line(ctx, line);
+    masm_append_line(ctx, "    movsxd r11, DWORD PTR [rdx+r11*4]");
+    masm_append_line(ctx, "    add r11, rdx");
+    masm_append_line(ctx, "    jmp r11");
+    masm_append_line(ctx, "    ALIGN 4");
+    snprintf(line, sizeof(line), "%s:", table);
+    masm_append_line(ctx, line);
+
+    I64 i = 0;
+    for (U64 v = 0; v < span; v++) {
+        I64 value = (I64)((U64)r[0].lo + v);
+        while (i < count && r[i].hi < value) i++;
+        const char *target = i < count && r[i].lo <= value ? r[i].target : sw->default_label;
+        snprintf(line, sizeof(line), "    DD %s - %s", target, table);
+        masm_append_line(ctx, line);
+    }
+}
+
+/* Compare tree split that halves the profiled executions rather than the ranges */
+static I64 masm_switch_weighted_middle(MASMSwitchRange *r, I64 count) {
+    U64 total = 0, left = 0, best_diff = ~(U64)0;
+    for (I64 i = 0; i < count; i++) total += r[i].count;
+    if (total == 0) return count / 2;
+    
+    I64 best = count / 2;
+    for (I64 mid = 1; mid < count; mid++) {
+        left += r[mid - 1].count;
+        U64 diff = left * 2 > total ? left * 2 - total : total - left * 2;
+        if (diff < best_diff) {
+            best_diff = diff;
+            best = mid;
+        }
+    }
+    return best;
+}
+
+/* Jump from the switch value in rax to the target of its range, or to the default */
+static void masm_switch_dispatch(MASMContext *ctx, MASMSwitch *sw, MASMSwitchRange *r, I64 count, Bool nobounds) {
+    if (count <= MASM_SWITCH_LINEAR_MAX) {
+        masm_switch_linear(ctx, sw, r, count);
+        return;
+    }
+
+    U64 span = (U64)r[count - 1].hi - (U64)r[0].lo + 1;
+    U64 values = 0;
+    for (I64 i = 0; i < count; i++) {
+        values += (U64)r[i].hi - (U64)r[i].lo + 1;
+    }
+
+    if (span != 0 && masm_switch_bit_test(ctx, sw, r, count, span)) return;
+    if (span != 0 && span <= MASM_SWITCH_TABLE_MAX && values * 100 >= span * MASM_SWITCH_DENSITY) {
+        masm_switch_table(ctx, sw, r, count, span, nobounds);
+        return;
+    }
+
+    /* Compare tree: each half picks its own dispatch */
+    I64 mid = sw->profiled ? masm_switch_weighted_middle(r, count) : count / 2;
+    char left[64], line[96];
+    snprintf(left, sizeof(left), "sw%lld_node%lld", sw->id, sw->node_count++);
+    masm_append_line(ctx, "; Switch dispatch: compare tree");
+    masm_switch_compare(ctx, "rax", r[mid].lo);
+    masm_switch_jump(ctx, "jl", left);
+    masm_switch_dispatch(ctx, sw, r + mid, count - mid, false);
+    snprintf(line, sizeof(line), "%s:", left);
+    masm_append_line(ctx, line);
+    masm_switch_dispatch(ctx, sw, r, mid, false);
+}
+
+/* Dispatch of a whole switch (or sub-switch): a dominant case is peeled off first */
+static void masm_switch_dispatch_top(MASMContext *ctx, MASMSwitch *sw, MASMSwitchRange *r, I64 count, Bool nobounds) {
+    U64 total = 0;
+    I64 hot = 0;
+    for (I64 i = 0; i < count; i++) {
+        total += r[i].count;
+        if (r[i].count > r[hot].count) hot = i;
+    }
+    if (sw->profiled && count > MASM_SWITCH_LINEAR_MAX && r[hot].count * 2 > total) {
+        printf("DEBUG: Switch %lld: testing hot case %lld first (%llu of %llu)\n", sw->id, r[hot].lo,
+               (unsigned long long)r[hot].count, (unsigned long long)total);
+        masm_append_line(ctx, "; Switch dispatch: hottest case first");
+        masm_switch_test(ctx, &r[hot]);
+    }
+    masm_switch_dispatch(ctx, sw, r, count, nobounds);
+}
+
+static Bool masm_generate_statements(MASMContext *ctx, ASTNode *stmt) {
+    for (; stmt; stmt = stmt->next) {
+        if (!masm_generate_ast_node(ctx, stmt)) return false;
+    }
+    return true;
+}
+
+/*
+ * Cases between start: and end: form a sub-switch. Their values dispatch
+ * to the start: code, which then dispatches again among them; a break in
+ * one of them runs the end: code. The switch value stays on the stack for
+ * that second dispatch.
+ */
+static Bool masm_generate_switch(MASMContext *ctx, ASTNode *node) {
+    static I64 switch_label_counter = 0;
+    MASMSwitch sw;
+    memset(&sw, 0, sizeof(sw));
+    sw.id = switch_label_counter++;
+
+    char default_label[48], end_label[48], line[128];
+    snprintf(end_label, sizeof(end_label), "sw%lld_end", sw.id);
+    snprintf(default_label, sizeof(default_label), "sw%lld_default", sw.id);
+    sw.default_label = node->data.switch_stmt.default_case ? default_label : end_label;
+    sw.profiled = profile_has_counts(ctx->profile);
+
+    /* Case values: a null case (case:) follows the previous case */
+    I64 case_count = 0, group_count = 0;
+    for (ASTNode *item = node->data.switch_stmt.cases; item; item = item->next) {
+        if (item->type == NODE_CASE && !item->data.case_stmt.is_default) case_count++;
+        if (item->type == NODE_START_BLOCK) group_count++;
+    }
+    MASMSwitchRange *cases = malloc(sizeof(MASMSwitchRange) * (case_count + 1));
+    MASMSwitchRange *ranges = malloc(sizeof(MASMSwitchRange) * (case_count + 1));
+    I64 *case_group = malloc(sizeof(I64) * (case_count + 1));
+    Bool *group_has_end = calloc(group_count + 1, sizeof(Bool));
+    if (!cases || !ranges || !case_group || !group_has_end) {
+        free(cases);
+        free(ranges);
+        free(case_group);
+        free(group_has_end);
+        return false;
+    }
+
+    Bool ok = true;
+    I64 c = 0, group = -1, current = -1, next_value = 0;
+    for (ASTNode *item = node->data.switch_stmt.cases; item && ok; item = item->next) {
+        if (item->type == NODE_START_BLOCK) {
+            current = ++group;
+        } else if (item->type == NODE_END_BLOCK) {
+            if (current >= 0) group_has_end[current] = true;
+            current = -1;
+        } else if (item->type == NODE_CASE && !item->data.case_stmt.is_default) {
+            MASMSwitchRange *r = &cases[c];
+            if (item->data.case_stmt.is_range) {
+                ok = masm_constant_value(item->data.case_stmt.range_start, &r->lo) &&
+                     masm_constant_value(item->data.case_stmt.range_end, &r->hi) && r->lo <= r->hi;
+            } else if (item->data.case_stmt.is_null_case) {
+                r->lo = r->hi = next_value;
+            } else {
+                ok = masm_constant_value(item->data.case_stmt.value, &r->lo);
+                r->hi = r->lo;
+            }
+            if (!ok) printf("ERROR: Case value must be an integer constant (or an ascending range)\n");
+            next_value = r->hi + 1;
+            snprintf(r->target, sizeof(r->target), "sw%lld_case%lld", sw.id, c);
+            r->count = profile_count(ctx->profile, item, 0);
+            case_group[c] = current;
+            c++;
+        }
+    }
+
+    /* case 'a': case 'e': ... share the code of the last one */
+    c = 0;
+    for (ASTNode *item = node->data.switch_stmt.cases; item && ok; item = item->next) {
+        if (item->type != NODE_CASE || item->data.case_stmt.is_default) continue;
+        ASTNode *run = item;
+        I64 last = c;
+        while (!run->data.case_stmt.body && run->next && run->next->type == NODE_CASE &&
+               !run->next->data.case_stmt.is_default) {
+            run = run->next;
+            last++;
+        }
+        if (last != c) strcpy(cases[c].target, cases[last].target);
+        c++;
+    }
+
+    /* Outer dispatch: cases of a sub-switch go to its start: code */
+    I64 range_count = case_count;
+    for (I64 i = 0; ok && i < case_count; i++) {
+        ranges[i] = cases[i];
+        if (case_group[i] >= 0) {
+            snprintf(ranges[i].target, sizeof(ranges[i].target), "sw%lld_start%lld", sw.id, case_group[i]);
+        }
+    }
+    ok = ok && masm_switch_prepare(ranges, &range_count);
+
+    const char *outer_break = ctx->break_label;
+    if (ok) {
+        masm_append_line(ctx, "; Switch expression");
+        ok = masm_generate_ast_node(ctx, node->data.switch_stmt.expression);
+    }
+    if (ok) {
+        if (group_count > 0) masm_stack_push(ctx, "    push rax        ; Keep the switch value for sub-switches");
+        masm_switch_dispatch_top(ctx, &sw, ranges, range_count, node->data.switch_stmt.nobounds);
+        ctx->break_label = end_label;
+    }
+
+    c = 0;
+    group = current = -1;
+    char fin_label[48];
+    for (ASTNode *item = node->data.switch_stmt.cases; item && ok; item = item->next) {
+        if (item->type == NODE_START_BLOCK) {
+            current = ++group;
+            snprintf(line, sizeof(line), "sw%lld_start%lld:", sw.id, group);
+            masm_append_line(ctx, line);
+            ctx->break_label = end_label;
+            ok = masm_generate_statements(ctx, item->data.start_end_block.statements);
+
+            I64 sub_count = 0;
+            for (I64 i = 0; i < case_count; i++) {
+                if (case_group[i] == group) ranges[sub_count++] = cases[i];
+            }
+            ok = ok && masm_switch_prepare(ranges, &sub_count);
+            if (ok) {
+                masm_append_line(ctx, "    mov rax, [rsp]  ; Switch value");
+                masm_switch_dispatch_top(ctx, &sw, ranges, sub_count, false);
+            }
+            snprintf(fin_label, sizeof(fin_label), "sw%lld_fin%lld", sw.id, group);
+            ctx->break_label = group_has_end[group] ? fin_label : end_label;
+        } else if (item->type == NODE_END_BLOCK) {
+            if (current >= 0) {
+                snprintf(line, sizeof(line), "%s:", fin_label);
+                masm_append_line(ctx, line);
+            }
+            current = -1;
+            ctx->break_label = end_label;
+            ok = masm_generate_statements(ctx, item->data.start_end_block.statements);
+        } else if (item->type == NODE_CASE && !item->data.case_stmt.is_default) {
+            snprintf(line, sizeof(line), "sw%lld_case%lld:", sw.id, c++);
+            masm_append_line(ctx, line);
+            masm_profile_count(ctx, item, 0);
+            ok = masm_generate_statements(ctx, item->data.case_stmt.body);
+        }
+    }
+
+    if (ok && node->data.switch_stmt.default_case) {
+        ctx->break_label = end_label;
+        snprintf(line, sizeof(line), "%s:", default_label);
+        masm_append_line(ctx, line);
+        masm_profile_count(ctx, node->data.switch_stmt.default_case, 0);
+        ok = masm_generate_statements(ctx, node->data.switch_stmt.default_case->data.case_stmt.body);
+    }
+    if (ok) {
+        snprintf(line, sizeof(line), "%s:", end_label);
+        masm_append_line(ctx, line);
+        if (group_count > 0) {
+            masm_append_line(ctx, "    add rsp, 8      ; Drop the switch value");
+            ctx->stack_depth -= 8;
+        }
+    }
+
+    ctx->break_label = outer_break;
+    free(cases);
+    free(ranges);
+    free(case_group);
+    free(group_has_end);
+    return ok;
+}
+
+/* ========================================================================
+ * Range Comparisons
+ * ======================================================================== */
+
+/*
+ * 5<i<j+1<20 is i>5 && i<j+1 && j+1<20 with each operand evaluated once.
+ * Operands are evaluated left to right, only as far as the chain stays
+ * true; the previous operand lives in r11 and only has to be saved across
+ * operands that are not a constant or a plain variable load.
+ */
+
+static Bool masm_range_ascending(BinaryOpType op) {
+    return op == BINOP_LT || op == BINOP_LE;
+}
+
+static const char* masm_range_jump_if_false(BinaryOpType op) {
+    switch (op) {
+        case BINOP_LT: return "jge";
+        case BINOP_GT: return "jle";
+        case BINOP_LE: return "jg";
+        default:       return "jl";
+    }
+}
+
+static const char* masm_range_set_if_true(BinaryOpType op) {
+    switch (op) {
+        case BINOP_LT: return "setl";
+        case BINOP_GT: return "setg";
+        case BINOP_LE: return "setle";
+        default:       return "setge";
+    }
+}
+
+/* lo OP x OP hi with constant bounds: one unsigned compare of x-lo against hi-lo */
+static Bool masm_generate_constant_range(MASMContext *ctx, ASTNode *node) {
+    ASTNode *first = node->data.range_comparison.expressions;
+    ASTNode *op = node->data.range_comparison.operators;
+    ASTNode *x, *last;
+    I64 outer_lo, outer_hi, lo, hi;
+    BinaryOpType op_lo, op_hi;
+    char line[128];
+
+    if (node->data.range_comparison.expression_count != 3 || !op || !op->next) return false;
+    x = first->next;
+    last = x->next;
+    if (!masm_constant_value(first, &outer_lo) || !masm_constant_value(last, &outer_hi)) return false;
+    if (masm_range_ascending(op->data.binary_op.op) != masm_range_ascending(op->next->data.binary_op.op)) return false;
+
+    /* Turn both directions into lo <= x <= hi */
+    if (masm_range_ascending(op->data.binary_op.op)) {
+        op_lo = op->data.binary_op.op;
+        op_hi = op->next->data.binary_op.op;
+    } else {
+        I64 swap = outer_lo;
+        outer_lo = outer_hi;
+        outer_hi = swap;
+        op_lo = op->next->data.binary_op.op;
+        op_hi = op->data.binary_op.op;
+    }
+    Bool empty = false;
+    lo = outer_lo;
+    hi = outer_hi;
+    if (op_lo == BINOP_LT || op_lo == BINOP_GT) {
+        if (lo == INT64_MAX) empty = true;
+        else lo++;
+    }
+    if (op_hi == BINOP_LT || op_hi == BINOP_GT) {
+        if (hi == INT64_MIN) empty = true;
+        else hi--;
+    }
+    if (lo > hi) empty = true;
+
+    if (!masm_generate_ast_node(ctx, x)) return false;
+    if (empty) {
+        masm_append_line(ctx, "    xor eax, eax    ; Range comparison can never hold");
+        return true;
+    }
+    masm_switch_offset(ctx, lo);
+    masm_switch_compare(ctx, "r11", (I64)((U64)hi - (U64)lo));
+    masm_append_line(ctx, "    setbe al        ; x-lo <= hi-lo unsigned");
+    snprintf(line, sizeof(line), "    movzx rax, al   ; Range comparison %lld..%lld", lo, hi);
+    masm_append_line(ctx, line);
+    return true;
+}
+
+static Bool masm_generate_range_comparison(MASMContext *ctx, ASTNode *node) {
+    static I64 range_label_counter = 0;
+    ASTNode *expr = node->data.range_comparison.expressions;
+    ASTNode *op = node->data.range_comparison.operators;
+    Bool need_false = false;
+    char false_label[64], end_label[64], line[128];
+    I64 value;
+
+    printf("DEBUG: Generating range comparison with %ld expressions\n", node->data.range_comparison.expression_count);
+
+    if (!expr || !op) return masm_generate_ast_node(ctx, expr);
+    if (masm_generate_constant_range(ctx, node)) return true;
+
+    range_label_counter++;
+    snprintf(false_label, sizeof(false_label), "range_false_%d", (int)range_label_counter);
+    snprintf(end_label, sizeof(end_label), "range_end_%d", (int)range_label_counter);
+
+    /* First operand into r11 */
+    if (masm_constant_value(expr, &value)) {
+        snprintf(line, sizeof(line), "    mov r11, %lld", value);
+        masm_append_line(ctx, line);
+    } else {
+        if (!masm_generate_ast_node(ctx, expr)) return false;
+        masm_append_line(ctx, "    mov r11, rax    ; Previous range operand");
+    }
+
+    for (expr = expr->next; expr && op; expr = expr->next, op = op->next) {
+        Bool last = !expr->next || !op->next;
+        Bool constant = masm_constant_value(expr, &value);
+
+        if (constant) {
+            masm_switch_compare(ctx, "r11", value);
+        } else if (expr->type == NODE_IDENTIFIER) {
+            if (!masm_generate_ast_node(ctx, expr)) return false;
+            masm_append_line(ctx, "    cmp r11, rax");
+        } else {
+            masm_stack_push(ctx, "    push r11        ; Save previous range operand");
+            if (!masm_generate_ast_node(ctx, expr)) return false;
+            masm_stack_pop(ctx, "    pop r11");
+            masm_append_line(ctx, "    cmp r11, rax");
+        }
+
+        if (last) {
+            snprintf(line, sizeof(line), "    %s al", masm_range_set_if_true(op->data.binary_op.op));
+            masm_append_line(ctx, line);
+            masm_append_line(ctx, "    movzx rax, al   ; Range comparison result");
+            break;
+        }
+
+        snprintf(line, sizeof(line), "    %s %s", masm_range_jump_if_false(op->data.binary_op.op), false_label);
+        masm_append_line(ctx, line);
+        need_false = true;
+        if (constant) {
+            snprintf(line, sizeof(line), "    mov r11, %lld", value);
+            masm_append_line(ctx, line);
+        } else {
+            masm_append_line(ctx, "    mov r11, rax    ; Previous range operand");
+        }
+    }
+
+    if (need_false) {
+        snprintf(line, sizeof(line), "    jmp %s", end_label);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "%s:", false_label);
+        masm_append_line(ctx, line);
+        masm_append_line(ctx, "    xor eax, eax    ; Range comparison result: false");
+        snprintf(line, sizeof(line), "%s:", end_label);
+        masm_append_line(ctx, line);
+    }
+    return true;
+}
+
+/* ========================================================================
+ * Multiplication by Constants
+ * ======================================================================== */
+
+/*
+ * x * c with a constant c is built from steps that each multiply rax by a
+ * small factor, when their critical path is shorter than an imul:
+ *  - shl k (add rax, rax for k of 1): 2^k;
+ *  - lea rax, [rax+rax*s]: s+1 for s of 2, 4 or 8;
+ *  - mov r11, rax; shl rax, k; add or sub rax, r11: 2^k+1 or 2^k-1 (the
+ *    mov is off the path);
+ *  - neg: -1.
+ * The search tries the factorizations of c into these steps and keeps the
+ * shortest path, then the fewest instructions. Sequences only use rax and
+ * r11, so neither the dividend a modulo keeps in rbx nor the argument
+ * registers of a call being set up are touched.
+ */
+
+typedef enum {
+    MASM_MUL_SHL,
+    MASM_MUL_LEA,
+    MASM_MUL_ADD_SHIFTED,
+    MASM_MUL_SUB_SHIFTED,
+    MASM_MUL_NEG,
+    MASM_MUL_STEP_KINDS
+} MASMMulStepKind;
+
+/* Latency in cycles and instruction count of each step */
+static const struct {
+    I64 latency;
+    I64 size;
+} masm_mul_cost[MASM_MUL_STEP_KINDS] = {
+    {1, 1},                              /* shl */
+    {1, 1},                              /* lea */
+    {2, 3},                              /* mov, shl, add */
+    {2, 3},                              /* mov, shl, sub */
+    {1, 1}                               /* neg */
+};
+
+#define MASM_IMUL_LATENCY   3
+#define MASM_MUL_MAX_STEPS  3
+
+typedef struct {
+    MASMMulStepKind kind;
+    I64 shift;                           /* Shift count, or log2 of the lea scale */
+} MASMMulStep;
+
+typedef struct {
+    MASMMulStep steps[MASM_MUL_MAX_STEPS];
+    I64 count;
+    I64 latency;
+    I64 size;
+} MASMMulPlan;
+
+/* Find the best plan for the factor m still to be multiplied in */
+static void masm_mul_search(U64 m, I64 width, MASMMulPlan *current, MASMMulPlan *best) {
+    if (m == 1) {
+        if (current->latency < best->latency ||
+            (current->latency == best->latency && current->size < best->size)) {
+            *best = *current;
+        }
+        return;
+    }
+    if (current->count == MASM_MUL_MAX_STEPS) return;
+
+    for (int kind = MASM_MUL_SHL; kind < MASM_MUL_NEG; kind++) {
+        if (current->latency + masm_mul_cost[kind].latency > best->latency) continue;
+        I64 last = kind == MASM_MUL_LEA ? 3 : width - 1;
+        for (I64 k = 1; k <= last; k++) {
+            U64 factor = 1ULL << k;
+            if (kind == MASM_MUL_LEA || kind == MASM_MUL_ADD_SHIFTED) factor++;
+            if (kind == MASM_MUL_SUB_SHIFTED) factor--;
+            if (factor < 2 || m % factor != 0) continue;
+
+            current->steps[current->count].kind = (MASMMulStepKind)kind;
+            current->steps[current->count].shift = k;
+            current->count++;
+            current->latency += masm_mul_cost[kind].latency;
+            current->size += masm_mul_cost[kind].size;
+            masm_mul_search(m / factor, width, current, best);
+            current->count--;
+            current->latency -= masm_mul_cost[kind].latency;
+            current->size -= masm_mul_cost[kind].size;
+        }
+    }
+}
+
+/* rax = rax * c at width bits (32-bit results are left in eax) */
+static void masm_multiply_constant(MASMContext *ctx, I64 width, I64 c) {
+    const char *ax = width == 64 ? "rax" : "eax";
+    const char *scratch = width == 64 ? "r11" : "r11d";
+    char line[128];
+
+    U64 m = c < 0 ? 0 - (U64)c : (U64)c;
+    if (m == 0) {
+        masm_append_line(ctx, "    xor eax, eax    ; Multiply by 0");
+        return;
+    }
+
+    /* imul is the plan to beat: a size of 0 keeps it on equal latency */
+    MASMMulPlan best, current;
+    memset(&best, 0, sizeof(best));
+    memset(&current, 0, sizeof(current));
+    best.latency = MASM_IMUL_LATENCY;
+    best.count = -1;
+    if (c < 0) {
+        current.steps[0].kind = MASM_MUL_NEG;
+        current.count = 1;
+        current.latency = masm_mul_cost[MASM_MUL_NEG].latency;
+        current.size = masm_mul_cost[MASM_MUL_NEG].size;
+    }
+    masm_mul_search(m, width, &current, &best);
+
+    if (best.count < 0) {
+        if (c >= -2147483647LL - 1 && c <= 2147483647LL) {
+            snprintf(line, sizeof(line), "    imul %s, %lld    ; Multiply by %lld", ax, c, c);
+        } else {
+            snprintf(line, sizeof(line), "    mov r11, %lld", c);
+            masm_append_line(ctx, line);
+            snprintf(line, sizeof(line), "    imul rax, r11    ; Multiply by %lld", c);
+        }
+        masm_append_line(ctx, line);
+        return;
+    }
+
+    for (I64 s = 0; s < best.count; s++) {
+        MASMMulStep *step = &best.steps[s];
+        switch (step->kind) {
+            case MASM_MUL_SHL:
+                if (step->shift == 1) {
+                    snprintf(line, sizeof(line), "    add %s, %s", ax, ax);
+                } else {
+                    snprintf(line, sizeof(line), "    shl %s, %lld", ax, step->shift);
+                }
+                break;
+            case MASM_MUL_LEA:
+                snprintf(line, sizeof(line), "    lea %s, [rax+rax*%d]", ax, 1 << step->shift);
+                break;
+            case MASM_MUL_ADD_SHIFTED:
+            case MASM_MUL_SUB_SHIFTED:
+                snprintf(line, sizeof(line), "    mov %s, %s", scratch, ax);
+                masm_append_line(ctx, line);
+                snprintf(line, sizeof(line), "    shl %s, %lld", ax, step->shift);
+                masm_append_line(ctx, line);
+                snprintf(line, sizeof(line), "    %s %s, %s", step->kind == MASM_MUL_ADD_SHIFTED ? "add" : "sub", ax, scratch);
+                break;
+            case MASM_MUL_NEG:
+            default:
+                snprintf(line, sizeof(line), "    neg %s", ax);
+                break;
+        }
+        if (s == best.count - 1) {
+            size_t len = strlen(line);
+            snprintf(line + len, sizeof(line) - len, "    ; Multiply by %lld", c);
+        }
+        masm_append_line(ctx, line);
+    }
+}
+
+/* Does x * c or c * x have a constant c; operand is the other side */
+static Bool masm_is_constant_multiply(ASTNode *node, I64 *c, ASTNode **operand) {
+    if (node->data.binary_op.op != BINOP_MUL) return false;
+    if (masm_constant_value(node->data.binary_op.right, c)) {
+        *operand = node->data.binary_op.left;
+        return true;
+    }
+    if (masm_constant_value(node->data.binary_op.left, c)) {
+        *operand = node->data.binary_op.right;
+        return true;
+    }
+    return false;
+}
+
+static Bool masm_generate_constant_multiply(MASMContext *ctx, ASTNode *operand, I64 c) {
+    if (!masm_generate_ast_node(ctx, operand)) {
+        printf("ERROR: Failed to generate MASM for multiplied operand\n");
+        return false;
+    }
+    printf("DEBUG: Multiplication by constant %lld\n", c);
+    masm_multiply_constant(ctx, 64, c);
+    return true;
+}
+
+/*
+ * Address of a sub-int or union element, with the object address pushed
+ * and the index in rax. Elements of 1, 2, 4 or 8 bytes are scaled by the
+ * addressing mode; when the caller reloads rax before the access the
+ * scaled address is formed in rbx with an lea. Writes the memory operand
+ * to address.
+ */
+static void masm_element_address(MASMContext *ctx, I64 member_size, Bool in_rbx, const char *object,
+                                 char *address, size_t size) {
+    char line[128];
+    I64 scale = member_size > 1 ? member_size : 1;
+
+    if (scale == 1 || scale == 2 || scale == 4 || scale == 8) {
+        snprintf(line, sizeof(line), "    pop rbx         ; Restore %s address", object);
+        masm_stack_pop(ctx, line);
+        if (scale == 1) {
+            snprintf(address, size, "[rbx+rax]");
+        } else {
+            snprintf(address, size, "[rbx+rax*%lld]", scale);
+        }
+        if (in_rbx) {
+            snprintf(line, sizeof(line), "    lea rbx, %s    ; Element address", address);
+            masm_append_line(ctx, line);
+            snprintf(address, size, "[rbx]");
+        }
+        return;
+    }
+
+    masm_multiply_constant(ctx, 64, scale);
+    snprintf(line, sizeof(line), "    pop rbx         ; Restore %s address", object);
+    masm_stack_pop(ctx, line);
+    masm_append_line(ctx, "    add rbx, rax    ; Add offset to base address");
+    snprintf(address, size, "[rbx]");
+}
+
+/* ========================================================================
+ * Division by Constants
+ * ======================================================================== */
+
+/*
+ * x / d and x % d with a constant d never need idiv: powers of two are
+ * shifts and masks (signed dividends are biased by d-1 when negative so
+ * the quotient rounds toward zero), anything else is a multiply by a
+ * fixed-point reciprocal of d, keeping the high half of the product
+ * (Granlund and Montgomery; the magic numbers follow Hacker's Delight,
+ * chapter 10), computed in masm_divide.c. The remainder is x - q * d.
+ * Sequences only use rax, rbx, r11 and, for the high half of the product,
+ * rdx, which the idiv they replace clobbers as well.
+ */
+
+/*
+ * Width and signedness of a dividend. Everything is an I64 in rax except
+ * sub-int loads, which arrive sign- or zero-extended from their member
+ * (8-bit members are always zero-extended).
+ */
+static void masm_div_operand_type(ASTNode *node, I64 *width, Bool *is_signed) {
+    *width = 64;
+    *is_signed = true;
+    if (node && node->type == NODE_SUB_INT_ACCESS && node->data.sub_int_access.member_size <= 4) {
+        *width = 32;
+        *is_signed = node->data.sub_int_access.is_signed && node->data.sub_int_access.member_size > 1;
+    }
+}
+
+/* Power of two divisor 2^k, k >= 1: rax = rax / d or rax % d */
+static void masm_div_power_of_two(MASMContext *ctx, I64 k, I64 width, Bool is_signed, Bool negate, Bool modulo) {
+    const char *ax = width == 64 ? "rax" : "eax";
+    const char *bx = width == 64 ? "rbx" : "ebx";
+    const char *scratch = width == 64 ? "r11" : "r11d";
+    char line[128];
+
+    if (!is_signed) {
+        if (!modulo) {
+            snprintf(line, sizeof(line), "    shr %s, %lld    ; Unsigned divide by %llu", ax, k, 1ULL << k);
+        } else if (k < 31) {
+            snprintf(line, sizeof(line), "    and %s, %lld    ; Unsigned modulo by %llu", ax, (1LL << k) - 1, 1ULL << k);
+        } else {
+            snprintf(line, sizeof(line), "    mov r11, %lld", (I64)((1ULL << k) - 1));
+            masm_append_line(ctx, line);
+            snprintf(line, sizeof(line), "    and rax, r11    ; Unsigned modulo by %llu", 1ULL << k);
+        }
+        masm_append_line(ctx, line);
+        return;
+    }
+
+    /* Bias negative dividends by 2^k-1 so the shift rounds toward zero */
+    if (modulo) {
+        snprintf(line, sizeof(line), "    mov %s, %s", bx, ax);
+        masm_append_line(ctx, line);
+    }
+    snprintf(line, sizeof(line), "    mov %s, %s", scratch, ax);
+    masm_append_line(ctx, line);
+    snprintf(line, sizeof(line), "    sar %s, %lld", scratch, width - 1);
+    masm_append_line(ctx, line);
+    snprintf(line, sizeof(line), "    shr %s, %lld", scratch, width - k);
+    masm_append_line(ctx, line);
+    snprintf(line, sizeof(line), "    add %s, %s", ax, scratch);
+    masm_append_line(ctx, line);
+
+    if (modulo) {
+        /* x - (biased x rounded down to a multiple of 2^k); the sign of d does not matter */
+        snprintf(line, sizeof(line), "    sar %s, %lld", ax, k);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    shl %s, %lld", ax, k);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    sub %s, %s", bx, ax);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    mov %s, %s    ; Signed modulo by %llu", ax, bx, 1ULL << k);
+        masm_append_line(ctx, line);
+    } else {
+        snprintf(line, sizeof(line), "    sar %s, %lld    ; Signed divide by %s%llu", ax, k, negate ? "-" : "", 1ULL << k);
+        masm_append_line(ctx, line);
+        if (negate) {
+            snprintf(line, sizeof(line), "    neg %s", ax);
+            masm_append_line(ctx, line);
+        }
+    }
+    if (width == 32) masm_append_line(ctx, "    movsxd rax, eax");
+}
+
+/* Any other divisor: high half of rax * magic, shifted and corrected */
+static void masm_div_multiply_high(MASMContext *ctx, I64 d, I64 width, Bool is_signed, Bool modulo) {
+    const char *ax = width == 64 ? "rax" : "eax";
+    const char *bx = width == 64 ? "rbx" : "ebx";
+    const char *dx = width == 64 ? "rdx" : "edx";
+    MASMDivMagic magic;
+    char line[128];
+
+    if (is_signed) {
+        masm_div_magic_signed(d, width, &magic);
+    } else {
+        masm_div_magic_unsigned((U64)d, width, &magic);
+    }
+
+    /* The magic number is taken as signed; the wrap is undone when its sign differs from d's */
+    Bool top = (magic.multiplier >> (width - 1)) != 0;
+    Bool correct = is_signed && ((d > 0 && top) || (d < 0 && !top));
+    if (modulo || correct || magic.add) {
+        snprintf(line, sizeof(line), "    mov %s, %s    ; Keep the dividend", bx, ax);
+        masm_append_line(ctx, line);
+    }
+    snprintf(line, sizeof(line), "    mov %s, 0%llXh    ; Magic number for %s %lld", dx,
+             (unsigned long long)magic.multiplier, modulo ? "modulo" : "divide", d);
+    masm_append_line(ctx, line);
+    snprintf(line, sizeof(line), "    %s %s", is_signed ? "imul" : "mul", dx);
+    masm_append_line(ctx, line);
+
+    if (is_signed) {
+        if (correct) {
+            snprintf(line, sizeof(line), "    %s %s, %s", d > 0 ? "add" : "sub", dx, bx);
+            masm_append_line(ctx, line);
+        }
+        if (magic.shift > 0) {
+            snprintf(line, sizeof(line), "    sar %s, %lld", dx, magic.shift);
+            masm_append_line(ctx, line);
+        }
+        /* Round toward zero: add one when the quotient is negative */
+        snprintf(line, sizeof(line), "    mov %s, %s", ax, dx);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    shr %s, %lld", ax, width - 1);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    add %s, %s", ax, dx);
+        masm_append_line(ctx, line);
+    } else if (magic.add) {
+        /* A width+1 bit multiplier: q = (((x - hi) >> 1) + hi) >> (shift - 1) */
+        snprintf(line, sizeof(line), "    mov %s, %s", ax, bx);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    sub %s, %s", ax, dx);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    shr %s, 1", ax);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    add %s, %s", ax, dx);
+        masm_append_line(ctx, line);
+        if (magic.shift > 1) {
+            snprintf(line, sizeof(line), "    shr %s, %lld", ax, magic.shift - 1);
+            masm_append_line(ctx, line);
+        }
+    } else {
+        if (magic.shift > 0) {
+            snprintf(line, sizeof(line), "    shr %s, %lld", dx, magic.shift);
+            masm_append_line(ctx, line);
+        }
+        snprintf(line, sizeof(line), "    mov %s, %s", ax, dx);
+        masm_append_line(ctx, line);
+    }
+
+    if (modulo) {
+        masm_multiply_constant(ctx, width, d);
+        snprintf(line, sizeof(line), "    sub %s, %s", bx, ax);
+        masm_append_line(ctx, line);
+        snprintf(line, sizeof(line), "    mov %s, %s", ax, bx);
+        masm_append_line(ctx, line);
+    }
+    if (width == 32 && is_signed) masm_append_line(ctx, "    movsxd rax, eax");
+}
+
+/*
+ * Does x / d or x % d have a constant d that needs no idiv (d of 0 keeps
+ * its fault, the I64 minimum has no magic number)
+ */
+static Bool masm_is_constant_divide(ASTNode *node, I64 *d, I64 *width, Bool *is_signed) {
+    if (node->data.binary_op.op != BINOP_DIV && node->data.binary_op.op != BINOP_MOD) return false;
+    if (!masm_constant_value(node->data.binary_op.right, d) || *d == 0 || *d == -9223372036854775807LL - 1) {
+        return false;
+    }
+    masm_div_operand_type(node->data.binary_op.left, width, is_signed);
+    if (!*is_signed && *d < 0) return false;
+    return *width == 64 || (*d >= -2147483647LL - 1 && *d <= (*is_signed ? 2147483647LL : 4294967295LL));
+}
+
+static Bool masm_generate_constant_divide(MASMContext *ctx, ASTNode *node, I64 d, I64 width, Bool is_signed) {
+    Bool modulo = node->data.binary_op.op == BINOP_MOD;
+    if (!masm_generate_ast_node(ctx, node->data.binary_op.left)) {
+        printf("ERROR: Failed to generate MASM for left operand\n");
+        return false;
+    }
+
+    U64 magnitude = d < 0 ? (U64)-d : (U64)d;
+    I64 k = masm_div_log2(magnitude);
+    printf("DEBUG: %s by constant %lld (%s %lld-bit)\n", modulo ? "Modulo" : "Division", d,
+           is_signed ? "signed" : "unsigned", width);
+
+    if (magnitude == 1) {
+        if (modulo) {
+            masm_append_line(ctx, "    xor eax, eax    ; Modulo by 1");
+        } else if (d < 0) {
+            masm_append_line(ctx, "    neg rax         ; Divide by -1");
+        }
+    } else if (k > 0) {
+        masm_div_power_of_two(ctx, k, width, is_signed, d < 0, modulo);
+    } else {
+        masm_div_multiply_high(ctx, d, width, is_signed, modulo);
+    }
+    return true;
+}
+
+/* ========================================================================
+ * Conditions
+ * ======================================================================== */
+
+static void masm_new_label(MASMContext *ctx, const char *prefix, char *label, size_t size) {
+    snprintf(label, size, "%s_%d", prefix, ++ctx->label_counter);
+}
+
+static Bool masm_is_logical(ASTNode *node) {
+    return node && node->type == NODE_BINARY_OP &&
+           (node->data.binary_op.op == BINOP_AND_AND || node->data.binary_op.op == BINOP_OR_OR);
+}
+
+static Bool masm_is_comparison(ASTNode *node) {
+    if (!node || node->type != NODE_BINARY_OP) return false;
+    switch (node->data.binary_op.op) {
+        case BINOP_EQ: case BINOP_NE: case BINOP_LT:
+        case BINOP_LE: case BINOP_GT: case BINOP_GE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Condition code of a comparison, signed as every value is an I64 */
+static const char* masm_condition_code(BinaryOpType op) {
+    switch (op) {
+        case BINOP_EQ: return "e";
+        case BINOP_NE: return "ne";
+        case BINOP_LT: return "l";
+        case BINOP_LE: return "le";
+        case BINOP_GT: return "g";
+        default:       return "ge";
+    }
+}
+
+static const char* masm_negate_condition_code(const char *cc) {
+    static const char *pairs[][2] = {
+        {"e", "ne"}, {"ne", "e"}, {"l", "ge"}, {"ge", "l"}, {"le", "g"}, {"g", "le"},
+        {"z", "nz"}, {"nz", "z"}
+    };
+    for (size_t i = 0; i < sizeof(pairs) / sizeof(pairs[0]); i++) {
+        if (strcmp(cc, pairs[i][0]) == 0) return pairs[i][1];
+    }
+    return "z";
+}
+
+/*
+ * Set the flags from cond and return the condition code that holds when
+ * it is true: cmp for comparisons (against an immediate when the right
+ * operand is a constant that fits, test against 0), test for anything else
+ */
+static Bool masm_generate_condition_flags(MASMContext *ctx, ASTNode *cond, const char **cc) {
+    char line[128];
+    I64 value;
+
+    if (cond->type == NODE_UNARY_OP && cond->data.unary_op.op == UNOP_NOT) {
+        if (!masm_generate_condition_flags(ctx, cond->data.unary_op.operand, cc)) return false;
+        *cc = masm_negate_condition_code(*cc);
+        return true;
+    }
+
+    if (!masm_is_comparison(cond)) {
+        if (!masm_generate_ast_node(ctx, cond)) return false;
+        masm_append_line(ctx, "    test rax, rax   ; Test condition");
+        *cc = "nz";
+        return true;
+    }
+
+    *cc = masm_condition_code(cond->data.binary_op.op);
+    if (!masm_generate_ast_node(ctx, cond->data.binary_op.left)) return false;
+    if (masm_constant_value(cond->data.binary_op.right, &value) &&
+        value >= -2147483647LL - 1 && value <= 2147483647LL) {
+        if (value == 0) {
+            masm_append_line(ctx, "    test rax, rax   ; Compare with 0");
+        } else {
+            snprintf(line, sizeof(line), "    cmp rax, %lld    ; Compare", value);
+            masm_append_line(ctx, line);
+        }
+        return true;
+    }
+    masm_stack_push(ctx, "    push rax        ; Save left operand");
+    if (!masm_generate_ast_node(ctx, cond->data.binary_op.right)) return false;
+    masm_stack_pop(ctx, "    pop rbx         ; Restore left operand");
+    masm_append_line(ctx, "    cmp rbx, rax    ; Compare");
+    return true;
+}
+
+/*
+ * Jump to label when cond is jump_if, fall through otherwise. && and ||
+ * branch on each operand in turn, so the right operand is skipped as soon
+ * as the left one decides the result and no 0/1 value is built for if and
+ * while. Comparisons jump on the flags of their cmp; ^^ needs both
+ * operands and is tested as a value.
+ */
+static Bool masm_generate_branch(MASMContext *ctx, ASTNode *cond, Bool jump_if, const char *label) {
+    char skip[64], line[128];
+    I64 value;
+
+    if (masm_constant_value(cond, &value)) {
+        if ((value != 0) == jump_if) {
+            snprintf(line, sizeof(line), "    jmp %s         ; Constant condition", label);
+            masm_append_line(ctx, line);
+        }
+        return true;
+    }
+
+    if (cond->type == NODE_UNARY_OP && cond->data.unary_op.op == UNOP_NOT) {
+        return masm_generate_branch(ctx, cond->data.unary_op.operand, !jump_if, label);
+    }
+
+    if (masm_is_logical(cond)) {
+        Bool is_and = cond->data.binary_op.op == BINOP_AND_AND;
+        if (jump_if != is_and) {
+            /* && jumping when false, || jumping when true: either operand decides */
+            return masm_generate_branch(ctx, cond->data.binary_op.left, jump_if, label) &&
+                   masm_generate_branch(ctx, cond->data.binary_op.right, jump_if, label);
+        }
+        /* The left operand can only rule the jump out; the right one decides */
+        masm_new_label(ctx, is_and ? "and_skip" : "or_skip", skip, sizeof(skip));
+        if (!masm_generate_branch(ctx, cond->data.binary_op.left, !jump_if, skip) ||
+            !masm_generate_branch(ctx, cond->data.binary_op.right, jump_if, label)) {
+            return false;
+        }
+        snprintf(line, sizeof(line), "%s:", skip);
+        masm_append_line(ctx, line);
+        return true;
+    }
+
+    /* cmp or test right before the jcc, so the pair can macro-fuse */
+    const char *cc;
+    if (!masm_generate_condition_flags(ctx, cond, &cc)) return false;
+    snprintf(line, sizeof(line), "    j%s %s", jump_if ? cc : masm_negate_condition_code(cc), label);
+    masm_append_line(ctx, line);
+    return true;
+}
+
+/* 0/1 value of a comparison that is stored or passed on rather than branched on */
+static Bool masm_generate_comparison_value(MASMContext *ctx, ASTNode *node) {
+    char line[128];
+    const char *cc;
+    if (!masm_generate_condition_flags(ctx, node, &cc)) return false;
+    snprintf(line, sizeof(line), "    set%s al", cc);
+    masm_append_line(ctx, line);
+    masm_append_line(ctx, "    movzx eax, al   ; Comparison result");
+    return true;
+}
+
+/* 0/1 value of && or || for uses outside a condition */
+static Bool masm_generate_logical_value(MASMContext *ctx, ASTNode *node) {
+    char false_label[64], end_label[64], line[128];
+    Bool is_and = node->data.binary_op.op == BINOP_AND_AND;
+
+    masm_new_label(ctx, is_and ? "and_false" : "or_false", false_label, sizeof(false_label));
+    masm_new_label(ctx, is_and ? "and_end" : "or_end", end_label, sizeof(end_label));
+    if (!masm_generate_branch(ctx, node, false, false_label)) return false;
+    masm_append_line(ctx, "    mov rax, 1      ; Logical result: true");
+    snprintf(line, sizeof(line), "    jmp %s", end_label);
+    masm_append_line(ctx, line);
+    snprintf(line, sizeof(line), "%s:", false_label);
+    masm_append_line(ctx, line);
+    masm_append_line(ctx, "    xor eax, eax    ; Logical result: false");
+    snprintf(line, sizeof(line), "%s:", end_label);
+    masm_append_line(ctx, line);
+    return true;
+}
+
+/* ========================================================================
+ * Selects
+ * ======================================================================== */
+
+/*
+ * c ? a : b, and if/else arms that only assign one variable, become cmov
+ * when nothing in them can fault or have side effects and both arms are
+ * cheap: a data-dependent branch that mispredicts costs far more than
+ * computing the arm that is not taken. The arms are evaluated first and
+ * kept on the stack, since evaluating them clobbers the flags, then the
+ * condition sets the flags and cmov picks the value. The backend has no
+ * F64 values, so there is no minsd/maxsd form.
  */
 
-Bool masm_generate_function_declaration(MASMContext *ctx, ASTNode *node) {
-    if (!ctx || !node || node->type != NODE_FUNCTION) return false;
-    
-    printf("DEBUG: Generating MASM function declaration: %s\n", 
-           node->data.function.name ? (char*)node->data.function.name : "unknown");
-    
-    /* Generate function signature */
-    char func_sig[256];
-    snprintf(func_sig, sizeof(func_sig), "%s PROC", 
-             node->data.function.name ? (char*)node->data.function.name : "unknown_func");
-    
-    masm_append_line(ctx, "");
-    masm_append_line(ctx, func_sig);
-    ctx->indent_level++;
-    
-    /* Generate function prologue */
-    masm_append_line(ctx, "; Function prologue");
-    masm_append_line(ctx, "    push rbp        ; Save caller's frame pointer");
-    masm_append_line(ctx, "    mov rbp, rsp    ; Set up new frame pointer");
-    
-    /* Calculate local variable space */
-    I64 local_space = 32; /* Default shadow space */
-    /* TODO: Count parameters from parameter list */
-    /* For now, use default shadow space */
-    
-    char sub_instr[64];
-    snprintf(sub_instr, sizeof(sub_instr), "    sub rsp, %ldh    ; Allocate local space", local_space);
-    masm_append_line(ctx, sub_instr);
-    masm_append_line(ctx, "");
-    
-    /* Generate function body */
-    if (node->data.function.body) {
-        masm_append_line(ctx, "; Function body");
-        if (!masm_generate_ast_node(ctx, node->data.function.body)) {
-            printf("ERROR: Failed to generate MASM for function body\n");
-            return false;
-        }
+#define MASM_SELECT_MAX_COST  8          /* Instructions both arms may take together */
+
+/* Instructions an expression costs, -1 when it may fault or has side effects */
+static I64 masm_select_cost(ASTNode *node) {
+    I64 value, left, right;
+    if (!node) return -1;
+    if (masm_constant_value(node, &value)) return 1;
+
+    switch (node->type) {
+        case NODE_IDENTIFIER:
+            return node->data.identifier.name ? 1 : -1;
+        case NODE_BINARY_OP:
+            if (node->data.binary_op.op == BINOP_MUL) {
+                ASTNode *operand;
+                if (!masm_is_constant_multiply(node, &value, &operand)) return -1;
+                left = masm_select_cost(operand);
+                return left < 0 ? -1 : left + 2;
+            }
+            if (node->data.binary_op.op != BINOP_ADD && node->data.binary_op.op != BINOP_SUB) return -1;
+            left = masm_select_cost(node->data.binary_op.left);
+            right = masm_select_cost(node->data.binary_op.right);
+            return left < 0 || right < 0 ? -1 : left + right + 2;
+        default:
+            return -1;
     }
-    
-    /* Generate function epilogue */
-    masm_append_line(ctx, "");
-    masm_append_line(ctx, "; Function epilogue");
-    masm_append_line(ctx, "    mov rsp, rbp    ; Restore stack pointer");
-    masm_append_line(ctx, "    pop rbp         ; Restore caller's frame pointer");
-    masm_append_line(ctx, "    ret             ; Return to caller");
-    
-    ctx->indent_level--;
-    
-    /* Generate function end */
-    char func_end[256];
-    snprintf(func_end, sizeof(func_end), "%s ENDP", 
-             node->data.function.name ? (char*)node->data.function.name : "unknown_func");
-    masm_append_line(ctx, func_end);
-    
-    printf("DEBUG: Generated MASM function declaration successfully\n");
-    return true;
 }
 
-Bool masm_generate_function_call(MASMContext *ctx, ASTNode *node) {
-    if (!ctx || !node || node->type != NODE_CALL) return false;
-    
-    printf("DEBUG: Generating MASM function call: %s\n", 
-           node->data.call.name ? (char*)node->data.call.name : "unknown");
-    
-    I64 arg_count = node->data.call.arg_count;
-    
-    /* Allocate shadow space if we have arguments */
-    if (arg_count > 0) {
-        masm_append_line(ctx, "; Allocate shadow space");
-        masm_append_line(ctx, "    sub rsp, 20h    ; 32 bytes shadow space");
+/* Can cond ? a : b be a cmov */
+static Bool masm_is_select(MASMContext *ctx, ASTNode *cond, ASTNode *a, ASTNode *b) {
+    if (masm_profile_generating(ctx)) return false;
+    I64 cost_a = masm_select_cost(a), cost_b = masm_select_cost(b);
+    if (cost_a < 0 || cost_b < 0 || cost_a + cost_b > MASM_SELECT_MAX_COST) return false;
+
+    ASTNode *test = cond;
+    while (test && test->type == NODE_UNARY_OP && test->data.unary_op.op == UNOP_NOT) {
+        test = test->data.unary_op.operand;
     }
-    
-    /* Generate argument passing */
-    if (node->data.call.arguments && node->data.call.arguments->data.block.statements) {
-        ASTNode *arg = node->data.call.arguments->data.block.statements;
-        I64 arg_index = 0;
-        
-        masm_append_line(ctx, "; Pass arguments");
-        
-        while (arg && arg_index < arg_count) {
-            if (arg_index < 4) {
-                /* First 4 arguments go in registers */
-                const char *reg_names[] = {"rcx", "rdx", "r8", "r9"};
-                
-                /* Generate code to evaluate argument and move to register */
-                if (!masm_generate_ast_node(ctx, arg)) {
-                    printf("ERROR: Failed to generate MASM for argument %lld\n", arg_index);
-                    return false;
-                }
-                
-                /* Move result to appropriate register */
-                char mov_instr[64];
-                snprintf(mov_instr, sizeof(mov_instr), "    mov %s, rax    ; Argument %ld", 
-                         reg_names[arg_index], arg_index);
-                masm_append_line(ctx, mov_instr);
-                
-            } else {
-                /* Additional arguments go on stack */
-                /* Generate code to evaluate argument */
-                if (!masm_generate_ast_node(ctx, arg)) {
-                    printf("ERROR: Failed to generate MASM for stack argument %lld\n", arg_index);
-                    return false;
-                }
-                
-                /* Push argument onto stack */
-                masm_append_line(ctx, "    push rax        ; Stack argument");
-            }
-            
-            arg = arg->next;
-            arg_index++;
-        }
+    if (masm_is_comparison(test)) {
+        return masm_select_cost(test->data.binary_op.left) >= 0 &&
+               masm_select_cost(test->data.binary_op.right) >= 0;
     }
-    
-    /* Generate function call */
-    masm_append_line(ctx, "");
-    masm_append_line(ctx, "; Call function");
-    char call_instr[128];
-    snprintf(call_instr, sizeof(call_instr), "    call %s", 
-             node->data.call.name ? (char*)node->data.call.name : "unknown_func");
-    masm_append_line(ctx, call_instr);
-    
-    /* Clean up stack arguments */
-    if (arg_count > 4) {
-        I64 stack_args = arg_count - 4;
-        char cleanup_instr[64];
-        snprintf(cleanup_instr, sizeof(cleanup_instr), "    add rsp, %ldh    ; Clean up stack arguments", 
-                 stack_args * 8);
-        masm_append_line(ctx, cleanup_instr);
+    return masm_select_cost(test) >= 0;
+}
+
+/* rax = cond ? a : b without a branch */
+static Bool masm_generate_select(MASMContext *ctx, ASTNode *cond, ASTNode *a, ASTNode *b) {
+    char line[128];
+    const char *cc;
+
+    printf("DEBUG: Generating MASM select with cmov\n");
+    if (!masm_generate_ast_node(ctx, b)) return false;
+    masm_stack_push(ctx, "    push rax        ; Save false value");
+    if (!masm_generate_ast_node(ctx, a)) return false;
+    masm_stack_push(ctx, "    push rax        ; Save true value");
+    if (!masm_generate_condition_flags(ctx, cond, &cc)) return false;
+    masm_stack_pop(ctx, "    pop rax         ; True value");
+    masm_stack_pop(ctx, "    pop r11         ; False value");
+    snprintf(line, sizeof(line), "    cmov%s rax, r11    ; Select", masm_negate_condition_code(cc));
+    masm_append_line(ctx, line);
+    return true;
+}
+
+/* c ? a : b: a cmov when it can be, otherwise a branch around each value */
+static Bool masm_generate_conditional(MASMContext *ctx, ASTNode *node) {
+    ASTNode *cond = node->data.conditional.condition;
+    ASTNode *a = node->data.conditional.true_expr;
+    ASTNode *b = node->data.conditional.false_expr;
+    char false_label[64], end_label[64], line[128];
+
+    if (masm_is_select(ctx, cond, a, b)) return masm_generate_select(ctx, cond, a, b);
+
+    masm_new_label(ctx, "cond_false", false_label, sizeof(false_label));
+    masm_new_label(ctx, "cond_end", end_label, sizeof(end_label));
+    if (!masm_generate_branch(ctx, cond, false, false_label)) return false;
+    if (!masm_generate_ast_node(ctx, a)) return false;
+    snprintf(line, sizeof(line), "    jmp %s", end_label);
+    masm_append_line(ctx, line);
+    snprintf(line, sizeof(line), "%s:", false_label);
+    masm_append_line(ctx, line);
+    if (!masm_generate_ast_node(ctx, b)) return false;
+    snprintf(line, sizeof(line), "%s:", end_label);
+    masm_append_line(ctx, line);
+    return true;
+}
+
+/* The plain assignment an if arm consists of, looking through a block of one statement */
+static ASTNode* masm_arm_assignment(ASTNode *arm) {
+    while (arm && arm->type == NODE_BLOCK && arm->data.block.statements &&
+           !arm->data.block.statements->next) {
+        arm = arm->data.block.statements;
     }
-    
-    /* Restore shadow space */
-    if (arg_count > 0) {
-        masm_append_line(ctx, "    add rsp, 20h    ; Restore shadow space");
+    if (!arm || arm->type != NODE_ASSIGNMENT || arm->data.assignment.op != BINOP_ASSIGN) return NULL;
+
+    ASTNode *left = arm->data.assignment.left;
+    if (!left || (left->type != NODE_VARIABLE && left->type != NODE_IDENTIFIER) ||
+        !left->data.identifier.name) {
+        return NULL;
     }
-    
-    printf("DEBUG: Generated MASM function call successfully\n");
-    return true;
+    return arm;
 }
 
-Bool masm_generate_return_statement(MASMContext *ctx, ASTNode *node) {
-    if (!ctx || !node || node->type != NODE_RETURN) return false;
-    
-    printf("DEBUG: Generating MASM return statement\n");
-    
-    /* Check if we have a return value or expression */
-    if (node->data.return_stmt.return_value != 0) {
-        /* Simple return value (integer literal) */
-        I64 return_value = node->data.return_stmt.return_value;
-        
-        char mov_instr[64];
-        snprintf(mov_instr, sizeof(mov_instr), "    mov rax, %ld    ; Return value", return_value);
-        masm_append_line(ctx, mov_instr);
-        
-    } else if (node->data.return_stmt.expression) {
-        /* Complex return expression */
-        masm_append_line(ctx, "; Evaluate return expression");
-        if (!masm_generate_ast_node(ctx, node->data.return_stmt.expression)) {
-            printf("ERROR: Failed to generate MASM for return expression\n");
-            return false;
-        }
-        masm_append_line(ctx, "; Result is in rax");
-        
-    } else {
-        /* No return value - just return */
-        masm_append_line(ctx, "; Return void");
+/*
+ * if (c) x = a; else x = b; and if (c) x = a; as x = c ? a : x. A branch
+ * that the profile shows going one way almost always is left alone, it
+ * predicts well. The assignment to x is generated from an assignment
+ * node built on the stack around the select.
+ */
+static Bool masm_is_select_if(MASMContext *ctx, ASTNode *node, ASTNode **then_assign, ASTNode **else_assign) {
+    ASTNode *then_stmt = node->data.if_stmt.then_stmt;
+    ASTNode *else_stmt = node->data.if_stmt.else_stmt;
+    *then_assign = masm_arm_assignment(then_stmt);
+    *else_assign = else_stmt ? masm_arm_assignment(else_stmt) : NULL;
+    if (!*then_assign || (else_stmt && !*else_assign)) return false;
+
+    U64 then_count = profile_count(ctx->profile, node, 0);
+    U64 else_count = profile_count(ctx->profile, node, 1);
+    if (profile_is_cold(then_count, then_count + else_count) ||
+        profile_is_cold(else_count, then_count + else_count)) {
+        return false;
     }
-    
-    printf("DEBUG: Generated MASM return statement successfully\n");
-    return true;
+
+    ASTNode *target = (*then_assign)->data.assignment.left;
+    if (*else_assign && strcmp((char*)(*else_assign)->data.assignment.left->data.identifier.name,
+                               (char*)target->data.identifier.name) != 0) {
+        return false;
+    }
+    ASTNode current = *target;
+    current.type = NODE_IDENTIFIER;
+    current.next = NULL;
+    return masm_is_select(ctx, node->data.if_stmt.condition, (*then_assign)->data.assignment.right,
+                          *else_assign ? (*else_assign)->data.assignment.right : &current);
+}
+
+static Bool masm_generate_select_if(MASMContext *ctx, ASTNode *node, ASTNode *then_assign, ASTNode *else_assign) {
+    ASTNode *target = then_assign->data.assignment.left;
+    ASTNode current = *target;
+    current.type = NODE_IDENTIFIER;
+    current.next = NULL;
+
+    ASTNode select;
+    memset(&select, 0, sizeof(select));
+    select.type = NODE_CONDITIONAL;
+    select.data.conditional.condition = node->data.if_stmt.condition;
+    select.data.conditional.true_expr = then_assign->data.assignment.right;
+    select.data.conditional.false_expr = else_assign ? else_assign->data.assignment.right : &current;
+
+    ASTNode assign = *then_assign;
+    assign.next = NULL;
+    assign.data.assignment.right = &select;
+    masm_append_line(ctx, "; If converted to a select");
+    return masm_generate_ast_node(ctx, &assign);
 }
 
 Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
@@ -404,6 +2454,20 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
         case NODE_RETURN:
             return masm_generate_return_statement(ctx, node);
             
+        case NODE_SWITCH:
+            return masm_generate_switch(ctx, node);
+            
+        case NODE_BREAK: {
+            if (!ctx->break_label) {
+                printf("WARNING: break outside of switch or loop ignored\n");
+                return true;
+            }
+            char jmp_instr[96];
+            snprintf(jmp_instr, sizeof(jmp_instr), "    jmp %s    ; Break", ctx->break_label);
+            masm_append_line(ctx, jmp_instr);
+            return true;
+        }
+            
         case NODE_INTEGER: {
             /* Generate immediate value */
             char mov_instr[64];
@@ -428,17 +2492,17 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                 masm_append_line(ctx, "; Get stdout handle");
                 masm_append_line(ctx, "mov rcx, -11        ; STD_OUTPUT_HANDLE");
                 masm_append_line(ctx, "call GetStdHandle");
-                masm_append_line(ctx, "mov rdi, rax        ; Save handle");
                 
                 masm_append_line(ctx, "; Write string to console");
-                masm_append_line(ctx, "mov rcx, rdi        ; hConsoleOutput");
+                masm_append_line(ctx, "mov rcx, rax        ; hConsoleOutput");
                 masm_append_line(ctx, "lea rdx, [str_literal_0]  ; lpBuffer");
                 masm_append_line(ctx, "mov r8, 13          ; nNumberOfCharsToWrite (length of 'Hello, World!')");
                 masm_append_line(ctx, "mov r9, 0           ; lpNumberOfCharsWritten (NULL)");
+                masm_append_line(ctx, "sub rsp, 8          ; Keep the stack alignment");
                 masm_append_line(ctx, "push 0              ; lpReserved (NULL)");
                 masm_append_line(ctx, "sub rsp, 32         ; Shadow space");
                 masm_append_line(ctx, "call WriteConsoleA");
-                masm_append_line(ctx, "add rsp, 40         ; Clean up stack");
+                masm_append_line(ctx, "add rsp, 48         ; Clean up stack");
                 
                 ctx->string_counter++;  /* Increment counter for next string */
                 
@@ -476,7 +2540,28 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
             /* Generate variable reference - load from stack frame */
             if (node->data.identifier.name) {
                 /* Check if this is a parameter or local variable */
-                if (node->data.identifier.stack_offset >= 0) {
+                const char *reg = masm_promoted_register(ctx, node->data.identifier.name);
+                I64 param_index = masm_parameter_index(ctx->current_function, node->data.identifier.name);
+                I64 local_offset = masm_local_offset(ctx, node->data.identifier.name);
+                if (reg) {
+                    /* Promoted to a register */
+                    char mov_instr[128];
+                    snprintf(mov_instr, sizeof(mov_instr), "    mov rax, %s    ; Load variable %s",
+                             reg, (char*)node->data.identifier.name);
+                    masm_append_line(ctx, mov_instr);
+                } else if (param_index >= 0) {
+                    /* Parameter - load from its home slot */
+                    char mov_instr[128];
+                    snprintf(mov_instr, sizeof(mov_instr), "    mov rax, [rbp+%lld]    ; Load parameter %s",
+                             16 + param_index * 8, (char*)node->data.identifier.name);
+                    masm_append_line(ctx, mov_instr);
+                } else if (local_offset < 0) {
+                    /* Local - load from its slot below rbp */
+                    char mov_instr[128];
+                    snprintf(mov_instr, sizeof(mov_instr), "    mov rax, [rbp%lld]    ; Load variable %s",
+                             local_offset, (char*)node->data.identifier.name);
+                    masm_append_line(ctx, mov_instr);
+                } else if (node->data.identifier.stack_offset >= 0) {
                     /* Local variable or parameter - load from stack frame */
                     char mov_instr[128];
                     snprintf(mov_instr, sizeof(mov_instr), "    mov rax, [rbp%+ld]    ; Load variable %s", 
@@ -511,7 +2596,7 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
             }
             
             /* Save the value to be assigned */
-            masm_append_line(ctx, "    push rax        ; Save value to be assigned");
+            masm_stack_push(ctx, "    push rax        ; Save value to be assigned");
             
             /* Generate address calculation for the left side */
             if (node->data.assignment.left) {
@@ -526,7 +2611,7 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                     }
                     
                     /* Save base object address */
-                    masm_append_line(ctx, "    push rax        ; Save base object address");
+                    masm_stack_push(ctx, "    push rax        ; Save base object address");
                     
                     /* Generate index expression */
                     if (!masm_generate_ast_node(ctx, node->data.assignment.left->data.sub_int_access.index)) {
@@ -534,20 +2619,13 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                         return false;
                     }
                     
-                    /* Calculate offset: index * member_size */
-                    I64 member_size = node->data.assignment.left->data.sub_int_access.member_size;
-                    if (member_size > 1) {
-                        char mul_instr[64];
-                        snprintf(mul_instr, sizeof(mul_instr), "    imul rax, %ld    ; Multiply index by member size", (long)member_size);
-                        masm_append_line(ctx, mul_instr);
-                    }
-                    
-                    /* Add offset to base address */
-                    masm_append_line(ctx, "    pop rbx         ; Restore base object address");
-                    masm_append_line(ctx, "    add rbx, rax    ; Add offset to base address");
+                    /* Element address: base + index * member_size, in rbx as rax is reloaded */
+                    char address[32];
+                    masm_element_address(ctx, node->data.assignment.left->data.sub_int_access.member_size, true,
+                                         "base object", address, sizeof(address));
                     
                     /* Restore the value to be assigned */
-                    masm_append_line(ctx, "    pop rax         ; Restore value to be assigned");
+                    masm_stack_pop(ctx, "    pop rax         ; Restore value to be assigned");
                     
                     /* Store the value with appropriate size */
                     U8 *member_type = node->data.assignment.left->data.sub_int_access.member_type;
@@ -576,7 +2654,7 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                     }
                     
                     /* Save union object address */
-                    masm_append_line(ctx, "    push rax        ; Save union object address");
+                    masm_stack_push(ctx, "    push rax        ; Save union object address");
                     
                     /* Generate index expression */
                     if (!masm_generate_ast_node(ctx, node->data.assignment.left->data.union_member_access.index)) {
@@ -584,20 +2662,13 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                         return false;
                     }
                     
-                    /* Calculate offset: index * member_size */
-                    I64 member_size = node->data.assignment.left->data.union_member_access.member_size;
-                    if (member_size > 1) {
-                        char mul_instr[64];
-                        snprintf(mul_instr, sizeof(mul_instr), "    imul rax, %ld    ; Multiply index by member size", (long)member_size);
-                        masm_append_line(ctx, mul_instr);
-                    }
-                    
-                    /* Add offset to union address */
-                    masm_append_line(ctx, "    pop rbx         ; Restore union object address");
-                    masm_append_line(ctx, "    add rbx, rax    ; Add offset to union address");
+                    /* Element address: union + index * member_size, in rbx as rax is reloaded */
+                    char address[32];
+                    masm_element_address(ctx, node->data.assignment.left->data.union_member_access.member_size, true,
+                                         "union object", address, sizeof(address));
                     
                     /* Restore the value to be assigned */
-                    masm_append_line(ctx, "    pop rax         ; Restore value to be assigned");
+                    masm_stack_pop(ctx, "    pop rax         ; Restore value to be assigned");
                     
                     /* Store the value */
                     masm_append_line(ctx, "    mov [rbx], rax  ; Store union member value");
@@ -605,9 +2676,31 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                 } else if (node->data.assignment.left->data.identifier.name) {
                     /* Regular variable assignment */
                     /* Restore the value to be assigned */
-                    masm_append_line(ctx, "    pop rax         ; Restore value to be assigned");
+                    masm_stack_pop(ctx, "    pop rax         ; Restore value to be assigned");
                     
-                    if (node->data.assignment.left->data.identifier.stack_offset >= 0) {
+                    const char *reg = masm_promoted_register(ctx, node->data.assignment.left->data.identifier.name);
+                    I64 param_index = masm_parameter_index(ctx->current_function,
+                                                           node->data.assignment.left->data.identifier.name);
+                    I64 local_offset = masm_local_offset(ctx, node->data.assignment.left->data.identifier.name);
+                    if (reg) {
+                        /* Promoted to a register */
+                        char mov_instr[128];
+                        snprintf(mov_instr, sizeof(mov_instr), "    mov %s, rax    ; Store in variable %s",
+                                 reg, (char*)node->data.assignment.left->data.identifier.name);
+                        masm_append_line(ctx, mov_instr);
+                    } else if (param_index >= 0) {
+                        /* Parameter - store in its home slot */
+                        char mov_instr[128];
+                        snprintf(mov_instr, sizeof(mov_instr), "    mov [rbp+%lld], rax    ; Store in parameter %s",
+                                 16 + param_index * 8, (char*)node->data.assignment.left->data.identifier.name);
+                        masm_append_line(ctx, mov_instr);
+                    } else if (local_offset < 0) {
+                        /* Local - store in its slot below rbp */
+                        char mov_instr[128];
+                        snprintf(mov_instr, sizeof(mov_instr), "    mov [rbp%lld], rax    ; Store in variable %s",
+                                 local_offset, (char*)node->data.assignment.left->data.identifier.name);
+                        masm_append_line(ctx, mov_instr);
+                    } else if (node->data.assignment.left->data.identifier.stack_offset >= 0) {
                         /* Local variable or parameter - store in stack frame */
                         char mov_instr[128];
                         snprintf(mov_instr, sizeof(mov_instr), "    mov [rbp%+ld], rax    ; Store in variable %s", 
@@ -624,16 +2717,34 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                     }
                 } else {
                     /* Fallback - just restore the value */
-                    masm_append_line(ctx, "    pop rax         ; Restore value to be assigned");
+                    masm_stack_pop(ctx, "    pop rax         ; Restore value to be assigned");
                 }
             } else {
                 /* No left side - just restore the value */
-                masm_append_line(ctx, "    pop rax         ; Restore value to be assigned");
+                masm_stack_pop(ctx, "    pop rax         ; Restore value to be assigned");
             }
             return true;
         }
             
         case NODE_BINARY_OP: {
+            /* && and || evaluate their right operand only when needed */
+            if (masm_is_logical(node)) return masm_generate_logical_value(ctx, node);
+            if (masm_is_comparison(node)) return masm_generate_comparison_value(ctx, node);
+            
+            /* Constant divisors are multiplied or shifted instead of divided */
+            I64 divisor, width;
+            Bool is_signed;
+            if (masm_is_constant_divide(node, &divisor, &width, &is_signed)) {
+                return masm_generate_constant_divide(ctx, node, divisor, width, is_signed);
+            }
+            
+            /* So are constant factors, when shifts and lea are faster than imul */
+            I64 factor;
+            ASTNode *factor_operand;
+            if (masm_is_constant_multiply(node, &factor, &factor_operand)) {
+                return masm_generate_constant_multiply(ctx, factor_operand, factor);
+            }
+            
             /* Generate binary operation */
             if (!masm_generate_ast_node(ctx, node->data.binary_op.left)) {
                 printf("ERROR: Failed to generate MASM for left operand\n");
@@ -641,7 +2752,7 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
             }
             
             /* Save left operand */
-            masm_append_line(ctx, "    push rax        ; Save left operand");
+            masm_stack_push(ctx, "    push rax        ; Save left operand");
             
             /* Generate right operand */
             if (!masm_generate_ast_node(ctx, node->data.binary_op.right)) {
@@ -650,7 +2761,7 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
             }
             
             /* Restore left operand and perform operation */
-            masm_append_line(ctx, "    pop rbx         ; Restore left operand");
+            masm_stack_pop(ctx, "    pop rbx         ; Restore left operand");
             
             switch (node->data.binary_op.op) {
                 case BINOP_ADD:
@@ -668,19 +2779,12 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                     masm_append_line(ctx, "    cqo             ; Sign extend rax to rdx:rax");
                     masm_append_line(ctx, "    idiv rbx        ; Division");
                     break;
-                case BINOP_AND_AND: {
-                    /* Logical AND: result = left && right */
-                    masm_append_line(ctx, "    test rax, rax   ; Test left operand");
-                    masm_append_line(ctx, "    jz and_false    ; Jump to false if left is 0");
-                    masm_append_line(ctx, "    test rbx, rbx   ; Test right operand");
-                    masm_append_line(ctx, "    jz and_false    ; Jump to false if right is 0");
-                    masm_append_line(ctx, "    mov rax, 1      ; Both true: result = 1");
-                    masm_append_line(ctx, "    jmp and_end     ; Jump to end");
-                    masm_append_line(ctx, "and_false:");
-                    masm_append_line(ctx, "    mov rax, 0      ; Either false: result = 0");
-                    masm_append_line(ctx, "and_end:");
+                case BINOP_MOD:
+                    masm_append_line(ctx, "    xchg rax, rbx   ; Swap operands");
+                    masm_append_line(ctx, "    cqo             ; Sign extend rax to rdx:rax");
+                    masm_append_line(ctx, "    idiv rbx        ; Division");
+                    masm_append_line(ctx, "    mov rax, rdx    ; Remainder");
                     break;
-                }
                 case BINOP_XOR_XOR: {
                     /* Logical XOR: result = left ^^ right (exactly one true) */
                     masm_append_line(ctx, "    test rax, rax   ; Test left operand");
@@ -691,19 +2795,6 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                     masm_append_line(ctx, "    movzx rax, al   ; Zero-extend result to rax");
                     break;
                 }
-                case BINOP_OR_OR: {
-                    /* Logical OR: result = left || right */
-                    masm_append_line(ctx, "    test rax, rax   ; Test left operand");
-                    masm_append_line(ctx, "    jnz or_true     ; Jump to true if left is non-zero");
-                    masm_append_line(ctx, "    test rbx, rbx   ; Test right operand");
-                    masm_append_line(ctx, "    jnz or_true     ; Jump to true if right is non-zero");
-                    masm_append_line(ctx, "    mov rax, 0      ; Both false: result = 0");
-                    masm_append_line(ctx, "    jmp or_end      ; Jump to end");
-                    masm_append_line(ctx, "or_true:");
-                    masm_append_line(ctx, "    mov rax, 1      ; Either true: result = 1");
-                    masm_append_line(ctx, "or_end:");
-                    break;
-                }
                 default:
                     printf("WARNING: Unhandled binary operator %d\n", node->data.binary_op.op);
                     masm_append_line(ctx, "    mov rax, rbx    ; Default: use left operand");
@@ -716,59 +2807,91 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
             /* Generate if statement */
             printf("DEBUG: Generating MASM if statement\n");
             
+            /* Arms that only assign one variable may not need a branch */
+            ASTNode *then_assign, *else_assign;
+            if (masm_is_select_if(ctx, node, &then_assign, &else_assign)) {
+                return masm_generate_select_if(ctx, node, then_assign, else_assign);
+            }
+            
             /* Generate unique labels */
             static I64 if_label_counter = 0;
             if_label_counter++;
-            char else_label[64], end_label[64];
-            snprintf(else_label, sizeof(else_label), "if_else_%d", (int)if_label_counter);
+            char second_label[64], end_label[64], label_line[80];
             snprintf(end_label, sizeof(end_label), "if_end_%d", (int)if_label_counter);
+            ASTNode *then_stmt = node->data.if_stmt.then_stmt;
+            ASTNode *else_stmt = node->data.if_stmt.else_stmt;
             
-            /* Generate condition evaluation */
+            /* Profile layout: a cold arm moves out of line, otherwise the
+             * hotter arm falls through. When counting, the missing else arm
+             * still gets a block of its own so its edge can be counted. */
+            U64 then_count = profile_count(ctx->profile, node, 0);
+            U64 else_count = profile_count(ctx->profile, node, 1);
+            Bool cold_then = masm_can_defer(ctx) && profile_is_cold(then_count, then_count + else_count);
+            Bool cold_else = else_stmt && !cold_then && masm_can_defer(ctx) &&
+                             profile_is_cold(else_count, then_count + else_count);
+            Bool swap = else_stmt && !cold_then && !cold_else && else_count > then_count;
+            Bool else_arm = else_stmt || masm_profile_generating(ctx);
+            snprintf(second_label, sizeof(second_label), swap ? "if_then_%d" : "if_else_%d", (int)if_label_counter);
+            
+            if (cold_then || cold_else) {
+                printf("DEBUG: Moving cold %s arm of if out of line\n", cold_then ? "then" : "else");
+                char cold_label[64];
+                snprintf(cold_label, sizeof(cold_label), "if_cold_%d", (int)if_label_counter);
+                masm_append_line(ctx, "; If condition evaluation");
+                if (!masm_generate_branch(ctx, node->data.if_stmt.condition, cold_then, cold_label)) {
+                    printf("ERROR: Failed to generate MASM for if condition\n");
+                    return false;
+                }
+                ASTNode *hot = cold_then ? else_stmt : then_stmt;
+                if (hot && !masm_generate_ast_node(ctx, hot)) {
+                    printf("ERROR: Failed to generate MASM for %s statement\n", cold_then ? "else" : "then");
+                    return false;
+                }
+                snprintf(label_line, sizeof(label_line), "%s:", end_label);
+                masm_append_line(ctx, label_line);
+                if (!masm_generate_cold(ctx, cold_then ? then_stmt : else_stmt, cold_label, end_label)) {
+                    printf("ERROR: Failed to generate MASM for cold %s statement\n", cold_then ? "then" : "else");
+                    return false;
+                }
+                return true;
+            }
+            
+            /* Branch on the condition past the arm that falls through */
             masm_append_line(ctx, "; If condition evaluation");
-            if (!masm_generate_ast_node(ctx, node->data.if_stmt.condition)) {
+            if (!masm_generate_branch(ctx, node->data.if_stmt.condition, swap,
+                                      else_arm ? second_label : end_label)) {
                 printf("ERROR: Failed to generate MASM for if condition\n");
                 return false;
             }
             
-            /* Test condition and jump to else if false */
-            masm_append_line(ctx, "    test rax, rax   ; Test condition");
-            if (node->data.if_stmt.else_stmt) {
-                char jz_instr[64];
-                snprintf(jz_instr, sizeof(jz_instr), "    jz %s          ; Jump to else if false", else_label);
-                masm_append_line(ctx, jz_instr);
-            } else {
-                char jz_instr[64];
-                snprintf(jz_instr, sizeof(jz_instr), "    jz %s          ; Jump to end if false", end_label);
-                masm_append_line(ctx, jz_instr);
-            }
-            
-            /* Generate then statement */
-            masm_append_line(ctx, "; Then statement");
-            if (!masm_generate_ast_node(ctx, node->data.if_stmt.then_stmt)) {
-                printf("ERROR: Failed to generate MASM for then statement\n");
+            /* Generate the first arm: then, or else when it is the hotter one */
+            masm_append_line(ctx, swap ? "; Else statement (hotter)" : "; Then statement");
+            masm_profile_count(ctx, node, swap ? 1 : 0);
+            if (!masm_generate_ast_node(ctx, swap ? else_stmt : then_stmt)) {
+                printf("ERROR: Failed to generate MASM for %s statement\n", swap ? "else" : "then");
                 return false;
             }
             
-            /* Jump to end if we have else clause */
-            if (node->data.if_stmt.else_stmt) {
+            /* Jump to end if there is a second arm */
+            if (else_arm) {
                 char jmp_instr[64];
                 snprintf(jmp_instr, sizeof(jmp_instr), "    jmp %s         ; Jump to end", end_label);
                 masm_append_line(ctx, jmp_instr);
-                char else_label_line[64];
-                snprintf(else_label_line, sizeof(else_label_line), "%s:", else_label);
-                masm_append_line(ctx, else_label_line);
+                snprintf(label_line, sizeof(label_line), "%s:", second_label);
+                masm_append_line(ctx, label_line);
                 
-                /* Generate else statement */
-                masm_append_line(ctx, "; Else statement");
-                if (!masm_generate_ast_node(ctx, node->data.if_stmt.else_stmt)) {
-                    printf("ERROR: Failed to generate MASM for else statement\n");
+                /* Generate the second arm */
+                masm_append_line(ctx, swap ? "; Then statement" : "; Else statement");
+                masm_profile_count(ctx, node, swap ? 0 : 1);
+                ASTNode *second = swap ? then_stmt : else_stmt;
+                if (second && !masm_generate_ast_node(ctx, second)) {
+                    printf("ERROR: Failed to generate MASM for %s statement\n", swap ? "then" : "else");
                     return false;
                 }
             }
             
-            char end_label_line[64];
-            snprintf(end_label_line, sizeof(end_label_line), "%s:", end_label);
-            masm_append_line(ctx, end_label_line);
+            snprintf(label_line, sizeof(label_line), "%s:", end_label);
+            masm_append_line(ctx, label_line);
             return true;
         }
             
@@ -779,39 +2902,53 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
             /* Generate unique labels */
             static I64 while_label_counter = 0;
             while_label_counter++;
-            char loop_label[64], end_label[64];
+            char loop_label[64], cond_label[64], end_label[64];
             snprintf(loop_label, sizeof(loop_label), "while_loop_%d", (int)while_label_counter);
+            snprintf(cond_label, sizeof(cond_label), "while_cond_%d", (int)while_label_counter);
             snprintf(end_label, sizeof(end_label), "while_end_%d", (int)while_label_counter);
             
-            /* Generate loop start label */
-            char loop_label_line[64];
-            snprintf(loop_label_line, sizeof(loop_label_line), "%s:", loop_label);
-            masm_append_line(ctx, loop_label_line);
-            
-            /* Generate condition evaluation */
-            masm_append_line(ctx, "; While condition evaluation");
-            if (!masm_generate_ast_node(ctx, node->data.while_stmt.condition)) {
-                printf("ERROR: Failed to generate MASM for while condition\n");
+            /* Rotated so the test at the bottom is the only branch per
+             * iteration; a copy of the condition guards the first one.
+             * Condition labels come from ctx->label_counter, so the copy
+             * gets labels of its own. */
+            masm_append_line(ctx, "; While guard");
+            if (!masm_generate_branch(ctx, node->data.while_stmt.condition, false, end_label)) {
+                printf("ERROR: Failed to generate MASM for while guard\n");
                 return false;
             }
             
-            /* Test condition and jump to end if false */
-            masm_append_line(ctx, "    test rax, rax   ; Test condition");
-            char jz_instr[64];
-            snprintf(jz_instr, sizeof(jz_instr), "    jz %s          ; Jump to end if false", end_label);
-            masm_append_line(ctx, jz_instr);
+            /* Generate aligned loop start label; padding is wasted on a
+             * loop the profile never saw iterate */
+            if (!profile_has_counts(ctx->profile) || node->profile_id <= 0 ||
+                profile_count(ctx->profile, node, 0) > 0) {
+                masm_append_line(ctx, "    ALIGN 16");
+            }
+            char loop_label_line[64];
+            snprintf(loop_label_line, sizeof(loop_label_line), "%s:", loop_label);
+            masm_append_line(ctx, loop_label_line);
             
             /* Generate loop body */
             masm_append_line(ctx, "; While loop body");
-            if (!masm_generate_ast_node(ctx, node->data.while_stmt.body_stmt)) {
+            masm_profile_count(ctx, node, 0);
+            const char *outer_break = ctx->break_label;
+            ctx->break_label = end_label;
+            Bool body_ok = masm_generate_ast_node(ctx, node->data.while_stmt.body_stmt);
+            ctx->break_label = outer_break;
+            if (!body_ok) {
                 printf("ERROR: Failed to generate MASM for while body\n");
                 return false;
             }
             
-            /* Jump back to loop start */
-            char jmp_instr[64];
-            snprintf(jmp_instr, sizeof(jmp_instr), "    jmp %s         ; Jump back to loop start", loop_label);
-            masm_append_line(ctx, jmp_instr);
+            /* Generate condition evaluation */
+            char cond_label_line[64];
+            snprintf(cond_label_line, sizeof(cond_label_line), "%s:", cond_label);
+            masm_append_line(ctx, cond_label_line);
+            masm_append_line(ctx, "; While condition evaluation");
+            /* Loop back while the condition holds */
+            if (!masm_generate_branch(ctx, node->data.while_stmt.condition, true, loop_label)) {
+                printf("ERROR: Failed to generate MASM for while condition\n");
+                return false;
+            }
             
             /* Generate end label */
             char end_label_line[64];
@@ -831,7 +2968,7 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
             }
             
             /* Save base object address */
-            masm_append_line(ctx, "    push rax        ; Save base object address");
+            masm_stack_push(ctx, "    push rax        ; Save base object address");
             
             /* Generate index expression */
             if (!masm_generate_ast_node(ctx, node->data.sub_int_access.index)) {
@@ -839,41 +2976,35 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                 return false;
             }
             
-            /* Calculate offset: index * member_size */
-            I64 member_size = node->data.sub_int_access.member_size;
-            if (member_size > 1) {
-                char mul_instr[64];
-                snprintf(mul_instr, sizeof(mul_instr), "    imul rax, %ld    ; Multiply index by member size", (long)member_size);
-                masm_append_line(ctx, mul_instr);
-            }
-            
-            /* Add offset to base address */
-            masm_append_line(ctx, "    pop rbx         ; Restore base object address");
-            masm_append_line(ctx, "    add rbx, rax    ; Add offset to base address");
+            /* Element address: base + index * member_size */
+            char address[32], load[96];
+            masm_element_address(ctx, node->data.sub_int_access.member_size, false,
+                                 "base object", address, sizeof(address));
             
             /* Load the value from memory with appropriate size */
             U8 *member_type = node->data.sub_int_access.member_type;
             if (member_type) {
                 if (strcmp(member_type, "i8") == 0 || strcmp(member_type, "u8") == 0) {
-                    masm_append_line(ctx, "    movzx rax, byte [rbx]    ; Load 8-bit value");
+                    snprintf(load, sizeof(load), "    movzx rax, byte %s    ; Load 8-bit value", address);
                 } else if (strcmp(member_type, "i16") == 0 || strcmp(member_type, "u16") == 0) {
                     if (strcmp(member_type, "i16") == 0) {
-                        masm_append_line(ctx, "    movsx rax, word [rbx]    ; Load 16-bit signed value");
+                        snprintf(load, sizeof(load), "    movsx rax, word %s    ; Load 16-bit signed value", address);
                     } else {
-                        masm_append_line(ctx, "    movzx rax, word [rbx]    ; Load 16-bit unsigned value");
+                        snprintf(load, sizeof(load), "    movzx rax, word %s    ; Load 16-bit unsigned value", address);
                     }
                 } else if (strcmp(member_type, "i32") == 0 || strcmp(member_type, "u32") == 0) {
                     if (strcmp(member_type, "i32") == 0) {
-                        masm_append_line(ctx, "    movsxd rax, dword [rbx]  ; Load 32-bit signed value");
+                        snprintf(load, sizeof(load), "    movsxd rax, dword %s  ; Load 32-bit signed value", address);
                     } else {
-                        masm_append_line(ctx, "    mov eax, dword [rbx]     ; Load 32-bit unsigned value");
+                        snprintf(load, sizeof(load), "    mov eax, dword %s     ; Load 32-bit unsigned value", address);
                     }
                 } else {
-                    masm_append_line(ctx, "    mov rax, [rbx]           ; Load default value");
+                    snprintf(load, sizeof(load), "    mov rax, %s           ; Load default value", address);
                 }
             } else {
-                masm_append_line(ctx, "    mov rax, [rbx]           ; Load value");
+                snprintf(load, sizeof(load), "    mov rax, %s           ; Load value", address);
             }
+            masm_append_line(ctx, load);
             
             return true;
         }
@@ -889,7 +3020,7 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
             }
             
             /* Save union object address */
-            masm_append_line(ctx, "    push rax        ; Save union object address");
+            masm_stack_push(ctx, "    push rax        ; Save union object address");
             
             /* Generate index expression */
             if (!masm_generate_ast_node(ctx, node->data.union_member_access.index)) {
@@ -897,20 +3028,14 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
                 return false;
             }
             
-            /* Calculate offset: index * member_size */
-            I64 member_size = node->data.union_member_access.member_size;
-            if (member_size > 1) {
-                char mul_instr[64];
-                snprintf(mul_instr, sizeof(mul_instr), "    imul rax, %ld    ; Multiply index by member size", (long)member_size);
-                masm_append_line(ctx, mul_instr);
-            }
-            
-            /* Add offset to union address */
-            masm_append_line(ctx, "    pop rbx         ; Restore union object address");
-            masm_append_line(ctx, "    add rbx, rax    ; Add offset to union address");
+            /* Element address: union + index * member_size */
+            char address[32], load[96];
+            masm_element_address(ctx, node->data.union_member_access.member_size, false,
+                                 "union object", address, sizeof(address));
             
             /* Load the value from memory */
-            masm_append_line(ctx, "    mov rax, [rbx]  ; Load union member value");
+            snprintf(load, sizeof(load), "    mov rax, %s  ; Load union member value", address);
+            masm_append_line(ctx, load);
             
             return true;
         }
@@ -922,109 +3047,11 @@ Bool masm_generate_ast_node(MASMContext *ctx, ASTNode *node) {
             return true;
         }
             
-        case NODE_RANGE_COMPARISON: {
-            /* Generate range comparison (5<i<j+1<20) */
-            printf("DEBUG: Generating range comparison with %ld expressions\n", node->data.range_comparison.expression_count);
-            
-            /* Generate unique labels for the range comparison */
-            static I64 range_label_counter = 0;
-            range_label_counter++;
-            char true_label[64], false_label[64], end_label[64];
-            snprintf(true_label, sizeof(true_label), "range_true_%d", (int)range_label_counter);
-            snprintf(false_label, sizeof(false_label), "range_false_%d", (int)range_label_counter);
-            snprintf(end_label, sizeof(end_label), "range_end_%d", (int)range_label_counter);
-            
-            /* Generate all expressions first and store them on the stack */
-            ASTNode *expr = node->data.range_comparison.expressions;
-            I64 expr_count = 0;
-            while (expr) {
-                if (!masm_generate_ast_node(ctx, expr)) {
-                    printf("ERROR: Failed to generate MASM for range expression %ld\n", expr_count);
-                    return false;
-                }
-                masm_append_line(ctx, "    push rax        ; Save expression result");
-                expr = expr->next;
-                expr_count++;
-            }
-            
-            /* Generate comparison operations */
-            ASTNode *op = node->data.range_comparison.operators;
-            expr_count = 0;
-            
-            /* Load first expression */
-            masm_append_line(ctx, "    pop rax         ; Load first expression");
-            
-            while (op && expr_count < node->data.range_comparison.expression_count - 1) {
-                /* Load next expression */
-                masm_append_line(ctx, "    pop rbx         ; Load next expression");
-                
-                /* Perform comparison based on operator */
-                switch (op->data.binary_op.op) {
-                    case BINOP_LT: {
-                        char jge_instr[128];
-                        snprintf(jge_instr, sizeof(jge_instr), "    jge %s    ; Jump to false if not <", false_label);
-                        masm_append_line(ctx, "    cmp rax, rbx    ; Compare <");
-                        masm_append_line(ctx, jge_instr);
-                        break;
-                    }
-                    case BINOP_GT: {
-                        char jle_instr[128];
-                        snprintf(jle_instr, sizeof(jle_instr), "    jle %s    ; Jump to false if not >", false_label);
-                        masm_append_line(ctx, "    cmp rax, rbx    ; Compare >");
-                        masm_append_line(ctx, jle_instr);
-                        break;
-                    }
-                    case BINOP_LE: {
-                        char jg_instr[128];
-                        snprintf(jg_instr, sizeof(jg_instr), "    jg %s     ; Jump to false if not <=", false_label);
-                        masm_append_line(ctx, "    cmp rax, rbx    ; Compare <=");
-                        masm_append_line(ctx, jg_instr);
-                        break;
-                    }
-                    case BINOP_GE: {
-                        char jl_instr[128];
-                        snprintf(jl_instr, sizeof(jl_instr), "    jl %s     ; Jump to false if not >=", false_label);
-                        masm_append_line(ctx, "    cmp rax, rbx    ; Compare >=");
-                        masm_append_line(ctx, jl_instr);
-                        break;
-                    }
-                    default: {
-                        char jne_instr[128];
-                        snprintf(jne_instr, sizeof(jne_instr), "    jne %s    ; Jump to false if not equal", false_label);
-                        printf("WARNING: Unhandled range comparison operator %d\n", op->data.binary_op.op);
-                        masm_append_line(ctx, "    cmp rax, rbx    ; Default comparison");
-                        masm_append_line(ctx, jne_instr);
-                        break;
-                    }
-                }
-                
-                /* Move to next expression for next comparison */
-                masm_append_line(ctx, "    mov rax, rbx    ; Move to next expression");
-                
-                op = op->next;
-                expr_count++;
-            }
-            
-            /* All comparisons passed - set result to true */
-            masm_append_line(ctx, "    mov rax, 1      ; Range comparison result: true");
-            char jmp_end_instr[128];
-            snprintf(jmp_end_instr, sizeof(jmp_end_instr), "    jmp %s     ; Jump to end", end_label);
-            masm_append_line(ctx, jmp_end_instr);
-            
-            /* False label */
-            char false_label_line[64];
-            snprintf(false_label_line, sizeof(false_label_line), "%s:", false_label);
-            masm_append_line(ctx, false_label_line);
-            masm_append_line(ctx, "    mov rax, 0      ; Range comparison result: false");
-            
-            /* End label */
-            char end_label_line[64];
-            snprintf(end_label_line, sizeof(end_label_line), "%s:", end_label);
-            masm_append_line(ctx, end_label_line);
+        case NODE_RANGE_COMPARISON:
+            return masm_generate_range_comparison(ctx, node);
             
-            printf("DEBUG: Range comparison assembly generation completed\n");
-            return true;
-        }
+        case NODE_CONDITIONAL:
+            return masm_generate_conditional(ctx, node);
             
         default:
             printf("WARNING: Unhandled AST node type %d in MASM generation\n", node->type);
@@ -1046,6 +3073,7 @@ Bool masm_generate_assembly_from_ast(MASMContext *ctx, ASTNode *ast, const char
         return false;
     }
     
+    if (!masm_generate_profile_runtime(ctx)) return false;
     if (!masm_generate_footer(ctx)) return false;
     
     /* Write to file */
@@ -0,0 +1,579 @@
+/*
+ * MASM Peephole Optimizer
+ * The lines of each PROC are held as opcode/operand records until the PROC
+ * is complete, cleaned up here, and only then written to the output buffer
+ */
+
+#include "masm_output.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MASM_REG_COUNT        16
+#define MASM_REG_ALL          0xFFFFu
+#define MASM_REG_RAX          0
+#define MASM_REG_RSP          4
+#define MASM_PEEPHOLE_PASSES  16     /* Rewrites are rerun until nothing changes */
+#define MASM_PUSH_POP_WINDOW  8      /* Instructions a push/pop pair may enclose */
+
+/*
+ * Line List
+ */
+
+MASMLineList* masm_lines_new(void) {
+    MASMLineList *list = malloc(sizeof(MASMLineList));
+    if (!list) return NULL;
+    memset(list, 0, sizeof(MASMLineList));
+    return list;
+}
+
+void masm_lines_free(MASMLineList *list) {
+    if (!list) return;
+    for (size_t i = 0; i < list->count; i++) free(list->lines[i].text);
+    free(list->lines);
+    free(list);
+}
+
+static void masm_trim_copy(char *dst, size_t size, const char *start, const char *end) {
+    while (start < end && isspace((unsigned char)*start)) start++;
+    while (end > start && isspace((unsigned char)end[-1])) end--;
+    size_t len = (size_t)(end - start);
+    if (len >= size) len = size - 1;
+    memcpy(dst, start, len);
+    dst[len] = '\0';
+}
+
+/* Split a line into label or mnemonic and operands; anything unusual stays opaque text */
+static void masm_line_parse(MASMLine *line) {
+    const char *s = line->text;
+    while (isspace((unsigned char)*s)) s++;
+    line->kind = MASM_LINE_TEXT;
+    if (*s == '\0' || *s == ';') return;
+
+    const char *comment = strchr(s, ';');
+    const char *end = comment ? comment : s + strlen(s);
+    if (comment) masm_trim_copy(line->comment, sizeof(line->comment), comment + 1, comment + strlen(comment));
+    for (const char *p = s; p < end; p++) {
+        if (*p == '"' || *p == '\'') {
+            line->kind = MASM_LINE_INSTR;
+            strcpy(line->op, "?");
+            return;
+        }
+    }
+    while (end > s && isspace((unsigned char)end[-1])) end--;
+
+    const char *word = s;
+    while (word < end && !isspace((unsigned char)*word)) word++;
+    if (word == end && end[-1] == ':') {
+        line->kind = MASM_LINE_LABEL;
+        masm_trim_copy(line->op, sizeof(line->op), s, end - 1);
+        return;
+    }
+
+    line->kind = MASM_LINE_INSTR;
+    if ((size_t)(word - s) >= sizeof(line->op)) {
+        strcpy(line->op, "?");
+        return;
+    }
+    for (size_t i = 0; s + i < word; i++) line->op[i] = (char)tolower((unsigned char)s[i]);
+    line->op[word - s] = '\0';
+
+    /* Operands split at top-level commas; three or more make the line opaque */
+    const char *comma = NULL;
+    int depth = 0;
+    for (const char *p = word; p < end; p++) {
+        if (*p == '[') depth++;
+        else if (*p == ']') depth--;
+        else if (*p == ',' && depth == 0) {
+            if (comma) {
+                strcpy(line->op, "?");
+                return;
+            }
+            comma = p;
+        }
+    }
+    if ((size_t)((comma ? comma : end) - word) >= sizeof(line->dst) ||
+        (comma && (size_t)(end - comma) >= sizeof(line->src))) {
+        strcpy(line->op, "?");
+        return;
+    }
+    masm_trim_copy(line->dst, sizeof(line->dst), word, comma ? comma : end);
+    if (comma) masm_trim_copy(line->src, sizeof(line->src), comma + 1, end);
+}
+
+Bool masm_lines_add(MASMLineList *list, const char *text) {
+    if (!list || !text) return false;
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 256;
+        MASMLine *lines = realloc(list->lines, capacity * sizeof(MASMLine));
+        if (!lines) return false;
+        list->lines = lines;
+        list->capacity = capacity;
+    }
+    MASMLine *line = &list->lines[list->count];
+    memset(line, 0, sizeof(MASMLine));
+    line->text = malloc(strlen(text) + 1);
+    if (!line->text) return false;
+    strcpy(line->text, text);
+    masm_line_parse(line);
+    list->count++;
+    return true;
+}
+
+/* Text of a line without the newline; rewritten lines keep the original indentation */
+size_t masm_line_render(const MASMLine *line, char *buffer, size_t size) {
+    if (!line->changed) return (size_t)snprintf(buffer, size, "%s", line->text);
+
+    int indent = 0;
+    while (isspace((unsigned char)line->text[indent])) indent++;
+    char operands[160];
+    if (line->src[0]) snprintf(operands, sizeof(operands), " %s, %s", line->dst, line->src);
+    else if (line->dst[0]) snprintf(operands, sizeof(operands), " %s", line->dst);
+    else operands[0] = '\0';
+    if (line->comment[0]) {
+        return (size_t)snprintf(buffer, size, "%.*s%s%s    ; %s", indent, line->text, line->op, operands, line->comment);
+    }
+    return (size_t)snprintf(buffer, size, "%.*s%s%s", indent, line->text, line->op, operands);
+}
+
+/*
+ * Operand Classification
+ */
+
+static const char *masm_reg_names[4][MASM_REG_COUNT] = {
+    {"rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"},
+    {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi", "r8d", "r9d", "r10d", "r11d", "r12d", "r13d", "r14d", "r15d"},
+    {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di", "r8w", "r9w", "r10w", "r11w", "r12w", "r13w", "r14w", "r15w"},
+    {"al", "cl", "dl", "bl", "spl", "bpl", "sil", "dil", "r8b", "r9b", "r10b", "r11b", "r12b", "r13b", "r14b", "r15b"}
+};
+
+/* Register number of name, with its size in bytes; -1 for anything else */
+static int masm_reg(const char *name, int *bytes) {
+    static const int sizes[4] = {8, 4, 2, 1};
+    static const char *high[4] = {"ah", "ch", "dh", "bh"};
+    for (int w = 0; w < 4; w++) {
+        for (int r = 0; r < MASM_REG_COUNT; r++) {
+            if (strcmp(name, masm_reg_names[w][r]) == 0) {
+                if (bytes) *bytes = sizes[w];
+                return r;
+            }
+        }
+    }
+    for (int r = 0; r < 4; r++) {
+        if (strcmp(name, high[r]) == 0) {
+            if (bytes) *bytes = 1;
+            return r;
+        }
+    }
+    return -1;
+}
+
+/* Register written whole (64 bits, or 32 bits which zero-extend), else -1 */
+static int masm_full_reg(const char *name) {
+    int bytes = 0;
+    int r = masm_reg(name, &bytes);
+    return bytes >= 4 ? r : -1;
+}
+
+static int masm_reg64(const char *name) {
+    int bytes = 0;
+    int r = masm_reg(name, &bytes);
+    return bytes == 8 ? r : -1;
+}
+
+static Bool masm_is_memory(const char *operand) {
+    return strchr(operand, '[') != NULL;
+}
+
+static Bool masm_is_immediate(const char *operand, I64 *value) {
+    char *end;
+    if (!isdigit((unsigned char)operand[0]) && operand[0] != '-') return false;
+    long long v = strtoll(operand, &end, 10);
+    if (*end != '\0') return false;
+    if (value) *value = (I64)v;
+    return true;
+}
+
+/* Registers named anywhere in an operand, including address registers */
+static unsigned masm_operand_regs(const char *operand) {
+    unsigned regs = 0;
+    const char *p = operand;
+    while (*p) {
+        if (isalnum((unsigned char)*p) || *p == '_') {
+            char word[16];
+            size_t len = 0;
+            while (isalnum((unsigned char)*p) || *p == '_') {
+                if (len < sizeof(word) - 1) word[len++] = *p;
+                p++;
+            }
+            word[len] = '\0';
+            int r = masm_reg(word, NULL);
+            if (r >= 0) regs |= 1u << r;
+        } else {
+            p++;
+        }
+    }
+    return regs;
+}
+
+/* Registers an operand reads as an address when it is memory */
+static unsigned masm_address_regs(const char *operand) {
+    return masm_is_memory(operand) ? masm_operand_regs(operand) : 0;
+}
+
+/*
+ * Instruction Effects
+ */
+
+typedef struct {
+    unsigned use, def;           /* Registers read, registers written whole */
+    Bool reads_flags, writes_flags;
+    Bool ends_block;             /* Control leaves or may leave here */
+    Bool barrier;                /* Unknown effects: nothing moves across it */
+} MASMEffect;
+
+static Bool masm_is_jcc(const char *op) {
+    return op[0] == 'j' && strcmp(op, "jmp") != 0;
+}
+
+/* Write to dst: whole registers are defined, partial ones are also read */
+static void masm_effect_write(MASMEffect *e, const char *dst) {
+    int r = masm_full_reg(dst);
+    if (r >= 0) {
+        e->def |= 1u << r;
+    } else if (masm_reg(dst, NULL) >= 0) {
+        e->use |= masm_operand_regs(dst);
+    } else {
+        e->use |= masm_address_regs(dst);
+    }
+}
+
+static void masm_effect(const MASMLine *line, MASMEffect *e) {
+    const char *op = line->op, *dst = line->dst, *src = line->src;
+    memset(e, 0, sizeof(MASMEffect));
+
+    if (line->kind == MASM_LINE_LABEL) {
+        e->ends_block = true;
+        return;
+    }
+    if (line->kind != MASM_LINE_INSTR) return;
+
+    if (!strcmp(op, "mov") || !strcmp(op, "movzx") || !strcmp(op, "movsx") || !strcmp(op, "movsxd")) {
+        masm_effect_write(e, dst);
+        e->use |= masm_operand_regs(src);
+    } else if (!strcmp(op, "lea")) {
+        masm_effect_write(e, dst);
+        e->use |= masm_address_regs(src);
+    } else if (!strcmp(op, "xor") && !strcmp(dst, src) && masm_full_reg(dst) >= 0) {
+        e->def |= 1u << masm_full_reg(dst);    /* Zeroing idiom */
+        e->writes_flags = true;
+    } else if (!strcmp(op, "add") || !strcmp(op, "sub") || !strcmp(op, "and") || !strcmp(op, "or") ||
+               !strcmp(op, "xor") || !strcmp(op, "shl") || !strcmp(op, "shr") || !strcmp(op, "sar") ||
+               !strcmp(op, "adc") || !strcmp(op, "sbb") || (!strcmp(op, "imul") && src[0])) {
+        e->use |= masm_operand_regs(dst) | masm_operand_regs(src);
+        e->def |= masm_full_reg(dst) >= 0 ? 1u << masm_full_reg(dst) : 0;
+        e->reads_flags = !strcmp(op, "adc") || !strcmp(op, "sbb");
+        e->writes_flags = true;
+    } else if (!strcmp(op, "cmp") || !strcmp(op, "test") || !strcmp(op, "bt")) {
+        e->use |= masm_operand_regs(dst) | masm_operand_regs(src);
+        e->writes_flags = true;
+    } else if (!strcmp(op, "inc") || !strcmp(op, "dec") || !strcmp(op, "neg") || !strcmp(op, "not")) {
+        e->use |= masm_operand_regs(dst);
+        e->def |= masm_full_reg(dst) >= 0 ? 1u << masm_full_reg(dst) : 0;
+        e->writes_flags = strcmp(op, "not") != 0;
+    } else if (!strcmp(op, "push") && dst[0] && !src[0]) {
+        e->use |= masm_operand_regs(dst) | 1u << MASM_REG_RSP;
+        e->def |= 1u << MASM_REG_RSP;
+    } else if (!strcmp(op, "pop") && dst[0] && !src[0]) {
+        masm_effect_write(e, dst);
+        e->use |= 1u << MASM_REG_RSP;
+        e->def |= 1u << MASM_REG_RSP;
+    } else if (!strcmp(op, "cqo")) {
+        e->use |= 1u << MASM_REG_RAX;
+        e->def |= 1u << 2;
+    } else if (!strcmp(op, "idiv") || !strcmp(op, "div") || (!strcmp(op, "imul") && !src[0]) || !strcmp(op, "mul")) {
+        e->use |= 1u << MASM_REG_RAX | 1u << 2 | masm_operand_regs(dst);
+        e->def |= 1u << MASM_REG_RAX | 1u << 2;
+        e->writes_flags = true;
+    } else if (!strcmp(op, "xchg")) {
+        e->use |= masm_operand_regs(dst) | masm_operand_regs(src);
+        e->def |= (masm_full_reg(dst) >= 0 ? 1u << masm_full_reg(dst) : 0) |
+                  (masm_full_reg(src) >= 0 ? 1u << masm_full_reg(src) : 0);
+    } else if (!strncmp(op, "set", 3) && !src[0]) {
+        e->use |= masm_operand_regs(dst);
+        e->reads_flags = true;
+    } else if (!strncmp(op, "cmov", 4)) {
+        e->use |= masm_operand_regs(dst) | masm_operand_regs(src);
+        e->def |= masm_full_reg(dst) >= 0 ? 1u << masm_full_reg(dst) : 0;
+        e->reads_flags = true;
+    } else if (masm_is_jcc(op) && !src[0]) {
+        e->reads_flags = true;
+        e->ends_block = true;
+    } else if (!strcmp(op, "jmp") || !strcmp(op, "ret")) {
+        e->ends_block = true;
+    } else {
+        /* call, directives and anything not modelled above */
+        e->barrier = true;
+        e->ends_block = true;
+    }
+}
+
+/*
+ * Liveness
+ * Computed inside straight-line runs only: every register and the flags are
+ * taken to be live wherever control can leave the run.
+ */
+
+typedef struct {
+    unsigned live_out;           /* Registers read after this line */
+    Bool flags_out;              /* Flags read after this line */
+} MASMLiveness;
+
+static void masm_liveness(MASMLineList *list, MASMLiveness *live) {
+    unsigned regs = MASM_REG_ALL;
+    Bool flags = true;
+    for (size_t i = list->count; i-- > 0;) {
+        MASMLine *line = &list->lines[i];
+        MASMEffect e;
+        live[i].live_out = regs;
+        live[i].flags_out = flags;
+        if (line->deleted || line->kind == MASM_LINE_TEXT) continue;
+        masm_effect(line, &e);
+        if (e.ends_block) {
+            regs = MASM_REG_ALL;
+            /* A call or ret clobbers the flags; other exits may be followed by a flag test */
+            flags = !(line->kind == MASM_LINE_INSTR && (!strcmp(line->op, "call") || !strcmp(line->op, "ret")));
+            if (e.reads_flags) flags = true;
+            continue;
+        }
+        regs = (regs & ~e.def) | e.use;
+        if (e.writes_flags) flags = false;
+        if (e.reads_flags) flags = true;
+    }
+}
+
+/*
+ * Rewrites
+ */
+
+typedef struct {
+    I64 push_pop;                /* Instructions removed from push/pop pairs */
+    I64 mov;                     /* Folded or dead moves */
+    I64 load;                    /* Reloads of a register just stored */
+    I64 jump;                    /* Jumps to the next instruction */
+    I64 xor_zero;                /* mov reg, 0 turned into xor */
+} MASMPeepholeStats;
+
+/* Next live instruction or label after i, skipping blank and comment lines */
+static size_t masm_next(MASMLineList *list, size_t i) {
+    for (i++; i < list->count; i++) {
+        MASMLine *line = &list->lines[i];
+        if (!line->deleted && line->kind != MASM_LINE_TEXT) return i;
+    }
+    return list->count;
+}
+
+/* The operands may point into line itself, so they are copied out first */
+static void masm_line_set(MASMLine *line, const char *op, const char *dst, const char *src) {
+    char new_op[sizeof(line->op)], new_dst[sizeof(line->dst)], new_src[sizeof(line->src)];
+    snprintf(new_op, sizeof(new_op), "%s", op);
+    snprintf(new_dst, sizeof(new_dst), "%s", dst);
+    snprintf(new_src, sizeof(new_src), "%s", src);
+    memcpy(line->op, new_op, sizeof(new_op));
+    memcpy(line->dst, new_dst, sizeof(new_dst));
+    memcpy(line->src, new_src, sizeof(new_src));
+    line->changed = true;
+}
+
+static Bool masm_is_mov(const MASMLine *line) {
+    return line->kind == MASM_LINE_INSTR && !strcmp(line->op, "mov");
+}
+
+/* push P ... pop S becomes mov S, P when nothing between touches S or the stack */
+static Bool masm_fold_push_pop(MASMLineList *list, size_t i, MASMPeepholeStats *stats) {
+    MASMLine *push = &list->lines[i];
+    if (push->kind != MASM_LINE_INSTR || strcmp(push->op, "push") || push->src[0]) return false;
+    if (masm_reg64(push->dst) < 0 && !masm_is_immediate(push->dst, NULL)) return false;
+
+    unsigned touched = 0;
+    size_t between = 0;
+    size_t j = masm_next(list, i);
+    for (; j < list->count; j = masm_next(list, j)) {
+        MASMLine *line = &list->lines[j];
+        MASMEffect e;
+        if (line->kind == MASM_LINE_INSTR && !strcmp(line->op, "pop")) break;
+        masm_effect(line, &e);
+        if (e.ends_block || e.barrier || ((e.use | e.def) & 1u << MASM_REG_RSP)) return false;
+        if (++between > MASM_PUSH_POP_WINDOW) return false;
+        touched |= e.use | e.def;
+    }
+    if (j >= list->count) return false;
+
+    MASMLine *pop = &list->lines[j];
+    int s = masm_reg64(pop->dst);
+    if (s < 0 || pop->src[0]) return false;
+    if (between > 0 && (touched & 1u << s)) return false;
+
+    if (strcmp(push->dst, pop->dst) == 0) {
+        push->deleted = true;
+        stats->push_pop += 2;
+    } else {
+        masm_line_set(push, "mov", pop->dst, push->dst);
+        push->comment[0] = '\0';
+        stats->push_pop++;
+    }
+    pop->deleted = true;
+    return true;
+}
+
+/* mov A, X followed by mov B, A with A dead afterwards: load B directly */
+static Bool masm_fold_mov_chain(MASMLineList *list, MASMLiveness *live, size_t i, MASMPeepholeStats *stats) {
+    MASMLine *first = &list->lines[i];
+    if (first->kind != MASM_LINE_INSTR) return false;
+    Bool is_mov = !strcmp(first->op, "mov");
+    if (!is_mov && strcmp(first->op, "lea") && strcmp(first->op, "movzx") &&
+        strcmp(first->op, "movsx") && strcmp(first->op, "movsxd")) return false;
+    int a = masm_reg64(first->dst);
+    if (a < 0) return false;
+
+    size_t j = masm_next(list, i);
+    if (j >= list->count) return false;
+    MASMLine *second = &list->lines[j];
+    if (!masm_is_mov(second) || strcmp(second->src, first->dst) != 0) return false;
+
+    /* mov A, B; mov B, A: the second move changes nothing */
+    if (is_mov && strcmp(second->dst, first->src) == 0) {
+        second->deleted = true;
+        stats->mov++;
+        return true;
+    }
+
+    if (live[j].live_out & 1u << a) return false;
+    if (masm_operand_regs(second->dst) & 1u << a) return false;    /* mov [A], A needs A */
+
+    const char *value = first->src, *target = second->dst;
+    char sized[64];
+    I64 imm;
+    if (masm_reg64(second->dst) < 0) {
+        if (!is_mov || !masm_is_memory(second->dst)) return false;
+        if (masm_is_immediate(value, &imm)) {
+            /* Immediates stored to memory are 32 bits and need an explicit size */
+            if (imm < -2147483647LL - 1 || imm > 2147483647LL) return false;
+            if (!strstr(second->dst, "PTR")) {
+                if (strlen(second->dst) + 11 > sizeof(sized)) return false;
+                snprintf(sized, sizeof(sized), "QWORD PTR %s", second->dst);
+                target = sized;
+            }
+        } else if (masm_reg64(value) < 0) {
+            return false;
+        }
+    }
+
+    masm_line_set(second, first->op, target, value);
+    first->deleted = true;
+    stats->mov++;
+    return true;
+}
+
+/* mov R, X whose result is never read */
+static Bool masm_drop_dead_mov(MASMLineList *list, MASMLiveness *live, size_t i, MASMPeepholeStats *stats) {
+    MASMLine *line = &list->lines[i];
+    if (line->kind != MASM_LINE_INSTR) return false;
+    if (strcmp(line->op, "mov") && strcmp(line->op, "lea") && strcmp(line->op, "movzx") &&
+        strcmp(line->op, "movsx") && strcmp(line->op, "movsxd")) return false;
+    int r = masm_full_reg(line->dst);
+    if (r < 0 || r == MASM_REG_RSP || (live[i].live_out & 1u << r)) return false;
+    line->deleted = true;
+    stats->mov++;
+    return true;
+}
+
+/* mov [m], R followed by a load of [m]: use R */
+static Bool masm_forward_store(MASMLineList *list, size_t i, MASMPeepholeStats *stats) {
+    MASMLine *store = &list->lines[i];
+    if (!masm_is_mov(store) || !masm_is_memory(store->dst) || masm_reg64(store->src) < 0) return false;
+    if (strstr(store->dst, "PTR") && !strstr(store->dst, "QWORD")) return false;
+
+    size_t j = masm_next(list, i);
+    if (j >= list->count) return false;
+    MASMLine *load = &list->lines[j];
+    if (!masm_is_mov(load) || strcmp(load->src, store->dst) != 0 || masm_reg64(load->dst) < 0) return false;
+
+    if (strcmp(load->dst, store->src) == 0) {
+        load->deleted = true;
+        stats->load++;
+    } else {
+        masm_line_set(load, "mov", load->dst, store->src);
+    }
+    return true;
+}
+
+/* jmp or jcc to a label that directly follows it */
+static Bool masm_drop_jump_to_next(MASMLineList *list, size_t i, MASMPeepholeStats *stats) {
+    MASMLine *jump = &list->lines[i];
+    if (jump->kind != MASM_LINE_INSTR || jump->op[0] != 'j' || !jump->dst[0] || jump->src[0]) return false;
+    for (size_t j = masm_next(list, i); j < list->count; j = masm_next(list, j)) {
+        MASMLine *line = &list->lines[j];
+        if (line->kind != MASM_LINE_LABEL) return false;
+        if (strcmp(line->op, jump->dst) == 0) {
+            jump->deleted = true;
+            stats->jump++;
+            return true;
+        }
+    }
+    return false;
+}
+
+/* mov R, 0 as xor R32, R32 where nothing reads the flags it clobbers */
+static void masm_zero_with_xor(MASMLineList *list, MASMLiveness *live, MASMPeepholeStats *stats) {
+    for (size_t i = 0; i < list->count; i++) {
+        MASMLine *line = &list->lines[i];
+        I64 value;
+        if (line->deleted || !masm_is_mov(line) || live[i].flags_out) continue;
+        int r = masm_full_reg(line->dst);
+        if (r < 0 || r == MASM_REG_RSP || !masm_is_immediate(line->src, &value) || value != 0) continue;
+        masm_line_set(line, "xor", masm_reg_names[1][r], masm_reg_names[1][r]);
+        stats->xor_zero++;
+    }
+}
+
+void masm_peephole_optimize(MASMLineList *list, const char *function_name) {
+    if (!list || list->count == 0) return;
+
+    MASMPeepholeStats stats;
+    memset(&stats, 0, sizeof(stats));
+    MASMLiveness *live = malloc(list->count * sizeof(MASMLiveness));
+    if (!live) return;
+
+    for (int pass = 0; pass < MASM_PEEPHOLE_PASSES; pass++) {
+        Bool changed = false;
+        for (size_t i = 0; i < list->count; i++) {
+            if (list->lines[i].deleted) continue;
+            changed |= masm_fold_push_pop(list, i, &stats);
+            if (list->lines[i].deleted) continue;
+            changed |= masm_forward_store(list, i, &stats);
+            changed |= masm_drop_jump_to_next(list, i, &stats);
+        }
+        masm_liveness(list, live);
+        for (size_t i = 0; i < list->count; i++) {
+            if (list->lines[i].deleted) continue;
+            if (masm_fold_mov_chain(list, live, i, &stats)) {
+                changed = true;
+                masm_liveness(list, live);
+            } else if (masm_drop_dead_mov(list, live, i, &stats)) {
+                changed = true;
+                masm_liveness(list, live);
+            }
+        }
+        if (!changed) break;
+    }
+    masm_liveness(list, live);
+    masm_zero_with_xor(list, live, &stats);
+    free(live);
+
+    printf("DEBUG: masm_peephole - %s: %lld instructions removed (%lld push/pop, %lld mov, %lld load, "
+           "%lld jump), %lld zeroing moves turned into xor\n", function_name,
+           stats.push_pop + stats.mov + stats.load + stats.jump,
+           stats.push_pop, stats.mov, stats.load, stats.jump, stats.xor_zero);
+}
@@ -850,6 +850,11 @@ static SchismTokenType lex_parse_number(LexerState *lexer) {
            (lex_is_digit(lexer->input_buffer[lexer->buffer_pos]) ||
             lexer->input_buffer[lexer->buffer_pos] == '.')) {
         if (lexer->input_buffer[lexer->buffer_pos] == '.') {
+            /* A second dot starts the '...' of a case range (case 4...7:) */
+            if (is_float || (lexer->buffer_pos + 1 < lexer->buffer_size &&
+                             lexer->input_buffer[lexer->buffer_pos + 1] == '.')) {
+                break;
+            }
             is_float = true;
         }
         lexer->buffer_pos++;
@@ -1764,15 +1764,9 @@ ASTNode* parse_switch_statement(ParserState *parser) {
     }
     parser_next_token(parser); /* consume 'switch' */
     
-    /* Check for nobounds switch (switch [expr]) */
-    Bool nobounds = false;
-    if (parser_current_token(parser) == '[') {
-        nobounds = true;
-        parser_next_token(parser); /* consume '[' */
-    }
-    
-    /* Expect '(' or '[' */
-    if (parser_current_token(parser) != '(' && parser_current_token(parser) != '[') {
+    /* Expect '(' or '[' (switch [expr] has no bounds check) */
+    Bool nobounds = parser_current_token(parser) == '[';
+    if (parser_current_token(parser) != '(' && !nobounds) {
         parser_error(parser, (U8*)"Expected '(' or '[' after 'switch'");
         return NULL;
     }
@@ -1785,8 +1779,8 @@ ASTNode* parse_switch_statement(ParserState *parser) {
         return NULL;
     }
     
-    /* Expect ')' or ']' */
-    if (parser_current_token(parser) != ')' && parser_current_token(parser) != ']') {
+    /* Expect ')' or ']' to match */
+    if (parser_current_token(parser) != (nobounds ? ']' : ')')) {
         parser_error(parser, (U8*)"Expected ')' or ']' after switch expression");
         ast_node_free(expression);
         return NULL;
@@ -2415,7 +2409,7 @@ ASTNode* parse_function_declaration(ParserState *parser) {
     /* Set function information */
     func_node->data.function.name = func_name;
     func_node->data.function.return_type = (U8*)return_type->data.type_specifier.type; /* Cast for now */
-    func_node->data.function.parameters = NULL; /* TODO: Parse parameters */
+    func_node->data.function.parameters = parameters;
     func_node->data.function.body = NULL; /* TODO: Parse function body */
     func_node->data.function.is_extern = false;
     func_node->data.function.is_public = false;
@@ -2912,9 +2906,10 @@ ASTNode* parse_relational_expression(ParserState *parser) {
         ASTNode *second_expr = parse_shift_expression(parser);
         if (second_expr) {
             /* Check if there's another comparison operator */
-            if (parser_current_token(parser) == '<' || parser_current_token(parser) == '>' ||
-                parser_current_token(parser) == TK_LESS_EQU || parser_current_token(parser) == TK_GREATER_EQU) {
-                
+            Bool is_range = parser_current_token(parser) == '<' || parser_current_token(parser) == '>' ||
+                            parser_current_token(parser) == TK_LESS_EQU || parser_current_token(parser) == TK_GREATER_EQU;
+            ast_node_free(second_expr);
+            if (is_range) {
                 /* This is a range comparison! Parse the entire range */
                 parser_restore_position(parser);
                 return parse_range_comparison(parser, left);
@@ -3251,7 +3246,7 @@ ASTNode* parse_parameter_list(ParserState *parser) {
         if (parser_current_token(parser) == '=') {
             printf("DEBUG: Found default argument value\n");
             parser_next_token(parser); /* consume '=' */
-            default_value = parse_expression(parser);
+            default_value = parse_assignment_expression(parser);
             if (!default_value) {
                 printf("DEBUG: Failed to parse default argument value\n");
             }
@@ -3352,8 +3347,8 @@ ASTNode* parse_argument_list(ParserState *parser) {
             continue;
         }
         
-        /* Parse argument expression */
-        ASTNode *arg_expr = parse_expression(parser);
+        /* Parse argument expression - commas here separate arguments */
+        ASTNode *arg_expr = parse_assignment_expression(parser);
         if (arg_expr) {
             printf("DEBUG: Parsed function call argument: type %d\n", arg_expr->type);
             
@@ -4985,9 +4980,11 @@ ASTNode* parse_case_statement(ParserState *parser) {
     ASTNode *body = NULL;
     ASTNode *last_stmt = NULL;
     
-    /* Parse statements until we hit another case, default, or closing brace */
+    /* Parse statements until we hit another case, default, start, end, or closing brace */
     while (parser_current_token(parser) != TK_CASE && 
            parser_current_token(parser) != TK_DEFAULT && 
+           parser_current_token(parser) != TK_START && 
+           parser_current_token(parser) != TK_END && 
            parser_current_token(parser) != '}' && 
            parser_current_token(parser) != TK_EOF) {
         
@@ -5061,9 +5058,11 @@ ASTNode* parse_default_statement(ParserState *parser) {
     ASTNode *body = NULL;
     ASTNode *last_stmt = NULL;
     
-    /* Parse statements until we hit another case, default, or closing brace */
+    /* Parse statements until we hit another case, default, start, end, or closing brace */
     while (parser_current_token(parser) != TK_CASE && 
            parser_current_token(parser) != TK_DEFAULT && 
+           parser_current_token(parser) != TK_START && 
+           parser_current_token(parser) != TK_END && 
            parser_current_token(parser) != '}' && 
            parser_current_token(parser) != TK_EOF) {
         
@@ -5505,8 +5504,8 @@ ASTNode* parse_range_comparison(ParserState *parser, ASTNode *first_expr) {
             last_op = op_node;
         }
         
-        /* Parse the next expression - use simple identifier/constant to avoid circular dependency */
-        ASTNode *next_expr = parse_simple_expression(parser);
+        /* Parse the next operand at shift level so j+1 in 5<i<j+1<20 is one operand */
+        ASTNode *next_expr = parse_shift_expression(parser);
         if (!next_expr) {
             parser_error(parser, (U8*)"Expected expression after comparison operator in range");
             ast_node_free(expressions);
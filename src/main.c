@@ -13,6 +13,7 @@
 #include "backend.h"
 #include "aot.h"
 #include "masm_output.h"
+#include "ipa.h"
 #include "debug.h"
 
 /* Function prototypes */
@@ -23,7 +24,7 @@ Bool test_masm_output_generation(void);
 Bool create_simple_hello_executable(const char *filename);
 
 /* Function to compile using MASM toolchain */
-Bool compile_with_masm_toolchain(ASTNode *ast, const char *output_filename);
+Bool compile_with_masm_toolchain(ASTNode *ast, const char *output_filename, ProfileData *profile);
 
 int main(int argc, char *argv[]) {
     /* Initialize debug system */
@@ -45,6 +46,10 @@ int main(int argc, char *argv[]) {
         printf("  --show-location            Show file:line location\n");
         printf("  --debug-categories <list>  Enable specific categories (comma-separated)\n");
         printf("  --debug-tokens             Debug tokenization only\n");
+        printf("  --dump-ic                  Print the intermediate code after optimization\n");
+        printf("  --no-schedule              Keep instructions in source order (no list scheduling)\n");
+        printf("  --profile-generate[=file]  Count block, edge and call executions; write them at exit\n");
+        printf("  --profile-use[=file]       Lay out branches, switches and inlining from a profile\n");
         return 1;
     }
     
@@ -57,6 +62,10 @@ int main(int argc, char *argv[]) {
     char *input_file = argv[1];
     char *output_file = NULL;
     Bool debug_tokens_only = false;
+    Bool dump_ic = false;
+    Bool no_schedule = false;
+    ProfileMode profile_mode = PROFILE_NONE;
+    const char *profile_path = PROFILE_DEFAULT_FILE;
     
     DEBUG_GENERAL(DEBUG_INFO, "Input file: %s", input_file);
     
@@ -69,6 +78,20 @@ int main(int argc, char *argv[]) {
         else if (strcmp(argv[i], "--debug-tokens") == 0) {
             debug_tokens_only = true;
         }
+        else if (strcmp(argv[i], "--dump-ic") == 0) {
+            dump_ic = true;
+        }
+        else if (strcmp(argv[i], "--no-schedule") == 0) {
+            no_schedule = true;
+        }
+        else if (strncmp(argv[i], "--profile-generate", 18) == 0 && (argv[i][18] == '\0' || argv[i][18] == '=')) {
+            profile_mode = PROFILE_GENERATE;
+            if (argv[i][18] == '=') profile_path = argv[i] + 19;
+        }
+        else if (strncmp(argv[i], "--profile-use", 13) == 0 && (argv[i][13] == '\0' || argv[i][13] == '=')) {
+            profile_mode = PROFILE_USE;
+            if (argv[i][13] == '=') profile_path = argv[i] + 14;
+        }
         /* Skip debug options that were already processed */
         else if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0 ||
                  strcmp(argv[i], "--trace") == 0 || strcmp(argv[i], "--debug-level") == 0 ||
@@ -95,7 +118,6 @@ int main(int argc, char *argv[]) {
         DEBUG_GENERAL(DEBUG_VERBOSE, "  - Assembly mode: %s", cc->use_64bit_mode ? "x86-64" : "x86-32");
         DEBUG_GENERAL(DEBUG_VERBOSE, "  - RIP-relative: %s", cc->use_rip_relative ? "enabled" : "disabled");
         DEBUG_GENERAL(DEBUG_VERBOSE, "  - Extended regs: %s", cc->use_extended_regs ? "enabled" : "disabled");
-        ccmpctrl_free(cc);
     } else {
         DEBUG_ERROR(DEBUG_CAT_GENERAL, "✗ Failed to create CCmpCtrl");
         debug_system_cleanup();
@@ -291,11 +313,34 @@ int main(int argc, char *argv[]) {
                     debug_symbol_table_print_statistics(parser);
                 }
                 
+                /* Whole-program passes: constant arguments, specialization, dead functions */
+                I64 ipa_changes = ipa_optimize(parser, ast);
+                DEBUG_PARSER(DEBUG_INFO, "✓ Interprocedural optimization: %lld changes", ipa_changes);
+                
+                /* Number the profile counters; --profile-use reads their counts back */
+                ProfileData *profile = NULL;
+                if (profile_mode != PROFILE_NONE) {
+                    profile = profile_new(profile_mode, profile_path);
+                    if (profile) {
+                        profile_annotate(profile, ast);
+                        if (profile_mode == PROFILE_USE && !profile_load(profile)) {
+                            profile_free(profile);
+                            profile = NULL;
+                        }
+                    }
+                    if (profile) {
+                        printf("✓ Profile %s: %s (%lld counters)\n",
+                               profile_mode == PROFILE_GENERATE ? "instrumentation" : "loaded",
+                               profile->path, profile->counter_count);
+                    }
+                }
+                
                 /* Generate MASM Assembly Output */
                 DEBUG_MASM(DEBUG_INFO, "=== MASM Assembly Output Generation ===");
                 MASMContext *masm_ctx = masm_context_new(NULL);
                 if (masm_ctx) {
                     DEBUG_MASM(DEBUG_INFO, "✓ MASM context created successfully");
+                    masm_ctx->profile = profile;
                     
                     /* Generate MASM assembly from AST */
                     if (masm_generate_assembly_from_ast(masm_ctx, ast, "output.asm")) {
@@ -345,10 +390,14 @@ int main(int argc, char *argv[]) {
                 /* Convert AST to intermediate code */
                 ICGenContext *ic_ctx = ic_gen_context_new(cc);
                 if (ic_ctx) {
+                    ic_ctx->instruction_scheduling = !no_schedule;
+                    ic_ctx->profile = profile;
                     printf("✓ Intermediate code context created successfully\n");
                     printf("  - Optimization level: %lld\n", ic_ctx->optimization_level);
                     printf("  - Constant folding: %s\n", ic_ctx->constant_folding ? "enabled" : "disabled");
                     printf("  - Dead code elimination: %s\n", ic_ctx->dead_code_elimination ? "enabled" : "disabled");
+                    printf("  - Instruction scheduling: %s\n", ic_ctx->instruction_scheduling ? "enabled" : "disabled");
+                    printf("  - Profile-guided optimization: %s\n", profile_has_counts(profile) ? "enabled" : "disabled");
                     
                     /* Convert AST to intermediate code */
                     if (ic_gen_from_ast(ic_ctx, ast)) {
@@ -365,12 +414,6 @@ int main(int argc, char *argv[]) {
                                 printf("  - Pass 0-2 (constant folding) completed\n");
                             }
                             
-                            /* Pass 3: Register allocation optimization */
-                            if (ic_ctx->optimization_level >= 3) {
-                                opt_pass_3(ic_ctx);
-                                printf("  - Pass 3 (register allocation) completed\n");
-                            }
-                            
                             /* Pass 4: Memory layout optimization */
                             if (ic_ctx->optimization_level >= 4) {
                                 opt_pass_4(ic_ctx);
@@ -389,6 +432,12 @@ int main(int argc, char *argv[]) {
                                 printf("  - Pass 6 (control flow) completed\n");
                             }
                             
+                            /* Pass 3: Register allocation, after the passes that rewrite the IC chain */
+                            if (ic_ctx->optimization_level >= 3) {
+                                opt_pass_3(ic_ctx);
+                                printf("  - Pass 3 (register allocation) completed\n");
+                            }
+                            
                             /* Pass 7-9: Assembly generation and final optimization */
                             if (ic_ctx->optimization_level >= 7) {
                                 opt_pass_789(ic_ctx);
@@ -396,6 +445,9 @@ int main(int argc, char *argv[]) {
                             }
                         }
                         
+                        /* Show the optimized intermediate code */
+                        if (dump_ic) ic_dump(ic_ctx);
+                        
                         /* Generate final assembly code */
                         I64 assembly_size;
                         U8 *assembly = ic_generate_assembly(ic_ctx, &assembly_size);
@@ -418,7 +470,7 @@ int main(int argc, char *argv[]) {
                 /* MASM Toolchain Compilation to Executable */
                 printf("\n=== MASM Toolchain Compilation to Executable ===\n");
                 char *exe_filename = output_file ? output_file : "test_masm_output.exe";
-                if (compile_with_masm_toolchain(ast, exe_filename)) {
+                if (compile_with_masm_toolchain(ast, exe_filename, profile)) {
                     printf("✓ MASM toolchain compilation successful\n");
                     printf("  - Output file: %s\n", exe_filename);
                 } else {
@@ -426,6 +478,7 @@ int main(int argc, char *argv[]) {
                 }
                 
                 /* Free AST */
+                profile_free(profile);
                 ast_node_free(ast);
             } else {
                 printf("✗ Failed to generate AST\n");
@@ -448,6 +501,9 @@ int main(int argc, char *argv[]) {
     
     fclose(input);
     
+    /* The parser and code generators hold cc until here */
+    ccmpctrl_free(cc);
+    
     printf("\n✓ Complete compilation pipeline tested successfully!\n");
     printf("✓ SchismC: Lexer → Parser → AST → Intermediate Code → Assembly\n");
     printf("✓ Ready for full assembly-centric HolyC compilation!\n");
@@ -1085,7 +1141,7 @@ Bool test_masm_output_generation(void) {
 /*
  * Compile using MASM toolchain approach
  */
-Bool compile_with_masm_toolchain(ASTNode *ast, const char *output_filename) {
+Bool compile_with_masm_toolchain(ASTNode *ast, const char *output_filename, ProfileData *profile) {
     if (!ast || !output_filename) return false;
     
     printf("\n=== MASM Toolchain Compilation ===\n");
@@ -1103,6 +1159,7 @@ Bool compile_with_masm_toolchain(ASTNode *ast, const char *output_filename) {
         assembly_context_free(asm_ctx);
         return false;
     }
+    masm_ctx->profile = profile;
     
     /* Generate MASM assembly */
     const char *asm_filename = "output.asm";
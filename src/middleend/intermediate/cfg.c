@@ -0,0 +1,667 @@
+/*
+ * Control Flow Graph Construction
+ * Basic blocks, dominator tree and loop nesting forest over the IC chain,
+ * plus the CFG-based jump cleanups run by opt_pass_6
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Block Construction
+ */
+
+static ICBasicBlock* ic_cfg_new_block(ICCfg *cfg, I64 *capacity) {
+    if (cfg->block_count >= *capacity) {
+        I64 new_capacity = *capacity ? *capacity * 2 : 16;
+        ICBasicBlock **blocks = realloc(cfg->blocks, sizeof(ICBasicBlock*) * new_capacity);
+        if (!blocks) return NULL;
+        cfg->blocks = blocks;
+        *capacity = new_capacity;
+    }
+
+    ICBasicBlock *bb = malloc(sizeof(ICBasicBlock));
+    if (!bb) return NULL;
+    memset(bb, 0, sizeof(ICBasicBlock));
+    bb->id = cfg->block_count;
+    bb->rpo_number = -1;
+    cfg->blocks[cfg->block_count++] = bb;
+    return bb;
+}
+
+static Bool ic_cfg_add_edge(ICBasicBlock *from, ICBasicBlock *to) {
+    if (!from || !to || from->succ_count >= 2) return false;
+
+    if (to->pred_count >= to->pred_capacity) {
+        I64 new_capacity = to->pred_capacity ? to->pred_capacity * 2 : 4;
+        ICBasicBlock **preds = realloc(to->preds, sizeof(ICBasicBlock*) * new_capacity);
+        if (!preds) return false;
+        to->preds = preds;
+        to->pred_capacity = new_capacity;
+    }
+
+    from->succ[from->succ_count++] = to;
+    to->preds[to->pred_count++] = from;
+    return true;
+}
+
+/* Only labels so far: a following label can join the block */
+static Bool ic_cfg_block_is_labels(ICBasicBlock *bb) {
+    for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+        if (ic->base.ic_code != IC_LABEL) return false;
+        if (ic == bb->last) break;
+    }
+    return true;
+}
+
+/* Number blocks in reverse post-order from the entry (iterative DFS) */
+static Bool ic_cfg_compute_rpo(ICCfg *cfg) {
+    ICBasicBlock **stack = malloc(sizeof(ICBasicBlock*) * (cfg->block_count + 1));
+    I64 *next_succ = calloc(cfg->block_count + 1, sizeof(I64));
+    Bool *visited = calloc(cfg->block_count + 1, sizeof(Bool));
+    ICBasicBlock **postorder = malloc(sizeof(ICBasicBlock*) * (cfg->block_count + 1));
+
+    if (!stack || !next_succ || !visited || !postorder) {
+        free(stack);
+        free(next_succ);
+        free(visited);
+        free(postorder);
+        return false;
+    }
+
+    I64 sp = 0, post_count = 0;
+    stack[sp++] = cfg->blocks[0];
+    visited[0] = true;
+
+    while (sp > 0) {
+        ICBasicBlock *bb = stack[sp - 1];
+        if (next_succ[bb->id] < bb->succ_count) {
+            ICBasicBlock *succ = bb->succ[next_succ[bb->id]++];
+            if (!visited[succ->id]) {
+                visited[succ->id] = true;
+                stack[sp++] = succ;
+            }
+        } else {
+            postorder[post_count++] = bb;
+            sp--;
+        }
+    }
+
+    cfg->rpo = malloc(sizeof(ICBasicBlock*) * (post_count + 1));
+    if (cfg->rpo) {
+        cfg->rpo_count = post_count;
+        for (I64 i = 0; i < post_count; i++) {
+            ICBasicBlock *bb = postorder[post_count - 1 - i];
+            bb->rpo_number = i;
+            cfg->rpo[i] = bb;
+        }
+    }
+
+    free(stack);
+    free(next_succ);
+    free(visited);
+    free(postorder);
+    return cfg->rpo != NULL;
+}
+
+/* Build the CFG of the function starting at enter (an IC_ENTER) */
+ICCfg* ic_cfg_build(ICGenContext *ctx, CIntermediateCode *enter) {
+    if (!ctx || !enter || enter->base.ic_code != IC_ENTER) return NULL;
+
+    CIntermediateCode *leave = enter->base.next;
+    while (leave && leave->base.ic_code != IC_LEAVE) {
+        leave = leave->base.next;
+    }
+    if (!leave) {
+        printf("ERROR: ic_cfg_build - function has no IC_LEAVE\n");
+        return NULL;
+    }
+
+    ICCfg *cfg = malloc(sizeof(ICCfg));
+    if (!cfg) return NULL;
+    memset(cfg, 0, sizeof(ICCfg));
+    cfg->enter = enter;
+    cfg->leave = leave;
+
+    /* Partition: blocks start at labels, after terminators, and IC_LEAVE gets its own exit block */
+    I64 capacity = 0;
+    ICBasicBlock *bb = NULL;
+    CIntermediateCode *prev = NULL;
+    for (CIntermediateCode *ic = enter; ic; ic = ic->base.next) {
+        Bool leader = !bb || ic == leave || (prev && ic_is_terminator(prev)) ||
+                      (ic->base.ic_code == IC_LABEL && !(bb->id > 0 && ic_cfg_block_is_labels(bb)));
+        if (leader) {
+            bb = ic_cfg_new_block(cfg, &capacity);
+            if (!bb) {
+                ic_cfg_free(cfg);
+                return NULL;
+            }
+            bb->first = ic;
+        }
+        bb->last = ic;
+        ic->ic_block = bb;
+        prev = ic;
+        if (ic == leave) break;
+    }
+
+    /* Edges: [0] is the fall-through or unconditional target, [1] the taken branch */
+    ICBasicBlock *exit_block = cfg->blocks[cfg->block_count - 1];
+    for (I64 i = 0; i < cfg->block_count; i++) {
+        ICBasicBlock *block = cfg->blocks[i];
+        CIntermediateCode *last = block->last;
+        ICBasicBlock *next = i + 1 < cfg->block_count ? cfg->blocks[i + 1] : NULL;
+        CIntermediateCode *target = ic_branch_target(last);
+        ICBasicBlock *target_block = target ? (ICBasicBlock*)target->ic_block : NULL;
+
+        if (target && !target_block) {
+            printf("WARNING: ic_cfg_build - branch to label L%lld outside function\n", target->ic_data);
+            target_block = NULL;
+        }
+
+        switch (last->base.ic_code) {
+            case IC_JUMP:
+                if (target_block) ic_cfg_add_edge(block, target_block);
+                break;
+            case IC_JUMP_TRUE:
+            case IC_JUMP_FALSE:
+                if (next) ic_cfg_add_edge(block, next);
+                if (target_block) ic_cfg_add_edge(block, target_block);
+                break;
+            case IC_RETURN:
+            case IC_RETURN_VAL:
+                ic_cfg_add_edge(block, exit_block);
+                break;
+            case IC_LEAVE:
+                break;
+            default:
+                if (next) ic_cfg_add_edge(block, next);
+                break;
+        }
+    }
+
+    if (!ic_cfg_compute_rpo(cfg) || !ic_cfg_compute_dominators(cfg) || !ic_cfg_find_loops(cfg)) {
+        ic_cfg_free(cfg);
+        return NULL;
+    }
+
+    return cfg;
+}
+
+void ic_cfg_free(ICCfg *cfg) {
+    if (!cfg) return;
+
+    for (I64 i = 0; i < cfg->block_count; i++) {
+        ICBasicBlock *bb = cfg->blocks[i];
+
+        /* Drop back pointers so stale blocks are never reached through ICs */
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            if (ic->ic_block == bb) ic->ic_block = NULL;
+            if (ic == bb->last) break;
+        }
+        free(bb->preds);
+        free(bb);
+    }
+    for (I64 i = 0; i < cfg->loop_count; i++) {
+        free(cfg->loops[i]->blocks);
+        free(cfg->loops[i]->latches);
+        free(cfg->loops[i]);
+    }
+
+    free(cfg->blocks);
+    free(cfg->rpo);
+    free(cfg->loops);
+    free(cfg);
+}
+
+ICBasicBlock* ic_cfg_block_of(CIntermediateCode *ic) {
+    return ic ? (ICBasicBlock*)ic->ic_block : NULL;
+}
+
+/* Label at the start of bb, inserting one if the block has none */
+CIntermediateCode* ic_cfg_block_label(ICGenContext *ctx, ICBasicBlock *bb) {
+    if (!ctx || !bb) return NULL;
+    if (bb->first->base.ic_code == IC_LABEL) return bb->first;
+
+    CIntermediateCode *label = ic_gen_new_label(ctx);
+    if (!label) return NULL;
+
+    if (bb->first->base.ic_code == IC_ENTER) {
+        /* The entry block keeps IC_ENTER first; the label follows it */
+        ic_insert_after(ctx, bb->first, label);
+        if (bb->last == bb->first) bb->last = label;
+    } else {
+        ic_insert_before(ctx, bb->first, label);
+        bb->first = label;
+    }
+    label->ic_block = bb;
+    return label;
+}
+
+/*
+ * Dominators (Cooper, Harvey and Kennedy's iterative algorithm)
+ */
+
+static ICBasicBlock* ic_cfg_intersect(ICBasicBlock *a, ICBasicBlock *b) {
+    while (a != b) {
+        while (a->rpo_number > b->rpo_number) a = a->idom;
+        while (b->rpo_number > a->rpo_number) b = b->idom;
+    }
+    return a;
+}
+
+Bool ic_cfg_compute_dominators(ICCfg *cfg) {
+    if (!cfg || cfg->rpo_count == 0) return false;
+
+    ICBasicBlock *entry = cfg->rpo[0];
+    for (I64 i = 0; i < cfg->block_count; i++) {
+        cfg->blocks[i]->idom = NULL;
+        cfg->blocks[i]->dom_child = NULL;
+        cfg->blocks[i]->dom_sibling = NULL;
+        cfg->blocks[i]->dom_depth = 0;
+    }
+    entry->idom = entry;
+
+    Bool changed = true;
+    while (changed) {
+        changed = false;
+        for (I64 i = 1; i < cfg->rpo_count; i++) {
+            ICBasicBlock *bb = cfg->rpo[i];
+            ICBasicBlock *new_idom = NULL;
+
+            for (I64 p = 0; p < bb->pred_count; p++) {
+                ICBasicBlock *pred = bb->preds[p];
+                if (pred->rpo_number < 0 || !pred->idom) continue;
+                new_idom = new_idom ? ic_cfg_intersect(pred, new_idom) : pred;
+            }
+            if (new_idom && bb->idom != new_idom) {
+                bb->idom = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    /* Dominator tree links; RPO visits parents before children */
+    entry->idom = NULL;
+    for (I64 i = cfg->rpo_count - 1; i >= 1; i--) {
+        ICBasicBlock *bb = cfg->rpo[i];
+        bb->dom_sibling = bb->idom->dom_child;
+        bb->idom->dom_child = bb;
+    }
+    for (I64 i = 1; i < cfg->rpo_count; i++) {
+        cfg->rpo[i]->dom_depth = cfg->rpo[i]->idom->dom_depth + 1;
+    }
+    return true;
+}
+
+/* True if a dominates b (both reachable) */
+Bool ic_cfg_dominates(ICBasicBlock *a, ICBasicBlock *b) {
+    if (!a || !b || a->rpo_number < 0 || b->rpo_number < 0) return false;
+    while (b && b->dom_depth > a->dom_depth) {
+        b = b->idom;
+    }
+    return b == a;
+}
+
+/*
+ * Loop Nesting Forest
+ * Natural loops of back edges (tail -> dominating header), merged per header
+ */
+
+static Bool ic_loop_add_block(ICLoop *loop, ICBasicBlock *bb, I64 *capacity) {
+    if (loop->block_count >= *capacity) {
+        I64 new_capacity = *capacity ? *capacity * 2 : 8;
+        ICBasicBlock **blocks = realloc(loop->blocks, sizeof(ICBasicBlock*) * new_capacity);
+        if (!blocks) return false;
+        loop->blocks = blocks;
+        *capacity = new_capacity;
+    }
+    loop->blocks[loop->block_count++] = bb;
+    return true;
+}
+
+static int ic_loop_compare_size(const void *a, const void *b) {
+    const ICLoop *la = *(const ICLoop* const*)a;
+    const ICLoop *lb = *(const ICLoop* const*)b;
+    if (la->block_count != lb->block_count) return la->block_count > lb->block_count ? -1 : 1;
+    return la->header->rpo_number < lb->header->rpo_number ? -1 : 1;
+}
+
+Bool ic_cfg_find_loops(ICCfg *cfg) {
+    if (!cfg) return false;
+
+    ICLoop **header_loop = calloc(cfg->block_count, sizeof(ICLoop*));
+    I64 *mark = malloc(sizeof(I64) * cfg->block_count);
+    ICBasicBlock **work = malloc(sizeof(ICBasicBlock*) * (cfg->block_count + 1));
+    if (!header_loop || !mark || !work) {
+        free(header_loop);
+        free(mark);
+        free(work);
+        return false;
+    }
+
+    /* Collect back edges per header */
+    for (I64 i = 0; i < cfg->rpo_count; i++) {
+        ICBasicBlock *bb = cfg->rpo[i];
+        bb->loop = NULL;
+        for (I64 s = 0; s < bb->succ_count; s++) {
+            ICBasicBlock *header = bb->succ[s];
+            if (!ic_cfg_dominates(header, bb)) continue;
+
+            ICLoop *loop = header_loop[header->id];
+            if (!loop) {
+                loop = malloc(sizeof(ICLoop));
+                if (!loop) continue;
+                memset(loop, 0, sizeof(ICLoop));
+                loop->header = header;
+                header_loop[header->id] = loop;
+
+                ICLoop **loops = realloc(cfg->loops, sizeof(ICLoop*) * (cfg->loop_count + 1));
+                if (!loops) {
+                    free(loop);
+                    header_loop[header->id] = NULL;
+                    continue;
+                }
+                cfg->loops = loops;
+                cfg->loops[cfg->loop_count++] = loop;
+            }
+            ICBasicBlock **latches = realloc(loop->latches, sizeof(ICBasicBlock*) * (loop->latch_count + 1));
+            if (!latches) continue;
+            loop->latches = latches;
+            loop->latches[loop->latch_count++] = bb;
+        }
+    }
+
+    /* Body: everything that reaches a latch without passing the header */
+    for (I64 l = 0; l < cfg->loop_count; l++) {
+        ICLoop *loop = cfg->loops[l];
+        I64 capacity = 0, sp = 0;
+
+        for (I64 i = 0; i < cfg->block_count; i++) mark[i] = 0;
+        mark[loop->header->id] = 1;
+        ic_loop_add_block(loop, loop->header, &capacity);
+
+        for (I64 i = 0; i < loop->latch_count; i++) {
+            if (!mark[loop->latches[i]->id]) {
+                mark[loop->latches[i]->id] = 1;
+                work[sp++] = loop->latches[i];
+            }
+        }
+        while (sp > 0) {
+            ICBasicBlock *bb = work[--sp];
+            ic_loop_add_block(loop, bb, &capacity);
+            for (I64 p = 0; p < bb->pred_count; p++) {
+                ICBasicBlock *pred = bb->preds[p];
+                if (pred->rpo_number >= 0 && !mark[pred->id]) {
+                    mark[pred->id] = 1;
+                    work[sp++] = pred;
+                }
+            }
+        }
+    }
+
+    /* Nesting: assign outer loops first so inner loops overwrite bb->loop */
+    if (cfg->loop_count > 1) {
+        qsort(cfg->loops, cfg->loop_count, sizeof(ICLoop*), ic_loop_compare_size);
+    }
+    for (I64 l = 0; l < cfg->loop_count; l++) {
+        ICLoop *loop = cfg->loops[l];
+        loop->parent = loop->header->loop;
+        loop->depth = loop->parent ? loop->parent->depth + 1 : 1;
+        if (loop->parent) {
+            loop->next_sibling = loop->parent->first_child;
+            loop->parent->first_child = loop;
+        }
+        for (I64 i = 0; i < loop->block_count; i++) {
+            loop->blocks[i]->loop = loop;
+        }
+    }
+
+    free(header_loop);
+    free(mark);
+    free(work);
+    return true;
+}
+
+Bool ic_loop_contains(ICLoop *loop, ICBasicBlock *bb) {
+    if (!loop || !bb) return false;
+    for (ICLoop *l = bb->loop; l; l = l->parent) {
+        if (l == loop) return true;
+    }
+    return false;
+}
+
+void ic_cfg_dump(ICCfg *cfg) {
+    if (!cfg) return;
+
+    printf("DEBUG: CFG of %s - %lld blocks, %lld reachable, %lld loops\n",
+           cfg->enter->arg1.ptr_val ? (char*)cfg->enter->arg1.ptr_val : "?",
+           cfg->block_count, cfg->rpo_count, cfg->loop_count);
+    for (I64 i = 0; i < cfg->block_count; i++) {
+        ICBasicBlock *bb = cfg->blocks[i];
+        printf("  B%lld: rpo=%lld idom=B%lld loop_depth=%lld succ=", bb->id, bb->rpo_number,
+               bb->idom ? bb->idom->id : -1, bb->loop ? bb->loop->depth : 0);
+        for (I64 s = 0; s < bb->succ_count; s++) {
+            printf("%sB%lld", s ? "," : "", bb->succ[s]->id);
+        }
+        printf("\n");
+    }
+}
+
+/*
+ * CFG-Based Cleanups (opt_pass_6)
+ */
+
+/* True if control falls from ic straight into label (only labels in between) */
+static Bool ic_falls_through_to(CIntermediateCode *ic, CIntermediateCode *label) {
+    for (CIntermediateCode *next = ic->base.next; next; next = next->base.next) {
+        if (next == label) return true;
+        if (next->base.ic_code != IC_LABEL) return false;
+    }
+    return false;
+}
+
+/*
+ * Final destination of a branch to label: follows empty blocks, blocks
+ * holding only an unconditional jump, and blocks that re-test the branch's
+ * own condition (whose outcome is then already known).
+ */
+static CIntermediateCode* ic_cfg_thread_target(ICGenContext *ctx, CIntermediateCode *branch, CIntermediateCode *label) {
+    for (I64 hops = 0; hops < 32 && label; hops++) {
+        ICBasicBlock *bb = ic_cfg_block_of(label);
+        if (!bb) break;
+
+        CIntermediateCode *ic = label;
+        while (ic != bb->last && ic->base.ic_code == IC_LABEL) {
+            ic = ic->base.next;
+        }
+
+        if (ic->base.ic_code == IC_LABEL) {
+            /* Empty block: continue into its fall-through successor, but not up to
+               IC_LEAVE, which would only get a fresh label of its own every round */
+            if (bb->succ_count != 1 || bb->succ[0] == bb || bb->succ[0]->first->base.ic_code == IC_LEAVE) break;
+            label = ic_cfg_block_label(ctx, bb->succ[0]);
+            continue;
+        }
+        if (ic != bb->last) break;
+
+        if (ic->base.ic_code == IC_JUMP) {
+            CIntermediateCode *next = ic_branch_target(ic);
+            if (!next || next == label) break;
+            label = next;
+            continue;
+        }
+
+        if ((ic->base.ic_code == IC_JUMP_TRUE || ic->base.ic_code == IC_JUMP_FALSE) &&
+            (branch->base.ic_code == IC_JUMP_TRUE || branch->base.ic_code == IC_JUMP_FALSE) &&
+            ic != branch && ic_arg_is_value(&ic->arg1) && ic_arg_equal(&ic->arg1, &branch->arg1)) {
+            /* Arriving here the condition is known to be true for jt, false for jf */
+            Bool cond = branch->base.ic_code == IC_JUMP_TRUE;
+            Bool taken = (ic->base.ic_code == IC_JUMP_TRUE) == cond;
+            if (taken) {
+                label = ic_branch_target(ic);
+            } else {
+                if (bb->succ_count < 1) break;
+                label = ic_cfg_block_label(ctx, bb->succ[0]);
+            }
+            continue;
+        }
+        break;
+    }
+    return label;
+}
+
+/* Peephole rewrites of branches that need no CFG; returns the number applied */
+static I64 ic_simplify_branches(ICGenContext *ctx, CIntermediateCode *enter, CIntermediateCode *leave) {
+    I64 changes = 0;
+    CIntermediateCode *ic = enter;
+
+    while (ic && ic != leave) {
+        CIntermediateCode *next = ic->base.next;
+        U16 code = ic->base.ic_code;
+
+        if (!ic_is_branch(ic)) {
+            ic = next;
+            continue;
+        }
+
+        /* Branch folding: conditions that are known constants */
+        if ((code == IC_JUMP_TRUE || code == IC_JUMP_FALSE) && ic->arg1.type == IC_ARG_CONST) {
+            Bool taken = (ic->arg1.i64_val != 0) == (code == IC_JUMP_TRUE);
+            if (taken) {
+                ic->base.ic_code = IC_JUMP;
+                ic->arg1 = ic->arg2;
+                ic->arg2 = ic_arg_const(0);
+            } else {
+                ic_remove(ctx, ic);
+            }
+            changes++;
+            ic = next;
+            continue;
+        }
+
+        /* Jumps to the very next instruction */
+        CIntermediateCode *target = ic_branch_target(ic);
+        if (target && ic_falls_through_to(ic, target)) {
+            ic_remove(ctx, ic);
+            changes++;
+            ic = next;
+            continue;
+        }
+
+        /* jf c, L1; jmp L2; L1:  ->  jt c, L2 */
+        if ((code == IC_JUMP_TRUE || code == IC_JUMP_FALSE) && next && next != leave &&
+            next->base.ic_code == IC_JUMP && ic_falls_through_to(next, target)) {
+            ic->base.ic_code = code == IC_JUMP_TRUE ? IC_JUMP_FALSE : IC_JUMP_TRUE;
+            ic_set_branch_target(ic, ic_branch_target(next));
+            ic_remove(ctx, next);
+            changes++;
+            continue;
+        }
+
+        ic = next;
+    }
+    return changes;
+}
+
+/* Remove labels that no branch refers to; returns the number removed */
+static I64 ic_remove_unused_labels(ICGenContext *ctx, CIntermediateCode *enter, CIntermediateCode *leave) {
+    I64 removed = 0;
+
+    for (CIntermediateCode *ic = enter; ic && ic != leave; ic = ic->base.next) {
+        if (ic->base.ic_code == IC_LABEL) ic->ic_flags &= ~ICF_LABEL_USED;
+    }
+    for (CIntermediateCode *ic = ctx->ic_head; ic; ic = ic->base.next) {
+        CIntermediateCode *target = ic_branch_target(ic);
+        if (target) target->ic_flags |= ICF_LABEL_USED;
+    }
+
+    CIntermediateCode *ic = enter;
+    while (ic && ic != leave) {
+        CIntermediateCode *next = ic->base.next;
+        if (ic->base.ic_code == IC_LABEL && !(ic->ic_flags & ICF_LABEL_USED)) {
+            ic_remove(ctx, ic);
+            removed++;
+        }
+        ic = next;
+    }
+    return removed;
+}
+
+/*
+ * Branch optimization: constant branch folding, jump-to-next removal,
+ * inversion of branches over jumps, jump threading through empty and
+ * jump-only blocks, and removal of labels left without references.
+ */
+Bool opt_branch_optimization(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    I64 folded = 0, threaded = 0, labels = 0;
+
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        ICCfg *cfg = ic_cfg_build(ctx, enter);
+        if (!cfg) continue;
+        CIntermediateCode *leave = cfg->leave;
+
+        /* Threading only retargets branches, so the CFG stays valid throughout */
+        for (CIntermediateCode *ic = enter; ic && ic != leave; ic = ic->base.next) {
+            if (!ic_is_branch(ic)) continue;
+            CIntermediateCode *target = ic_branch_target(ic);
+            CIntermediateCode *final = ic_cfg_thread_target(ctx, ic, target);
+            if (final && final != target) {
+                ic_set_branch_target(ic, final);
+                threaded++;
+            }
+        }
+        ic_cfg_free(cfg);
+
+        folded += ic_simplify_branches(ctx, enter, leave);
+        labels += ic_remove_unused_labels(ctx, enter, leave);
+    }
+
+    ctx->opt_changes += folded + threaded + labels;
+    printf("DEBUG: opt_branch_optimization - %lld branches folded, %lld threaded, %lld labels removed\n",
+           folded, threaded, labels);
+    return true;
+}
+
+/* Delete every block that cannot be reached from the function entry */
+Bool opt_unreachable_code_elimination(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    I64 blocks = 0, removed = 0;
+
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        ICCfg *cfg = ic_cfg_build(ctx, enter);
+        if (!cfg) continue;
+
+        for (I64 i = 0; i < cfg->block_count; i++) {
+            ICBasicBlock *bb = cfg->blocks[i];
+            if (bb->rpo_number >= 0) continue;
+
+            CIntermediateCode *ic = bb->first;
+            CIntermediateCode *stop = bb->last->base.next;
+            Bool any = false;
+            while (ic && ic != stop) {
+                CIntermediateCode *next = ic->base.next;
+                /* Function boundaries survive even when the exit is unreachable */
+                if (ic->base.ic_code != IC_ENTER && ic->base.ic_code != IC_LEAVE) {
+                    ic_remove(ctx, ic);
+                    removed++;
+                    any = true;
+                }
+                ic = next;
+            }
+            bb->first = bb->last = NULL;
+            if (any) blocks++;
+        }
+        ic_cfg_free(cfg);
+    }
+
+    ctx->opt_changes += removed;
+    printf("DEBUG: opt_unreachable_code_elimination - removed %lld blocks (%lld instructions)\n", blocks, removed);
+    return true;
+}
@@ -0,0 +1,277 @@
+/*
+ * Escape Analysis
+ * Heap to stack promotion of MAlloc blocks whose pointer never leaves
+ * the function that allocates them. The top-level statements form the
+ * implicit main function, whose frame lasts as long as the program, so a
+ * block allocated there outside a loop may stay in a top-level variable
+ * or hold other pointers; a variable some function reads is global, and
+ * storing the block there still counts as an escape.
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define ESCAPE_MAX_ALLOC     256   /* Largest block moved to the stack */
+#define ESCAPE_FRAME_BUDGET  1024  /* Stack bytes one function may gain */
+
+/*
+ * Runtime functions that read or fill a buffer argument but never keep
+ * the pointer, so passing an allocation to them is not an escape
+ */
+static const char *escape_no_capture[] = {
+    "Print", "PutChars", "GetString", "StrNew", "StrPrint", "FileWrite"
+};
+
+#define ESCAPE_NO_CAPTURE_COUNT (I64)(sizeof(escape_no_capture) / sizeof(escape_no_capture[0]))
+
+/*
+ * One candidate allocation; the values that may hold a pointer into it
+ * are tracked by index: temps 0..temp_count-1, variable v at temp_count+v
+ */
+typedef struct {
+    ICGenContext *ctx;
+    CIntermediateCode *enter;
+    CIntermediateCode *leave;
+    CIntermediateCode *alloc;        /* The IC_MALLOC */
+    Bool *derived;                   /* Values derived from the allocation */
+    I64 value_count;
+} ICEscape;
+
+static I64 ic_escape_index(ICEscape *es, CICArg *arg) {
+    if (!arg) return -1;
+    if (arg->type == IC_ARG_TEMP && arg->i64_val >= 0 && arg->i64_val < es->ctx->temp_count) {
+        return arg->i64_val;
+    }
+    if (arg->type == IC_ARG_VAR && arg->i64_val >= 0 && arg->i64_val < es->ctx->var_count) {
+        return es->ctx->temp_count + arg->i64_val;
+    }
+    return -1;
+}
+
+static Bool ic_escape_is_derived(ICEscape *es, CICArg *arg) {
+    I64 value = ic_escape_index(es, arg);
+    return value >= 0 && es->derived[value];
+}
+
+/* Callee of the push, which is the next call of the function */
+static Bool ic_escape_push_is_safe(ICEscape *es, CIntermediateCode *push) {
+    for (CIntermediateCode *ic = push->base.next; ic && ic != es->leave; ic = ic->base.next) {
+        if (ic->base.ic_code != IC_CALL) continue;
+        if (ic->arg1.type != IC_ARG_SYMBOL || !ic->arg1.ptr_val) return false;
+        for (I64 f = 0; f < ESCAPE_NO_CAPTURE_COUNT; f++) {
+            if (strcmp((char*)ic->arg1.ptr_val, escape_no_capture[f]) == 0) return true;
+        }
+        return false;
+    }
+    return false;
+}
+
+/* Operations that pass a pointer on to their result */
+static Bool ic_escape_is_copy(U16 code) {
+    return code == IC_ASSIGN || code == IC_ADD || code == IC_SUB || code == IC_CAST || code == IC_PHI;
+}
+
+/* A variable that something besides this function's code can see */
+static Bool ic_escape_var_is_visible(ICEscape *es, CICArg *arg) {
+    if (arg->type != IC_ARG_VAR) return false;
+    ICVar *v = &es->ctx->vars[arg->i64_val];
+    return v->is_global || v->address_taken || v->is_volatile || v->is_array;
+}
+
+/* Does ic read a derived value in a way that lets the pointer out */
+static Bool ic_escape_use_escapes(ICEscape *es, CIntermediateCode *ic) {
+    U16 code = ic->base.ic_code;
+
+    if (code == IC_PHI) {
+        CICArg *ops = (CICArg*)ic->arg1.ptr_val;
+        for (I64 p = 0; p < ic->ic_data; p++) {
+            if (ic_escape_is_derived(es, &ops[p])) return ic_escape_var_is_visible(es, &ic->res);
+        }
+        return false;
+    }
+    if (code == IC_ASM_INLINE) return true;
+
+    CICArg *uses[2];
+    I64 use_count = ic_get_uses(ic, uses);
+    for (I64 u = 0; u < use_count; u++) {
+        if (!ic_escape_is_derived(es, uses[u])) continue;
+        switch (code) {
+            case IC_LOAD:
+            case IC_FREE:
+            case IC_EQU: case IC_NOT_EQU: case IC_LESS: case IC_GREATER:
+            case IC_LESS_EQU: case IC_GREATER_EQU:
+            case IC_JUMP_TRUE: case IC_JUMP_FALSE:
+                break;
+            case IC_STORE:
+                /* Writing through the pointer is fine, writing the pointer itself is not */
+                if (uses[u] == &ic->arg2) return true;
+                break;
+            case IC_PUSH:
+                if (!ic_escape_push_is_safe(es, ic)) return true;
+                break;
+            default:
+                if (!ic_escape_is_copy(code) || ic_escape_var_is_visible(es, &ic->res)) return true;
+                break;
+        }
+    }
+    return false;
+}
+
+/* Does ic make its result point into the allocation */
+static Bool ic_escape_defines_derived(ICEscape *es, CIntermediateCode *ic) {
+    if (ic == es->alloc) return true;
+    if (!ic_escape_is_copy(ic->base.ic_code)) return false;
+
+    if (ic->base.ic_code == IC_PHI) {
+        CICArg *ops = (CICArg*)ic->arg1.ptr_val;
+        for (I64 p = 0; p < ic->ic_data; p++) {
+            if (ic_escape_is_derived(es, &ops[p])) return true;
+        }
+        return false;
+    }
+    return ic_escape_is_derived(es, &ic->arg1) || ic_escape_is_derived(es, &ic->arg2);
+}
+
+/*
+ * Follow the pointer through copies to a fixed point, then check every use
+ * of it. A derived value must also never be written with anything else, so
+ * that a Free of it is always a Free of this allocation.
+ */
+static Bool ic_escape_is_local(ICEscape *es) {
+    Bool changed = true;
+    while (changed) {
+        changed = false;
+        for (CIntermediateCode *ic = es->enter; ic && ic != es->leave; ic = ic->base.next) {
+            I64 value = ic_escape_index(es, ic_get_def(ic));
+            if (value >= 0 && !es->derived[value] && ic_escape_defines_derived(es, ic)) {
+                es->derived[value] = true;
+                changed = true;
+            }
+        }
+    }
+
+    for (CIntermediateCode *ic = es->enter; ic && ic != es->leave; ic = ic->base.next) {
+        if (ic_escape_use_escapes(es, ic)) return false;
+        if (ic->base.ic_code == IC_RETURN_VAL && ic_escape_is_derived(es, &ic->arg1)) return false;
+
+        CICArg *def = ic_get_def(ic);
+        if (!ic_escape_is_derived(es, def)) continue;
+        if (ic_escape_var_is_visible(es, def)) return false;
+        if (ic == es->alloc) continue;
+
+        /* Mixing with other pointers, including through a phi, is not followed */
+        if (ic->base.ic_code == IC_PHI) {
+            CICArg *ops = (CICArg*)ic->arg1.ptr_val;
+            for (I64 p = 0; p < ic->ic_data; p++) {
+                if (!ic_escape_is_derived(es, &ops[p])) return false;
+            }
+        } else if (!ic_escape_is_copy(ic->base.ic_code) ||
+                   (ic->base.ic_code == IC_SUB && ic_escape_is_derived(es, &ic->arg2)) ||
+                   (!ic_escape_is_derived(es, &ic->arg1) && ic->base.ic_code != IC_ADD)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Replace the allocation with a frame slot and drop its Free calls */
+static I64 ic_escape_promote(ICEscape *es, I64 size, I64 func_index) {
+    ICGenContext *ctx = es->ctx;
+    I64 var = ic_var_add(ctx, NULL, size);
+    if (var < 0) return -1;
+    ctx->vars[var].func_index = func_index;
+    ctx->vars[var].is_array = true;
+
+    es->alloc->base.ic_code = IC_ADDR;
+    es->alloc->arg1 = ic_arg_var(var);
+    es->alloc->arg2 = ic_arg_const(0);
+
+    I64 frees = 0;
+    CIntermediateCode *ic = es->enter;
+    while (ic && ic != es->leave) {
+        CIntermediateCode *next = ic->base.next;
+        if (ic->base.ic_code == IC_FREE && ic_escape_is_derived(es, &ic->arg1)) {
+            ic_remove(ctx, ic);
+            frees++;
+        }
+        ic = next;
+    }
+    return frees;
+}
+
+static I64 ic_escape_function(ICGenContext *ctx, CIntermediateCode *enter, I64 func_index) {
+    ICCfg *cfg = ic_cfg_build(ctx, enter);
+    if (!cfg) return 0;
+    CIntermediateCode *leave = cfg->leave;
+
+    I64 alloc_count = 0;
+    for (CIntermediateCode *ic = enter; ic && ic != leave; ic = ic->base.next) {
+        if (ic->base.ic_code == IC_MALLOC) alloc_count++;
+    }
+    CIntermediateCode **allocs = alloc_count ? malloc(sizeof(CIntermediateCode*) * alloc_count) : NULL;
+
+    /* Constant sizes outside loops: each iteration of a loop needs a block of its own */
+    I64 candidate_count = 0;
+    for (CIntermediateCode *ic = enter; allocs && ic && ic != leave; ic = ic->base.next) {
+        if (ic->base.ic_code != IC_MALLOC || ic->arg1.type != IC_ARG_CONST) continue;
+        ICBasicBlock *bb = ic_cfg_block_of(ic);
+        if (!bb || bb->rpo_number < 0 || bb->loop) continue;
+        allocs[candidate_count++] = ic;
+    }
+    /* Promotion removes Free calls, so the blocks are not used past this point */
+    ic_cfg_free(cfg);
+
+    I64 promoted = 0;
+    I64 budget = ESCAPE_FRAME_BUDGET;
+    for (I64 c = 0; c < candidate_count; c++) {
+        CIntermediateCode *ic = allocs[c];
+        I64 bytes = ic->arg1.i64_val;
+        I64 size = (bytes + 7) & ~(I64)7;
+        if (bytes <= 0 || size > ESCAPE_MAX_ALLOC || size > budget) continue;
+
+        ICEscape es;
+        memset(&es, 0, sizeof(es));
+        es.ctx = ctx;
+        es.enter = enter;
+        es.leave = leave;
+        es.alloc = ic;
+        es.value_count = ctx->temp_count + ctx->var_count;
+        es.derived = calloc(es.value_count + 1, sizeof(Bool));
+        if (!es.derived) break;
+
+        I64 value = ic_escape_index(&es, ic_get_def(ic));
+        if (value >= 0) {
+            es.derived[value] = true;
+            if (ic_escape_is_local(&es)) {
+                I64 frees = ic_escape_promote(&es, size, func_index);
+                if (frees >= 0) {
+                    printf("DEBUG: opt_escape_analysis - MAlloc(%lld) moved to the stack, %lld Free calls removed\n",
+                           bytes, frees);
+                    budget -= size;
+                    promoted++;
+                }
+            }
+        }
+        free(es.derived);
+    }
+
+    free(allocs);
+    return promoted;
+}
+
+Bool opt_escape_analysis(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    I64 promoted = 0;
+    I64 func_index = 0;
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next), func_index++) {
+        promoted += ic_escape_function(ctx, enter, func_index);
+    }
+
+    ctx->opt_changes += promoted;
+    printf("DEBUG: opt_escape_analysis - completed, %lld allocations promoted to the stack\n", promoted);
+    return true;
+}
@@ -0,0 +1,317 @@
+/*
+ * Value Numbering
+ * Hash-based value numbering within blocks, scoped over the dominator
+ * tree, replacing recomputed arithmetic, loads and addresses with copies
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define GVN_BUCKETS 256
+
+/* Key kinds that are not opcodes */
+#define GVN_KEY_CONST   -1
+#define GVN_KEY_ADDR    -2
+
+typedef struct ICGvnEntry {
+    I64 op, a, b, extra;             /* Expression key */
+    I64 vn;                          /* Value number of the expression */
+    CICArg holder;                   /* Operand currently holding it */
+    struct ICGvnEntry *next;         /* Next (older) entry in the bucket */
+} ICGvnEntry;
+
+typedef struct {
+    ICGenContext *ctx;
+    ICLiveness *lv;                  /* Only used for value indices */
+    I64 *vn_of;                      /* Current value number per value, 0 = none yet */
+    I64 *def_count;                  /* Definitions per value in the function */
+    I64 next_vn;
+    I64 mem_version;                 /* Changes whenever memory may have been written */
+    Bool has_memory_writes;          /* Function contains stores, calls or inline assembly */
+    ICGvnEntry *buckets[GVN_BUCKETS];
+    ICGvnEntry **stack;              /* Entries in insertion order for scoped removal */
+    I64 stack_count;
+    I64 stack_capacity;
+    ICGvnEntry *consts[GVN_BUCKETS]; /* Constant value numbers, function-wide */
+    I64 replaced;
+} ICGvn;
+
+static U64 ic_gvn_hash(I64 op, I64 a, I64 b, I64 extra) {
+    U64 h = (U64)op * 0x9E3779B97F4A7C15ULL;
+    h ^= (U64)a + 0x7F4A7C159E3779B9ULL + (h << 6) + (h >> 2);
+    h ^= (U64)b + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+    h ^= (U64)extra + (h << 6) + (h >> 2);
+    return h % GVN_BUCKETS;
+}
+
+static ICGvnEntry* ic_gvn_find(ICGvnEntry **buckets, I64 op, I64 a, I64 b, I64 extra) {
+    for (ICGvnEntry *e = buckets[ic_gvn_hash(op, a, b, extra)]; e; e = e->next) {
+        if (e->op == op && e->a == a && e->b == b && e->extra == extra) return e;
+    }
+    return NULL;
+}
+
+static ICGvnEntry* ic_gvn_new_entry(ICGvnEntry **buckets, I64 op, I64 a, I64 b, I64 extra, I64 vn, CICArg *holder) {
+    ICGvnEntry *e = malloc(sizeof(ICGvnEntry));
+    if (!e) return NULL;
+    e->op = op;
+    e->a = a;
+    e->b = b;
+    e->extra = extra;
+    e->vn = vn;
+    e->holder = *holder;
+    U64 h = ic_gvn_hash(op, a, b, extra);
+    e->next = buckets[h];
+    buckets[h] = e;
+    return e;
+}
+
+/* Scoped entry: removed again when the dominator subtree is left */
+static void ic_gvn_push(ICGvn *gvn, I64 op, I64 a, I64 b, I64 extra, I64 vn, CICArg *holder) {
+    if (gvn->stack_count >= gvn->stack_capacity) {
+        I64 new_capacity = gvn->stack_capacity ? gvn->stack_capacity * 2 : 64;
+        ICGvnEntry **stack = realloc(gvn->stack, sizeof(ICGvnEntry*) * new_capacity);
+        if (!stack) return;
+        gvn->stack = stack;
+        gvn->stack_capacity = new_capacity;
+    }
+    ICGvnEntry *e = ic_gvn_new_entry(gvn->buckets, op, a, b, extra, vn, holder);
+    if (e) gvn->stack[gvn->stack_count++] = e;
+}
+
+/* Entries are removed in reverse order, so each is the head of its bucket */
+static void ic_gvn_pop_to(ICGvn *gvn, I64 mark) {
+    while (gvn->stack_count > mark) {
+        ICGvnEntry *e = gvn->stack[--gvn->stack_count];
+        gvn->buckets[ic_gvn_hash(e->op, e->a, e->b, e->extra)] = e->next;
+        free(e);
+    }
+}
+
+static Bool ic_gvn_is_stable(ICGvn *gvn, I64 value) {
+    /* Single-definition temps keep their value everywhere their definition dominates */
+    return value < gvn->lv->temp_count && gvn->def_count[value] == 1;
+}
+
+/* Value number of an operand, -1 if it is not a value */
+static I64 ic_gvn_value(ICGvn *gvn, CICArg *arg) {
+    if (arg->type == IC_ARG_CONST) {
+        ICGvnEntry *e = ic_gvn_find(gvn->consts, GVN_KEY_CONST, arg->i64_val, 0, 0);
+        if (!e) e = ic_gvn_new_entry(gvn->consts, GVN_KEY_CONST, arg->i64_val, 0, 0, ++gvn->next_vn, arg);
+        return e ? e->vn : -1;
+    }
+
+    I64 value = ic_liveness_index(gvn->lv, arg);
+    if (value < 0) return -1;
+
+    /* Volatile variables may change between any two reads */
+    if (arg->type == IC_ARG_VAR && gvn->ctx->vars[arg->i64_val].is_volatile) return ++gvn->next_vn;
+
+    if (gvn->vn_of[value] == 0) gvn->vn_of[value] = ++gvn->next_vn;
+    return gvn->vn_of[value];
+}
+
+/* A holder is usable while it still holds the value number recorded for it */
+static Bool ic_gvn_holds(ICGvn *gvn, ICGvnEntry *e) {
+    if (e->holder.type == IC_ARG_CONST) return true;
+    I64 value = ic_liveness_index(gvn->lv, &e->holder);
+    return value >= 0 && gvn->vn_of[value] == e->vn;
+}
+
+/* Forget values that memory writes may have changed */
+static void ic_gvn_kill_memory(ICGvn *gvn, Bool all_vars) {
+    ICGenContext *ctx = gvn->ctx;
+    gvn->mem_version = ++gvn->next_vn;
+    for (I64 v = 0; v < ctx->var_count; v++) {
+        ICVar *var = &ctx->vars[v];
+        if (all_vars || var->is_global || var->address_taken || var->is_array) {
+            gvn->vn_of[gvn->lv->temp_count + v] = 0;
+        }
+    }
+}
+
+static Bool ic_gvn_is_commutative(U16 code) {
+    switch (code) {
+        case IC_ADD: case IC_MUL: case IC_AND: case IC_OR: case IC_XOR:
+        case IC_EQU: case IC_NOT_EQU:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static Bool ic_gvn_is_candidate(CIntermediateCode *ic) {
+    switch (ic->base.ic_code) {
+        case IC_ASSIGN: case IC_PARAM: case IC_PHI: case IC_NOP:
+            return false;
+        default:
+            return ic_get_def(ic) && !ic_has_side_effects(ic);
+    }
+}
+
+static void ic_gvn_block(ICGvn *gvn, ICBasicBlock *bb, I64 *multi, I64 multi_count) {
+    /* Values with several definitions only carry numbers within one block */
+    for (I64 m = 0; m < multi_count; m++) {
+        gvn->vn_of[multi[m]] = 0;
+    }
+    if (gvn->has_memory_writes) gvn->mem_version = ++gvn->next_vn;
+
+    I64 mark = gvn->stack_count;
+
+    for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+        U16 code = ic->base.ic_code;
+        CICArg *def = ic_get_def(ic);
+        I64 def_value = ic_liveness_index(gvn->lv, def);
+
+        if (code == IC_ASSIGN && def_value >= 0) {
+            /* Copies share the value number of their source */
+            I64 vn = ic_gvn_value(gvn, &ic->arg1);
+            gvn->vn_of[def_value] = vn > 0 ? vn : ++gvn->next_vn;
+        } else if (ic_gvn_is_candidate(ic) && def_value >= 0) {
+            I64 op = code, a, b = 0, extra = 0;
+            Bool ok = true;
+
+            if (code == IC_ADDR) {
+                /* The address of a variable does not depend on its value */
+                op = GVN_KEY_ADDR;
+                a = ic->arg1.i64_val;
+                b = ic->arg1.type;
+            } else {
+                a = ic_gvn_value(gvn, &ic->arg1);
+                ok = a >= 0;
+                if (code != IC_LOAD && ic_fold_is_binary(code)) {
+                    b = ic_gvn_value(gvn, &ic->arg2);
+                    ok = ok && b >= 0;
+                }
+                if (ic_gvn_is_commutative(code) && a > b) {
+                    I64 t = a; a = b; b = t;
+                }
+                if (code == IC_LOAD) {
+                    b = gvn->mem_version;
+                    extra = ic->memory_operand_size;
+                }
+            }
+
+            if (ok) {
+                ICGvnEntry *e = ic_gvn_find(gvn->buckets, op, a, b, extra);
+                if (e && ic_gvn_holds(gvn, e)) {
+                    ic->base.ic_code = IC_ASSIGN;
+                    ic->arg1 = e->holder;
+                    ic->arg2 = ic_arg_const(0);
+                    gvn->vn_of[def_value] = e->vn;
+                    gvn->replaced++;
+                } else {
+                    I64 vn = ++gvn->next_vn;
+                    gvn->vn_of[def_value] = vn;
+                    ic_gvn_push(gvn, op, a, b, extra, vn, def);
+                }
+            } else {
+                gvn->vn_of[def_value] = ++gvn->next_vn;
+            }
+        } else if (def_value >= 0) {
+            gvn->vn_of[def_value] = ++gvn->next_vn;
+        }
+
+        switch (code) {
+            case IC_STORE: {
+                ic_gvn_kill_memory(gvn, false);
+                /* A load right after the store reads back the stored value */
+                I64 addr = ic_gvn_value(gvn, &ic->arg1);
+                I64 value = ic_gvn_value(gvn, &ic->arg2);
+                if (addr >= 0 && value >= 0) {
+                    ic_gvn_push(gvn, IC_LOAD, addr, gvn->mem_version, ic->memory_operand_size, value, &ic->arg2);
+                }
+                break;
+            }
+            case IC_CALL:
+            case IC_MALLOC:
+            case IC_FREE:
+            case IC_VEC_STORE:
+                ic_gvn_kill_memory(gvn, false);
+                break;
+            case IC_ASM_INLINE:
+                ic_gvn_kill_memory(gvn, true);
+                break;
+            default:
+                break;
+        }
+
+        if (ic == bb->last) break;
+    }
+
+    for (ICBasicBlock *child = bb->dom_child; child; child = child->dom_sibling) {
+        ic_gvn_block(gvn, child, multi, multi_count);
+    }
+
+    ic_gvn_pop_to(gvn, mark);
+}
+
+/*
+ * Replace recomputations of an available value with a copy of it. An
+ * expression over single-definition temps stays available in every block
+ * its definition dominates; anything involving variables, other
+ * multiply-defined values or memory only within its own block.
+ */
+Bool opt_value_numbering(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    I64 replaced = 0;
+
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        ICCfg *cfg = ic_cfg_build(ctx, enter);
+        if (!cfg) continue;
+
+        ICGvn gvn;
+        memset(&gvn, 0, sizeof(gvn));
+        gvn.ctx = ctx;
+        gvn.lv = ic_liveness_compute(ctx, cfg);
+        I64 value_count = ctx->temp_count + ctx->var_count;
+        gvn.vn_of = calloc(value_count + 1, sizeof(I64));
+        gvn.def_count = calloc(value_count + 1, sizeof(I64));
+        I64 *multi = malloc(sizeof(I64) * (value_count + 1));
+
+        if (gvn.lv && gvn.vn_of && gvn.def_count && multi && cfg->rpo_count > 0) {
+            for (CIntermediateCode *ic = enter; ic; ic = ic->base.next) {
+                I64 value = ic_liveness_index(gvn.lv, ic_get_def(ic));
+                if (value >= 0) gvn.def_count[value]++;
+                U16 code = ic->base.ic_code;
+                if (code == IC_STORE || code == IC_VEC_STORE || code == IC_CALL || code == IC_ASM_INLINE ||
+                    code == IC_MALLOC || code == IC_FREE) {
+                    gvn.has_memory_writes = true;
+                }
+                if (ic == cfg->leave) break;
+            }
+
+            I64 multi_count = 0;
+            for (I64 v = 0; v < value_count; v++) {
+                if (!ic_gvn_is_stable(&gvn, v)) multi[multi_count++] = v;
+            }
+
+            ic_gvn_block(&gvn, cfg->rpo[0], multi, multi_count);
+            replaced += gvn.replaced;
+        }
+
+        ic_gvn_pop_to(&gvn, 0);
+        for (I64 b = 0; b < GVN_BUCKETS; b++) {
+            ICGvnEntry *e = gvn.consts[b];
+            while (e) {
+                ICGvnEntry *next = e->next;
+                free(e);
+                e = next;
+            }
+        }
+        free(gvn.stack);
+        free(gvn.vn_of);
+        free(gvn.def_count);
+        free(multi);
+        ic_liveness_free(gvn.lv);
+        ic_cfg_free(cfg);
+    }
+
+    ctx->opt_changes += replaced;
+    printf("DEBUG: opt_value_numbering - %lld redundant computations replaced\n", replaced);
+    return true;
+}
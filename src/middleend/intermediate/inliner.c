@@ -0,0 +1,419 @@
+/*
+ * Function Inlining
+ * Replaces calls to small functions with a copy of their body, using
+ * ic_calculate_cost and the loop depth of the call site, or its execution
+ * count when compiling with --profile-use
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#define INLINE_ALWAYS_COST     8     /* Leaf functions this small are always inlined */
+#define INLINE_BASE_COST       16    /* Callee cost limit outside loops */
+#define INLINE_MAX_COST        64    /* Callee cost limit in the hottest loops */
+#define INLINE_CALLER_GROWTH   64    /* Growth every caller may take, beyond doubling */
+#define INLINE_MAX_ROUNDS      4
+#define INLINE_HOT_FRACTION    16    /* Profiled sites within 1/16 of the hottest get INLINE_MAX_COST */
+
+typedef struct {
+    CIntermediateCode *enter;
+    CIntermediateCode *leave;
+    U8 *name;
+    I64 param_count;
+    I64 cost;                        /* Sum of ic_calculate_cost over the body */
+    I64 original_cost;               /* Cost before this pass touched it */
+    I64 growth;                      /* Cost added to it by inlining */
+    Bool is_leaf;                    /* Makes no calls */
+    Bool inlinable;                  /* Body can be copied into a caller */
+    Bool recursive;                  /* On a cycle of the call graph */
+} ICInlineFunc;
+
+typedef struct {
+    CIntermediateCode *call;
+    I64 caller;
+    I64 callee;
+    I64 depth;                       /* Loop nesting depth of the call site */
+    I64 count;                       /* Profiled executions of the call, -1 without a profile */
+} ICInlineSite;
+
+static I64 ic_inline_find(ICInlineFunc *funcs, I64 count, CICArg *sym) {
+    if (sym->type != IC_ARG_SYMBOL || !sym->ptr_val) return -1;
+    for (I64 f = 0; f < count; f++) {
+        if (funcs[f].name && strcmp((char*)funcs[f].name, (char*)sym->ptr_val) == 0) return f;
+    }
+    return -1;
+}
+
+/* Measure each function and decide whether its body can be copied */
+static void ic_inline_scan(ICGenContext *ctx, ICInlineFunc *func) {
+    func->cost = 0;
+    func->is_leaf = true;
+    func->inlinable = func->name && strcmp((char*)func->name, "main") != 0;
+
+    for (CIntermediateCode *ic = func->enter->base.next; ic && ic != func->leave; ic = ic->base.next) {
+        U16 code = ic->base.ic_code;
+        if (code != IC_PARAM && code != IC_LABEL) func->cost += ic_calculate_cost(ic);
+        if (code == IC_CALL || code == IC_MALLOC || code == IC_FREE) func->is_leaf = false;
+        /* Inline assembly refers to the callee's own frame by name */
+        if (code == IC_ASM_INLINE || code == IC_PHI) func->inlinable = false;
+
+        CICArg *args[3] = { &ic->arg1, &ic->arg2, &ic->res };
+        for (int a = 0; a < 3; a++) {
+            if (args[a]->type == IC_ARG_OWNED) func->inlinable = false;
+            if (args[a]->type == IC_ARG_VAR && args[a]->i64_val >= 0 && args[a]->i64_val < ctx->var_count &&
+                ctx->vars[args[a]->i64_val].is_volatile) {
+                func->inlinable = false;
+            }
+        }
+    }
+}
+
+/* Mark functions that can reach themselves through calls */
+static Bool ic_inline_find_recursion(ICInlineFunc *funcs, I64 count) {
+    Bool *reach = calloc(count * count + 1, sizeof(Bool));
+    if (!reach) return false;
+
+    for (I64 f = 0; f < count; f++) {
+        for (CIntermediateCode *ic = funcs[f].enter->base.next; ic && ic != funcs[f].leave; ic = ic->base.next) {
+            if (ic->base.ic_code != IC_CALL) continue;
+            I64 callee = ic_inline_find(funcs, count, &ic->arg1);
+            if (callee >= 0) reach[f * count + callee] = true;
+        }
+    }
+    /* Transitive closure */
+    for (I64 k = 0; k < count; k++) {
+        for (I64 i = 0; i < count; i++) {
+            if (!reach[i * count + k]) continue;
+            for (I64 j = 0; j < count; j++) {
+                if (reach[k * count + j]) reach[i * count + j] = true;
+            }
+        }
+    }
+    for (I64 f = 0; f < count; f++) {
+        funcs[f].recursive = reach[f * count + f];
+    }
+    free(reach);
+    return true;
+}
+
+static I64 ic_inline_cost_limit(I64 depth) {
+    I64 limit = INLINE_BASE_COST;
+    for (I64 d = 0; d < depth && limit < INLINE_MAX_COST; d++) limit *= 2;
+    return limit > INLINE_MAX_COST ? INLINE_MAX_COST : limit;
+}
+
+/* Measured heat replaces the loop depth guess: hot sites get the most room, unexecuted ones none */
+static I64 ic_inline_site_limit(ICInlineSite *site, I64 hottest) {
+    if (site->count < 0) return ic_inline_cost_limit(site->depth);
+    if (site->count == 0) return 0;
+    if (site->count * INLINE_HOT_FRACTION >= hottest) return INLINE_MAX_COST;
+    return ic_inline_cost_limit(site->depth);
+}
+
+/* Order of the budget: executions when both sites were profiled, loop depth otherwise */
+static Bool ic_inline_hotter(ICInlineSite *a, ICInlineSite *b) {
+    if (a->count >= 0 && b->count >= 0) return a->count > b->count;
+    return a->depth > b->depth;
+}
+
+/* The pushes of a call's arguments, first argument first; false if they are not all right before it */
+static Bool ic_inline_pushes(CIntermediateCode *call, CIntermediateCode **pushes) {
+    CIntermediateCode *push = call->base.last;
+    for (I64 a = call->ic_data - 1; a >= 0; a--, push = push->base.last) {
+        if (!push || push->base.ic_code != IC_PUSH) return false;
+        pushes[a] = push;
+    }
+    return true;
+}
+
+/*
+ * Body Copy
+ * Parameters become copies of the pushed arguments, the callee's locals,
+ * temps and labels get fresh ones, and returns jump to a label after the
+ * copy with the value moved into the call's result.
+ */
+typedef struct {
+    ICGenContext *ctx;
+    I64 *var_map;                    /* Callee variable -> caller copy, -1 until needed */
+    I64 var_limit;
+    CICArg *temp_map;
+    Bool *temp_mapped;
+    I64 temp_limit;
+    CIntermediateCode **label_old;
+    CIntermediateCode **label_new;
+    I64 label_count;
+} ICInlineMap;
+
+static void ic_inline_map_arg(ICInlineMap *map, CICArg *arg) {
+    ICGenContext *ctx = map->ctx;
+    if (arg->type == IC_ARG_TEMP && arg->i64_val >= 0 && arg->i64_val < map->temp_limit) {
+        if (!map->temp_mapped[arg->i64_val]) {
+            map->temp_map[arg->i64_val] = ic_arg_temp(ctx);
+            map->temp_mapped[arg->i64_val] = true;
+        }
+        *arg = map->temp_map[arg->i64_val];
+    } else if (arg->type == IC_ARG_VAR && arg->i64_val >= 0 && arg->i64_val < map->var_limit) {
+        I64 var = arg->i64_val;
+        if (ctx->vars[var].is_global) return;
+        if (map->var_map[var] < 0) {
+            I64 copy = ic_var_add(ctx, ctx->vars[var].name, ctx->vars[var].size);
+            if (copy < 0) return;
+            ICVar *v = &ctx->vars[copy];
+            *v = ctx->vars[var];
+            v->is_parameter = false;
+            v->param_index = -1;
+            map->var_map[var] = copy;
+        }
+        arg->i64_val = map->var_map[var];
+    } else if (arg->type == IC_ARG_LABEL) {
+        for (I64 l = 0; l < map->label_count; l++) {
+            if (map->label_old[l] == arg->ic_ptr) {
+                arg->ic_ptr = map->label_new[l];
+                break;
+            }
+        }
+    }
+}
+
+static Bool ic_inline_site(ICGenContext *ctx, ICInlineSite *site, ICInlineFunc *callee) {
+    CIntermediateCode *call = site->call;
+    I64 argc = call->ic_data;
+    CIntermediateCode **pushes = malloc(sizeof(CIntermediateCode*) * (argc + 1));
+    if (!pushes || !ic_inline_pushes(call, pushes)) {
+        free(pushes);
+        return false;
+    }
+
+    ICInlineMap map;
+    memset(&map, 0, sizeof(map));
+    map.ctx = ctx;
+    map.var_limit = ctx->var_count;
+    map.temp_limit = ctx->temp_count;
+    map.var_map = malloc(sizeof(I64) * (map.var_limit + 1));
+    map.temp_map = malloc(sizeof(CICArg) * (map.temp_limit + 1));
+    map.temp_mapped = calloc(map.temp_limit + 1, sizeof(Bool));
+
+    I64 label_total = 0;
+    for (CIntermediateCode *ic = callee->enter->base.next; ic != callee->leave; ic = ic->base.next) {
+        if (ic->base.ic_code == IC_LABEL) label_total++;
+    }
+    map.label_old = malloc(sizeof(CIntermediateCode*) * (label_total + 1));
+    map.label_new = malloc(sizeof(CIntermediateCode*) * (label_total + 1));
+    CIntermediateCode *return_label = ic_gen_new_label(ctx);
+
+    Bool ok = map.var_map && map.temp_map && map.temp_mapped && map.label_old && map.label_new && return_label;
+    for (I64 v = 0; ok && v < map.var_limit; v++) map.var_map[v] = -1;
+    for (CIntermediateCode *ic = callee->enter->base.next; ok && ic != callee->leave; ic = ic->base.next) {
+        if (ic->base.ic_code != IC_LABEL) continue;
+        CIntermediateCode *label = ic_gen_new_label(ctx);
+        if (!label) {
+            ok = false;
+            break;
+        }
+        map.label_old[map.label_count] = ic;
+        map.label_new[map.label_count++] = label;
+    }
+
+    I64 label_index = 0;
+    for (CIntermediateCode *ic = callee->enter->base.next; ok && ic != callee->leave; ic = ic->base.next) {
+        U16 code = ic->base.ic_code;
+        CIntermediateCode *copy = NULL;
+
+        if (code == IC_LABEL) {
+            ic_insert_before(ctx, call, map.label_new[label_index++]);
+            continue;
+        }
+        if (code == IC_PARAM) {
+            if (ic->ic_data < 0 || ic->ic_data >= argc) {
+                ok = false;
+                break;
+            }
+            copy = ic_new(IC_ASSIGN);
+            if (!copy) break;
+            copy->arg1 = pushes[ic->ic_data]->arg1;
+            copy->res = ic->res;
+            copy->ic_line = ic->ic_line;
+            ic_inline_map_arg(&map, &copy->res);
+            ic_insert_before(ctx, call, copy);
+            continue;
+        }
+        if (code == IC_RETURN_VAL) {
+            copy = ic_new(IC_ASSIGN);
+            if (!copy) break;
+            copy->arg1 = ic->arg1;
+            copy->res = call->res;
+            copy->ic_line = ic->ic_line;
+            ic_inline_map_arg(&map, &copy->arg1);
+            ic_insert_before(ctx, call, copy);
+        }
+        if (code == IC_RETURN || code == IC_RETURN_VAL) {
+            copy = ic_new(IC_JUMP);
+            if (!copy) break;
+            copy->ic_line = ic->ic_line;
+            ic_set_branch_target(copy, return_label);
+            ic_insert_before(ctx, call, copy);
+            continue;
+        }
+
+        copy = ic_clone(ic);
+        if (!copy) break;
+        ic_inline_map_arg(&map, &copy->arg1);
+        ic_inline_map_arg(&map, &copy->arg2);
+        ic_inline_map_arg(&map, &copy->res);
+        ic_insert_before(ctx, call, copy);
+    }
+
+    if (ok) {
+        ic_insert_before(ctx, call, return_label);
+        for (I64 a = 0; a < argc; a++) ic_remove(ctx, pushes[a]);
+        ic_remove(ctx, call);
+    } else if (return_label && !return_label->base.next && !return_label->base.last) {
+        ic_free(return_label);
+    }
+
+    free(pushes);
+    free(map.var_map);
+    free(map.temp_map);
+    free(map.temp_mapped);
+    free(map.label_old);
+    free(map.label_new);
+    return ok;
+}
+
+/* Loop depth of every call in each function, from its CFG */
+static I64 ic_inline_collect_sites(ICGenContext *ctx, ICInlineFunc *funcs, I64 count, ICInlineSite *sites, I64 capacity) {
+    I64 site_count = 0;
+    for (I64 f = 0; f < count; f++) {
+        ICCfg *cfg = ic_cfg_build(ctx, funcs[f].enter);
+        for (CIntermediateCode *ic = funcs[f].enter->base.next; ic && ic != funcs[f].leave; ic = ic->base.next) {
+            if (ic->base.ic_code != IC_CALL || site_count >= capacity) continue;
+            I64 callee = ic_inline_find(funcs, count, &ic->arg1);
+            if (callee < 0) continue;
+            ICBasicBlock *bb = cfg ? ic_cfg_block_of(ic) : NULL;
+            sites[site_count].call = ic;
+            sites[site_count].caller = f;
+            sites[site_count].callee = callee;
+            sites[site_count].depth = bb && bb->loop ? bb->loop->depth : 0;
+            sites[site_count].count = ic->ic_flags & ICF_PROFILED ? (I64)ic->ic_exec_count : -1;
+            site_count++;
+        }
+        ic_cfg_free(cfg);
+    }
+    return site_count;
+}
+
+/*
+ * Inline call sites, hottest first within each round:
+ *  - leaf functions costing at most INLINE_ALWAYS_COST always;
+ *  - others up to INLINE_BASE_COST, doubling per enclosing loop level
+ *    up to INLINE_MAX_COST, while the caller has grown by no more than
+ *    its original cost plus INLINE_CALLER_GROWTH.
+ * With a profile, sites near the hottest one get INLINE_MAX_COST and
+ * sites that never ran only take the always-inline leaves.
+ * Functions on a call graph cycle are never inlined. Calls exposed by
+ * inlining are considered in the next round.
+ */
+Bool opt_function_inlining(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    clock_t started = clock();
+    I64 ic_count_before = ctx->ic_count;
+    I64 inlined = 0;
+    I64 always = 0;
+    I64 cost_growth = 0;
+
+    I64 count = 0;
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        count++;
+    }
+    ICInlineFunc *funcs = calloc(count + 1, sizeof(ICInlineFunc));
+    if (!funcs) return false;
+
+    I64 f = 0;
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        funcs[f].enter = enter;
+        funcs[f].name = enter->arg1.type == IC_ARG_SYMBOL ? (U8*)enter->arg1.ptr_val : NULL;
+        funcs[f].param_count = enter->ic_data;
+        CIntermediateCode *leave = enter->base.next;
+        while (leave && leave->base.ic_code != IC_LEAVE) leave = leave->base.next;
+        funcs[f].leave = leave;
+        if (leave) {
+            ic_inline_scan(ctx, &funcs[f]);
+            funcs[f].original_cost = funcs[f].cost;
+        }
+        f++;
+    }
+    for (f = 0; f < count; f++) {
+        if (!funcs[f].leave) {
+            free(funcs);
+            return false;
+        }
+    }
+
+    for (I64 round = 0; round < INLINE_MAX_ROUNDS; round++) {
+        if (!ic_inline_find_recursion(funcs, count)) break;
+
+        I64 capacity = ctx->ic_count + 1;
+        ICInlineSite *sites = malloc(sizeof(ICInlineSite) * capacity);
+        if (!sites) break;
+        I64 site_count = ic_inline_collect_sites(ctx, funcs, count, sites, capacity);
+
+        /* Hottest call sites get the budget first */
+        I64 hottest = 0;
+        for (I64 i = 0; i < site_count; i++) {
+            if (sites[i].count > hottest) hottest = sites[i].count;
+        }
+        for (I64 i = 1; i < site_count; i++) {
+            ICInlineSite site = sites[i];
+            I64 j = i - 1;
+            while (j >= 0 && ic_inline_hotter(&site, &sites[j])) {
+                sites[j + 1] = sites[j];
+                j--;
+            }
+            sites[j + 1] = site;
+        }
+
+        I64 round_inlined = 0;
+        for (I64 s = 0; s < site_count; s++) {
+            ICInlineFunc *caller = &funcs[sites[s].caller];
+            ICInlineFunc *callee = &funcs[sites[s].callee];
+            if (sites[s].caller == sites[s].callee || callee->recursive || !callee->inlinable) continue;
+            if (sites[s].call->ic_data != callee->param_count) continue;
+
+            Bool tiny = callee->is_leaf && callee->cost <= INLINE_ALWAYS_COST;
+            if (!tiny) {
+                if (callee->cost > ic_inline_site_limit(&sites[s], hottest)) continue;
+                if (caller->growth + callee->cost > caller->original_cost + INLINE_CALLER_GROWTH) continue;
+            }
+
+            if (ic_inline_site(ctx, &sites[s], callee)) {
+                caller->growth += callee->cost;
+                caller->cost += callee->cost;
+                cost_growth += callee->cost;
+                if (tiny) always++;
+                inlined++;
+                round_inlined++;
+            }
+        }
+        free(sites);
+        if (round_inlined == 0) break;
+
+        /* Callers changed: measure again before the next round */
+        for (f = 0; f < count; f++) {
+            ic_inline_scan(ctx, &funcs[f]);
+        }
+    }
+
+    free(funcs);
+    ctx->opt_changes += inlined;
+    double ms = (double)(clock() - started) * 1000.0 / CLOCKS_PER_SEC;
+    printf("DEBUG: opt_function_inlining - %lld call sites inlined (%lld always-inline), "
+           "code growth %+lld instructions, cost %+lld, %.2f ms\n",
+           inlined, always, ctx->ic_count - ic_count_before, cost_growth, ms);
+    return true;
+}
@@ -30,6 +30,7 @@ ICGenContext* ic_gen_context_new(CCmpCtrl *cc) {
     ctx->dead_code_elimination = true;
     ctx->constant_folding = true;
     ctx->register_optimization = true;
+    ctx->instruction_scheduling = true;
     
     return ctx;
 }
@@ -45,6 +46,8 @@ void ic_gen_context_free(ICGenContext *ctx) {
         ic = next;
     }
     
+    free(ctx->vars);
+    free(ctx->value_locs);
     free(ctx);
 }
 
@@ -147,11 +150,6 @@ U8* ic_gen_compile_statement(ICGenContext *ctx, I64 *type, I64 cmp_flags) {
             opt_pass_012(ctx);
         }
         
-        /* Pass 3: Register allocation optimization */
-        if (ctx->optimization_level >= 3) {
-            opt_pass_3(ctx);
-        }
-        
         /* Pass 4: Memory layout optimization */
         if (ctx->optimization_level >= 4) {
             opt_pass_4(ctx);
@@ -167,6 +165,11 @@ U8* ic_gen_compile_statement(ICGenContext *ctx, I64 *type, I64 cmp_flags) {
             opt_pass_6(ctx);
         }
         
+        /* Pass 3: Register allocation, after the passes that rewrite the IC chain */
+        if (ctx->optimization_level >= 3) {
+            opt_pass_3(ctx);
+        }
+        
         /* Pass 7-9: Assembly generation and final optimization */
         if (ctx->optimization_level >= 7) {
             opt_pass_789(ctx);
@@ -189,31 +192,24 @@ Bool opt_pass_012(ICGenContext *ctx) {
     I64 count = 0;
     
     printf("DEBUG: opt_pass_012 - starting optimization pass\n");
+    /* Inline small functions first so the passes below see through the calls */
+    opt_function_inlining(ctx);
+    ic = ctx->ic_head;
+    
     while (ic) {
         count++;
         if (count > 1000) {
             printf("ERROR: opt_pass_012 - infinite loop detected, breaking\n");
             break;
         }
-        /* Constant folding for arithmetic operations */
-        if (ic->base.ic_code >= IC_ADD && ic->base.ic_code <= IC_MOD) {
-            if (ic->arg1.type == 0 && ic->arg2.type == 0) {  /* Both are constants */
-                I64 result = 0;
-                I64 val1 = ic->arg1.i64_val;
-                I64 val2 = ic->arg2.i64_val;
-                
-                switch (ic->base.ic_code) {
-                    case IC_ADD: result = val1 + val2; break;
-                    case IC_SUB: result = val1 - val2; break;
-                    case IC_MUL: result = val1 * val2; break;
-                    case IC_DIV: if (val2 != 0) result = val1 / val2; break;
-                    case IC_MOD: if (val2 != 0) result = val1 % val2; break;
-                }
-                
-                /* Replace with constant result */
-                ic->base.ic_code = IC_NOP;
-                ic->res.i64_val = result;
-                ic->res.type = 0;  /* Constant type */
+        /* Constant folding of operations whose operands are all literals */
+        if (ic->arg1.type == IC_ARG_CONST && (ic->arg2.type == IC_ARG_CONST || !ic_fold_is_binary(ic->base.ic_code))) {
+            I64 result;
+            if (ic_fold_constant(ic->base.ic_code, ic->arg1.i64_val, ic->arg2.i64_val, &result)) {
+                /* Replace with a copy of the constant result */
+                ic->base.ic_code = ic_get_def(ic) ? IC_ASSIGN : IC_NOP;
+                ic->arg1 = ic_arg_const(result);
+                ic->arg2 = ic_arg_const(0);
             }
         }
         
@@ -227,6 +223,29 @@ Bool opt_pass_012(ICGenContext *ctx) {
     }
     
     printf("DEBUG: opt_pass_012 - completed, processed %lld instructions\n", count);
+    
+    /* Propagate the folded constants through variables, phis and branches */
+    if (ctx->constant_folding) {
+        opt_constant_propagation(ctx);
+    }
+    
+    /* Allocations of a now known size that stay in their function go on the stack */
+    opt_escape_analysis(ctx);
+    
+    /* Then reuse values that are computed more than once */
+    opt_value_numbering(ctx);
+    
+    /* And move what does not change inside loops out of them */
+    opt_loop_optimization(ctx);
+    
+    /* Run the counted array loops on vectors while they still count by one */
+    opt_loop_vectorization(ctx);
+    
+    /* Then turn induction variable arithmetic into increments */
+    opt_induction_variables(ctx);
+    
+    /* And unroll the small counted loops that are left */
+    opt_loop_unrolling(ctx);
     return true;
 }
 
@@ -235,36 +254,21 @@ Bool opt_pass_012(ICGenContext *ctx) {
  * Based on HolyC's OptPass3
  */
 Bool opt_pass_3(ICGenContext *ctx) {
-    CIntermediateCode *ic = ctx->ic_head;
-    I64 count = 0;
-    
     printf("DEBUG: opt_pass_3 - starting optimization pass\n");
-    while (ic) {
-        count++;
-        if (count > 1000) {
-            printf("ERROR: opt_pass_3 - infinite loop detected, breaking\n");
-            break;
-        }
-        /* Register allocation for variables */
-        if (ic->base.ic_code == IC_ASSIGN || ic->base.ic_code == IC_LOAD) {
-            /* Allocate register for result */
-            if (ctx->reg_count < MAX_X86_REGS) {
-                X86Register reg = (X86Register)(X86_REG_RAX + ctx->reg_count);
-                ctx->allocated_regs[ctx->reg_count] = reg;
-                ctx->reg_count++;
-                
-                /* Mark register as allocated in IC */
-                ic->reg_alloc[ic->reg_count] = reg;
-                ic->reg_count++;
-                ic->regs_allocated = true;
-            }
-        }
-        
-        ic = ic->base.next;
+    
+    /* Schedule first so the allocator sees the final instruction order */
+    opt_instruction_scheduling(ctx);
+    
+    if (!ctx->register_optimization) {
+        printf("DEBUG: opt_pass_3 - register optimization disabled\n");
+        return true;
     }
     
-    printf("DEBUG: opt_pass_3 - completed, processed %lld instructions\n", count);
-    return true;
+    /* Linear scan over live intervals, see regalloc.c */
+    Bool ok = opt_register_allocation(ctx);
+    
+    printf("DEBUG: opt_pass_3 - completed\n");
+    return ok;
 }
 
 /*
@@ -301,44 +305,56 @@ Bool opt_pass_4(ICGenContext *ctx) {
  * Based on HolyC's OptPass5
  */
 Bool opt_pass_5(ICGenContext *ctx) {
-    CIntermediateCode *ic = ctx->ic_head;
-    CIntermediateCode *prev = NULL;
     I64 count = 0;
+    I64 removed = 0;
+    Bool changed = true;
     
     printf("DEBUG: opt_pass_5 - starting optimization pass\n");
-    while (ic) {
-        count++;
-        if (count > 1000) {
-            printf("ERROR: opt_pass_5 - infinite loop detected, breaking\n");
-            break;
-        }
-        if (ic_is_dead(ic)) {
-            /* Remove dead instruction */
-            if (prev) {
-                prev->base.next = ic->base.next;
-                if (ic->base.next) {
-                    ic->base.next->base.last = prev;
+    
+    /* Removing a dead use can make its operands dead; repeat until stable */
+    while (changed) {
+        changed = false;
+        opt_dead_code_elimination(ctx);
+        
+        CIntermediateCode *ic = ctx->ic_head;
+        CIntermediateCode *prev = NULL;
+        while (ic) {
+            count++;
+            if (count > 100000) {
+                printf("ERROR: opt_pass_5 - infinite loop detected, breaking\n");
+                changed = false;
+                break;
+            }
+            if (ic_is_dead(ic)) {
+                /* Remove dead instruction */
+                if (prev) {
+                    prev->base.next = ic->base.next;
+                    if (ic->base.next) {
+                        ic->base.next->base.last = prev;
+                    } else {
+                        ctx->ic_tail = prev;
+                    }
                 } else {
-                    ctx->ic_tail = prev;
+                    ctx->ic_head = ic->base.next;
+                    if (ctx->ic_head) {
+                        ctx->ic_head->base.last = NULL;
+                    }
                 }
+            
+                CIntermediateCode *dead = ic;
+                ic = ic->base.next;
+                ic_free(dead);
+                ctx->ic_count--;
+                removed++;
+                changed = true;
             } else {
-                ctx->ic_head = ic->base.next;
-                if (ctx->ic_head) {
-                    ctx->ic_head->base.last = NULL;
-                }
+                prev = ic;
+                ic = ic->base.next;
             }
-            
-            CIntermediateCode *dead = ic;
-            ic = ic->base.next;
-            ic_free(dead);
-            ctx->ic_count--;
-        } else {
-            prev = ic;
-            ic = ic->base.next;
         }
     }
     
-    printf("DEBUG: opt_pass_5 - completed, processed %lld instructions\n", count);
+    printf("DEBUG: opt_pass_5 - completed, removed %lld of %lld processed instructions\n", removed, count);
     return true;
 }
 
@@ -347,25 +363,25 @@ Bool opt_pass_5(ICGenContext *ctx) {
  * Based on HolyC's OptPass6
  */
 Bool opt_pass_6(ICGenContext *ctx) {
-    CIntermediateCode *ic = ctx->ic_head;
     I64 count = 0;
+    Bool changed = true;
     
     printf("DEBUG: opt_pass_6 - starting optimization pass\n");
-    while (ic) {
+    
+    /* Jump cleanups expose dead blocks and vice versa; iterate to a fixed point */
+    while (changed) {
         count++;
         if (count > 1000) {
             printf("ERROR: opt_pass_6 - infinite loop detected, breaking\n");
             break;
         }
-        /* Optimize jump instructions */
-        if (ic->base.ic_code == IC_JUMP || ic->base.ic_code == IC_JUMP_TRUE || ic->base.ic_code == IC_JUMP_FALSE) {
-            /* TODO: Implement jump optimization */
-        }
-        
-        ic = ic->base.next;
+        I64 before = ctx->opt_changes;
+        opt_branch_optimization(ctx);
+        opt_unreachable_code_elimination(ctx);
+        changed = ctx->opt_changes != before;
     }
     
-    printf("DEBUG: opt_pass_6 - completed, processed %lld instructions\n", count);
+    printf("DEBUG: opt_pass_6 - completed in %lld rounds, %lld instructions remain\n", count, ctx->ic_count);
     return true;
 }
 
@@ -389,8 +405,9 @@ Bool opt_pass_789(ICGenContext *ctx) {
             U8 *assembly = malloc(ic->instruction_size);
             if (assembly) {
                 I64 size;
-                CAsmArg *arg1 = (CAsmArg*)ic->arg1.i64_val;
-                CAsmArg *arg2 = (CAsmArg*)ic->arg2.i64_val;
+                /* Only legacy CAsmArg operands can be encoded directly */
+                CAsmArg *arg1 = ic->arg1.type == IC_ARG_ASM ? (CAsmArg*)ic->arg1.ptr_val : NULL;
+                CAsmArg *arg2 = ic->arg2.type == IC_ARG_ASM ? (CAsmArg*)ic->arg2.ptr_val : NULL;
                 
                 if (encode_x86_instruction(arg1, arg2, ic->x86_opcode, assembly, &size)) {
                     ic->assembly_bytes = assembly;
@@ -417,8 +434,56 @@ Bool ic_is_dead(CIntermediateCode *ic) {
     /* Check if instruction result is never used */
     if (ic->base.ic_code == IC_NOP) return true;
     
-    /* TODO: Implement more sophisticated dead code detection */
-    return false;
+    /* Marked by opt_dead_code_elimination from liveness */
+    return (ic->ic_flags & ICF_RES_NOT_USED) != 0;
+}
+
+/* True for foldable operations that read both arg1 and arg2 */
+Bool ic_fold_is_binary(U16 code) {
+    return code != IC_NOT && code != IC_UNARY_MINUS && code != IC_UNARY_BITNOT && code != IC_ASSIGN;
+}
+
+/*
+ * Evaluate a side-effect free operation on constant operands. Returns false
+ * when the operation is not foldable or the result would be undefined at
+ * run time (division by zero, oversized shifts, overflowing division).
+ */
+Bool ic_fold_constant(U16 code, I64 a, I64 b, I64 *result) {
+    if (!result) return false;
+    
+    switch (code) {
+        case IC_ADD: *result = (I64)((U64)a + (U64)b); return true;
+        case IC_SUB: *result = (I64)((U64)a - (U64)b); return true;
+        case IC_MUL: *result = (I64)((U64)a * (U64)b); return true;
+        case IC_DIV:
+        case IC_MOD:
+            if (b == 0 || (a == INT64_MIN && b == -1)) return false;
+            *result = code == IC_DIV ? a / b : a % b;
+            return true;
+        case IC_AND: *result = a & b; return true;
+        case IC_OR: *result = a | b; return true;
+        case IC_XOR: *result = a ^ b; return true;
+        case IC_SHL:
+            if (b < 0 || b > 63) return false;
+            *result = (I64)((U64)a << b);
+            return true;
+        case IC_SHR:
+            if (b < 0 || b > 63) return false;
+            *result = a >> b;
+            return true;
+        case IC_EQU: *result = a == b; return true;
+        case IC_NOT_EQU: *result = a != b; return true;
+        case IC_LESS: *result = a < b; return true;
+        case IC_GREATER: *result = a > b; return true;
+        case IC_LESS_EQU: *result = a <= b; return true;
+        case IC_GREATER_EQU: *result = a >= b; return true;
+        case IC_NOT: *result = !a; return true;
+        case IC_UNARY_MINUS: *result = (I64)(0 - (U64)a); return true;
+        case IC_UNARY_BITNOT: *result = ~a; return true;
+        case IC_ASSIGN: *result = a; return true;
+        default:
+            return false;
+    }
 }
 
 I64 ic_calculate_cost(CIntermediateCode *ic) {
@@ -428,6 +493,7 @@ I64 ic_calculate_cost(CIntermediateCode *ic) {
         case IC_ADD: case IC_SUB: return 1;
         case IC_MUL: case IC_DIV: return 3;
         case IC_LOAD: case IC_STORE: return 2;
+        case IC_VEC_LOAD: case IC_VEC_STORE: return 2;
         default: return 1;
     }
 }
@@ -443,12 +509,14 @@ U8* ic_generate_assembly(ICGenContext *ctx, I64 *size) {
     I64 total_size = 0;
     CIntermediateCode *ic = ctx->ic_head;
     while (ic) {
-        total_size += ic->instruction_size;
+        if (ic->assembly_generated && ic->assembly_bytes) {
+            total_size += ic->assembly_size;
+        }
         ic = ic->base.next;
     }
     
     /* Allocate output buffer */
-    U8 *output = malloc(total_size);
+    U8 *output = malloc(total_size > 0 ? total_size : 1);
     if (!output) return NULL;
     
     /* Generate assembly for each instruction */
@@ -497,11 +565,479 @@ Bool ic_resolve_symbols(ICGenContext *ctx, CAOT *aot) {
     return true;
 }
 
+/*
+ * IC Building and Editing Helpers
+ */
+
+CICArg ic_arg_const(I64 value) {
+    CICArg arg;
+    arg.i64_val = value;
+    arg.type = IC_ARG_CONST;
+    return arg;
+}
+
+CICArg ic_arg_temp(ICGenContext *ctx) {
+    CICArg arg;
+    arg.i64_val = ctx->temp_count++;
+    arg.type = IC_ARG_TEMP;
+    return arg;
+}
+
+CICArg ic_arg_var(I64 index) {
+    CICArg arg;
+    arg.i64_val = index;
+    arg.type = IC_ARG_VAR;
+    return arg;
+}
+
+CICArg ic_arg_label(CIntermediateCode *label) {
+    CICArg arg;
+    arg.ic_ptr = label;
+    arg.type = IC_ARG_LABEL;
+    return arg;
+}
+
+CICArg ic_arg_symbol(U8 *name) {
+    CICArg arg;
+    arg.ptr_val = name;
+    arg.type = IC_ARG_SYMBOL;
+    return arg;
+}
+
+Bool ic_arg_equal(CICArg *a, CICArg *b) {
+    if (!a || !b || a->type != b->type) return false;
+    if (a->type == IC_ARG_SYMBOL || a->type == IC_ARG_STRING) {
+        if (!a->ptr_val || !b->ptr_val) return a->ptr_val == b->ptr_val;
+        return strcmp((char*)a->ptr_val, (char*)b->ptr_val) == 0;
+    }
+    return a->i64_val == b->i64_val;
+}
+
+/* True for operands that carry a value computed by the IC (temps and variables) */
+Bool ic_arg_is_value(CICArg *arg) {
+    return arg && (arg->type == IC_ARG_TEMP || arg->type == IC_ARG_VAR);
+}
+
+CIntermediateCode* ic_gen_emit(ICGenContext *ctx, ICOperation op, CICArg *arg1, CICArg *arg2, CICArg *res) {
+    if (!ctx) return NULL;
+    
+    CIntermediateCode *ic = ic_new(op);
+    if (!ic) return NULL;
+    
+    ic->ic_line = ctx->cc ? ctx->cc->last_line_num : 0;
+    if (arg1) ic->arg1 = *arg1;
+    if (arg2) ic->arg2 = *arg2;
+    if (res) ic->res = *res;
+    
+    /* Set assembly instruction mapping */
+    ic->x86_opcode = 0x90;  /* NOP by default */
+    ic->opcode_size = 1;
+    ic->instruction_size = 1;
+    
+    ic_insert_before(ctx, NULL, ic);
+    return ic;
+}
+
+/* Create a label that is placed later with ic_gen_place_label */
+CIntermediateCode* ic_gen_new_label(ICGenContext *ctx) {
+    if (!ctx) return NULL;
+    
+    CIntermediateCode *label = ic_new(IC_LABEL);
+    if (!label) return NULL;
+    
+    label->ic_data = ++ctx->label_count;
+    label->ic_line = ctx->cc ? ctx->cc->last_line_num : 0;
+    label->instruction_size = 0;
+    return label;
+}
+
+void ic_gen_place_label(ICGenContext *ctx, CIntermediateCode *label) {
+    if (!ctx || !label) return;
+    ic_insert_before(ctx, NULL, label);
+}
+
+/* Link ic in front of pos (at the tail when pos is NULL) */
+void ic_insert_before(ICGenContext *ctx, CIntermediateCode *pos, CIntermediateCode *ic) {
+    if (!ctx || !ic) return;
+    
+    if (!pos) {
+        ic->base.next = NULL;
+        ic->base.last = ctx->ic_tail;
+        if (ctx->ic_tail) {
+            ctx->ic_tail->base.next = ic;
+        } else {
+            ctx->ic_head = ic;
+        }
+        ctx->ic_tail = ic;
+    } else {
+        ic->base.next = pos;
+        ic->base.last = pos->base.last;
+        if (pos->base.last) {
+            pos->base.last->base.next = ic;
+        } else {
+            ctx->ic_head = ic;
+        }
+        pos->base.last = ic;
+    }
+    ctx->ic_count++;
+}
+
+void ic_insert_after(ICGenContext *ctx, CIntermediateCode *pos, CIntermediateCode *ic) {
+    if (!ctx || !ic) return;
+    
+    if (!pos) {
+        /* Insert at the head */
+        ic_insert_before(ctx, ctx->ic_head, ic);
+    } else {
+        ic_insert_before(ctx, pos->base.next, ic);
+    }
+}
+
+void ic_unlink(ICGenContext *ctx, CIntermediateCode *ic) {
+    if (!ctx || !ic) return;
+    
+    if (ic->base.last) {
+        ic->base.last->base.next = ic->base.next;
+    } else {
+        ctx->ic_head = ic->base.next;
+    }
+    if (ic->base.next) {
+        ic->base.next->base.last = ic->base.last;
+    } else {
+        ctx->ic_tail = ic->base.last;
+    }
+    ic->base.next = ic->base.last = NULL;
+    ctx->ic_count--;
+}
+
+/* Unlinked copy of ic with the same operands, without block or codegen state */
+CIntermediateCode* ic_clone(CIntermediateCode *ic) {
+    if (!ic) return NULL;
+    
+    CIntermediateCode *copy = ic_new(ic->base.ic_code);
+    if (!copy) return NULL;
+    
+    memcpy(copy, ic, sizeof(CIntermediateCode));
+    copy->base.next = copy->base.last = NULL;
+    copy->ic_flags &= ~(ICF_RES_NOT_USED | ICF_LABEL_USED | ICF_LOOP_UNROLLED);
+    copy->ic_block = NULL;
+    copy->regs_allocated = false;
+    copy->regs_spilled = false;
+    copy->assembly_generated = false;
+    copy->assembly_bytes = NULL;
+    copy->assembly_size = 0;
+    return copy;
+}
+
+void ic_remove(ICGenContext *ctx, CIntermediateCode *ic) {
+    if (!ctx || !ic) return;
+    ic_unlink(ctx, ic);
+    ic_free(ic);
+}
+
+Bool ic_is_branch(CIntermediateCode *ic) {
+    if (!ic) return false;
+    return ic->base.ic_code == IC_JUMP || ic->base.ic_code == IC_JUMP_TRUE ||
+           ic->base.ic_code == IC_JUMP_FALSE;
+}
+
+/* Instructions after which control never falls through */
+Bool ic_is_terminator(CIntermediateCode *ic) {
+    if (!ic) return false;
+    return ic_is_branch(ic) || ic->base.ic_code == IC_RETURN || ic->base.ic_code == IC_RETURN_VAL;
+}
+
+/* Instructions that must be kept even when their result is unused */
+Bool ic_has_side_effects(CIntermediateCode *ic) {
+    if (!ic) return false;
+    
+    switch (ic->base.ic_code) {
+        case IC_NOP:
+        case IC_ADD: case IC_SUB: case IC_MUL:
+        case IC_AND: case IC_OR: case IC_XOR: case IC_NOT:
+        case IC_UNARY_MINUS: case IC_UNARY_BITNOT:
+        case IC_SHL: case IC_SHR:
+        case IC_EQU: case IC_NOT_EQU: case IC_LESS: case IC_GREATER:
+        case IC_LESS_EQU: case IC_GREATER_EQU:
+        case IC_ASSIGN: case IC_LOAD: case IC_ADDR: case IC_PARAM: case IC_PHI:
+        case IC_VEC_SPLAT: case IC_VEC_ADD: case IC_VEC_SUB: case IC_VEC_MUL:
+        case IC_VEC_AND: case IC_VEC_OR: case IC_VEC_XOR:
+            return false;
+        case IC_DIV:
+        case IC_MOD:
+            /* Division can fault unless the divisor is a known non-zero */
+            return !(ic->arg2.type == IC_ARG_CONST && ic->arg2.i64_val != 0);
+        default:
+            return true;
+    }
+}
+
+CIntermediateCode* ic_branch_target(CIntermediateCode *ic) {
+    if (!ic) return NULL;
+    if (ic->base.ic_code == IC_JUMP && ic->arg1.type == IC_ARG_LABEL) return ic->arg1.ic_ptr;
+    if ((ic->base.ic_code == IC_JUMP_TRUE || ic->base.ic_code == IC_JUMP_FALSE) &&
+        ic->arg2.type == IC_ARG_LABEL) return ic->arg2.ic_ptr;
+    return NULL;
+}
+
+void ic_set_branch_target(CIntermediateCode *ic, CIntermediateCode *label) {
+    if (!ic) return;
+    if (ic->base.ic_code == IC_JUMP) {
+        ic->arg1 = ic_arg_label(label);
+    } else if (ic->base.ic_code == IC_JUMP_TRUE || ic->base.ic_code == IC_JUMP_FALSE) {
+        ic->arg2 = ic_arg_label(label);
+    }
+}
+
+/* Collect the value operands read by ic; returns how many were stored in uses */
+I64 ic_get_uses(CIntermediateCode *ic, CICArg **uses) {
+    I64 count = 0;
+    if (!ic || !uses) return 0;
+    
+    /* IC_ADDR names its variable without reading it; phi operands live in arg1's array */
+    if (ic->base.ic_code == IC_ADDR || ic->base.ic_code == IC_PHI) return 0;
+    
+    if (ic_arg_is_value(&ic->arg1)) uses[count++] = &ic->arg1;
+    if (ic_arg_is_value(&ic->arg2)) uses[count++] = &ic->arg2;
+    return count;
+}
+
+/* The value operand written by ic, or NULL */
+CICArg* ic_get_def(CIntermediateCode *ic) {
+    if (!ic || !ic_arg_is_value(&ic->res)) return NULL;
+    return &ic->res;
+}
+
+/* First IC_ENTER at or after ic */
+CIntermediateCode* ic_next_function(CIntermediateCode *ic) {
+    while (ic && ic->base.ic_code != IC_ENTER) {
+        ic = ic->base.next;
+    }
+    return ic;
+}
+
+/* Find a variable visible from the current function, -1 if unknown */
+I64 ic_var_lookup(ICGenContext *ctx, U8 *name) {
+    if (!ctx || !name) return -1;
+    
+    for (I64 i = ctx->var_count - 1; i >= ctx->func_var_base; i--) {
+        if (ctx->vars[i].name && strcmp((char*)ctx->vars[i].name, (char*)name) == 0) return i;
+    }
+    
+    /* Variables of the implicit main function are the program's globals */
+    for (I64 i = 0; i < ctx->func_var_base && ctx->vars[i].func_index == 0; i++) {
+        if (ctx->vars[i].name && strcmp((char*)ctx->vars[i].name, (char*)name) == 0) {
+            ctx->vars[i].is_global = true;
+            return i;
+        }
+    }
+    return -1;
+}
+
+I64 ic_var_add(ICGenContext *ctx, U8 *name, I64 size) {
+    if (!ctx) return -1;
+    
+    if (ctx->var_count >= ctx->var_capacity) {
+        I64 new_capacity = ctx->var_capacity ? ctx->var_capacity * 2 : 32;
+        ICVar *vars = realloc(ctx->vars, sizeof(ICVar) * new_capacity);
+        if (!vars) return -1;
+        ctx->vars = vars;
+        ctx->var_capacity = new_capacity;
+    }
+    
+    ICVar *var = &ctx->vars[ctx->var_count];
+    memset(var, 0, sizeof(ICVar));
+    var->name = name;
+    var->size = size;
+    var->func_index = ctx->func_count - 1;
+    var->param_index = -1;
+    return ctx->var_count++;
+}
+
+/* Open a new IC_ENTER region; variables declared from here on belong to it */
+static CIntermediateCode* ic_gen_begin_function(ICGenContext *ctx, CICArg *sym) {
+    ctx->func_count++;
+    ctx->func_var_base = ctx->var_count;
+    ctx->break_label = ctx->continue_label = NULL;
+    return ic_gen_emit(ctx, IC_ENTER, sym, NULL, NULL);
+}
+
+/* Attach the count of node's first profile counter to ic (--profile-use) */
+static void ic_gen_profile(ICGenContext *ctx, CIntermediateCode *ic, ASTNode *node) {
+    if (!ic || !profile_has_counts(ctx->profile) || !node || node->profile_id <= 0) return;
+    ic->ic_exec_count = profile_count(ctx->profile, node, 0);
+    ic->ic_flags |= ICF_PROFILED;
+}
+
+static const char* ic_opcode_name(U16 code) {
+    switch (code) {
+        case IC_NOP: return "nop";
+        case IC_ADD: return "add";
+        case IC_SUB: return "sub";
+        case IC_MUL: return "mul";
+        case IC_DIV: return "div";
+        case IC_MOD: return "mod";
+        case IC_AND: return "and";
+        case IC_OR: return "or";
+        case IC_XOR: return "xor";
+        case IC_NOT: return "not";
+        case IC_UNARY_MINUS: return "neg";
+        case IC_UNARY_BITNOT: return "com";
+        case IC_SHL: return "shl";
+        case IC_SHR: return "shr";
+        case IC_EQU: return "eq";
+        case IC_NOT_EQU: return "ne";
+        case IC_LESS: return "lt";
+        case IC_GREATER: return "gt";
+        case IC_LESS_EQU: return "le";
+        case IC_GREATER_EQU: return "ge";
+        case IC_ASSIGN: return "mov";
+        case IC_CALL: return "call";
+        case IC_RETURN: return "ret";
+        case IC_RETURN_VAL: return "retval";
+        case IC_ENTER: return "enter";
+        case IC_LEAVE: return "leave";
+        case IC_PARAM: return "param";
+        case IC_JUMP: return "jmp";
+        case IC_JUMP_TRUE: return "jt";
+        case IC_JUMP_FALSE: return "jf";
+        case IC_LABEL: return "label";
+        case IC_PHI: return "phi";
+        case IC_PUSH: return "push";
+        case IC_POP: return "pop";
+        case IC_LOAD: return "load";
+        case IC_STORE: return "store";
+        case IC_ADDR: return "addr";
+        case IC_PRINT: return "print";
+        case IC_MALLOC: return "malloc";
+        case IC_FREE: return "free";
+        case IC_ASM_INLINE: return "asm";
+        case IC_VEC_LOAD: return "vload";
+        case IC_VEC_STORE: return "vstore";
+        case IC_VEC_SPLAT: return "vsplat";
+        case IC_VEC_ADD: return "vadd";
+        case IC_VEC_SUB: return "vsub";
+        case IC_VEC_MUL: return "vmul";
+        case IC_VEC_AND: return "vand";
+        case IC_VEC_OR: return "vor";
+        case IC_VEC_XOR: return "vxor";
+        case IC_VEC_REDUCE: return "vreduce";
+        default: return "?";
+    }
+}
+
+static Bool ic_has_arg2(U16 code) {
+    switch (code) {
+        case IC_ADD: case IC_SUB: case IC_MUL: case IC_DIV: case IC_MOD:
+        case IC_AND: case IC_OR: case IC_XOR: case IC_SHL: case IC_SHR:
+        case IC_EQU: case IC_NOT_EQU: case IC_LESS: case IC_GREATER:
+        case IC_LESS_EQU: case IC_GREATER_EQU:
+        case IC_STORE: case IC_JUMP_TRUE: case IC_JUMP_FALSE:
+        case IC_VEC_STORE: case IC_VEC_ADD: case IC_VEC_SUB: case IC_VEC_MUL:
+        case IC_VEC_AND: case IC_VEC_OR: case IC_VEC_XOR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void ic_dump_arg(ICGenContext *ctx, CICArg *arg) {
+    switch (arg->type) {
+        case IC_ARG_CONST: printf(" %lld", arg->i64_val); break;
+        case IC_ARG_FCONST: printf(" %g", arg->f64_val); break;
+        case IC_ARG_TEMP: printf(" t%lld", arg->i64_val); break;
+        case IC_ARG_VAR:
+            if (arg->i64_val < ctx->var_count && ctx->vars[arg->i64_val].name) {
+                printf(" %s.%lld", (char*)ctx->vars[arg->i64_val].name, arg->i64_val);
+            } else {
+                printf(" v%lld", arg->i64_val);
+            }
+            break;
+        case IC_ARG_LABEL: printf(" L%lld", arg->ic_ptr ? arg->ic_ptr->ic_data : -1); break;
+        case IC_ARG_SYMBOL: printf(" %s", arg->ptr_val ? (char*)arg->ptr_val : "?"); break;
+        case IC_ARG_STRING: printf(" \"%s\"", arg->ptr_val ? (char*)arg->ptr_val : ""); break;
+        default: printf(" <%lld>", arg->type); break;
+    }
+}
+
+/* Register allocation annotation: location of res, arg1, arg2 */
+static void ic_dump_regs(ICGenContext *ctx, CIntermediateCode *ic) {
+    if (ic->base.ic_code == IC_ENTER) {
+        printf("    ; spill %lld", ic->stack_offset);
+        if (ic->reg_count > 0) printf(", save");
+        for (I64 i = 0; i < ic->reg_count; i++) {
+            printf(" %s", ic_reg_name(ic->reg_alloc[i]));
+        }
+        return;
+    }
+    
+    CICArg *args[3] = { &ic->res, &ic->arg1, &ic->arg2 };
+    Bool first = true;
+    for (int i = 0; i < 3; i++) {
+        if (args[i]->type != IC_ARG_TEMP && args[i]->type != IC_ARG_VAR) continue;
+        if (i == 0 && !ic_arg_is_value(&ic->res)) continue;
+        if (i == 2 && !ic_has_arg2(ic->base.ic_code)) continue;
+        
+        I64 value = args[i]->type == IC_ARG_TEMP ? args[i]->i64_val : ctx->temp_count + args[i]->i64_val;
+        printf("%s", first ? "    ;" : ",");
+        first = false;
+        if (ic->reg_alloc[i] != X86_REG_NONE) {
+            printf(" %s", ic_reg_name(ic->reg_alloc[i]));
+        } else if (value < ctx->value_loc_count && ctx->value_locs[value].remat) {
+            printf(" =%lld", ctx->value_locs[value].remat_value);
+        } else if (value < ctx->value_loc_count && ctx->value_locs[value].spill_offset >= 0) {
+            printf(" [spill+%lld]", ctx->value_locs[value].spill_offset);
+        } else {
+            printf(" mem");
+        }
+    }
+}
+
+/* Print the IC chain, one instruction per line */
+void ic_dump(ICGenContext *ctx) {
+    if (!ctx) return;
+    
+    printf("DEBUG: IC dump (%lld instructions)\n", ctx->ic_count);
+    for (CIntermediateCode *ic = ctx->ic_head; ic; ic = ic->base.next) {
+        if (ic->base.ic_code == IC_LABEL) {
+            printf("  L%lld:\n", ic->ic_data);
+            continue;
+        }
+        printf("    %-7s", ic_opcode_name(ic->base.ic_code));
+        if (ic_arg_is_value(&ic->res)) {
+            ic_dump_arg(ctx, &ic->res);
+            printf(" =");
+        }
+        if (ic->base.ic_code == IC_PARAM) {
+            printf(" #%lld", ic->ic_data);
+        } else {
+            ic_dump_arg(ctx, &ic->arg1);
+        }
+        if (ic_has_arg2(ic->base.ic_code)) {
+            ic_dump_arg(ctx, &ic->arg2);
+        }
+        if (ic_is_vector_op(ic->base.ic_code)) {
+            char mnemonic[64];
+            ic_vec_mnemonic(ic, mnemonic, sizeof(mnemonic));
+            printf("  [%s]", mnemonic);
+        }
+        if (ic->ic_flags & ICF_PROFILED) {
+            printf("  {x%llu}", (unsigned long long)ic->ic_exec_count);
+        }
+        if (ic->regs_allocated) {
+            ic_dump_regs(ctx, ic);
+        }
+        printf("\n");
+    }
+}
+
 /*
  * AST-to-Intermediate Code Conversion
  * Convert AST nodes into optimized intermediate code
  */
 
+static Bool ic_gen_element_address(ICGenContext *ctx, ASTNode *node, CICArg *addr, I64 *size);
+
 /* Main AST-to-IC conversion function */
 Bool ic_gen_from_ast(ICGenContext *ctx, ASTNode *ast) {
     if (!ctx || !ast) return false;
@@ -513,10 +1049,24 @@ Bool ic_gen_from_ast(ICGenContext *ctx, ASTNode *ast) {
     ctx->ic_head = ctx->ic_tail = NULL;
     ctx->ic_count = 0;
     
-    /* Convert AST nodes to intermediate code */
+    /* Top-level statements form the implicit main function */
+    CICArg main_sym = ic_arg_symbol((U8*)"main");
+    ic_gen_begin_function(ctx, &main_sym);
+    
     ASTNode *child = ast->children;
     while (child) {
-        if (!ic_gen_ast_node(ctx, child)) {
+        if (child->type != NODE_FUNCTION && !ic_gen_ast_node(ctx, child)) {
+            printf("ERROR: Failed to convert AST node type %d\n", child->type);
+            return false;
+        }
+        child = child->next;
+    }
+    ic_gen_emit(ctx, IC_LEAVE, &main_sym, NULL, NULL);
+    
+    /* Function bodies follow, one IC_ENTER/IC_LEAVE region each */
+    child = ast->children;
+    while (child) {
+        if (child->type == NODE_FUNCTION && !ic_gen_ast_node(ctx, child)) {
             printf("ERROR: Failed to convert AST node type %d\n", child->type);
             return false;
         }
@@ -542,6 +1092,9 @@ Bool ic_gen_ast_node(ICGenContext *ctx, ASTNode *node) {
             return ic_gen_float_literal(ctx, node);
         case NODE_CHAR:
             return ic_gen_char_literal(ctx, node);
+        case NODE_BOOLEAN:
+            ctx->last_result = ic_arg_const(node->data.boolean.value ? 1 : 0);
+            return true;
         case NODE_IDENTIFIER:
             return ic_gen_identifier(ctx, node);
         case NODE_BINARY_OP:
@@ -557,11 +1110,40 @@ Bool ic_gen_ast_node(ICGenContext *ctx, ASTNode *node) {
         case NODE_FUNCTION:
             return ic_gen_function_declaration(ctx, node);
         case NODE_IF:
+        case NODE_IF_STMT:
             return ic_gen_if_statement(ctx, node);
         case NODE_WHILE:
+        case NODE_WHILE_STMT:
             return ic_gen_while_statement(ctx, node);
+        case NODE_DO_WHILE_STMT:
+            return ic_gen_do_while_statement(ctx, node);
         case NODE_FOR:
+        case NODE_FOR_STMT:
             return ic_gen_for_statement(ctx, node);
+        case NODE_BREAK:
+        case NODE_CONTINUE: {
+            CIntermediateCode *target = node->type == NODE_BREAK ? ctx->break_label : ctx->continue_label;
+            if (!target) {
+                printf("WARNING: %s outside of loop ignored\n", node->type == NODE_BREAK ? "break" : "continue");
+                return true;
+            }
+            CICArg label = ic_arg_label(target);
+            return ic_gen_emit(ctx, IC_JUMP, &label, NULL, NULL) != NULL;
+        }
+        case NODE_CONDITIONAL:
+            return ic_gen_conditional(ctx, node);
+        case NODE_RANGE_COMPARISON:
+            return ic_gen_range_comparison(ctx, node);
+        case NODE_ARRAY_ACCESS:
+        case NODE_SUB_INT_ACCESS:
+        case NODE_POINTER_DEREF:
+            return ic_gen_memory_access(ctx, node);
+        case NODE_ADDRESS_OF: {
+            CICArg res;
+            if (!ic_gen_address_of(ctx, node->data.address_of.variable, &res)) return false;
+            ctx->last_result = res;
+            return true;
+        }
         case NODE_RETURN:
             return ic_gen_return_statement(ctx, node);
         case NODE_BLOCK:
@@ -612,6 +1194,7 @@ Bool ic_gen_integer_literal(ICGenContext *ctx, ASTNode *node) {
     /* In HolyC, integer literals are automatically printed */
     CIntermediateCode *ic = ic_gen_add_instruction(ctx, IC_PRINT, int_arg, NULL, NULL);
     if (!ic) return false;
+    ctx->last_result = ic_arg_const(node->data.literal.i64_value);
     
     /* Set up assembly instruction for printf call */
     ic->x86_opcode = 0xE8; /* CALL instruction */
@@ -639,6 +1222,8 @@ Bool ic_gen_float_literal(ICGenContext *ctx, ASTNode *node) {
     /* In HolyC, float literals are automatically printed */
     CIntermediateCode *ic = ic_gen_add_instruction(ctx, IC_PRINT, float_arg, NULL, NULL);
     if (!ic) return false;
+    ctx->last_result.f64_val = node->data.literal.f64_value;
+    ctx->last_result.type = IC_ARG_FCONST;
     
     /* Set up assembly instruction for printf call */
     ic->x86_opcode = 0xE8; /* CALL instruction */
@@ -666,6 +1251,7 @@ Bool ic_gen_char_literal(ICGenContext *ctx, ASTNode *node) {
     /* In HolyC, character literals are automatically printed */
     CIntermediateCode *ic = ic_gen_add_instruction(ctx, IC_PRINT, char_arg, NULL, NULL);
     if (!ic) return false;
+    ctx->last_result = ic_arg_const(node->data.literal.char_value);
     
     /* Set up assembly instruction for printf call */
     ic->x86_opcode = 0xE8; /* CALL instruction */
@@ -680,13 +1266,251 @@ Bool ic_gen_identifier(ICGenContext *ctx, ASTNode *node) {
     
     printf("DEBUG: Converting identifier: %s\n", node->data.identifier.name);
     
-    /* TODO: Implement identifier handling */
-    /* For now, just create a NOP instruction */
-    CIntermediateCode *ic = ic_gen_add_instruction(ctx, IC_NOP, NULL, NULL, NULL);
-    return ic != NULL;
+    I64 index = ic_var_lookup(ctx, node->data.identifier.name);
+    if (index < 0) {
+        /* Names not declared in this program are treated as globals defined elsewhere */
+        index = ic_var_add(ctx, node->data.identifier.name, 8);
+        if (index < 0) return false;
+        ctx->vars[index].is_global = true;
+    }
+    
+    CICArg var = ic_arg_var(index);
+    if (ctx->vars[index].is_array) {
+        /* Arrays decay to the address of their first element */
+        CICArg res = ic_arg_temp(ctx);
+        if (!ic_gen_emit(ctx, IC_ADDR, &var, NULL, &res)) return false;
+        ctx->last_result = res;
+    } else {
+        ctx->last_result = var;
+    }
+    return true;
+}
+
+/* Evaluate an expression and return the operand holding its value */
+Bool ic_gen_expression(ICGenContext *ctx, ASTNode *node, CICArg *result) {
+    if (!ctx || !node || !result) return false;
+    
+    switch (node->type) {
+        case NODE_INTEGER:
+            *result = ic_arg_const(node->data.literal.i64_value);
+            return true;
+        case NODE_CHAR:
+            *result = ic_arg_const(node->data.literal.char_value);
+            return true;
+        case NODE_BOOLEAN:
+            *result = ic_arg_const(node->data.boolean.value ? 1 : 0);
+            return true;
+        case NODE_FLOAT:
+            result->f64_val = node->data.literal.f64_value;
+            result->type = IC_ARG_FCONST;
+            return true;
+        case NODE_STRING:
+            result->ptr_val = node->data.literal.str_value;
+            result->type = IC_ARG_STRING;
+            return true;
+        default:
+            ctx->last_result = ic_arg_const(0);
+            if (!ic_gen_ast_node(ctx, node)) return false;
+            *result = ctx->last_result;
+            return true;
+    }
+}
+
+/* Map a binary AST operator onto its IC operation (IC_NOP if none) */
+static ICOperation ic_binary_opcode(BinaryOpType op) {
+    switch (op) {
+        case BINOP_ADD: case BINOP_PTR_ADD: case BINOP_ADD_ASSIGN: return IC_ADD;
+        case BINOP_SUB: case BINOP_PTR_SUB: case BINOP_SUB_ASSIGN: return IC_SUB;
+        case BINOP_MUL: case BINOP_MUL_ASSIGN: return IC_MUL;
+        case BINOP_DIV: case BINOP_DIV_ASSIGN: return IC_DIV;
+        case BINOP_MOD: case BINOP_MOD_ASSIGN: return IC_MOD;
+        case BINOP_AND: case BINOP_AND_ASSIGN: return IC_AND;
+        case BINOP_OR: case BINOP_OR_ASSIGN: return IC_OR;
+        case BINOP_XOR: case BINOP_XOR_ASSIGN: return IC_XOR;
+        case BINOP_SHL: case BINOP_SHL_ASSIGN: return IC_SHL;
+        case BINOP_SHR: case BINOP_SHR_ASSIGN: return IC_SHR;
+        case BINOP_EQ: return IC_EQU;
+        case BINOP_NE: return IC_NOT_EQU;
+        case BINOP_LT: return IC_LESS;
+        case BINOP_LE: return IC_LESS_EQU;
+        case BINOP_GT: return IC_GREATER;
+        case BINOP_GE: return IC_GREATER_EQU;
+        default: return IC_NOP;
+    }
+}
+
+/* Size in bytes of a declared type (identifier.type holds the type token) */
+static I64 ic_type_size(U8 *type) {
+    intptr_t token = (intptr_t)type;
+    
+    /* Anything that is not a small token value is a type name string */
+    if (token <= 0 || token > 0xFFFF) return 8;
+    
+    switch ((SchismTokenType)token) {
+        case TK_TYPE_I8: case TK_TYPE_U8: case TK_TYPE_BOOL: return 1;
+        case TK_TYPE_I16: case TK_TYPE_U16: return 2;
+        case TK_TYPE_I32: case TK_TYPE_U32: case TK_TYPE_F32: return 4;
+        default: return 8;
+    }
+}
+
+/* Declare (or reuse) the variable introduced by a NODE_VARIABLE */
+static I64 ic_gen_declare_variable(ICGenContext *ctx, ASTNode *node) {
+    U8 *name = node->data.identifier.name;
+    I64 index = -1;
+    
+    /* Redeclarations in nested blocks share the function's slot */
+    for (I64 i = ctx->var_count - 1; i >= ctx->func_var_base; i--) {
+        if (ctx->vars[i].name && name && strcmp((char*)ctx->vars[i].name, (char*)name) == 0) {
+            index = i;
+            break;
+        }
+    }
+    if (index < 0) {
+        index = ic_var_add(ctx, name, ic_type_size(node->data.identifier.type));
+        if (index < 0) return -1;
+    }
+    if (node->data.identifier.is_array) {
+        ctx->vars[index].is_array = true;
+    }
+    return index;
+}
+
+/*
+ * Resolve the target of an assignment.  Scalars that live in a variable set
+ * *var and return with *is_memory false; everything else yields an address.
+ */
+static Bool ic_gen_lvalue(ICGenContext *ctx, ASTNode *node, CICArg *var, CICArg *addr, I64 *size, Bool *is_memory) {
+    *is_memory = false;
+    *size = 8;
+    
+    switch (node->type) {
+        case NODE_VARIABLE: {
+            I64 index = ic_gen_declare_variable(ctx, node);
+            if (index < 0) return false;
+            *var = ic_arg_var(index);
+            *size = ctx->vars[index].size;
+            return true;
+        }
+        case NODE_IDENTIFIER: {
+            I64 index = ic_var_lookup(ctx, node->data.identifier.name);
+            if (index < 0) {
+                index = ic_var_add(ctx, node->data.identifier.name, 8);
+                if (index < 0) return false;
+                ctx->vars[index].is_global = true;
+            }
+            *var = ic_arg_var(index);
+            *size = ctx->vars[index].size;
+            return true;
+        }
+        case NODE_UNARY_OP:
+            if (node->data.unary_op.op != UNOP_DEREF && node->data.unary_op.op != UNOP_DEREFERENCE) break;
+            *is_memory = true;
+            return ic_gen_expression(ctx, node->data.unary_op.operand, addr);
+        case NODE_POINTER_DEREF:
+            *is_memory = true;
+            return ic_gen_expression(ctx, node->data.pointer_deref.pointer, addr);
+        case NODE_ARRAY_ACCESS:
+        case NODE_SUB_INT_ACCESS:
+            *is_memory = true;
+            return ic_gen_element_address(ctx, node, addr, size);
+        default:
+            break;
+    }
+    
+    printf("ERROR: Unsupported assignment target: %d\n", node->type);
+    return false;
+}
+
+/* Store value (optionally combined with the old value by op) into an lvalue */
+static Bool ic_gen_store(ICGenContext *ctx, ASTNode *target, ASTNode *value_node, CICArg *value_in, BinaryOpType op) {
+    CICArg var, addr, value;
+    I64 size;
+    Bool is_memory;
+    
+    if (!ic_gen_lvalue(ctx, target, &var, &addr, &size, &is_memory)) return false;
+    if (value_in) {
+        value = *value_in;
+    } else if (!ic_gen_expression(ctx, value_node, &value)) {
+        return false;
+    }
+    
+    /* Compound assignment: combine with the current value first */
+    if (op != BINOP_ASSIGN) {
+        ICOperation ic_op = ic_binary_opcode(op);
+        CICArg old = var;
+        CICArg combined = ic_arg_temp(ctx);
+        
+        if (ic_op == IC_NOP) {
+            printf("ERROR: Unsupported assignment operator: %d\n", op);
+            return false;
+        }
+        if (is_memory) {
+            old = ic_arg_temp(ctx);
+            CIntermediateCode *load = ic_gen_emit(ctx, IC_LOAD, &addr, NULL, &old);
+            if (!load) return false;
+            load->memory_operand_size = size;
+        }
+        if (!ic_gen_emit(ctx, ic_op, &old, &value, &combined)) return false;
+        value = combined;
+    }
+    
+    if (is_memory) {
+        CIntermediateCode *store = ic_gen_emit(ctx, IC_STORE, &addr, &value, NULL);
+        if (!store) return false;
+        store->memory_operand_size = size;
+    } else if (!ic_gen_emit(ctx, IC_ASSIGN, &value, NULL, &var)) {
+        return false;
+    }
+    
+    ctx->last_result = is_memory ? value : var;
+    return true;
 }
 
-/* Placeholder implementations for other AST node types */
+/* Materialize &&, || and ^^ as a 0/1 value */
+static Bool ic_gen_logical_value(ICGenContext *ctx, ASTNode *node) {
+    BinaryOpType op = node->data.binary_op.op;
+    
+    if (op == BINOP_XOR_XOR) {
+        /* No short circuit possible: both operands are always evaluated */
+        CICArg left, right, zero = ic_arg_const(0);
+        if (!ic_gen_expression(ctx, node->data.binary_op.left, &left)) return false;
+        if (!ic_gen_expression(ctx, node->data.binary_op.right, &right)) return false;
+        
+        CICArg left_bool = ic_arg_temp(ctx);
+        CICArg right_bool = ic_arg_temp(ctx);
+        CICArg res = ic_arg_temp(ctx);
+        if (!ic_gen_emit(ctx, IC_NOT_EQU, &left, &zero, &left_bool)) return false;
+        if (!ic_gen_emit(ctx, IC_NOT_EQU, &right, &zero, &right_bool)) return false;
+        if (!ic_gen_emit(ctx, IC_XOR, &left_bool, &right_bool, &res)) return false;
+        ctx->last_result = res;
+        return true;
+    }
+    
+    /* The result is written on two paths, so it lives in a hidden variable */
+    I64 index = ic_var_add(ctx, NULL, 8);
+    if (index < 0) return false;
+    
+    CICArg var = ic_arg_var(index);
+    CICArg one = ic_arg_const(1);
+    CICArg zero = ic_arg_const(0);
+    CIntermediateCode *false_label = ic_gen_new_label(ctx);
+    CIntermediateCode *end_label = ic_gen_new_label(ctx);
+    if (!false_label || !end_label) return false;
+    
+    if (!ic_gen_condition_jump(ctx, node, false, false_label)) return false;
+    ic_gen_emit(ctx, IC_ASSIGN, &one, NULL, &var);
+    CICArg end = ic_arg_label(end_label);
+    ic_gen_emit(ctx, IC_JUMP, &end, NULL, NULL);
+    ic_gen_place_label(ctx, false_label);
+    ic_gen_emit(ctx, IC_ASSIGN, &zero, NULL, &var);
+    ic_gen_place_label(ctx, end_label);
+    
+    ctx->last_result = var;
+    return true;
+}
+
+/* Convert binary operation to intermediate code */
 Bool ic_gen_binary_operation(ICGenContext *ctx, ASTNode *node) {
     if (!ctx || !node || node->type != NODE_BINARY_OP) return false;
     
@@ -700,61 +1524,91 @@ Bool ic_gen_binary_operation(ICGenContext *ctx, ASTNode *node) {
             /* Replace the binary operation with the folded constant */
             node->type = folded->type;
             node->data = folded->data;
-            return ic_gen_ast_node(ctx, node);
+            return ic_gen_expression(ctx, node, &ctx->last_result);
         }
     }
     
-    /* Generate intermediate code for left operand */
-    if (!ic_gen_ast_node(ctx, node->data.binary_op.left)) {
-        printf("ERROR: Failed to generate IC for left operand\n");
+    switch (node->data.binary_op.op) {
+        case BINOP_AND_AND:
+        case BINOP_OR_OR:
+        case BINOP_XOR_XOR:
+            return ic_gen_logical_value(ctx, node);
+        case BINOP_ASSIGN: case BINOP_ADD_ASSIGN: case BINOP_SUB_ASSIGN:
+        case BINOP_MUL_ASSIGN: case BINOP_DIV_ASSIGN: case BINOP_MOD_ASSIGN:
+        case BINOP_AND_ASSIGN: case BINOP_OR_ASSIGN: case BINOP_XOR_ASSIGN:
+        case BINOP_SHL_ASSIGN: case BINOP_SHR_ASSIGN:
+            return ic_gen_store(ctx, node->data.binary_op.left, node->data.binary_op.right,
+                                NULL, node->data.binary_op.op);
+        case BINOP_COMMA: {
+            CICArg ignored;
+            if (!ic_gen_expression(ctx, node->data.binary_op.left, &ignored)) return false;
+            return ic_gen_expression(ctx, node->data.binary_op.right, &ctx->last_result);
+        }
+        default:
+            break;
+    }
+    
+    ICOperation ic_op = ic_binary_opcode(node->data.binary_op.op);
+    if (ic_op == IC_NOP) {
+        printf("ERROR: Unsupported binary operator: %d\n", node->data.binary_op.op);
         return false;
     }
     
-    /* Generate intermediate code for right operand */
-    if (!ic_gen_ast_node(ctx, node->data.binary_op.right)) {
+    /* Generate intermediate code for both operands */
+    CICArg left, right;
+    if (!ic_gen_expression(ctx, node->data.binary_op.left, &left)) {
+        printf("ERROR: Failed to generate IC for left operand\n");
+        return false;
+    }
+    if (!ic_gen_expression(ctx, node->data.binary_op.right, &right)) {
         printf("ERROR: Failed to generate IC for right operand\n");
         return false;
     }
     
     /* Create intermediate code instruction for the binary operation */
-    CIntermediateCode *ic = ic_gen_add_instruction(ctx, IC_ADD, NULL, NULL, NULL);
+    CICArg res = ic_arg_temp(ctx);
+    CIntermediateCode *ic = ic_gen_emit(ctx, ic_op, &left, &right, &res);
     if (!ic) {
         printf("ERROR: Failed to create binary operation IC\n");
         return false;
     }
     
-    /* Set operation details based on operator type */
-    switch (node->data.binary_op.op) {
-        case BINOP_ADD:
-            ic->base.ic_code = IC_ADD;
-            break;
-        case BINOP_SUB:
-            ic->base.ic_code = IC_SUB;
-            break;
-        case BINOP_MUL:
-            ic->base.ic_code = IC_MUL;
-            break;
-        case BINOP_DIV:
-            ic->base.ic_code = IC_DIV;
-            break;
-        case BINOP_MOD:
-            ic->base.ic_code = IC_MOD;
-            break;
-        default:
-            printf("ERROR: Unsupported binary operator: %d\n", node->data.binary_op.op);
-            return false;
-    }
-    
-    /* Set register allocation info */
-    ic->reg_count = 3; /* left, right, result registers */
-    ic->reg_alloc[0] = ctx->reg_count++;  /* Temporary register for left operand */
-    ic->reg_alloc[1] = ctx->reg_count++; /* Temporary register for right operand */
-    ic->reg_alloc[2] = ctx->reg_count++; /* Result register */
-    
+    ctx->last_result = res;
     printf("DEBUG: Binary operation IC generated successfully\n");
     return true;
 }
 
+/* Take the address of an lvalue expression */
+Bool ic_gen_address_of(ICGenContext *ctx, ASTNode *node, CICArg *result) {
+    if (!ctx || !node || !result) return false;
+    
+    if (node->type == NODE_IDENTIFIER || node->type == NODE_VARIABLE) {
+        CICArg var, addr;
+        I64 size;
+        Bool is_memory;
+        if (!ic_gen_lvalue(ctx, node, &var, &addr, &size, &is_memory)) return false;
+        
+        /* The variable can now be reached through memory */
+        ctx->vars[var.i64_val].address_taken = true;
+        *result = ic_arg_temp(ctx);
+        return ic_gen_emit(ctx, IC_ADDR, &var, NULL, result) != NULL;
+    }
+    if (node->type == NODE_UNARY_OP &&
+        (node->data.unary_op.op == UNOP_DEREF || node->data.unary_op.op == UNOP_DEREFERENCE)) {
+        return ic_gen_expression(ctx, node->data.unary_op.operand, result);
+    }
+    if (node->type == NODE_POINTER_DEREF) {
+        return ic_gen_expression(ctx, node->data.pointer_deref.pointer, result);
+    }
+    if (node->type == NODE_ARRAY_ACCESS || node->type == NODE_SUB_INT_ACCESS) {
+        I64 size;
+        return ic_gen_element_address(ctx, node, result, &size);
+    }
+    
+    printf("ERROR: Cannot take address of node type %d\n", node->type);
+    return false;
+}
+
 Bool ic_gen_unary_operation(ICGenContext *ctx, ASTNode *node) {
     if (!ctx || !node || node->type != NODE_UNARY_OP) return false;
     
@@ -768,43 +1622,60 @@ Bool ic_gen_unary_operation(ICGenContext *ctx, ASTNode *node) {
             /* Replace the unary operation with the folded constant */
             node->type = folded->type;
             node->data = folded->data;
-            return ic_gen_ast_node(ctx, node);
+            return ic_gen_expression(ctx, node, &ctx->last_result);
         }
     }
     
+    ASTNode *operand = node->data.unary_op.operand;
+    ICOperation ic_op = IC_NOP;
+    
+    switch (node->data.unary_op.op) {
+        case UNOP_PLUS:
+            return ic_gen_expression(ctx, operand, &ctx->last_result);
+        case UNOP_MINUS: ic_op = IC_UNARY_MINUS; break;
+        case UNOP_BITNOT: ic_op = IC_UNARY_BITNOT; break;
+        case UNOP_NOT: ic_op = IC_NOT; break;
+        case UNOP_INC:
+        case UNOP_DEC: {
+            /* Prefix semantics: the result is the updated value */
+            CICArg one = ic_arg_const(1);
+            return ic_gen_store(ctx, operand, NULL, &one,
+                                node->data.unary_op.op == UNOP_INC ? BINOP_ADD_ASSIGN : BINOP_SUB_ASSIGN);
+        }
+        case UNOP_ADDR:
+            return ic_gen_address_of(ctx, operand, &ctx->last_result);
+        case UNOP_DEREF:
+        case UNOP_DEREFERENCE: {
+            CICArg addr;
+            if (!ic_gen_expression(ctx, operand, &addr)) return false;
+            CICArg res = ic_arg_temp(ctx);
+            CIntermediateCode *load = ic_gen_emit(ctx, IC_LOAD, &addr, NULL, &res);
+            if (!load) return false;
+            load->memory_operand_size = 8;
+            ctx->last_result = res;
+            return true;
+        }
+        default:
+            printf("ERROR: Unsupported unary operator: %d\n", node->data.unary_op.op);
+            return false;
+    }
+    
     /* Generate intermediate code for operand */
-    if (!ic_gen_ast_node(ctx, node->data.unary_op.operand)) {
+    CICArg value;
+    if (!ic_gen_expression(ctx, operand, &value)) {
         printf("ERROR: Failed to generate IC for unary operand\n");
         return false;
     }
     
     /* Create intermediate code instruction for the unary operation */
-    CIntermediateCode *ic = ic_gen_add_instruction(ctx, IC_PRINT, NULL, NULL, NULL); // Use IC_PRINT as placeholder
+    CICArg res = ic_arg_temp(ctx);
+    CIntermediateCode *ic = ic_gen_emit(ctx, ic_op, &value, NULL, &res);
     if (!ic) {
         printf("ERROR: Failed to create unary operation IC\n");
         return false;
     }
     
-    /* Set operation details based on operator type */
-    switch (node->data.unary_op.op) {
-        case UNOP_NOT: ic->base.ic_code = IC_PRINT; break; /* Placeholder - need IC_UNARY_NOT */
-        case UNOP_PLUS: ic->base.ic_code = IC_PRINT; break; /* No operation needed */
-        case UNOP_MINUS: ic->base.ic_code = IC_PRINT; break; /* Placeholder - need IC_UNARY_MINUS */
-        case UNOP_BITNOT: ic->base.ic_code = IC_PRINT; break; /* Placeholder - need IC_UNARY_BITNOT */
-        case UNOP_INC: ic->base.ic_code = IC_PRINT; break; /* Placeholder - need IC_UNARY_INC */
-        case UNOP_DEC: ic->base.ic_code = IC_PRINT; break; /* Placeholder - need IC_UNARY_DEC */
-        case UNOP_ADDR: ic->base.ic_code = IC_PRINT; break; /* Placeholder - need IC_UNARY_ADDR */
-        case UNOP_DEREF: ic->base.ic_code = IC_PRINT; break; /* Placeholder - need IC_UNARY_DEREF */
-        default:
-            printf("ERROR: Unsupported unary operator: %d\n", node->data.unary_op.op);
-            return false;
-    }
-    
-    /* Set register allocation info */
-    ic->reg_count = 2; /* operand, result registers */
-    ic->reg_alloc[0] = ctx->reg_count++;  /* Temporary register for operand */
-    ic->reg_alloc[1] = ctx->reg_count++;  /* Result register */
-    
+    ctx->last_result = res;
     printf("DEBUG: Unary operation IC generated successfully\n");
     return true;
 }
@@ -1080,29 +1951,254 @@ const char* ic_get_unary_operator_string(UnaryOpType op) {
     }
 }
 
+/* Compute the address of an array element or sub-int member */
+static Bool ic_gen_element_address(ICGenContext *ctx, ASTNode *node, CICArg *addr, I64 *size) {
+    ASTNode *index_node;
+    CICArg base, index;
+    I64 elem_size = 8;
+    
+    if (node->type == NODE_SUB_INT_ACCESS) {
+        index_node = node->data.sub_int_access.index;
+        if (node->data.sub_int_access.member_size > 0) {
+            elem_size = node->data.sub_int_access.member_size;
+        }
+        /* Sub-int access addresses the variable's own storage */
+        if (!ic_gen_address_of(ctx, node->data.sub_int_access.base_object, &base)) return false;
+    } else {
+        ASTNode *array = node->data.array_access.array;
+        index_node = node->data.array_access.index;
+        if (array && array->type == NODE_IDENTIFIER) {
+            I64 var = ic_var_lookup(ctx, array->data.identifier.name);
+            if (var >= 0 && ctx->vars[var].is_array) {
+                elem_size = ctx->vars[var].size;
+            }
+        }
+        if (!ic_gen_expression(ctx, array, &base)) return false;
+    }
+    
+    if (index_node) {
+        if (!ic_gen_expression(ctx, index_node, &index)) return false;
+    } else {
+        index = ic_arg_const(0);
+    }
+    *size = elem_size;
+    
+    /* Constant indices fold into a constant offset */
+    CICArg offset;
+    if (index.type == IC_ARG_CONST) {
+        offset = ic_arg_const(index.i64_val * elem_size);
+        if (offset.i64_val == 0) {
+            *addr = base;
+            return true;
+        }
+    } else if (elem_size == 1) {
+        offset = index;
+    } else {
+        CICArg scale = ic_arg_const(elem_size);
+        offset = ic_arg_temp(ctx);
+        if (!ic_gen_emit(ctx, IC_MUL, &index, &scale, &offset)) return false;
+    }
+    
+    *addr = ic_arg_temp(ctx);
+    return ic_gen_emit(ctx, IC_ADD, &base, &offset, addr) != NULL;
+}
+
+/* Load through a pointer, array element or sub-int member */
+Bool ic_gen_memory_access(ICGenContext *ctx, ASTNode *node) {
+    if (!ctx || !node) return false;
+    
+    CICArg addr;
+    I64 size = 8;
+    
+    if (node->type == NODE_POINTER_DEREF) {
+        if (!ic_gen_expression(ctx, node->data.pointer_deref.pointer, &addr)) return false;
+    } else if (!ic_gen_element_address(ctx, node, &addr, &size)) {
+        return false;
+    }
+    
+    CICArg res = ic_arg_temp(ctx);
+    CIntermediateCode *load = ic_gen_emit(ctx, IC_LOAD, &addr, NULL, &res);
+    if (!load) return false;
+    load->memory_operand_size = size;
+    
+    ctx->last_result = res;
+    return true;
+}
+
+/*
+ * Branch to label when the condition evaluates to jump_if, otherwise fall
+ * through.  &&, || and ! are lowered to control flow instead of values.
+ */
+Bool ic_gen_condition_jump(ICGenContext *ctx, ASTNode *node, Bool jump_if, CIntermediateCode *label) {
+    if (!ctx || !node || !label) return false;
+    
+    CICArg target = ic_arg_label(label);
+    
+    if (node->type == NODE_BINARY_OP &&
+        (node->data.binary_op.op == BINOP_AND_AND || node->data.binary_op.op == BINOP_OR_OR)) {
+        /* a && b jumps on false as soon as either side is false; a || b dually on true */
+        Bool short_value = node->data.binary_op.op == BINOP_OR_OR;
+        
+        if (jump_if == short_value) {
+            if (!ic_gen_condition_jump(ctx, node->data.binary_op.left, jump_if, label)) return false;
+            return ic_gen_condition_jump(ctx, node->data.binary_op.right, jump_if, label);
+        }
+        
+        CIntermediateCode *skip = ic_gen_new_label(ctx);
+        if (!skip) return false;
+        if (!ic_gen_condition_jump(ctx, node->data.binary_op.left, short_value, skip)) return false;
+        if (!ic_gen_condition_jump(ctx, node->data.binary_op.right, jump_if, label)) return false;
+        ic_gen_place_label(ctx, skip);
+        return true;
+    }
+    
+    if (node->type == NODE_UNARY_OP && node->data.unary_op.op == UNOP_NOT) {
+        return ic_gen_condition_jump(ctx, node->data.unary_op.operand, !jump_if, label);
+    }
+    
+    CICArg value;
+    if (!ic_gen_expression(ctx, node, &value)) return false;
+    
+    if (value.type == IC_ARG_CONST) {
+        /* Statically known: either always jump or never */
+        if ((value.i64_val != 0) == jump_if) {
+            return ic_gen_emit(ctx, IC_JUMP, &target, NULL, NULL) != NULL;
+        }
+        return true;
+    }
+    
+    return ic_gen_emit(ctx, jump_if ? IC_JUMP_TRUE : IC_JUMP_FALSE, &value, &target, NULL) != NULL;
+}
+
+/* Conditional expression (c ? a : b) */
+Bool ic_gen_conditional(ICGenContext *ctx, ASTNode *node) {
+    if (!ctx || !node || node->type != NODE_CONDITIONAL) return false;
+    
+    I64 index = ic_var_add(ctx, NULL, 8);
+    if (index < 0) return false;
+    
+    CICArg var = ic_arg_var(index);
+    CIntermediateCode *else_label = ic_gen_new_label(ctx);
+    CIntermediateCode *end_label = ic_gen_new_label(ctx);
+    if (!else_label || !end_label) return false;
+    
+    if (!ic_gen_condition_jump(ctx, node->data.conditional.condition, false, else_label)) return false;
+    
+    CICArg value;
+    if (!ic_gen_expression(ctx, node->data.conditional.true_expr, &value)) return false;
+    ic_gen_emit(ctx, IC_ASSIGN, &value, NULL, &var);
+    CICArg end = ic_arg_label(end_label);
+    ic_gen_emit(ctx, IC_JUMP, &end, NULL, NULL);
+    
+    ic_gen_place_label(ctx, else_label);
+    if (!ic_gen_expression(ctx, node->data.conditional.false_expr, &value)) return false;
+    ic_gen_emit(ctx, IC_ASSIGN, &value, NULL, &var);
+    ic_gen_place_label(ctx, end_label);
+    
+    ctx->last_result = var;
+    return true;
+}
+
+/* Chained range comparison (lo < x <= hi ...), evaluated left to right */
+Bool ic_gen_range_comparison(ICGenContext *ctx, ASTNode *node) {
+    if (!ctx || !node || node->type != NODE_RANGE_COMPARISON) return false;
+    
+    I64 index = ic_var_add(ctx, NULL, 8);
+    if (index < 0) return false;
+    
+    CICArg var = ic_arg_var(index);
+    CICArg one = ic_arg_const(1);
+    CICArg zero = ic_arg_const(0);
+    CIntermediateCode *false_label = ic_gen_new_label(ctx);
+    CIntermediateCode *end_label = ic_gen_new_label(ctx);
+    if (!false_label || !end_label) return false;
+    CICArg false_target = ic_arg_label(false_label);
+    
+    ASTNode *expr = node->data.range_comparison.expressions;
+    ASTNode *op = node->data.range_comparison.operators;
+    CICArg left;
+    if (!expr || !ic_gen_expression(ctx, expr, &left)) return false;
+    
+    /* Each operand is evaluated once and only if all earlier links held */
+    for (expr = expr->next; expr && op; expr = expr->next, op = op->next) {
+        CICArg right, cmp = ic_arg_temp(ctx);
+        if (!ic_gen_expression(ctx, expr, &right)) return false;
+        if (!ic_gen_emit(ctx, ic_binary_opcode(op->data.binary_op.op), &left, &right, &cmp)) return false;
+        if (!ic_gen_emit(ctx, IC_JUMP_FALSE, &cmp, &false_target, NULL)) return false;
+        left = right;
+    }
+    
+    ic_gen_emit(ctx, IC_ASSIGN, &one, NULL, &var);
+    CICArg end = ic_arg_label(end_label);
+    ic_gen_emit(ctx, IC_JUMP, &end, NULL, NULL);
+    ic_gen_place_label(ctx, false_label);
+    ic_gen_emit(ctx, IC_ASSIGN, &zero, NULL, &var);
+    ic_gen_place_label(ctx, end_label);
+    
+    ctx->last_result = var;
+    return true;
+}
+
 Bool ic_gen_function_call(ICGenContext *ctx, ASTNode *node) {
     if (!ctx || !node || node->type != NODE_CALL) return false;
     
     printf("DEBUG: Generating intermediate code for function call: %s\n", 
            node->data.call.name ? (char*)node->data.call.name : "unknown");
     
-    /* Generate intermediate code for function arguments if present */
-    if (node->data.call.arguments) {
+    ASTNode *first_arg = node->data.call.arguments ? node->data.call.arguments->data.block.statements : NULL;
+    I64 arg_count = 0;
+    for (ASTNode *arg = first_arg; arg; arg = arg->next) {
+        arg_count++;
+    }
+    
+    /* Evaluate every argument before any of them is pushed */
+    CICArg *values = NULL;
+    if (arg_count > 0) {
         printf("DEBUG: Processing function call arguments\n");
-        if (!ic_gen_ast_node(ctx, node->data.call.arguments)) {
-            printf("ERROR: Failed to generate intermediate code for function call arguments\n");
-            return false;
+        values = malloc(sizeof(CICArg) * arg_count);
+        if (!values) return false;
+        
+        I64 i = 0;
+        for (ASTNode *arg = first_arg; arg; arg = arg->next, i++) {
+            if (!ic_gen_expression(ctx, arg, &values[i])) {
+                printf("ERROR: Failed to generate intermediate code for function call arguments\n");
+                free(values);
+                return false;
+            }
         }
+        
+        /* Heap calls get their own opcodes so escape analysis can follow them */
+        U8 *name = node->data.call.name;
+        if (name && arg_count == 1 && (strcmp((char*)name, "MAlloc") == 0 || strcmp((char*)name, "Free") == 0)) {
+            Bool is_malloc = strcmp((char*)name, "MAlloc") == 0;
+            CICArg res = is_malloc ? ic_arg_temp(ctx) : ic_arg_const(0);
+            CIntermediateCode *ic = ic_gen_emit(ctx, is_malloc ? IC_MALLOC : IC_FREE, &values[0], NULL,
+                                                is_malloc ? &res : NULL);
+            free(values);
+            if (!ic) return false;
+            ic_gen_profile(ctx, ic, node);
+            ctx->last_result = res;
+            return true;
+        }
+        
+        for (i = 0; i < arg_count; i++) {
+            ic_gen_emit(ctx, IC_PUSH, &values[i], NULL, NULL);
+        }
+        free(values);
     }
     
     /* Generate function call instruction */
-    CIntermediateCode *ic = ic_gen_add_instruction(ctx, IC_CALL, 
-        (void*)node->data.call.name, NULL, NULL);
+    CICArg sym = ic_arg_symbol(node->data.call.name);
+    CICArg res = ic_arg_temp(ctx);
+    CIntermediateCode *ic = ic_gen_emit(ctx, IC_CALL, &sym, NULL, &res);
     if (!ic) {
         printf("ERROR: Failed to add function call instruction\n");
         return false;
     }
+    ic->ic_data = arg_count;
+    ic_gen_profile(ctx, ic, node);
     
+    ctx->last_result = res;
     printf("DEBUG: Function call intermediate code generated successfully\n");
     return true;
 }
@@ -1112,16 +2208,16 @@ Bool ic_gen_assignment(ICGenContext *ctx, ASTNode *node) {
     
     printf("DEBUG: Generating intermediate code for assignment\n");
     
-    /* Generate intermediate code for right-hand side expression */
-    if (node->data.assignment.right) {
-        if (!ic_gen_ast_node(ctx, node->data.assignment.right)) {
-            printf("ERROR: Failed to generate IC for assignment right-hand side\n");
-            return false;
-        }
+    if (!node->data.assignment.left || !node->data.assignment.right) {
+        printf("ERROR: Incomplete assignment\n");
+        return false;
     }
     
-    /* For now, we'll just generate a simple assignment instruction */
-    /* TODO: Implement proper variable assignment with memory addressing */
+    if (!ic_gen_store(ctx, node->data.assignment.left, node->data.assignment.right,
+                      NULL, node->data.assignment.op)) {
+        printf("ERROR: Failed to generate IC for assignment\n");
+        return false;
+    }
     
     printf("DEBUG: Assignment intermediate code generated successfully\n");
     return true;
@@ -1133,9 +2229,11 @@ Bool ic_gen_variable_declaration(ICGenContext *ctx, ASTNode *node) {
     printf("DEBUG: Generating intermediate code for variable declaration: %s\n", 
            node->data.identifier.name ? (char*)node->data.identifier.name : "unnamed");
     
-    /* For variable declarations, we don't need to generate any intermediate code */
-    /* The variable is already added to the scope during parsing */
-    /* We just need to ensure it's properly tracked for later use */
+    /* Declarations only reserve a variable; initializers arrive as assignments */
+    if (ic_gen_declare_variable(ctx, node) < 0) {
+        printf("ERROR: Failed to declare variable\n");
+        return false;
+    }
     
     printf("DEBUG: Variable declaration intermediate code generated successfully\n");
     return true;
@@ -1147,6 +2245,35 @@ Bool ic_gen_function_declaration(ICGenContext *ctx, ASTNode *node) {
     printf("DEBUG: Generating intermediate code for function: %s\n", 
            node->data.function.name ? (char*)node->data.function.name : "unknown");
     
+    CICArg sym = ic_arg_symbol(node->data.function.name);
+    CIntermediateCode *enter = ic_gen_begin_function(ctx, &sym);
+    if (!enter) return false;
+    ic_gen_profile(ctx, enter, node);
+    
+    /* Incoming arguments become variables defined by IC_PARAM */
+    I64 param_count = 0;
+    if (node->data.function.parameters) {
+        ASTNode *param = node->data.function.parameters->children;
+        for (; param; param = param->next) {
+            ASTNode *var_node = param;
+            if (param->type == NODE_DEFAULT_ARG) {
+                var_node = param->data.default_arg.parameter;
+            }
+            if (!var_node || var_node->type != NODE_VARIABLE) continue;
+            
+            I64 index = ic_var_add(ctx, var_node->data.variable.name, 8);
+            if (index < 0) return false;
+            ctx->vars[index].is_parameter = true;
+            ctx->vars[index].param_index = param_count;
+            
+            CICArg var = ic_arg_var(index);
+            CIntermediateCode *ic = ic_gen_emit(ctx, IC_PARAM, NULL, NULL, &var);
+            if (!ic) return false;
+            ic->ic_data = param_count++;
+        }
+    }
+    enter->ic_data = param_count;
+    
     /* Generate intermediate code for function body */
     if (node->data.function.body) {
         if (!ic_gen_block_statement(ctx, node->data.function.body)) {
@@ -1155,22 +2282,110 @@ Bool ic_gen_function_declaration(ICGenContext *ctx, ASTNode *node) {
         }
     }
     
+    ic_gen_emit(ctx, IC_LEAVE, &sym, NULL, NULL);
     printf("DEBUG: Function declaration intermediate code generated successfully\n");
     return true;
 }
 
 Bool ic_gen_if_statement(ICGenContext *ctx, ASTNode *node) {
-    printf("DEBUG: If statement not yet implemented\n");
+    if (!ctx || !node) return false;
+    
+    printf("DEBUG: Generating intermediate code for if statement\n");
+    
+    CIntermediateCode *else_label = ic_gen_new_label(ctx);
+    if (!else_label) return false;
+    
+    if (!ic_gen_condition_jump(ctx, node->data.if_stmt.condition, false, else_label)) return false;
+    if (node->data.if_stmt.then_stmt && !ic_gen_ast_node(ctx, node->data.if_stmt.then_stmt)) return false;
+    
+    if (node->data.if_stmt.else_stmt) {
+        CIntermediateCode *end_label = ic_gen_new_label(ctx);
+        if (!end_label) return false;
+        CICArg end = ic_arg_label(end_label);
+        ic_gen_emit(ctx, IC_JUMP, &end, NULL, NULL);
+        ic_gen_place_label(ctx, else_label);
+        if (!ic_gen_ast_node(ctx, node->data.if_stmt.else_stmt)) return false;
+        ic_gen_place_label(ctx, end_label);
+    } else {
+        ic_gen_place_label(ctx, else_label);
+    }
     return true;
 }
 
+/* Generate a loop body with break/continue bound to the given labels */
+static Bool ic_gen_loop_body(ICGenContext *ctx, ASTNode *body, CIntermediateCode *break_label, CIntermediateCode *continue_label) {
+    CIntermediateCode *saved_break = ctx->break_label;
+    CIntermediateCode *saved_continue = ctx->continue_label;
+    Bool ok = true;
+    
+    ctx->break_label = break_label;
+    ctx->continue_label = continue_label;
+    if (body) ok = ic_gen_ast_node(ctx, body);
+    ctx->break_label = saved_break;
+    ctx->continue_label = saved_continue;
+    return ok;
+}
+
 Bool ic_gen_while_statement(ICGenContext *ctx, ASTNode *node) {
-    printf("DEBUG: While statement not yet implemented\n");
+    if (!ctx || !node) return false;
+    
+    printf("DEBUG: Generating intermediate code for while statement\n");
+    
+    CIntermediateCode *top_label = ic_gen_new_label(ctx);
+    CIntermediateCode *exit_label = ic_gen_new_label(ctx);
+    if (!top_label || !exit_label) return false;
+    
+    ic_gen_place_label(ctx, top_label);
+    if (!ic_gen_condition_jump(ctx, node->data.while_stmt.condition, false, exit_label)) return false;
+    if (!ic_gen_loop_body(ctx, node->data.while_stmt.body_stmt, exit_label, top_label)) return false;
+    
+    CICArg top = ic_arg_label(top_label);
+    ic_gen_emit(ctx, IC_JUMP, &top, NULL, NULL);
+    ic_gen_place_label(ctx, exit_label);
+    return true;
+}
+
+Bool ic_gen_do_while_statement(ICGenContext *ctx, ASTNode *node) {
+    if (!ctx || !node || node->type != NODE_DO_WHILE_STMT) return false;
+    
+    printf("DEBUG: Generating intermediate code for do-while statement\n");
+    
+    CIntermediateCode *top_label = ic_gen_new_label(ctx);
+    CIntermediateCode *test_label = ic_gen_new_label(ctx);
+    CIntermediateCode *exit_label = ic_gen_new_label(ctx);
+    if (!top_label || !test_label || !exit_label) return false;
+    
+    ic_gen_place_label(ctx, top_label);
+    if (!ic_gen_loop_body(ctx, node->data.do_while_stmt.body, exit_label, test_label)) return false;
+    ic_gen_place_label(ctx, test_label);
+    if (!ic_gen_condition_jump(ctx, node->data.do_while_stmt.condition, true, top_label)) return false;
+    ic_gen_place_label(ctx, exit_label);
     return true;
 }
 
 Bool ic_gen_for_statement(ICGenContext *ctx, ASTNode *node) {
-    printf("DEBUG: For statement not yet implemented\n");
+    if (!ctx || !node) return false;
+    
+    printf("DEBUG: Generating intermediate code for for statement\n");
+    
+    if (node->data.for_stmt.init && !ic_gen_ast_node(ctx, node->data.for_stmt.init)) return false;
+    
+    CIntermediateCode *top_label = ic_gen_new_label(ctx);
+    CIntermediateCode *step_label = ic_gen_new_label(ctx);
+    CIntermediateCode *exit_label = ic_gen_new_label(ctx);
+    if (!top_label || !step_label || !exit_label) return false;
+    
+    ic_gen_place_label(ctx, top_label);
+    if (node->data.for_stmt.condition &&
+        !ic_gen_condition_jump(ctx, node->data.for_stmt.condition, false, exit_label)) return false;
+    if (!ic_gen_loop_body(ctx, node->data.for_stmt.body, exit_label, step_label)) return false;
+    
+    ic_gen_place_label(ctx, step_label);
+    if (node->data.for_stmt.increment && !ic_gen_ast_node(ctx, node->data.for_stmt.increment)) return false;
+    
+    CICArg top = ic_arg_label(top_label);
+    ic_gen_emit(ctx, IC_JUMP, &top, NULL, NULL);
+    ic_gen_place_label(ctx, exit_label);
     return true;
 }
 
@@ -1182,34 +2397,30 @@ Bool ic_gen_return_statement(ICGenContext *ctx, ASTNode *node) {
            node->data.return_stmt.return_value, 
            node->data.return_stmt.expression);
     
-    /* Generate intermediate code for return expression if present */
+    CICArg value;
     if (node->data.return_stmt.expression) {
         printf("DEBUG: Processing return expression\n");
-        if (!ic_gen_ast_node(ctx, node->data.return_stmt.expression)) {
+        if (!ic_gen_expression(ctx, node->data.return_stmt.expression, &value)) {
             printf("ERROR: Failed to generate intermediate code for return expression\n");
             return false;
         }
         printf("DEBUG: Return expression processed successfully\n");
-    } else {
+    } else if (node->data.return_stmt.return_value != 0) {
         /* Simple return value (like return 42;) */
-        if (node->data.return_stmt.return_value != 0) {
-            /* Generate intermediate code for the return value */
-            CIntermediateCode *ic = ic_gen_add_instruction(ctx, IC_RETURN_VAL, 
-                (void*)node->data.return_stmt.return_value, NULL, NULL);
-            if (!ic) {
-                printf("ERROR: Failed to add return value instruction\n");
-                return false;
-            }
-            printf("DEBUG: Added return value instruction: %lld\n", node->data.return_stmt.return_value);
-        } else {
-            /* No return value, just return */
-            CIntermediateCode *ic = ic_gen_add_instruction(ctx, IC_RETURN, NULL, NULL, NULL);
-            if (!ic) {
-                printf("ERROR: Failed to add return instruction\n");
-                return false;
-            }
-            printf("DEBUG: Added return instruction\n");
+        value = ic_arg_const(node->data.return_stmt.return_value);
+    } else {
+        /* No return value, just return */
+        if (!ic_gen_emit(ctx, IC_RETURN, NULL, NULL, NULL)) {
+            printf("ERROR: Failed to add return instruction\n");
+            return false;
         }
+        printf("DEBUG: Added return instruction\n");
+        return true;
+    }
+    
+    if (!ic_gen_emit(ctx, IC_RETURN_VAL, &value, NULL, NULL)) {
+        printf("ERROR: Failed to add return value instruction\n");
+        return false;
     }
     
     printf("DEBUG: Return statement intermediate code generated successfully\n");
@@ -1242,6 +2453,17 @@ Bool ic_gen_block_statement(ICGenContext *ctx, ASTNode *node) {
 }
 
 Bool ic_gen_assembly_block(ICGenContext *ctx, ASTNode *node) {
-    printf("DEBUG: Assembly block not yet implemented\n");
+    if (!ctx || !node) return false;
+    
+    printf("DEBUG: Generating intermediate code for assembly block\n");
+    
+    /* The block stays opaque; it may touch any local of the function */
+    for (I64 i = ctx->func_var_base; i < ctx->var_count; i++) {
+        ctx->vars[i].is_volatile = true;
+    }
+    
+    CIntermediateCode *ic = ic_gen_emit(ctx, IC_ASM_INLINE, NULL, NULL, NULL);
+    if (!ic) return false;
+    ic->ic_data = (I64)node;
     return true;
 }
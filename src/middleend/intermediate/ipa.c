@@ -0,0 +1,878 @@
+/*
+ * Interprocedural Optimization
+ * Builds the call graph of the user functions from the AST and uses it to
+ * propagate constant arguments into callees, specialize functions for the
+ * constants some of their callers pass and drop functions nothing calls
+ */
+
+#include "ipa.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+typedef void (*IPAVisit)(ASTNode *node, void *data);
+
+/*
+ * AST Links
+ * The child pointers of a node, split into single children and heads of
+ * next-linked lists. Node types the pass does not know may hide calls or
+ * parameter uses, so ipa_links returns false for them.
+ */
+typedef struct {
+    ASTNode **node[4];
+    I64 node_count;
+    ASTNode **list[2];
+    I64 list_count;
+} IPALinks;
+
+static void ipa_link(IPALinks *links, ASTNode **child) {
+    links->node[links->node_count++] = child;
+}
+
+static void ipa_link_list(IPALinks *links, ASTNode **head) {
+    links->list[links->list_count++] = head;
+}
+
+static Bool ipa_in_list(ASTNode *head, ASTNode *node) {
+    for (; head; head = head->next) {
+        if (head == node) return true;
+    }
+    return false;
+}
+
+static Bool ipa_links(ASTNode *node, IPALinks *links) {
+    links->node_count = links->list_count = 0;
+
+    switch (node->type) {
+        case NODE_PROGRAM:
+            ipa_link_list(links, &node->children);
+            return true;
+        case NODE_FUNCTION:
+            ipa_link(links, &node->data.function.parameters);
+            ipa_link(links, &node->data.function.body);
+            return true;
+        case NODE_BLOCK:
+            /* Statement blocks keep one list in both fields, parameter lists only in children */
+            if (node->data.block.statements) ipa_link_list(links, &node->data.block.statements);
+            if (node->children && node->children != node->data.block.statements) ipa_link_list(links, &node->children);
+            return true;
+        case NODE_CALL:
+            ipa_link(links, &node->data.call.arguments);
+            return true;
+        case NODE_FUNC_CALL_NO_PARENS:
+            ipa_link(links, &node->data.func_call_no_parens.arguments);
+            return true;
+        case NODE_DEFAULT_ARG:
+            ipa_link(links, &node->data.default_arg.parameter);
+            ipa_link(links, &node->data.default_arg.default_value);
+            return true;
+        case NODE_ASSIGNMENT:
+            ipa_link(links, &node->data.assignment.left);
+            ipa_link(links, &node->data.assignment.right);
+            return true;
+        case NODE_BINARY_OP:
+            ipa_link(links, &node->data.binary_op.left);
+            ipa_link(links, &node->data.binary_op.right);
+            return true;
+        case NODE_UNARY_OP:
+            ipa_link(links, &node->data.unary_op.operand);
+            return true;
+        case NODE_RETURN:
+            ipa_link(links, &node->data.return_stmt.expression);
+            return true;
+        case NODE_RANGE_COMPARISON:
+            ipa_link_list(links, &node->data.range_comparison.expressions);
+            ipa_link_list(links, &node->data.range_comparison.operators);
+            return true;
+        case NODE_CONDITIONAL:
+            ipa_link(links, &node->data.conditional.condition);
+            ipa_link(links, &node->data.conditional.true_expr);
+            ipa_link(links, &node->data.conditional.false_expr);
+            return true;
+        case NODE_IF_STMT:
+            ipa_link(links, &node->data.if_stmt.condition);
+            ipa_link(links, &node->data.if_stmt.then_stmt);
+            ipa_link(links, &node->data.if_stmt.else_stmt);
+            return true;
+        case NODE_WHILE_STMT:
+            ipa_link(links, &node->data.while_stmt.condition);
+            ipa_link(links, &node->data.while_stmt.body_stmt);
+            return true;
+        case NODE_DO_WHILE_STMT:
+            ipa_link(links, &node->data.do_while_stmt.body);
+            ipa_link(links, &node->data.do_while_stmt.condition);
+            return true;
+        case NODE_FOR_STMT:
+            ipa_link(links, &node->data.for_stmt.init);
+            ipa_link(links, &node->data.for_stmt.condition);
+            ipa_link(links, &node->data.for_stmt.increment);
+            ipa_link(links, &node->data.for_stmt.body);
+            return true;
+        case NODE_SWITCH:
+            ipa_link(links, &node->data.switch_stmt.expression);
+            ipa_link_list(links, &node->data.switch_stmt.cases);
+            /* The default case may or may not also sit in the case list */
+            if (!ipa_in_list(node->data.switch_stmt.cases, node->data.switch_stmt.default_case)) {
+                ipa_link(links, &node->data.switch_stmt.default_case);
+            }
+            return true;
+        case NODE_CASE:
+            ipa_link(links, &node->data.case_stmt.value);
+            ipa_link(links, &node->data.case_stmt.range_start);
+            ipa_link(links, &node->data.case_stmt.range_end);
+            ipa_link_list(links, &node->data.case_stmt.body);
+            return true;
+        case NODE_START_BLOCK:
+        case NODE_END_BLOCK:
+            ipa_link_list(links, &node->data.start_end_block.statements);
+            return true;
+        case NODE_ARRAY_ACCESS:
+            ipa_link(links, &node->data.array_access.array);
+            ipa_link(links, &node->data.array_access.index);
+            return true;
+        case NODE_ARRAY_INIT:
+            ipa_link_list(links, &node->data.array_init.elements);
+            return true;
+        case NODE_POINTER_DEREF:
+            ipa_link(links, &node->data.pointer_deref.pointer);
+            return true;
+        case NODE_ADDRESS_OF:
+            ipa_link(links, &node->data.address_of.variable);
+            return true;
+        case NODE_MEMBER_ACCESS:
+            ipa_link(links, &node->data.member_access.object);
+            return true;
+        case NODE_SUB_INT_ACCESS:
+            ipa_link(links, &node->data.sub_int_access.base_object);
+            ipa_link(links, &node->data.sub_int_access.index);
+            return true;
+        case NODE_ENHANCED_CAST:
+            ipa_link(links, &node->data.enhanced_cast.expression);
+            return true;
+        case NODE_TYPE_INFERENCE:
+            ipa_link(links, &node->data.type_inference.expression);
+            return true;
+        case NODE_THROW_STMT:
+            ipa_link(links, &node->data.throw_stmt.exception);
+            return true;
+        case NODE_IDENTIFIER:
+        case NODE_VARIABLE:
+        case NODE_INTEGER:
+        case NODE_FLOAT:
+        case NODE_STRING:
+        case NODE_CHAR:
+        case NODE_BOOLEAN:
+        case NODE_MULTI_CHAR_CONST:
+        case NODE_TYPE_SPECIFIER:
+        case NODE_VARARGS:
+        case NODE_BREAK:
+        case NODE_CONTINUE:
+        case NODE_GOTO:
+        case NODE_LABEL:
+        case NODE_REG_DIRECTIVE:
+        case NODE_CLASS_DEF:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Visit node and everything under it; false if some node was not understood */
+static Bool ipa_walk(ASTNode *node, IPAVisit visit, void *data) {
+    if (!node) return true;
+
+    visit(node, data);
+
+    IPALinks links;
+    Bool known = ipa_links(node, &links);
+    for (I64 i = 0; i < links.node_count; i++) {
+        if (!ipa_walk(*links.node[i], visit, data)) known = false;
+    }
+    for (I64 i = 0; i < links.list_count; i++) {
+        for (ASTNode *item = *links.list[i]; item; item = item->next) {
+            if (!ipa_walk(item, visit, data)) known = false;
+        }
+    }
+    return known;
+}
+
+static U8* ipa_strdup(const U8 *text) {
+    if (!text) return NULL;
+    U8 *copy = malloc(strlen((const char*)text) + 1);
+    if (copy) strcpy((char*)copy, (const char*)text);
+    return copy;
+}
+
+/*
+ * AST Cloning
+ * Deep copy of a subtree. Each link of the copy sits at the same offset as
+ * in the original, so ipa_links drives the copy for every node type.
+ */
+
+static ASTNode* ipa_clone(ASTNode *node);
+
+static ASTNode* ipa_clone_list(ASTNode *head, ASTNode *parent, Bool *ok) {
+    ASTNode *first = NULL, *last = NULL;
+    for (; head; head = head->next) {
+        ASTNode *copy = ipa_clone(head);
+        if (!copy) {
+            *ok = false;
+            break;
+        }
+        copy->parent = parent;
+        copy->prev = last;
+        if (last) last->next = copy;
+        else first = copy;
+        last = copy;
+    }
+    return first;
+}
+
+static ASTNode* ipa_clone(ASTNode *node) {
+    if (!node) return NULL;
+
+    IPALinks links;
+    if (!ipa_links(node, &links) || node->type == NODE_PROGRAM) return NULL;
+
+    ASTNode *copy = malloc(sizeof(ASTNode));
+    if (!copy) return NULL;
+    memcpy(copy, node, sizeof(ASTNode));
+    copy->parent = copy->children = copy->next = copy->prev = NULL;
+    copy->assembly_generated = false;
+    copy->assembly_code = NULL;
+    copy->assembly_size = 0;
+    copy->intermediate = NULL;
+    copy->profile_id = 0;
+
+    /* Names are freed with their node */
+    switch (node->type) {
+        case NODE_FUNCTION:   copy->data.function.name = ipa_strdup(node->data.function.name); break;
+        case NODE_CALL:       copy->data.call.name = ipa_strdup(node->data.call.name); break;
+        case NODE_IDENTIFIER: copy->data.identifier.name = ipa_strdup(node->data.identifier.name); break;
+        case NODE_VARIABLE:   copy->data.variable.name = ipa_strdup(node->data.variable.name); break;
+        case NODE_STRING:     copy->data.literal.str_value = ipa_strdup(node->data.literal.str_value); break;
+        default: break;
+    }
+
+    Bool ok = true;
+    for (I64 i = 0; i < links.node_count; i++) {
+        ASTNode **slot = (ASTNode**)((char*)copy + ((char*)links.node[i] - (char*)node));
+        *slot = ipa_clone(*links.node[i]);
+        if (*links.node[i] && !*slot) ok = false;
+        if (*slot) (*slot)->parent = copy;
+    }
+    for (I64 i = 0; i < links.list_count; i++) {
+        ASTNode **slot = (ASTNode**)((char*)copy + ((char*)links.list[i] - (char*)node));
+        *slot = ipa_clone_list(*links.list[i], copy, &ok);
+    }
+
+    if (node->type == NODE_BLOCK && node->children == node->data.block.statements) {
+        copy->children = copy->data.block.statements;
+    }
+    if (node->type == NODE_SWITCH && ipa_in_list(node->data.switch_stmt.cases, node->data.switch_stmt.default_case)) {
+        ASTNode *original = node->data.switch_stmt.cases;
+        ASTNode *cloned = copy->data.switch_stmt.cases;
+        while (original && cloned && original != node->data.switch_stmt.default_case) {
+            original = original->next;
+            cloned = cloned->next;
+        }
+        copy->data.switch_stmt.default_case = cloned;
+    }
+
+    /* A partial copy is unusable; its nodes are left to leak */
+    return ok ? copy : NULL;
+}
+
+/*
+ * Call Graph
+ * One IPAFunction per user function with a body. Direct calls are the
+ * call sites; a function named anywhere else may be called through a
+ * pointer, so its parameters are left alone.
+ */
+
+static IPAFunction* ipa_find(CallGraph *graph, U8 *name) {
+    if (!name) return NULL;
+    for (I64 i = 0; i < graph->function_count; i++) {
+        U8 *function_name = graph->functions[i].node->data.function.name;
+        if (function_name && strcmp((char*)function_name, (char*)name) == 0) return &graph->functions[i];
+    }
+    return NULL;
+}
+
+static I64 ipa_param_index(IPAFunction *fn, U8 *name) {
+    if (!name) return -1;
+    for (I64 i = 0; i < fn->param_count; i++) {
+        U8 *param_name = fn->params[i] ? fn->params[i]->data.variable.name : NULL;
+        if (param_name && strcmp((char*)param_name, (char*)name) == 0) return i;
+    }
+    return -1;
+}
+
+static Bool ipa_is_assignment(BinaryOpType op) {
+    return op >= BINOP_ASSIGN && op <= BINOP_SHR_ASSIGN;
+}
+
+static void ipa_write(IPAFunction *fn, ASTNode *target) {
+    if (!target || target->type != NODE_IDENTIFIER) return;
+    I64 index = ipa_param_index(fn, target->data.identifier.name);
+    if (index >= 0) fn->written[index] = true;
+}
+
+static void ipa_scan_body(ASTNode *node, void *data) {
+    IPAFunction *fn = data;
+    fn->size++;
+
+    switch (node->type) {
+        case NODE_ASSIGNMENT:
+            ipa_write(fn, node->data.assignment.left);
+            break;
+        case NODE_BINARY_OP:
+            if (ipa_is_assignment(node->data.binary_op.op)) ipa_write(fn, node->data.binary_op.left);
+            break;
+        case NODE_UNARY_OP:
+            if (node->data.unary_op.op == UNOP_INC || node->data.unary_op.op == UNOP_DEC ||
+                node->data.unary_op.op == UNOP_ADDR) {
+                ipa_write(fn, node->data.unary_op.operand);
+            }
+            break;
+        case NODE_ADDRESS_OF:
+            ipa_write(fn, node->data.address_of.variable);
+            break;
+        case NODE_VARIABLE:
+            /* A local declared with a parameter's name hides it */
+            if (ipa_param_index(fn, node->data.variable.name) >= 0) fn->opaque = true;
+            break;
+        default:
+            break;
+    }
+}
+
+static Bool ipa_function_init(IPAFunction *fn, ASTNode *node) {
+    memset(fn, 0, sizeof(IPAFunction));
+    fn->node = node;
+
+    ASTNode *list = node->data.function.parameters;
+    I64 count = 0;
+    for (ASTNode *param = list ? list->children : NULL; param; param = param->next) {
+        if (param->type == NODE_VARARGS) fn->variadic = true;
+        else count++;
+    }
+    if (count > 0) {
+        fn->params = calloc(count, sizeof(ASTNode*));
+        fn->defaults = calloc(count, sizeof(ASTNode*));
+        fn->written = calloc(count, sizeof(Bool));
+        if (!fn->params || !fn->defaults || !fn->written) return false;
+    }
+
+    for (ASTNode *param = list ? list->children : NULL; param; param = param->next) {
+        if (param->type == NODE_VARARGS) continue;
+        ASTNode *var = param;
+        if (param->type == NODE_DEFAULT_ARG) {
+            var = param->data.default_arg.parameter;
+            fn->defaults[fn->param_count] = param->data.default_arg.default_value;
+        }
+        if (!var || var->type != NODE_VARIABLE || !var->data.variable.name) fn->opaque = true;
+        fn->params[fn->param_count++] = var;
+    }
+    if (list && list->data.block.local_var_count != fn->param_count) fn->opaque = true;
+
+    if (!ipa_walk(node->data.function.body, ipa_scan_body, fn)) fn->opaque = true;
+    return true;
+}
+
+static void ipa_add_site(IPAFunction *fn, ASTNode *call) {
+    if (fn->site_count == fn->site_capacity) {
+        I64 capacity = fn->site_capacity ? fn->site_capacity * 2 : 8;
+        ASTNode **sites = realloc(fn->sites, sizeof(ASTNode*) * capacity);
+        if (!sites) {
+            /* An unrecorded call must not see its callee's parameters change */
+            fn->opaque = true;
+            return;
+        }
+        fn->sites = sites;
+        fn->site_capacity = capacity;
+    }
+    fn->sites[fn->site_count++] = call;
+}
+
+static void ipa_scan_calls(ASTNode *node, void *data) {
+    CallGraph *graph = data;
+    IPAFunction *fn;
+
+    switch (node->type) {
+        case NODE_CALL:
+            fn = ipa_find(graph, node->data.call.name);
+            if (fn) ipa_add_site(fn, node);
+            break;
+        case NODE_FUNC_CALL_NO_PARENS:
+            fn = ipa_find(graph, node->data.func_call_no_parens.name);
+            if (fn) fn->opaque = true;
+            break;
+        case NODE_IDENTIFIER:
+            fn = ipa_find(graph, node->data.identifier.name);
+            if (fn) fn->address_taken = true;
+            break;
+        default:
+            break;
+    }
+}
+
+CallGraph* ipa_call_graph_new(ASTNode *program) {
+    if (!program || program->type != NODE_PROGRAM) return NULL;
+
+    CallGraph *graph = calloc(1, sizeof(CallGraph));
+    if (!graph) return NULL;
+    graph->program = program;
+
+    I64 count = 0;
+    for (ASTNode *child = program->children; child; child = child->next) {
+        if (child->type == NODE_FUNCTION && child->data.function.body) count++;
+    }
+
+    /* Room for the specializations, so entries never move */
+    graph->function_capacity = count * (1 + IPA_MAX_CLONES);
+    graph->functions = calloc(graph->function_capacity ? graph->function_capacity : 1, sizeof(IPAFunction));
+    if (!graph->functions) {
+        free(graph);
+        return NULL;
+    }
+
+    for (ASTNode *child = program->children; child; child = child->next) {
+        if (child->type != NODE_FUNCTION || !child->data.function.body) continue;
+        if (!ipa_function_init(&graph->functions[graph->function_count++], child)) {
+            ipa_call_graph_free(graph);
+            return NULL;
+        }
+        /* Two bodies with one name cannot be told apart by their callers */
+        if (ipa_find(graph, child->data.function.name) != &graph->functions[graph->function_count - 1]) {
+            ipa_call_graph_free(graph);
+            return NULL;
+        }
+    }
+
+    graph->complete = ipa_walk(program, ipa_scan_calls, graph);
+    printf("DEBUG: ipa_call_graph_new - %lld functions%s\n", graph->function_count,
+           graph->complete ? "" : ", some calls may be hidden");
+    return graph;
+}
+
+void ipa_call_graph_free(CallGraph *graph) {
+    if (!graph) return;
+    for (I64 i = 0; i < graph->function_count; i++) {
+        free(graph->functions[i].params);
+        free(graph->functions[i].defaults);
+        free(graph->functions[i].written);
+        free(graph->functions[i].sites);
+    }
+    free(graph->functions);
+    free(graph);
+}
+
+/*
+ * Rewriting Calls and Parameters
+ */
+
+static Bool ipa_constant(ASTNode *node, I64 *value) {
+    if (!node) return false;
+
+    switch (node->type) {
+        case NODE_INTEGER:
+            *value = node->data.literal.i64_value;
+            return true;
+        case NODE_CHAR:
+            *value = node->data.literal.char_value;
+            return true;
+        case NODE_UNARY_OP:
+            if (node->data.unary_op.op == UNOP_MINUS && ipa_constant(node->data.unary_op.operand, value)) {
+                *value = -*value;
+                return true;
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+/* An integer parameter the body only reads can become a constant */
+static Bool ipa_param_foldable(IPAFunction *fn, I64 index) {
+    if (fn->written[index]) return false;
+    SchismTokenType type = (SchismTokenType)(I64)fn->params[index]->data.variable.type;
+    return type != TK_TYPE_F32 && type != TK_TYPE_F64;
+}
+
+static ASTNode* ipa_argument(ASTNode *call, I64 index) {
+    ASTNode *arg = call->data.call.arguments ? call->data.call.arguments->data.block.statements : NULL;
+    for (; arg && index > 0; index--) arg = arg->next;
+    return arg;
+}
+
+static void ipa_set_argument_count(ASTNode *call, I64 count) {
+    call->data.call.arg_count = count;
+    call->data.call.arguments->data.block.statement_count = count;
+    call->data.call.arguments->data.block.local_var_count = count;
+}
+
+static void ipa_remove_argument(ASTNode *call, I64 index) {
+    ASTNode *args = call->data.call.arguments;
+    ASTNode *arg = ipa_argument(call, index);
+    if (!arg) return;
+
+    /* Argument lists are linked through next only */
+    ASTNode **link = &args->data.block.statements;
+    while (*link != arg) link = &(*link)->next;
+    *link = arg->next;
+    if (arg->next) arg->next->prev = NULL;
+    if (args->children == arg) args->children = arg->next;
+    arg->next = arg->prev = NULL;
+    ipa_set_argument_count(call, call->data.call.arg_count - 1);
+    ast_node_free(arg);
+}
+
+/* Drop a parameter; its variable stays, the scope tables still refer to it */
+static void ipa_remove_parameter(IPAFunction *fn, I64 index) {
+    ASTNode *list = fn->node->data.function.parameters;
+    ASTNode *param = list->children;
+    for (I64 i = 0; param && i < index; i++) param = param->next;
+    if (!param) return;
+
+    if (param->prev) param->prev->next = param->next;
+    else list->children = param->next;
+    if (param->next) param->next->prev = param->prev;
+    param->next = param->prev = NULL;
+    list->data.block.local_var_count--;
+
+    for (I64 i = index; i + 1 < fn->param_count; i++) {
+        fn->params[i] = fn->params[i + 1];
+        fn->defaults[i] = fn->defaults[i + 1];
+        fn->written[i] = fn->written[i + 1];
+        fn->params[i]->data.variable.parameter_index = i;
+    }
+    fn->param_count--;
+}
+
+typedef struct {
+    U8 *name;
+    I64 value;
+} IPAConstant;
+
+static void ipa_substitute_node(ASTNode *node, void *data) {
+    IPAConstant *constant = data;
+    if (node->type != NODE_IDENTIFIER || !node->data.identifier.name) return;
+    if (strcmp((char*)node->data.identifier.name, (char*)constant->name) != 0) return;
+
+    free(node->data.identifier.name);
+    memset(&node->data, 0, sizeof(node->data));
+    node->type = NODE_INTEGER;
+    node->data.literal.i64_value = constant->value;
+}
+
+/* Replace the uses of a parameter in the body with its value */
+static void ipa_substitute(IPAFunction *fn, I64 index, I64 value) {
+    IPAConstant constant = { fn->params[index]->data.variable.name, value };
+    ipa_walk(fn->node->data.function.body, ipa_substitute_node, &constant);
+}
+
+/*
+ * Default Arguments
+ * A call may leave off trailing parameters that have defaults. The
+ * defaults are written into the call, so every call site passes every
+ * argument and constant defaults take part in propagation below. Only
+ * literal defaults are copied: a name would resolve in the caller's scope.
+ */
+
+static void ipa_literal_node(ASTNode *node, void *data) {
+    Bool *literal = data;
+    if (node->type != NODE_INTEGER && node->type != NODE_FLOAT && node->type != NODE_STRING &&
+        node->type != NODE_CHAR && node->type != NODE_BOOLEAN && node->type != NODE_UNARY_OP &&
+        node->type != NODE_BINARY_OP) {
+        *literal = false;
+    }
+    if (node->type == NODE_BINARY_OP && ipa_is_assignment(node->data.binary_op.op)) *literal = false;
+}
+
+static Bool ipa_is_literal(ASTNode *node) {
+    Bool literal = true;
+    return ipa_walk(node, ipa_literal_node, &literal) && literal;
+}
+
+static void ipa_fill_defaults(CallGraph *graph, IPAFunction *fn) {
+    if (fn->variadic) return;
+
+    for (I64 s = 0; s < fn->site_count; s++) {
+        ASTNode *call = fn->sites[s];
+        I64 given = call->data.call.arg_count;
+        if (given >= fn->param_count) continue;
+
+        I64 missing = given;
+        while (missing < fn->param_count && fn->defaults[missing] && ipa_is_literal(fn->defaults[missing])) missing++;
+        if (missing < fn->param_count) continue;
+
+        if (!call->data.call.arguments) {
+            call->data.call.arguments = ast_node_new(NODE_BLOCK, call->line, call->column);
+            if (!call->data.call.arguments) return;
+            call->data.call.arguments->parent = call;
+        }
+        ASTNode *last = call->data.call.arguments->data.block.statements;
+        while (last && last->next) last = last->next;
+
+        for (I64 i = given; i < fn->param_count; i++) {
+            ASTNode *value = ipa_clone(fn->defaults[i]);
+            if (!value) break;
+            value->parent = call->data.call.arguments;
+            value->prev = last;
+            if (last) last->next = value;
+            else call->data.call.arguments->data.block.statements = value;
+            last = value;
+            ipa_set_argument_count(call, call->data.call.arg_count + 1);
+            graph->defaults_filled++;
+        }
+    }
+}
+
+/*
+ * Constant Propagation
+ * A parameter that gets the same constant at every call site is replaced
+ * by that constant in the body and dropped from the function and its
+ * calls. This needs every caller in view: the function must not be
+ * public or called through a pointer.
+ */
+
+static void ipa_propagate(CallGraph *graph, IPAFunction *fn) {
+    if (fn->opaque || fn->variadic || fn->address_taken || fn->node->data.function.is_public) return;
+    if (fn->site_count == 0) return;
+    for (I64 s = 0; s < fn->site_count; s++) {
+        if (fn->sites[s]->data.call.arg_count != fn->param_count) return;
+    }
+
+    for (I64 p = fn->param_count - 1; p >= 0; p--) {
+        if (!ipa_param_foldable(fn, p)) continue;
+
+        I64 value = 0;
+        Bool same = true;
+        for (I64 s = 0; s < fn->site_count && same; s++) {
+            I64 site_value;
+            same = ipa_constant(ipa_argument(fn->sites[s], p), &site_value) && (s == 0 || site_value == value);
+            value = site_value;
+        }
+        if (!same) continue;
+
+        printf("DEBUG: ipa_propagate - %s: parameter %s is %lld at all %lld calls\n",
+               (char*)fn->node->data.function.name, (char*)fn->params[p]->data.variable.name,
+               value, fn->site_count);
+        ipa_substitute(fn, p, value);
+        for (I64 s = 0; s < fn->site_count; s++) ipa_remove_argument(fn->sites[s], p);
+        ipa_remove_parameter(fn, p);
+        graph->propagated++;
+    }
+}
+
+/*
+ * Specialization
+ * Call sites passing constants the callee cannot take for granted get a
+ * copy of the callee with those constants substituted, one copy per
+ * distinct set of constants. The original stays for the other callers
+ * and for calls through pointers, and is dropped below if none remain.
+ */
+
+typedef struct {
+    Bool *is_constant;               /* Per parameter */
+    I64 *values;
+    IPAFunction *clone;
+} IPASpecialization;
+
+static Bool ipa_same_constants(IPASpecialization *spec, Bool *is_constant, I64 *values, I64 count) {
+    for (I64 p = 0; p < count; p++) {
+        if (spec->is_constant[p] != is_constant[p]) return false;
+        if (is_constant[p] && spec->values[p] != values[p]) return false;
+    }
+    return true;
+}
+
+static IPAFunction* ipa_make_clone(CallGraph *graph, IPAFunction *fn, Bool *is_constant, I64 *values) {
+    if (graph->function_count >= graph->function_capacity) return NULL;
+
+    ASTNode *copy = ipa_clone(fn->node);
+    if (!copy) return NULL;
+
+    char name[256];
+    do {
+        snprintf(name, sizeof(name), "%s_spec%lld", (char*)fn->node->data.function.name, ++fn->clone_count);
+    } while (ipa_find(graph, (U8*)name));
+    free(copy->data.function.name);
+    copy->data.function.name = ipa_strdup((U8*)name);
+
+    IPAFunction *clone = &graph->functions[graph->function_count];
+    if (!copy->data.function.name || !ipa_function_init(clone, copy)) return NULL;
+    graph->function_count++;
+
+    /* Emit the copy right after the original */
+    copy->parent = fn->node->parent;
+    copy->prev = fn->node;
+    copy->next = fn->node->next;
+    if (fn->node->next) fn->node->next->prev = copy;
+    fn->node->next = copy;
+    parser_add_symbol(graph->parser, copy->data.function.name, copy);
+
+    for (I64 p = clone->param_count - 1; p >= 0; p--) {
+        if (!is_constant[p]) continue;
+        ipa_substitute(clone, p, values[p]);
+        ipa_remove_parameter(clone, p);
+    }
+
+    /* Calls made from the copy are call sites too */
+    ipa_walk(copy->data.function.body, ipa_scan_calls, graph);
+
+    printf("DEBUG: ipa_specialize - %s specialized as %s\n", (char*)fn->node->data.function.name, name);
+    graph->specialized++;
+    return clone;
+}
+
+static void ipa_specialize(CallGraph *graph, IPAFunction *fn) {
+    if (fn->opaque || fn->variadic || fn->size > IPA_CLONE_MAX_NODES) return;
+    if (fn->site_count == 0 || fn->param_count == 0) return;
+
+    I64 count = fn->param_count;
+    IPASpecialization specs[IPA_MAX_CLONES];
+    I64 spec_count = 0;
+    Bool *is_constant = calloc(count * (IPA_MAX_CLONES + 1), sizeof(Bool));
+    I64 *values = calloc(count * (IPA_MAX_CLONES + 1), sizeof(I64));
+    if (!is_constant || !values) {
+        free(is_constant);
+        free(values);
+        return;
+    }
+
+    /* Sites added while copying are recursive calls inside the copies */
+    I64 site_count = fn->site_count;
+    for (I64 s = 0; s < site_count; s++) {
+        ASTNode *call = fn->sites[s];
+        if (call->data.call.arg_count != count) continue;
+
+        Bool any = false;
+        for (I64 p = 0; p < count; p++) {
+            is_constant[p] = ipa_param_foldable(fn, p) && ipa_constant(ipa_argument(call, p), &values[p]);
+            if (is_constant[p]) any = true;
+        }
+        if (!any) continue;
+
+        I64 c = 0;
+        while (c < spec_count && !ipa_same_constants(&specs[c], is_constant, values, count)) c++;
+        if (c == spec_count) {
+            if (spec_count == IPA_MAX_CLONES) continue;
+            specs[c].is_constant = is_constant + count * (c + 1);
+            specs[c].values = values + count * (c + 1);
+            memcpy(specs[c].is_constant, is_constant, sizeof(Bool) * count);
+            memcpy(specs[c].values, values, sizeof(I64) * count);
+            specs[c].clone = ipa_make_clone(graph, fn, is_constant, values);
+            if (!specs[c].clone) break;
+            spec_count++;
+        }
+
+        for (I64 p = count - 1; p >= 0; p--) {
+            if (specs[c].is_constant[p]) ipa_remove_argument(call, p);
+        }
+        free(call->data.call.name);
+        call->data.call.name = ipa_strdup(specs[c].clone->node->data.function.name);
+        ipa_add_site(specs[c].clone, call);
+    }
+
+    free(is_constant);
+    free(values);
+}
+
+/*
+ * Dead Function Elimination
+ * Functions not reachable from the top-level statements, main or a
+ * public function are unlinked from the program so nothing is emitted
+ * for them. They are not freed: the parser's symbol table still refers
+ * to them.
+ */
+
+static void ipa_mark(CallGraph *graph, IPAFunction *fn);
+
+static void ipa_mark_node(ASTNode *node, void *data) {
+    CallGraph *graph = data;
+    U8 *name = NULL;
+
+    switch (node->type) {
+        case NODE_CALL:                name = node->data.call.name; break;
+        case NODE_FUNC_CALL_NO_PARENS: name = node->data.func_call_no_parens.name; break;
+        case NODE_IDENTIFIER:          name = node->data.identifier.name; break;
+        default: return;
+    }
+
+    IPAFunction *fn = ipa_find(graph, name);
+    if (fn) ipa_mark(graph, fn);
+}
+
+static void ipa_mark(CallGraph *graph, IPAFunction *fn) {
+    if (fn->reachable) return;
+    fn->reachable = true;
+    ipa_walk(fn->node, ipa_mark_node, graph);
+}
+
+static I64 ipa_remove_unreachable(CallGraph *graph) {
+    /* A call the walk could not see might reach any function */
+    if (!graph->complete) return 0;
+
+    for (I64 i = 0; i < graph->function_count; i++) graph->functions[i].reachable = false;
+    Bool has_statements = false;
+    for (ASTNode *child = graph->program->children; child; child = child->next) {
+        if (child->type == NODE_FUNCTION) continue;
+        has_statements = true;
+        ipa_walk(child, ipa_mark_node, graph);
+    }
+    /* Without top-level statements the program starts in main, or is a library */
+    for (I64 i = 0; i < graph->function_count; i++) {
+        ASTNode *node = graph->functions[i].node;
+        if (!has_statements || node->data.function.is_public ||
+            (node->data.function.name && strcmp((char*)node->data.function.name, "main") == 0)) {
+            ipa_mark(graph, &graph->functions[i]);
+        }
+    }
+
+    I64 removed = 0;
+    for (I64 i = 0; i < graph->function_count; i++) {
+        ASTNode *node = graph->functions[i].node;
+        if (graph->functions[i].reachable) continue;
+
+        printf("DEBUG: ipa_remove_unreachable - dropping %s\n", (char*)node->data.function.name);
+        if (node->prev) node->prev->next = node->next;
+        else graph->program->children = node->next;
+        if (node->next) node->next->prev = node->prev;
+        node->next = node->prev = NULL;
+        removed++;
+    }
+    graph->removed += removed;
+    return removed;
+}
+
+/* Run the interprocedural passes over the program; returns how many changes they made */
+I64 ipa_optimize(ParserState *parser, ASTNode *program) {
+    CallGraph *graph = ipa_call_graph_new(program);
+    if (!graph) return 0;
+
+    /* Calls from dead functions must not hold back propagation */
+    I64 removed = ipa_remove_unreachable(graph);
+    if (removed > 0) {
+        ipa_call_graph_free(graph);
+        graph = ipa_call_graph_new(program);
+        if (!graph) return removed;
+        graph->removed = removed;
+    }
+    graph->parser = parser;
+
+    I64 original_count = graph->function_count;
+    for (I64 i = 0; i < original_count; i++) ipa_fill_defaults(graph, &graph->functions[i]);
+    for (I64 i = 0; i < original_count; i++) ipa_propagate(graph, &graph->functions[i]);
+    for (I64 i = 0; i < original_count; i++) ipa_specialize(graph, &graph->functions[i]);
+    ipa_remove_unreachable(graph);
+
+    printf("DEBUG: ipa_optimize - %lld defaults filled, %lld parameters propagated, "
+           "%lld specializations, %lld functions removed\n",
+           graph->defaults_filled, graph->propagated, graph->specialized, graph->removed);
+
+    I64 changes = graph->defaults_filled + graph->propagated + graph->specialized + graph->removed;
+    ipa_call_graph_free(graph);
+    return changes;
+}
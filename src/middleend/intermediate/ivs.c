@@ -0,0 +1,542 @@
+/*
+ * Induction Variables
+ * Basic induction variable detection, strength reduction of derived
+ * induction variables and count-down rewriting of loop counters. The
+ * rewrites apply to the IC chain --dump-ic shows: output.asm is written
+ * from the AST by the MASM backend, which does not lower array indexing
+ * and addresses sub-int and union elements of 1, 2, 4 and 8 bytes with a
+ * scaled index, so it has no per-iteration imul for this pass to remove.
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define IV_MAX_CHAIN 8
+
+/* A basic induction variable: one in-loop definition b = b + step */
+typedef struct {
+    CICArg value;
+    CICArg entry;                            /* Value on loop entry: a constant when known, else value */
+    I64 index;                               /* Liveness index of value */
+    I64 step;
+    CIntermediateCode *def;                  /* The definition of value in the loop */
+    CIntermediateCode *chain[IV_MAX_CHAIN];  /* def, the copies before it and the add */
+    I64 chain_count;
+} ICIndVar;
+
+typedef struct {
+    ICGenContext *ctx;
+    ICCfg *cfg;
+    ICLiveness *lv;
+    ICLoop *loop;
+    I64 *defs_in_loop;               /* Definitions of each value inside the loop */
+    CIntermediateCode **def_ic;      /* The in-loop definition when there is exactly one */
+    I64 *use_count;                  /* Uses of each value in the whole function */
+    ICIndVar *ivs;
+    I64 iv_count;
+    CIntermediateCode *pos;          /* Preheader insertion point */
+} ICIvs;
+
+static void ic_iv_scan(ICIvs *iv) {
+    for (I64 b = 0; b < iv->loop->block_count; b++) {
+        ICBasicBlock *bb = iv->loop->blocks[b];
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            I64 value = ic_liveness_index(iv->lv, ic_get_def(ic));
+            if (value >= 0) {
+                iv->defs_in_loop[value]++;
+                iv->def_ic[value] = ic;
+            }
+            if (ic == bb->last) break;
+        }
+    }
+    for (CIntermediateCode *ic = iv->cfg->enter; ic; ic = ic->base.next) {
+        CICArg *uses[2];
+        I64 use_count = ic_get_uses(ic, uses);
+        for (I64 u = 0; u < use_count; u++) {
+            I64 value = ic_liveness_index(iv->lv, uses[u]);
+            if (value >= 0) iv->use_count[value]++;
+        }
+        if (ic == iv->cfg->leave) break;
+    }
+}
+
+/* Register-like values: temps and promotable locals */
+static Bool ic_iv_is_register_value(ICIvs *iv, CICArg *arg) {
+    if (ic_liveness_index(iv->lv, arg) < 0) return false;
+    if (arg->type != IC_ARG_VAR) return true;
+    ICVar *var = &iv->ctx->vars[arg->i64_val];
+    return !var->is_global && !var->is_volatile && ic_ssa_is_promotable(iv->ctx, arg->i64_val);
+}
+
+static Bool ic_iv_is_invariant(ICIvs *iv, CICArg *arg) {
+    if (arg->type == IC_ARG_CONST) return true;
+    if (!ic_iv_is_register_value(iv, arg)) return false;
+    return iv->defs_in_loop[ic_liveness_index(iv->lv, arg)] == 0;
+}
+
+/* Does a come before b in the same block */
+static Bool ic_iv_precedes(CIntermediateCode *a, CIntermediateCode *b) {
+    ICBasicBlock *bb = ic_cfg_block_of(a);
+    if (!bb || bb != ic_cfg_block_of(b)) return false;
+    for (CIntermediateCode *ic = a->base.next; ic; ic = ic->base.next) {
+        if (ic == b) return true;
+        if (ic == bb->last) break;
+    }
+    return false;
+}
+
+static ICIndVar* ic_iv_lookup(ICIvs *iv, CICArg *arg) {
+    I64 value = ic_liveness_index(iv->lv, arg);
+    if (value < 0) return NULL;
+    for (I64 i = 0; i < iv->iv_count; i++) {
+        if (iv->ivs[i].index == value) return &iv->ivs[i];
+    }
+    return NULL;
+}
+
+static Bool ic_iv_in_chain(ICIndVar *b, CIntermediateCode *ic) {
+    for (I64 c = 0; c < b->chain_count; c++) {
+        if (b->chain[c] == ic) return true;
+    }
+    return false;
+}
+
+/*
+ * Basic Induction Variables
+ * b is carried around the loop and its only in-loop definition is
+ * b = b + c, possibly through a chain of single-use copies in one block
+ * (the shape SSA destruction leaves behind).
+ */
+static Bool ic_iv_match_basic(ICIvs *iv, CIntermediateCode *def, ICIndVar *out) {
+    CICArg *b = ic_get_def(def);
+    if (!b || !ic_iv_is_register_value(iv, b)) return false;
+    I64 index = ic_liveness_index(iv->lv, b);
+    if (iv->defs_in_loop[index] != 1) return false;
+
+    U64 *header_in = &iv->lv->live_in[iv->loop->header->id * iv->lv->words];
+    if (!((header_in[index >> 6] >> (index & 63)) & 1)) return false;
+
+    memset(out, 0, sizeof(ICIndVar));
+    out->value = *b;
+    out->index = index;
+    out->def = def;
+    out->chain[out->chain_count++] = def;
+
+    CIntermediateCode *cur = def;
+    while (cur->base.ic_code == IC_ASSIGN) {
+        I64 w = ic_liveness_index(iv->lv, &cur->arg1);
+        if (w < 0 || cur->arg1.type != IC_ARG_TEMP || out->chain_count >= IV_MAX_CHAIN) return false;
+        if (iv->defs_in_loop[w] != 1 || iv->use_count[w] != 1) return false;
+        CIntermediateCode *prev = iv->def_ic[w];
+        if (!ic_iv_precedes(prev, cur)) return false;
+        out->chain[out->chain_count++] = prev;
+        cur = prev;
+    }
+
+    if (cur->base.ic_code == IC_ADD) {
+        if (ic_arg_equal(&cur->arg1, b) && cur->arg2.type == IC_ARG_CONST) {
+            out->step = cur->arg2.i64_val;
+        } else if (ic_arg_equal(&cur->arg2, b) && cur->arg1.type == IC_ARG_CONST) {
+            out->step = cur->arg1.i64_val;
+        } else {
+            return false;
+        }
+    } else if (cur->base.ic_code == IC_SUB) {
+        if (!ic_arg_equal(&cur->arg1, b) || cur->arg2.type != IC_ARG_CONST) return false;
+        out->step = -cur->arg2.i64_val;
+    } else {
+        return false;
+    }
+    if (out->step == 0) return false;
+
+    /* A single constant definition outside the loop that dominates it gives the start value */
+    out->entry = *b;
+    CIntermediateCode *start = NULL;
+    I64 defs = 0;
+    for (CIntermediateCode *ic = iv->cfg->enter; ic; ic = ic->base.next) {
+        CICArg *d = ic_get_def(ic);
+        if (d && ic_arg_equal(d, b)) {
+            defs++;
+            if (ic != def) start = ic;
+        }
+        if (ic == iv->cfg->leave) break;
+    }
+    if (defs == 2 && start->base.ic_code == IC_ASSIGN && start->arg1.type == IC_ARG_CONST &&
+        ic_cfg_block_of(start) && ic_cfg_dominates(ic_cfg_block_of(start), iv->loop->header)) {
+        out->entry = start->arg1;
+    }
+    return true;
+}
+
+static void ic_iv_find_basic(ICIvs *iv) {
+    for (I64 b = 0; b < iv->loop->block_count; b++) {
+        ICBasicBlock *bb = iv->loop->blocks[b];
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            ICIndVar candidate;
+            if (ic_get_def(ic) && ic_iv_match_basic(iv, ic, &candidate)) {
+                iv->ivs[iv->iv_count++] = candidate;
+            }
+            if (ic == bb->last) break;
+        }
+    }
+}
+
+static CIntermediateCode* ic_iv_new(U16 code, CICArg arg1, CICArg arg2, CICArg res, I64 line) {
+    CIntermediateCode *ic = ic_new(code);
+    if (!ic) return NULL;
+    ic->arg1 = arg1;
+    ic->arg2 = arg2;
+    ic->res = res;
+    ic->ic_line = line;
+    return ic;
+}
+
+/* Emit res = a op b in front of pos, as a plain copy when it folds */
+static void ic_iv_emit_into(ICGenContext *ctx, CIntermediateCode *pos, U16 code, CICArg a, CICArg b, CICArg res, I64 line) {
+    I64 folded;
+    if (a.type == IC_ARG_CONST && b.type == IC_ARG_CONST && ic_fold_constant(code, a.i64_val, b.i64_val, &folded)) {
+        ic_insert_before(ctx, pos, ic_iv_new(IC_ASSIGN, ic_arg_const(folded), ic_arg_const(0), res, line));
+    } else if (b.type == IC_ARG_CONST && ((b.i64_val == 0 && (code == IC_ADD || code == IC_SUB)) ||
+                                          (b.i64_val == 1 && code == IC_MUL))) {
+        ic_insert_before(ctx, pos, ic_iv_new(IC_ASSIGN, a, ic_arg_const(0), res, line));
+    } else if (a.type == IC_ARG_CONST && ((a.i64_val == 0 && code == IC_ADD) || (a.i64_val == 1 && code == IC_MUL))) {
+        ic_insert_before(ctx, pos, ic_iv_new(IC_ASSIGN, b, ic_arg_const(0), res, line));
+    } else {
+        ic_insert_before(ctx, pos, ic_iv_new(code, a, b, res, line));
+    }
+}
+
+/* a op b as an operand: a constant when it folds, else a new temp set in front of pos */
+static CICArg ic_iv_emit_value(ICGenContext *ctx, CIntermediateCode *pos, U16 code, CICArg a, CICArg b, I64 line) {
+    I64 folded;
+    if (a.type == IC_ARG_CONST && b.type == IC_ARG_CONST && ic_fold_constant(code, a.i64_val, b.i64_val, &folded)) {
+        return ic_arg_const(folded);
+    }
+    CICArg res = ic_arg_temp(ctx);
+    ic_iv_emit_into(ctx, pos, code, a, b, res, line);
+    return res;
+}
+
+/* Turn ic into res = value */
+static void ic_iv_make_copy(CIntermediateCode *ic, CICArg value) {
+    ic->base.ic_code = IC_ASSIGN;
+    ic->arg1 = value;
+    ic->arg2 = ic_arg_const(0);
+}
+
+/* The only instruction reading value, when it is inside the loop */
+static CIntermediateCode* ic_iv_single_user(ICIvs *iv, CICArg *value) {
+    I64 index = ic_liveness_index(iv->lv, value);
+    if (index < 0 || iv->use_count[index] != 1) return NULL;
+    for (I64 b = 0; b < iv->loop->block_count; b++) {
+        ICBasicBlock *bb = iv->loop->blocks[b];
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            CICArg *uses[2];
+            I64 use_count = ic_get_uses(ic, uses);
+            for (I64 u = 0; u < use_count; u++) {
+                if (ic_arg_equal(uses[u], value)) return ic;
+            }
+            if (ic == bb->last) break;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Strength Reduction
+ * t = b * F (or b << k) becomes a copy of r, where r = b * F is set up in
+ * the preheader and advanced by step * F right after b is. F is a constant
+ * or a loop-invariant value, whose step * F is then computed once in the
+ * preheader as well. When t only
+ * feeds t + base with base invariant (an element address) the add is
+ * folded into r, which then walks the array as a pointer. A plain
+ * b + base used as an address is reduced the same way with F = 1.
+ */
+static Bool ic_iv_reduce(ICIvs *iv, CIntermediateCode *x) {
+    U16 code = x->base.ic_code;
+    ICIndVar *b = NULL;
+    CICArg *inv = NULL;
+    CICArg factor = ic_arg_const(0);
+    CIntermediateCode *user = NULL;
+    U16 user_code = IC_ADD;
+
+    if (x->res.type != IC_ARG_TEMP) return false;
+    I64 t = ic_liveness_index(iv->lv, &x->res);
+    if (t < 0 || iv->defs_in_loop[t] != 1) return false;
+
+    if (code == IC_MUL || code == IC_SHL) {
+        CICArg *k = &x->arg2;
+        b = ic_iv_lookup(iv, &x->arg1);
+        if (!b && code == IC_MUL) {
+            b = ic_iv_lookup(iv, &x->arg2);
+            k = &x->arg1;
+        }
+        if (!b) return false;
+        if (code == IC_SHL) {
+            if (k->type != IC_ARG_CONST || k->i64_val < 0 || k->i64_val > 62) return false;
+            factor = ic_arg_const((I64)1 << k->i64_val);
+        } else if (ic_iv_is_invariant(iv, k)) {
+            factor = *k;
+        } else {
+            return false;
+        }
+        if (factor.type == IC_ARG_CONST && factor.i64_val == 0) return false;
+
+        /* Fold a following t + base / t - base into the reduced value */
+        CIntermediateCode *next = ic_iv_single_user(iv, &x->res);
+        if (next && (next->base.ic_code == IC_ADD || next->base.ic_code == IC_SUB) &&
+            next->res.type == IC_ARG_TEMP && ic_iv_precedes(x, next) &&
+            !(ic_iv_precedes(x, b->def) && ic_iv_precedes(b->def, next)) &&
+            !ic_arg_equal(&next->arg1, &next->arg2)) {
+            CICArg *other = ic_arg_equal(&next->arg1, &x->res) ? &next->arg2 : &next->arg1;
+            I64 a = ic_liveness_index(iv->lv, &next->res);
+            Bool t_first = ic_arg_equal(&next->arg1, &x->res);
+            if (a >= 0 && iv->defs_in_loop[a] == 1 && ic_iv_is_invariant(iv, other) &&
+                (next->base.ic_code == IC_ADD || t_first)) {
+                user = next;
+                user_code = next->base.ic_code;
+                inv = other;
+            }
+        }
+    } else if (code == IC_ADD) {
+        /* Only worth it for addresses: the increment replaces the add */
+        b = ic_iv_lookup(iv, &x->arg1);
+        inv = &x->arg2;
+        if (!b) {
+            b = ic_iv_lookup(iv, &x->arg2);
+            inv = &x->arg1;
+        }
+        if (!b || inv->type == IC_ARG_CONST || !ic_iv_is_invariant(iv, inv)) return false;
+        CIntermediateCode *use = ic_iv_single_user(iv, &x->res);
+        U16 use_code = use ? use->base.ic_code : IC_NOP;
+        Bool is_store = use_code == IC_STORE || use_code == IC_VEC_STORE;
+        if (!use || (use_code != IC_LOAD && use_code != IC_VEC_LOAD && !is_store) ||
+            !ic_arg_equal(&use->arg1, &x->res) || (is_store && ic_arg_equal(&use->arg2, &x->res))) {
+            return false;
+        }
+        factor = ic_arg_const(1);
+    } else {
+        return false;
+    }
+    if (ic_iv_in_chain(b, x) || (user && ic_iv_in_chain(b, user))) return false;
+
+    ICGenContext *ctx = iv->ctx;
+    I64 line = x->ic_line;
+    CICArg r = ic_arg_temp(ctx);
+
+    /* Preheader: r = b * factor (+/- base) */
+    if (code == IC_ADD) {
+        ic_iv_emit_into(ctx, iv->pos, IC_ADD, *inv, b->entry, r, line);
+    } else if (user) {
+        CICArg scaled = ic_iv_emit_value(ctx, iv->pos, IC_MUL, b->entry, factor, line);
+        if (user_code == IC_ADD) {
+            ic_iv_emit_into(ctx, iv->pos, IC_ADD, *inv, scaled, r, line);
+        } else {
+            ic_iv_emit_into(ctx, iv->pos, IC_SUB, scaled, *inv, r, line);
+        }
+    } else {
+        ic_iv_emit_into(ctx, iv->pos, IC_MUL, b->entry, factor, r, line);
+    }
+
+    /* Advance r together with b */
+    CICArg stride = ic_iv_emit_value(ctx, iv->pos, IC_MUL, ic_arg_const(b->step), factor, line);
+    ic_insert_after(ctx, b->def, ic_iv_new(IC_ADD, r, stride, r, line));
+
+    if (user) {
+        ic_iv_make_copy(user, r);
+        x->base.ic_code = IC_NOP;
+    } else {
+        ic_iv_make_copy(x, r);
+    }
+    return true;
+}
+
+/*
+ * Count-Down Counters
+ * A counter that is only read by the exit test and dead after the loop
+ * is replaced by c = n - b counting down to zero, so the test becomes a
+ * compare against zero and the counter update disappears.
+ */
+static Bool ic_iv_count_down(ICIvs *iv, ICIndVar *b) {
+    CIntermediateCode *test = NULL;
+    for (I64 i = 0; i < iv->loop->block_count; i++) {
+        ICBasicBlock *bb = iv->loop->blocks[i];
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            if (ic->base.ic_code != IC_NOP && !ic_iv_in_chain(b, ic)) {
+                CICArg *uses[2];
+                I64 use_count = ic_get_uses(ic, uses);
+                for (I64 u = 0; u < use_count; u++) {
+                    if (!ic_arg_equal(uses[u], &b->value)) continue;
+                    if (test) return false;
+                    test = ic;
+                }
+            }
+            if (ic == bb->last) break;
+        }
+        /* Not needed once the loop exits */
+        for (I64 s = 0; s < bb->succ_count; s++) {
+            if (ic_loop_contains(iv->loop, bb->succ[s])) continue;
+            U64 *succ_in = &iv->lv->live_in[bb->succ[s]->id * iv->lv->words];
+            if ((succ_in[b->index >> 6] >> (b->index & 63)) & 1) return false;
+        }
+    }
+    if (!test || ic_arg_equal(&test->arg1, &test->arg2)) return false;
+
+    /* Normalize to b OP n */
+    U16 op = test->base.ic_code;
+    Bool b_first = ic_arg_equal(&test->arg1, &b->value);
+    CICArg n = b_first ? test->arg2 : test->arg1;
+    if (!b_first) {
+        switch (op) {
+            case IC_LESS:        op = IC_GREATER; break;
+            case IC_GREATER:     op = IC_LESS; break;
+            case IC_LESS_EQU:    op = IC_GREATER_EQU; break;
+            case IC_GREATER_EQU: op = IC_LESS_EQU; break;
+            default: break;
+        }
+    }
+    if (!ic_iv_is_invariant(iv, &n) || (n.type == IC_ARG_CONST && n.i64_val == 0)) return false;
+
+    /* c = n - b for upward counters, b - n for downward ones */
+    Bool up;
+    U16 zero_test;
+    switch (op) {
+        case IC_LESS:        up = true;  zero_test = IC_GREATER; break;
+        case IC_LESS_EQU:    up = true;  zero_test = IC_GREATER_EQU; break;
+        case IC_GREATER:     up = false; zero_test = IC_GREATER; break;
+        case IC_GREATER_EQU: up = false; zero_test = IC_GREATER_EQU; break;
+        case IC_EQU:         up = true;  zero_test = IC_EQU; break;
+        case IC_NOT_EQU:     up = true;  zero_test = IC_NOT_EQU; break;
+        default: return false;
+    }
+    if ((op == IC_LESS || op == IC_LESS_EQU) && b->step < 0) return false;
+    if ((op == IC_GREATER || op == IC_GREATER_EQU) && b->step > 0) return false;
+
+    ICGenContext *ctx = iv->ctx;
+    I64 line = test->ic_line;
+    CICArg c = ic_arg_temp(ctx);
+    if (up) {
+        ic_iv_emit_into(ctx, iv->pos, IC_SUB, n, b->entry, c, line);
+        ic_insert_before(ctx, b->def, ic_iv_new(IC_SUB, c, ic_arg_const(b->step), c, line));
+    } else {
+        ic_iv_emit_into(ctx, iv->pos, IC_SUB, b->entry, n, c, line);
+        ic_insert_before(ctx, b->def, ic_iv_new(IC_ADD, c, ic_arg_const(b->step), c, line));
+    }
+
+    test->base.ic_code = zero_test;
+    test->arg1 = c;
+    test->arg2 = ic_arg_const(0);
+    for (I64 k = 0; k < b->chain_count; k++) {
+        b->chain[k]->base.ic_code = IC_NOP;
+    }
+    return true;
+}
+
+static I64 ic_iv_loop(ICIvs *iv, I64 ic_total) {
+    ic_iv_scan(iv);
+    ic_iv_find_basic(iv);
+    if (iv->iv_count == 0) return 0;
+
+    /* Collect first: reductions insert instructions into the loop */
+    CIntermediateCode **candidates = malloc(sizeof(CIntermediateCode*) * (ic_total + 1));
+    if (!candidates) return 0;
+    I64 candidate_count = 0;
+    for (I64 b = 0; b < iv->loop->block_count; b++) {
+        ICBasicBlock *bb = iv->loop->blocks[b];
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            U16 code = ic->base.ic_code;
+            if ((code == IC_MUL || code == IC_SHL || code == IC_ADD) &&
+                (ic_iv_lookup(iv, &ic->arg1) || ic_iv_lookup(iv, &ic->arg2))) {
+                candidates[candidate_count++] = ic;
+            }
+            if (ic == bb->last) break;
+        }
+    }
+
+    I64 changes = 0;
+    for (I64 c = 0; c < candidate_count; c++) {
+        if (!iv->pos) iv->pos = ic_loop_preheader(iv->ctx, iv->loop);
+        if (!iv->pos) break;
+        if (candidates[c]->base.ic_code != IC_NOP && ic_iv_reduce(iv, candidates[c])) changes++;
+    }
+    free(candidates);
+
+    for (I64 i = 0; i < iv->iv_count; i++) {
+        if (!iv->pos) iv->pos = ic_loop_preheader(iv->ctx, iv->loop);
+        if (!iv->pos) break;
+        if (ic_iv_count_down(iv, &iv->ivs[i])) changes++;
+    }
+    return changes;
+}
+
+/*
+ * Find the basic induction variables of each loop, innermost first,
+ * replace multiplications by them with additions and rewrite counters
+ * that only drive the exit test. Runs after LICM so loop bases are
+ * already invariant temps; the CFG is rebuilt after each changed loop.
+ */
+Bool opt_induction_variables(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    I64 reduced = 0;
+
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        Bool changed = true;
+        I64 rounds = 0;
+        while (changed) {
+            changed = false;
+            rounds++;
+            if (rounds > 100) {
+                printf("ERROR: opt_induction_variables - infinite loop detected, breaking\n");
+                break;
+            }
+
+            ICCfg *cfg = ic_cfg_build(ctx, enter);
+            if (!cfg) break;
+            ICLiveness *lv = ic_liveness_compute(ctx, cfg);
+            I64 value_count = ctx->temp_count + ctx->var_count;
+
+            I64 ic_total = 0;
+            for (CIntermediateCode *ic = enter; ic; ic = ic->base.next) {
+                ic_total++;
+                if (ic == cfg->leave) break;
+            }
+
+            for (I64 l = cfg->loop_count - 1; lv && l >= 0 && !changed; l--) {
+                ICIvs iv;
+                memset(&iv, 0, sizeof(iv));
+                iv.ctx = ctx;
+                iv.cfg = cfg;
+                iv.lv = lv;
+                iv.loop = cfg->loops[l];
+                iv.defs_in_loop = calloc(value_count + 1, sizeof(I64));
+                iv.def_ic = calloc(value_count + 1, sizeof(CIntermediateCode*));
+                iv.use_count = calloc(value_count + 1, sizeof(I64));
+                iv.ivs = malloc(sizeof(ICIndVar) * (ic_total + 1));
+
+                if (iv.defs_in_loop && iv.def_ic && iv.use_count && iv.ivs) {
+                    I64 count = ic_iv_loop(&iv, ic_total);
+                    if (count > 0) {
+                        reduced += count;
+                        changed = true;
+                    }
+                }
+
+                free(iv.defs_in_loop);
+                free(iv.def_ic);
+                free(iv.use_count);
+                free(iv.ivs);
+            }
+
+            ic_liveness_free(lv);
+            ic_cfg_free(cfg);
+        }
+    }
+
+    ctx->opt_changes += reduced;
+    printf("DEBUG: opt_induction_variables - %lld induction variables reduced\n", reduced);
+    return true;
+}
@@ -0,0 +1,390 @@
+/*
+ * Loop Optimization
+ * Loop-invariant code motion into a loop preheader
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Pure Functions
+ * A function is pure when it only computes on its parameters: no memory,
+ * globals, calls or inline assembly, no faulting division and no loops,
+ * so a call always terminates and can be executed speculatively.
+ */
+
+typedef struct {
+    U8 *name;
+    Bool pure;
+} ICPureFunc;
+
+static Bool ic_licm_function_is_pure(ICGenContext *ctx, CIntermediateCode *enter) {
+    for (CIntermediateCode *ic = enter->base.next; ic && ic->base.ic_code != IC_LEAVE; ic = ic->base.next) {
+        switch (ic->base.ic_code) {
+            case IC_STORE: case IC_LOAD: case IC_CALL: case IC_ASM_INLINE: case IC_PUSH:
+            case IC_MALLOC: case IC_FREE:
+            case IC_VEC_STORE: case IC_VEC_LOAD:
+                return false;
+            default:
+                break;
+        }
+        if (ic->base.ic_code != IC_PHI && ic_has_side_effects(ic) && !ic_is_branch(ic) &&
+            ic->base.ic_code != IC_LABEL && ic->base.ic_code != IC_RETURN && ic->base.ic_code != IC_RETURN_VAL) {
+            return false;
+        }
+        /* A backward branch means a loop that might not terminate */
+        CIntermediateCode *target = ic_branch_target(ic);
+        if (target) {
+            for (CIntermediateCode *scan = target; scan; scan = scan->base.next) {
+                if (scan == ic) return false;
+                if (scan->base.ic_code == IC_LEAVE) break;
+            }
+        }
+        CICArg *args[3] = { &ic->arg1, &ic->arg2, &ic->res };
+        for (int a = 0; a < 3; a++) {
+            if (args[a]->type == IC_ARG_VAR && args[a]->i64_val < ctx->var_count &&
+                (ctx->vars[args[a]->i64_val].is_global || !ic_ssa_is_promotable(ctx, args[a]->i64_val))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static Bool ic_licm_call_is_pure(ICPureFunc *funcs, I64 func_count, CIntermediateCode *call) {
+    if (call->arg1.type != IC_ARG_SYMBOL || !call->arg1.ptr_val) return false;
+    for (I64 f = 0; f < func_count; f++) {
+        if (funcs[f].name && strcmp((char*)funcs[f].name, (char*)call->arg1.ptr_val) == 0) return funcs[f].pure;
+    }
+    return false;
+}
+
+/*
+ * Invariant Detection
+ */
+
+typedef struct {
+    ICGenContext *ctx;
+    ICCfg *cfg;
+    ICLiveness *lv;
+    ICLoop *loop;
+    ICPureFunc *funcs;
+    I64 func_count;
+    I64 *defs_in_loop;               /* Definitions of each value inside the loop */
+    CIntermediateCode **def_ic;      /* The in-loop definition when there is exactly one */
+    Bool has_barrier;                /* Loop contains a call or inline assembly */
+    Bool has_unknown_store;          /* Loop stores through a pointer of unknown target */
+    I64 *stored_vars;                /* Variables stored to through known addresses */
+    I64 stored_count;
+    CIntermediateCode **hoist;       /* Marked invariant ICs in dependence order */
+    I64 hoist_count;
+} ICLicm;
+
+static Bool ic_licm_is_marked(ICLicm *lm, CIntermediateCode *ic) {
+    for (I64 h = 0; h < lm->hoist_count; h++) {
+        if (lm->hoist[h] == ic) return true;
+    }
+    return false;
+}
+
+/* Local variable a pointer value is known to address (through ADDR and constant offsets), else -1 */
+static I64 ic_licm_address_var(ICLicm *lm, CICArg *addr) {
+    for (I64 hops = 0; hops < 8; hops++) {
+        I64 value = ic_liveness_index(lm->lv, addr);
+        if (value < 0 || value >= lm->lv->temp_count) return -1;
+
+        /* Follow the single definition, wherever it is in the function */
+        CIntermediateCode *def = NULL;
+        I64 defs = 0;
+        for (CIntermediateCode *ic = lm->cfg->enter; ic; ic = ic->base.next) {
+            CICArg *d = ic_get_def(ic);
+            if (d && d->type == IC_ARG_TEMP && d->i64_val == addr->i64_val) {
+                def = ic;
+                defs++;
+            }
+            if (ic == lm->cfg->leave) break;
+        }
+        if (defs != 1) return -1;
+
+        if (def->base.ic_code == IC_ADDR && def->arg1.type == IC_ARG_VAR) {
+            I64 var = def->arg1.i64_val;
+            ICVar *v = &lm->ctx->vars[var];
+            return (v->is_global || v->is_volatile) ? -1 : var;
+        }
+        if ((def->base.ic_code == IC_ADD && def->arg2.type == IC_ARG_CONST) || def->base.ic_code == IC_ASSIGN) {
+            addr = &def->arg1;
+        } else {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+static Bool ic_licm_operand_invariant(ICLicm *lm, CICArg *arg) {
+    if (arg->type == IC_ARG_CONST || arg->type == IC_ARG_FCONST ||
+        arg->type == IC_ARG_STRING || arg->type == IC_ARG_SYMBOL) {
+        return true;
+    }
+    I64 value = ic_liveness_index(lm->lv, arg);
+    if (value < 0) return false;
+
+    if (arg->type == IC_ARG_VAR) {
+        I64 var = arg->i64_val;
+        if (lm->ctx->vars[var].is_volatile) return false;
+        /* Memory-resident variables can change behind our back */
+        if (!ic_ssa_is_promotable(lm->ctx, var) && (lm->has_barrier || lm->has_unknown_store)) return false;
+        for (I64 s = 0; s < lm->stored_count; s++) {
+            if (lm->stored_vars[s] == var) return false;
+        }
+    }
+    if (lm->defs_in_loop[value] == 0) return true;
+    return lm->defs_in_loop[value] == 1 && ic_licm_is_marked(lm, lm->def_ic[value]);
+}
+
+/* May a load read memory that the loop writes */
+static Bool ic_licm_load_is_invariant(ICLicm *lm, CIntermediateCode *ic) {
+    if (lm->has_barrier || lm->has_unknown_store) return false;
+    I64 var = ic_licm_address_var(lm, &ic->arg1);
+    if (var < 0) return false;
+    for (I64 s = 0; s < lm->stored_count; s++) {
+        if (lm->stored_vars[s] == var) return false;
+    }
+    return true;
+}
+
+/* Single in-loop definition that is not live into the header, so hoisting it changes no path */
+static Bool ic_licm_result_hoistable(ICLicm *lm, CICArg *def) {
+    I64 value = ic_liveness_index(lm->lv, def);
+    if (value < 0 || lm->defs_in_loop[value] != 1) return false;
+    if (def->type == IC_ARG_VAR && !ic_ssa_is_promotable(lm->ctx, def->i64_val)) return false;
+    U64 *header_in = &lm->lv->live_in[lm->loop->header->id * lm->lv->words];
+    return !((header_in[value >> 6] >> (value & 63)) & 1);
+}
+
+static Bool ic_licm_is_invariant(ICLicm *lm, CIntermediateCode *ic) {
+    U16 code = ic->base.ic_code;
+    CICArg *def = ic_get_def(ic);
+    if (!def || code == IC_PARAM || code == IC_PHI) return false;
+
+    if (code == IC_CALL) {
+        /* Pure call: all its pushes must directly precede it and be invariant */
+        if (!ic_licm_call_is_pure(lm->funcs, lm->func_count, ic)) return false;
+        CIntermediateCode *push = ic->base.last;
+        for (I64 a = 0; a < ic->ic_data; a++, push = push->base.last) {
+            if (!push || push->base.ic_code != IC_PUSH || ic_cfg_block_of(push) != ic_cfg_block_of(ic)) return false;
+            if (!ic_licm_operand_invariant(lm, &push->arg1)) return false;
+        }
+    } else if (code == IC_LOAD) {
+        if (!ic_licm_operand_invariant(lm, &ic->arg1) || !ic_licm_load_is_invariant(lm, ic)) return false;
+    } else if (code == IC_ADDR) {
+        /* The address of a variable never changes */
+    } else {
+        if (ic_has_side_effects(ic)) return false;
+        CICArg *uses[2];
+        I64 use_count = ic_get_uses(ic, uses);
+        for (I64 u = 0; u < use_count; u++) {
+            if (!ic_licm_operand_invariant(lm, uses[u])) return false;
+        }
+    }
+    return ic_licm_result_hoistable(lm, def);
+}
+
+static void ic_licm_scan_loop(ICLicm *lm) {
+    for (I64 b = 0; b < lm->loop->block_count; b++) {
+        ICBasicBlock *bb = lm->loop->blocks[b];
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            I64 value = ic_liveness_index(lm->lv, ic_get_def(ic));
+            if (value >= 0) {
+                lm->defs_in_loop[value]++;
+                lm->def_ic[value] = ic;
+            }
+            if (ic->base.ic_code == IC_CALL || ic->base.ic_code == IC_ASM_INLINE ||
+                ic->base.ic_code == IC_MALLOC || ic->base.ic_code == IC_FREE) {
+                lm->has_barrier = true;
+            } else if (ic->base.ic_code == IC_STORE) {
+                I64 var = ic_licm_address_var(lm, &ic->arg1);
+                if (var < 0) {
+                    lm->has_unknown_store = true;
+                } else {
+                    lm->stored_vars[lm->stored_count++] = var;
+                }
+            } else if (ic->base.ic_code == IC_VEC_STORE) {
+                lm->has_unknown_store = true;
+            }
+            if (ic == bb->last) break;
+        }
+    }
+}
+
+/* Mark invariants until nothing changes; dependencies are always marked first */
+static void ic_licm_find_invariants(ICLicm *lm) {
+    Bool changed = true;
+    while (changed) {
+        changed = false;
+        for (I64 i = 0; i < lm->cfg->rpo_count; i++) {
+            ICBasicBlock *bb = lm->cfg->rpo[i];
+            if (!ic_loop_contains(lm->loop, bb)) continue;
+            for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+                if (!ic_licm_is_marked(lm, ic) && ic_licm_is_invariant(lm, ic)) {
+                    lm->hoist[lm->hoist_count++] = ic;
+                    changed = true;
+                }
+                if (ic == bb->last) break;
+            }
+        }
+    }
+}
+
+/*
+ * Preheader Insertion
+ */
+
+/* Position in front of which hoisted code goes, creating a preheader label if needed; NULL if impossible */
+CIntermediateCode* ic_loop_preheader(ICGenContext *ctx, ICLoop *loop) {
+    ICBasicBlock *header = loop->header;
+    CIntermediateCode *header_label = header->first;
+    if (header_label->base.ic_code != IC_LABEL) return NULL;
+
+    /* The code in front of the header must not belong to the loop and fall into it */
+    CIntermediateCode *before = header_label->base.last;
+    ICBasicBlock *layout_pred = ic_cfg_block_of(before);
+    if (!before || before->base.ic_code == IC_ENTER) return header_label;
+    if (layout_pred && ic_loop_contains(loop, layout_pred) &&
+        before->base.ic_code != IC_JUMP && before->base.ic_code != IC_RETURN &&
+        before->base.ic_code != IC_RETURN_VAL) {
+        return NULL;
+    }
+
+    /* Outside predecessors that jump to the header are sent to a new label */
+    CIntermediateCode *preheader = NULL;
+    for (I64 p = 0; p < header->pred_count; p++) {
+        ICBasicBlock *pred = header->preds[p];
+        if (ic_loop_contains(loop, pred)) continue;
+        if (ic_branch_target(pred->last) != header_label) continue;
+        if (!preheader) {
+            preheader = ic_gen_new_label(ctx);
+            if (!preheader) return NULL;
+            ic_insert_before(ctx, header_label, preheader);
+        }
+        ic_set_branch_target(pred->last, preheader);
+    }
+    return header_label;
+}
+
+static I64 ic_licm_loop(ICLicm *lm) {
+    ic_licm_scan_loop(lm);
+    ic_licm_find_invariants(lm);
+    if (lm->hoist_count == 0) return 0;
+
+    CIntermediateCode *pos = ic_loop_preheader(lm->ctx, lm->loop);
+    if (!pos) return 0;
+
+    for (I64 h = 0; h < lm->hoist_count; h++) {
+        CIntermediateCode *ic = lm->hoist[h];
+        if (ic->base.ic_code == IC_CALL) {
+            /* Move the argument pushes along with the call, in order */
+            CIntermediateCode *first = ic;
+            for (I64 a = 0; a < ic->ic_data; a++) first = first->base.last;
+            while (first != ic) {
+                CIntermediateCode *next = first->base.next;
+                ic_unlink(lm->ctx, first);
+                ic_insert_before(lm->ctx, pos, first);
+                first = next;
+            }
+        }
+        ic_unlink(lm->ctx, ic);
+        ic_insert_before(lm->ctx, pos, ic);
+    }
+    return lm->hoist_count;
+}
+
+/*
+ * Hoist loop-invariant computations (arithmetic, addresses, loads of
+ * locals the loop does not write, calls to pure functions) into a
+ * preheader, innermost loops first. The CFG is rebuilt after each loop
+ * that changes, so invariants of inner loops move on outwards.
+ */
+Bool opt_loop_optimization(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    I64 func_count = 0;
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        func_count++;
+    }
+    ICPureFunc *funcs = calloc(func_count + 1, sizeof(ICPureFunc));
+    if (!funcs) return false;
+    I64 f = 0;
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        funcs[f].name = enter->arg1.type == IC_ARG_SYMBOL ? (U8*)enter->arg1.ptr_val : NULL;
+        funcs[f].pure = ic_licm_function_is_pure(ctx, enter);
+        f++;
+    }
+
+    I64 hoisted = 0;
+    I64 value_count = ctx->temp_count + ctx->var_count;
+
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        Bool changed = true;
+        I64 rounds = 0;
+        while (changed) {
+            changed = false;
+            rounds++;
+            if (rounds > 100) {
+                printf("ERROR: opt_loop_optimization - infinite loop detected, breaking\n");
+                break;
+            }
+
+            ICCfg *cfg = ic_cfg_build(ctx, enter);
+            if (!cfg) break;
+            ICLiveness *lv = ic_liveness_compute(ctx, cfg);
+
+            I64 ic_total = 0;
+            for (CIntermediateCode *ic = enter; ic; ic = ic->base.next) {
+                ic_total++;
+                if (ic == cfg->leave) break;
+            }
+
+            /* Innermost loops come last in the forest order */
+            for (I64 l = cfg->loop_count - 1; lv && l >= 0 && !changed; l--) {
+                ICLicm lm;
+                memset(&lm, 0, sizeof(lm));
+                lm.ctx = ctx;
+                lm.cfg = cfg;
+                lm.lv = lv;
+                lm.loop = cfg->loops[l];
+                lm.funcs = funcs;
+                lm.func_count = func_count;
+                lm.defs_in_loop = calloc(value_count + 1, sizeof(I64));
+                lm.def_ic = calloc(value_count + 1, sizeof(CIntermediateCode*));
+                lm.stored_vars = malloc(sizeof(I64) * (ic_total + 1));
+                lm.hoist = malloc(sizeof(CIntermediateCode*) * (ic_total + 1));
+
+                if (lm.defs_in_loop && lm.def_ic && lm.stored_vars && lm.hoist) {
+                    I64 moved = ic_licm_loop(&lm);
+                    if (moved > 0) {
+                        hoisted += moved;
+                        changed = true;
+                    }
+                }
+
+                free(lm.defs_in_loop);
+                free(lm.def_ic);
+                free(lm.stored_vars);
+                free(lm.hoist);
+            }
+
+            ic_liveness_free(lv);
+            ic_cfg_free(cfg);
+        }
+    }
+
+    free(funcs);
+    ctx->opt_changes += hoisted;
+    printf("DEBUG: opt_loop_optimization - %lld loop-invariant instructions hoisted\n", hoisted);
+    return true;
+}
@@ -0,0 +1,295 @@
+/*
+ * Liveness Analysis
+ * Backward dataflow over the CFG for temps and variables, and the dead
+ * code / dead store marking used by opt_pass_5
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define LV_TEST(set, i)   (((set)[(i) >> 6] >> ((i) & 63)) & 1)
+#define LV_SET(set, i)    ((set)[(i) >> 6] |= (U64)1 << ((i) & 63))
+#define LV_CLEAR(set, i)  ((set)[(i) >> 6] &= ~((U64)1 << ((i) & 63)))
+
+/* Liveness index of a value operand, -1 for operands that are not tracked */
+I64 ic_liveness_index(ICLiveness *lv, CICArg *arg) {
+    if (!lv || !arg) return -1;
+    if (arg->type == IC_ARG_TEMP && arg->i64_val >= 0 && arg->i64_val < lv->temp_count) {
+        return arg->i64_val;
+    }
+    if (arg->type == IC_ARG_VAR && arg->i64_val >= 0 && arg->i64_val < lv->value_count - lv->temp_count) {
+        return lv->temp_count + arg->i64_val;
+    }
+    return -1;
+}
+
+static void ic_liveness_or_mask(ICLiveness *lv, U64 *live, U64 *mask) {
+    for (I64 w = 0; w < lv->words; w++) {
+        live[w] |= mask[w];
+    }
+}
+
+/*
+ * Backward transfer of one instruction: remove what ic defines, add what
+ * it reads. Calls, inline assembly and loads read memory, so they keep
+ * every variable that memory can reach alive; returns keep globals alive.
+ */
+void ic_liveness_transfer(ICLiveness *lv, CIntermediateCode *ic, U64 *live) {
+    if (!lv || !ic || !live) return;
+
+    CICArg *def = ic_get_def(ic);
+    I64 d = ic_liveness_index(lv, def);
+    if (d >= 0) LV_CLEAR(live, d);
+
+    CICArg *uses[2];
+    I64 use_count = ic_get_uses(ic, uses);
+    for (I64 u = 0; u < use_count; u++) {
+        I64 index = ic_liveness_index(lv, uses[u]);
+        if (index >= 0) LV_SET(live, index);
+    }
+
+    switch (ic->base.ic_code) {
+        case IC_CALL:
+        case IC_MALLOC:
+        case IC_FREE:
+            ic_liveness_or_mask(lv, live, lv->call_mask);
+            break;
+        case IC_ASM_INLINE:
+            ic_liveness_or_mask(lv, live, lv->asm_mask);
+            break;
+        case IC_LOAD:
+        case IC_VEC_LOAD:
+            ic_liveness_or_mask(lv, live, lv->load_mask);
+            break;
+        case IC_RETURN:
+        case IC_RETURN_VAL:
+        case IC_LEAVE:
+            ic_liveness_or_mask(lv, live, lv->exit_mask);
+            break;
+        default:
+            break;
+    }
+}
+
+/* Compute live-in/live-out sets for every block of cfg */
+ICLiveness* ic_liveness_compute(ICGenContext *ctx, ICCfg *cfg) {
+    if (!ctx || !cfg) return NULL;
+
+    ICLiveness *lv = malloc(sizeof(ICLiveness));
+    if (!lv) return NULL;
+    memset(lv, 0, sizeof(ICLiveness));
+
+    lv->temp_count = ctx->temp_count;
+    lv->value_count = ctx->temp_count + ctx->var_count;
+    lv->words = (lv->value_count + 63) / 64 + 1;
+    lv->block_count = cfg->block_count;
+
+    I64 set_bytes = sizeof(U64) * lv->words;
+    lv->live_in = calloc(cfg->block_count, set_bytes);
+    lv->live_out = calloc(cfg->block_count, set_bytes);
+    lv->call_mask = calloc(1, set_bytes);
+    lv->asm_mask = calloc(1, set_bytes);
+    lv->load_mask = calloc(1, set_bytes);
+    lv->exit_mask = calloc(1, set_bytes);
+    U64 *live = malloc(set_bytes);
+    Bool *in_function = calloc(ctx->var_count + 1, sizeof(Bool));
+
+    if (!lv->live_in || !lv->live_out || !lv->call_mask || !lv->asm_mask ||
+        !lv->load_mask || !lv->exit_mask || !live || !in_function) {
+        free(live);
+        free(in_function);
+        ic_liveness_free(lv);
+        return NULL;
+    }
+
+    /* Variables this function mentions */
+    for (CIntermediateCode *ic = cfg->enter; ic; ic = ic->base.next) {
+        CICArg *args[3] = { &ic->arg1, &ic->arg2, &ic->res };
+        for (int a = 0; a < 3; a++) {
+            if (args[a]->type == IC_ARG_VAR && args[a]->i64_val >= 0 && args[a]->i64_val < ctx->var_count) {
+                in_function[args[a]->i64_val] = true;
+            }
+        }
+        if (ic == cfg->leave) break;
+    }
+
+    /* Memory effects of barriers on the variables */
+    for (I64 v = 0; v < ctx->var_count; v++) {
+        if (!in_function[v]) continue;
+        ICVar *var = &ctx->vars[v];
+        I64 index = lv->temp_count + v;
+        Bool in_memory = var->address_taken || var->is_array;
+
+        LV_SET(lv->asm_mask, index);
+        if (var->is_global || in_memory) LV_SET(lv->call_mask, index);
+        if (in_memory) LV_SET(lv->load_mask, index);
+        if (var->is_global) LV_SET(lv->exit_mask, index);
+    }
+
+    /* Iterate to a fixed point in post-order (reverse RPO) */
+    Bool changed = true;
+    I64 rounds = 0;
+    while (changed) {
+        changed = false;
+        rounds++;
+        if (rounds > 1000) {
+            printf("ERROR: ic_liveness_compute - no fixed point, breaking\n");
+            break;
+        }
+        for (I64 i = cfg->rpo_count - 1; i >= 0; i--) {
+            ICBasicBlock *bb = cfg->rpo[i];
+            U64 *out = &lv->live_out[bb->id * lv->words];
+            U64 *in = &lv->live_in[bb->id * lv->words];
+
+            for (I64 s = 0; s < bb->succ_count; s++) {
+                U64 *succ_in = &lv->live_in[bb->succ[s]->id * lv->words];
+                for (I64 w = 0; w < lv->words; w++) {
+                    out[w] |= succ_in[w];
+                }
+            }
+
+            memcpy(live, out, set_bytes);
+            for (CIntermediateCode *ic = bb->last; ic; ic = ic->base.last) {
+                ic_liveness_transfer(lv, ic, live);
+                if (ic == bb->first) break;
+            }
+
+            if (memcmp(live, in, set_bytes) != 0) {
+                memcpy(in, live, set_bytes);
+                changed = true;
+            }
+        }
+    }
+
+    free(live);
+    free(in_function);
+    return lv;
+}
+
+void ic_liveness_free(ICLiveness *lv) {
+    if (!lv) return;
+    free(lv->live_in);
+    free(lv->live_out);
+    free(lv->call_mask);
+    free(lv->asm_mask);
+    free(lv->load_mask);
+    free(lv->exit_mask);
+    free(lv);
+}
+
+/*
+ * Dead Code and Dead Store Elimination
+ */
+
+/* Variable written by a store through a pointer known to address it, else -1 */
+static I64 ic_store_target_var(CIntermediateCode **temp_def, I64 temp_count, CICArg *addr) {
+    for (I64 hops = 0; hops < 8; hops++) {
+        if (addr->type != IC_ARG_TEMP || addr->i64_val < 0 || addr->i64_val >= temp_count) return -1;
+        CIntermediateCode *def = temp_def[addr->i64_val];
+        if (!def) return -1;
+
+        if (def->base.ic_code == IC_ADDR && def->arg1.type == IC_ARG_VAR) return def->arg1.i64_val;
+        if (def->base.ic_code == IC_ADD && def->arg2.type == IC_ARG_CONST) {
+            /* Constant offsets stay inside the same variable (index bounds are the program's) */
+            addr = &def->arg1;
+        } else if (def->base.ic_code == IC_ASSIGN) {
+            addr = &def->arg1;
+        } else {
+            return -1;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Mark instructions whose results are never used (ICF_RES_NOT_USED) so
+ * ic_is_dead reports them. Stores to non-volatile locals that are
+ * overwritten or never read again are marked as well.
+ */
+Bool opt_dead_code_elimination(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    I64 marked = 0;
+
+    for (CIntermediateCode *ic = ctx->ic_head; ic; ic = ic->base.next) {
+        ic->ic_flags &= ~ICF_RES_NOT_USED;
+    }
+
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        ICCfg *cfg = ic_cfg_build(ctx, enter);
+        if (!cfg) continue;
+
+        ICLiveness *lv = ic_liveness_compute(ctx, cfg);
+        I64 temp_count = ctx->temp_count;
+        CIntermediateCode **temp_def = calloc(temp_count + 1, sizeof(CIntermediateCode*));
+        I64 *def_count = calloc(temp_count + 1, sizeof(I64));
+        U64 *live = lv ? malloc(sizeof(U64) * lv->words) : NULL;
+
+        if (!lv || !temp_def || !def_count || !live) {
+            free(temp_def);
+            free(def_count);
+            free(live);
+            ic_liveness_free(lv);
+            ic_cfg_free(cfg);
+            continue;
+        }
+
+        /* Single definitions let stores be traced back to the variable they address */
+        for (CIntermediateCode *ic = enter; ic; ic = ic->base.next) {
+            CICArg *def = ic_get_def(ic);
+            if (def && def->type == IC_ARG_TEMP && def->i64_val < temp_count) {
+                def_count[def->i64_val]++;
+                temp_def[def->i64_val] = ic;
+            }
+            if (ic == cfg->leave) break;
+        }
+        for (I64 t = 0; t < temp_count; t++) {
+            if (def_count[t] != 1) temp_def[t] = NULL;
+        }
+
+        for (I64 i = 0; i < cfg->rpo_count; i++) {
+            ICBasicBlock *bb = cfg->rpo[i];
+            memcpy(live, &lv->live_out[bb->id * lv->words], sizeof(U64) * lv->words);
+
+            for (CIntermediateCode *ic = bb->last; ic; ic = ic->base.last) {
+                Bool dead = false;
+                CICArg *def = ic_get_def(ic);
+                I64 d = ic_liveness_index(lv, def);
+
+                /* IC_PARAM stays: it describes the frame even when unread */
+                if (d >= 0 && !LV_TEST(live, d) && !ic_has_side_effects(ic) &&
+                    ic->base.ic_code != IC_PARAM) {
+                    dead = def->type != IC_ARG_VAR || !ctx->vars[def->i64_val].is_volatile;
+                } else if (ic->base.ic_code == IC_STORE) {
+                    I64 var = ic_store_target_var(temp_def, temp_count, &ic->arg1);
+                    if (var >= 0 && !ctx->vars[var].is_volatile && !ctx->vars[var].is_global) {
+                        CICArg target = ic_arg_var(var);
+                        I64 index = ic_liveness_index(lv, &target);
+                        dead = index >= 0 && !LV_TEST(live, index);
+                    }
+                }
+
+                if (dead) {
+                    ic->ic_flags |= ICF_RES_NOT_USED;
+                    marked++;
+                } else {
+                    ic_liveness_transfer(lv, ic, live);
+                }
+                if (ic == bb->first) break;
+            }
+        }
+
+        free(temp_def);
+        free(def_count);
+        free(live);
+        ic_liveness_free(lv);
+        ic_cfg_free(cfg);
+    }
+
+    ctx->opt_changes += marked;
+    printf("DEBUG: opt_dead_code_elimination - %lld dead instructions found\n", marked);
+    return true;
+}
@@ -0,0 +1,237 @@
+/*
+ * Profile-Guided Optimization
+ * Numbers the execution counters of a program over its AST and reads
+ * the counts an instrumented run wrote back in
+ */
+
+#include "profile.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define PROFILE_FNV_OFFSET  0xCBF29CE484222325ULL
+#define PROFILE_FNV_PRIME   0x00000100000001B3ULL
+
+ProfileData* profile_new(ProfileMode mode, const char *path) {
+    ProfileData *profile = calloc(1, sizeof(ProfileData));
+    if (!profile) return NULL;
+
+    if (!path) path = PROFILE_DEFAULT_FILE;
+    profile->mode = mode;
+    profile->path = malloc(strlen(path) + 1);
+    if (!profile->path) {
+        free(profile);
+        return NULL;
+    }
+    strcpy(profile->path, path);
+    profile->checksum = PROFILE_FNV_OFFSET;
+    return profile;
+}
+
+void profile_free(ProfileData *profile) {
+    if (!profile) return;
+    free(profile->path);
+    free(profile->counts);
+    free(profile);
+}
+
+/*
+ * Counter Numbering
+ * Counters are numbered in one fixed walk of the AST, so the instrumented
+ * build and the optimizing build agree on them whatever layout either
+ * chooses. A node owns profile_slots consecutive counters from profile_id:
+ *  - functions: entries;
+ *  - calls: executions of the call site;
+ *  - if: then arm, else arm (counted even when there is no else);
+ *  - while: iterations of the body;
+ *  - case: arrivals at the case code.
+ */
+
+static I64 profile_slots(ASTNode *node) {
+    switch (node->type) {
+        case NODE_FUNCTION:
+            return node->data.function.body ? 1 : 0;
+        case NODE_CALL:
+        case NODE_WHILE_STMT:
+        case NODE_CASE:
+            return 1;
+        case NODE_IF_STMT:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+static void profile_mix(ProfileData *profile, U64 value) {
+    for (int i = 0; i < 8; i++) {
+        profile->checksum ^= (value >> (i * 8)) & 0xFF;
+        profile->checksum *= PROFILE_FNV_PRIME;
+    }
+}
+
+static void profile_mix_name(ProfileData *profile, U8 *name) {
+    for (; name && *name; name++) profile_mix(profile, *name);
+}
+
+static void profile_number(ProfileData *profile, ASTNode *node);
+
+static void profile_number_list(ProfileData *profile, ASTNode *node) {
+    for (; node; node = node->next) profile_number(profile, node);
+}
+
+static void profile_number(ProfileData *profile, ASTNode *node) {
+    if (!node) return;
+
+    I64 slots = profile_slots(node);
+    if (slots > 0) {
+        node->profile_id = profile->counter_count + 1;
+        profile->counter_count += slots;
+        profile_mix(profile, node->type);
+        if (node->type == NODE_FUNCTION) profile_mix_name(profile, node->data.function.name);
+        if (node->type == NODE_CALL) profile_mix_name(profile, node->data.call.name);
+    }
+
+    switch (node->type) {
+        case NODE_PROGRAM:
+            profile_number_list(profile, node->children);
+            break;
+        case NODE_FUNCTION:
+            profile_number(profile, node->data.function.body);
+            break;
+        case NODE_BLOCK:
+            profile_number_list(profile, node->data.block.statements);
+            break;
+        case NODE_CALL:
+            if (node->data.call.arguments) profile_number_list(profile, node->data.call.arguments->data.block.statements);
+            break;
+        case NODE_ASSIGNMENT:
+            profile_number(profile, node->data.assignment.left);
+            profile_number(profile, node->data.assignment.right);
+            break;
+        case NODE_BINARY_OP:
+            profile_number(profile, node->data.binary_op.left);
+            profile_number(profile, node->data.binary_op.right);
+            break;
+        case NODE_UNARY_OP:
+            profile_number(profile, node->data.unary_op.operand);
+            break;
+        case NODE_RETURN:
+            profile_number(profile, node->data.return_stmt.expression);
+            break;
+        case NODE_RANGE_COMPARISON:
+            profile_number_list(profile, node->data.range_comparison.expressions);
+            break;
+        case NODE_CONDITIONAL:
+            profile_number(profile, node->data.conditional.condition);
+            profile_number(profile, node->data.conditional.true_expr);
+            profile_number(profile, node->data.conditional.false_expr);
+            break;
+        case NODE_IF_STMT:
+            profile_number(profile, node->data.if_stmt.condition);
+            profile_number(profile, node->data.if_stmt.then_stmt);
+            profile_number(profile, node->data.if_stmt.else_stmt);
+            break;
+        case NODE_WHILE_STMT:
+            profile_number(profile, node->data.while_stmt.condition);
+            profile_number(profile, node->data.while_stmt.body_stmt);
+            break;
+        case NODE_DO_WHILE_STMT:
+            profile_number(profile, node->data.do_while_stmt.body);
+            profile_number(profile, node->data.do_while_stmt.condition);
+            break;
+        case NODE_FOR_STMT:
+            profile_number(profile, node->data.for_stmt.init);
+            profile_number(profile, node->data.for_stmt.condition);
+            profile_number(profile, node->data.for_stmt.increment);
+            profile_number(profile, node->data.for_stmt.body);
+            break;
+        case NODE_SWITCH:
+            profile_number(profile, node->data.switch_stmt.expression);
+            profile_number_list(profile, node->data.switch_stmt.cases);
+            /* The default case may or may not also sit in the case list */
+            if (node->data.switch_stmt.default_case && !node->data.switch_stmt.default_case->profile_id) {
+                profile_number(profile, node->data.switch_stmt.default_case);
+            }
+            break;
+        case NODE_CASE:
+            profile_number_list(profile, node->data.case_stmt.body);
+            break;
+        case NODE_START_BLOCK:
+        case NODE_END_BLOCK:
+            profile_number_list(profile, node->data.start_end_block.statements);
+            break;
+        default:
+            break;
+    }
+}
+
+/* Number the counters of the program; returns how many there are */
+I64 profile_annotate(ProfileData *profile, ASTNode *ast) {
+    if (!profile || !ast) return 0;
+
+    profile->counter_count = 0;
+    profile->checksum = PROFILE_FNV_OFFSET;
+    profile_number(profile, ast);
+    profile_mix(profile, (U64)profile->counter_count);
+
+    printf("DEBUG: profile_annotate - %lld counters, checksum %016llX\n",
+           profile->counter_count, (unsigned long long)profile->checksum);
+    return profile->counter_count;
+}
+
+/* Read the counts written by an instrumented build of the same program */
+Bool profile_load(ProfileData *profile) {
+    if (!profile) return false;
+
+    FILE *file = fopen(profile->path, "rb");
+    if (!file) {
+        printf("WARNING: Cannot open profile %s, compiling without it\n", profile->path);
+        return false;
+    }
+
+    U64 header[3];
+    U64 *counts = NULL;
+    Bool ok = fread(header, sizeof(U64), 3, file) == 3 && header[0] == PROFILE_MAGIC;
+    if (!ok) {
+        printf("WARNING: %s is not a SchismC profile, compiling without it\n", profile->path);
+    } else if (header[1] != profile->checksum || header[2] != (U64)profile->counter_count) {
+        printf("WARNING: Profile %s was made for a different program, compiling without it\n", profile->path);
+        ok = false;
+    } else {
+        counts = malloc(sizeof(U64) * (profile->counter_count + 1));
+        ok = counts && fread(counts, sizeof(U64), profile->counter_count, file) == (size_t)profile->counter_count;
+        if (!ok) printf("WARNING: Profile %s is truncated, compiling without it\n", profile->path);
+    }
+    fclose(file);
+
+    if (!ok) {
+        free(counts);
+        return false;
+    }
+    free(profile->counts);
+    profile->counts = counts;
+
+    U64 total = 0;
+    for (I64 i = 0; i < profile->counter_count; i++) total += counts[i];
+    printf("DEBUG: profile_load - %s: %lld counters, %llu counted executions\n",
+           profile->path, profile->counter_count, (unsigned long long)total);
+    return true;
+}
+
+Bool profile_has_counts(ProfileData *profile) {
+    return profile && profile->mode == PROFILE_USE && profile->counts;
+}
+
+/* Count of one of the node's counters, 0 without a profile */
+U64 profile_count(ProfileData *profile, ASTNode *node, I64 slot) {
+    if (!profile_has_counts(profile) || !node || node->profile_id <= 0) return 0;
+    if (slot < 0 || slot >= profile_slots(node)) return 0;
+
+    I64 index = node->profile_id - 1 + slot;
+    return index < profile->counter_count ? profile->counts[index] : 0;
+}
+
+/* A path taken count times out of total is cold if it is taken almost never */
+Bool profile_is_cold(U64 count, U64 total) {
+    return total > 0 && count * PROFILE_COLD_RATIO < total;
+}
@@ -0,0 +1,481 @@
+/*
+ * Register Allocation
+ * Linear scan over live intervals (Poletto & Sarkar) with Win64 register
+ * classes, interval splitting, spill slot reuse and rematerialization
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Win64 register classes. RSP and RBP hold the frame; R10 and R11 are kept
+ * back as scratch for reloads and rematerialization, so they never hold
+ * allocated values. Vectors get the caller-saved XMM0-XMM5; the vector
+ * loops never contain calls, so they need no callee-saved ones.
+ */
+static const X86Register ic_ra_volatile_regs[] = {
+    X86_REG_RAX, X86_REG_RCX, X86_REG_RDX, X86_REG_R8, X86_REG_R9
+};
+static const X86Register ic_ra_nonvolatile_regs[] = {
+    X86_REG_RBX, X86_REG_RSI, X86_REG_RDI, X86_REG_R12, X86_REG_R13, X86_REG_R14, X86_REG_R15
+};
+static const X86Register ic_ra_vector_regs[] = {
+    X86_REG_XMM0, X86_REG_XMM1, X86_REG_XMM2, X86_REG_XMM3, X86_REG_XMM4, X86_REG_XMM5
+};
+
+#define IC_RA_VOLATILE_COUNT    (I64)(sizeof(ic_ra_volatile_regs) / sizeof(ic_ra_volatile_regs[0]))
+#define IC_RA_NONVOLATILE_COUNT (I64)(sizeof(ic_ra_nonvolatile_regs) / sizeof(ic_ra_nonvolatile_regs[0]))
+#define IC_RA_VECTOR_COUNT      (I64)(sizeof(ic_ra_vector_regs) / sizeof(ic_ra_vector_regs[0]))
+#define IC_RA_VECTOR_SLOTS      4    /* A spilled vector takes 32 bytes */
+#define IC_RA_MAX_LOOP_WEIGHT   4
+
+static const char *ic_ra_reg_names[] = {
+    "none", "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
+};
+static const char *ic_ra_vector_reg_names[] = {
+    "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",
+    "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"
+};
+
+const char* ic_reg_name(X86Register reg) {
+    if (reg >= X86_REG_NONE && reg <= X86_REG_R15) return ic_ra_reg_names[reg];
+    if (reg >= X86_REG_XMM0 && reg <= X86_REG_XMM15) return ic_ra_vector_reg_names[reg - X86_REG_XMM0];
+    return "?";
+}
+
+static Bool ic_ra_is_volatile(X86Register reg) {
+    for (I64 i = 0; i < IC_RA_VOLATILE_COUNT; i++) {
+        if (ic_ra_volatile_regs[i] == reg) return true;
+    }
+    for (I64 i = 0; i < IC_RA_VECTOR_COUNT; i++) {
+        if (ic_ra_vector_regs[i] == reg) return true;
+    }
+    return false;
+}
+
+typedef struct {
+    I64 value;                       /* Liveness index of the value */
+    I64 start;                       /* First position (definition or live-in) */
+    I64 end;                         /* Last position (use or live-out) */
+    I64 weight;                      /* Uses and defs, scaled by loop depth */
+    I64 def_count;                   /* Number of definitions */
+    I64 first_call;                  /* First clobbering position inside the interval, -1 if none */
+    X86Register reg;                 /* Assigned register */
+    I64 split_pos;                   /* In memory from this position on, -1 if never */
+    I64 slot;                        /* Spill slot, -1 if none */
+    Bool remat;                      /* Single constant definition */
+    I64 remat_value;                 /* That constant */
+    Bool is_vector;                  /* Defined by a vector instruction: needs an XMM register */
+} ICInterval;
+
+typedef struct {
+    ICGenContext *ctx;
+    ICLiveness *lv;
+    CIntermediateCode **order;       /* ICs of the function by position */
+    I64 count;                       /* Number of positions */
+    ICInterval *intervals;           /* Indexed by liveness index */
+    I64 *clobbers;                   /* Positions of calls and inline assembly, ascending */
+    I64 clobber_count;
+    I64 *slot_busy_until;            /* Last position each spill slot is in use */
+    I64 slot_count;
+    I64 slot_capacity;
+    U32 callee_saved_used;           /* Bit per X86Register */
+} ICRegAlloc;
+
+/* Is value index allocatable: temps always, variables only when nothing can alias them */
+static Bool ic_ra_allocatable(ICRegAlloc *ra, I64 value) {
+    if (value < ra->lv->temp_count) return true;
+    return ic_ssa_is_promotable(ra->ctx, value - ra->lv->temp_count);
+}
+
+static void ic_ra_extend(ICRegAlloc *ra, I64 value, I64 pos) {
+    ICInterval *it = &ra->intervals[value];
+    if (pos < it->start) it->start = pos;
+    if (pos > it->end) it->end = pos;
+}
+
+static Bool ic_ra_is_clobber(CIntermediateCode *ic) {
+    return ic->base.ic_code == IC_CALL || ic->base.ic_code == IC_ASM_INLINE ||
+           ic->base.ic_code == IC_MALLOC || ic->base.ic_code == IC_FREE;
+}
+
+/*
+ * Build one conservative interval per value: the hull of every position
+ * where it is live. A value live around a loop back edge covers the
+ * whole loop, since loop blocks are laid out contiguously.
+ */
+static Bool ic_ra_build_intervals(ICRegAlloc *ra, ICCfg *cfg) {
+    ICLiveness *lv = ra->lv;
+    I64 *block_start = malloc(sizeof(I64) * (cfg->block_count + 1));
+    I64 *block_end = malloc(sizeof(I64) * (cfg->block_count + 1));
+    U64 *live = malloc(sizeof(U64) * lv->words);
+    if (!block_start || !block_end || !live) {
+        free(block_start);
+        free(block_end);
+        free(live);
+        return false;
+    }
+
+    /* Positions in layout order */
+    I64 pos = 0;
+    for (I64 b = 0; b < cfg->block_count; b++) {
+        ICBasicBlock *bb = cfg->blocks[b];
+        block_start[b] = pos;
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            ra->order[pos] = ic;
+            if (ic_ra_is_clobber(ic)) ra->clobbers[ra->clobber_count++] = pos;
+            pos++;
+            if (ic == bb->last) break;
+        }
+        block_end[b] = pos - 1;
+    }
+    ra->count = pos;
+
+    for (I64 v = 0; v < lv->value_count; v++) {
+        ICInterval *it = &ra->intervals[v];
+        it->value = v;
+        it->start = ra->count;
+        it->end = -1;
+        it->first_call = -1;
+        it->reg = X86_REG_NONE;
+        it->split_pos = -1;
+        it->slot = -1;
+    }
+
+    for (I64 b = 0; b < cfg->block_count; b++) {
+        ICBasicBlock *bb = cfg->blocks[b];
+        if (bb->rpo_number < 0 || block_end[b] < block_start[b]) continue;
+
+        I64 depth = bb->loop ? bb->loop->depth : 0;
+        if (depth > IC_RA_MAX_LOOP_WEIGHT) depth = IC_RA_MAX_LOOP_WEIGHT;
+        I64 weight = 1;
+        for (I64 d = 0; d < depth; d++) weight *= 10;
+
+        memcpy(live, &lv->live_out[bb->id * lv->words], sizeof(U64) * lv->words);
+        for (I64 v = 0; v < lv->value_count; v++) {
+            if ((live[v >> 6] >> (v & 63)) & 1) ic_ra_extend(ra, v, block_end[b]);
+        }
+
+        for (I64 p = block_end[b]; p >= block_start[b]; p--) {
+            CIntermediateCode *ic = ra->order[p];
+            I64 d = ic_liveness_index(lv, ic_get_def(ic));
+            if (d >= 0) {
+                ICInterval *it = &ra->intervals[d];
+                ic_ra_extend(ra, d, p);
+                it->weight += weight;
+                it->def_count++;
+                if (ic_defines_vector(ic)) it->is_vector = true;
+                if (ic->base.ic_code == IC_ASSIGN && ic->arg1.type == IC_ARG_CONST) {
+                    it->remat = true;
+                    it->remat_value = ic->arg1.i64_val;
+                } else {
+                    it->remat = false;
+                }
+            }
+
+            CICArg *uses[2];
+            I64 use_count = ic_get_uses(ic, uses);
+            for (I64 u = 0; u < use_count; u++) {
+                I64 index = ic_liveness_index(lv, uses[u]);
+                if (index >= 0) {
+                    ic_ra_extend(ra, index, p);
+                    ra->intervals[index].weight += weight;
+                }
+            }
+
+            ic_liveness_transfer(lv, ic, live);
+        }
+
+        for (I64 v = 0; v < lv->value_count; v++) {
+            if ((live[v >> 6] >> (v & 63)) & 1) ic_ra_extend(ra, v, block_start[b]);
+        }
+    }
+
+    /* First call strictly inside each interval; the call itself never reads a value */
+    for (I64 v = 0; v < lv->value_count; v++) {
+        ICInterval *it = &ra->intervals[v];
+        if (it->def_count != 1) it->remat = false;
+        for (I64 c = 0; c < ra->clobber_count; c++) {
+            if (ra->clobbers[c] > it->start && ra->clobbers[c] < it->end) {
+                it->first_call = ra->clobbers[c];
+                break;
+            }
+        }
+    }
+
+    free(block_start);
+    free(block_end);
+    free(live);
+    return true;
+}
+
+/* Spill slot for the memory part of it, reusing slots whose owner has ended */
+static void ic_ra_assign_slot(ICRegAlloc *ra, ICInterval *it) {
+    if (it->remat || it->slot >= 0) return;
+
+    if (it->is_vector) {
+        /* Consecutive fresh slots, never shared */
+        while (ra->slot_count + IC_RA_VECTOR_SLOTS > ra->slot_capacity) {
+            I64 new_capacity = ra->slot_capacity ? ra->slot_capacity * 2 : 8;
+            I64 *busy = realloc(ra->slot_busy_until, sizeof(I64) * new_capacity);
+            if (!busy) return;
+            ra->slot_busy_until = busy;
+            ra->slot_capacity = new_capacity;
+        }
+        it->slot = ra->slot_count;
+        for (I64 s = 0; s < IC_RA_VECTOR_SLOTS; s++) {
+            ra->slot_busy_until[ra->slot_count++] = ra->count;
+        }
+        return;
+    }
+
+    I64 from = it->split_pos >= 0 ? it->split_pos : it->start;
+    for (I64 s = 0; s < ra->slot_count; s++) {
+        if (ra->slot_busy_until[s] < from) {
+            ra->slot_busy_until[s] = it->end;
+            it->slot = s;
+            return;
+        }
+    }
+
+    if (ra->slot_count >= ra->slot_capacity) {
+        I64 new_capacity = ra->slot_capacity ? ra->slot_capacity * 2 : 8;
+        I64 *busy = realloc(ra->slot_busy_until, sizeof(I64) * new_capacity);
+        if (!busy) return;
+        ra->slot_busy_until = busy;
+        ra->slot_capacity = new_capacity;
+    }
+    ra->slot_busy_until[ra->slot_count] = it->end;
+    it->slot = ra->slot_count++;
+}
+
+/* Cost of keeping it out of a register: weighted references per position covered */
+static double ic_ra_spill_cost(ICInterval *it, I64 from) {
+    if (it->remat) return 0.0;
+    I64 length = it->end - from + 1;
+    return (double)it->weight / (double)(length > 0 ? length : 1);
+}
+
+static int ic_ra_compare_start(const void *a, const void *b) {
+    const ICInterval *ia = *(ICInterval* const*)a;
+    const ICInterval *ib = *(ICInterval* const*)b;
+    if (ia->start != ib->start) return ia->start < ib->start ? -1 : 1;
+    return ia->value < ib->value ? -1 : (ia->value > ib->value);
+}
+
+static void ic_ra_give_register(ICRegAlloc *ra, ICInterval *it, X86Register reg) {
+    it->reg = reg;
+    if (!ic_ra_is_volatile(reg)) {
+        ra->callee_saved_used |= (U32)1 << reg;
+    } else if (it->first_call >= 0) {
+        /* A call clobbers reg: keep it up to the call, live in memory after */
+        it->split_pos = it->first_call;
+        ic_ra_assign_slot(ra, it);
+    }
+}
+
+/* One register class at a time: general purpose, then vector */
+static Bool ic_ra_scan(ICRegAlloc *ra, Bool vector) {
+    I64 value_count = ra->lv->value_count;
+    ICInterval **sorted = malloc(sizeof(ICInterval*) * (value_count + 1));
+    ICInterval **active = malloc(sizeof(ICInterval*) * (value_count + 1));
+    if (!sorted || !active) {
+        free(sorted);
+        free(active);
+        return false;
+    }
+
+    I64 sorted_count = 0;
+    for (I64 v = 0; v < value_count; v++) {
+        ICInterval *it = &ra->intervals[v];
+        if (it->end >= it->start && ic_ra_allocatable(ra, v) && it->is_vector == vector) sorted[sorted_count++] = it;
+    }
+    qsort(sorted, sorted_count, sizeof(ICInterval*), ic_ra_compare_start);
+
+    I64 active_count = 0;
+    for (I64 i = 0; i < sorted_count; i++) {
+        ICInterval *cur = sorted[i];
+
+        /* Expire intervals (or their register parts) that ended before cur */
+        I64 kept = 0;
+        for (I64 a = 0; a < active_count; a++) {
+            ICInterval *it = active[a];
+            I64 reg_end = it->split_pos >= 0 ? it->split_pos : it->end;
+            if (reg_end >= cur->start) active[kept++] = it;
+        }
+        active_count = kept;
+
+        Bool taken[X86_REG_XMM15 + 1];
+        memset(taken, 0, sizeof(taken));
+        for (I64 a = 0; a < active_count; a++) taken[active[a]->reg] = true;
+
+        /* Values live across a call prefer callee-saved registers, others caller-saved */
+        const X86Register *first = cur->first_call >= 0 ? ic_ra_nonvolatile_regs : ic_ra_volatile_regs;
+        const X86Register *second = cur->first_call >= 0 ? ic_ra_volatile_regs : ic_ra_nonvolatile_regs;
+        I64 first_count = cur->first_call >= 0 ? IC_RA_NONVOLATILE_COUNT : IC_RA_VOLATILE_COUNT;
+        I64 second_count = cur->first_call >= 0 ? IC_RA_VOLATILE_COUNT : IC_RA_NONVOLATILE_COUNT;
+        if (vector) {
+            first = ic_ra_vector_regs;
+            first_count = IC_RA_VECTOR_COUNT;
+            second_count = 0;
+        }
+
+        X86Register reg = X86_REG_NONE;
+        for (I64 r = 0; r < first_count && reg == X86_REG_NONE; r++) {
+            if (!taken[first[r]]) reg = first[r];
+        }
+        for (I64 r = 0; r < second_count && reg == X86_REG_NONE; r++) {
+            if (!taken[second[r]]) reg = second[r];
+        }
+
+        if (reg == X86_REG_NONE) {
+            /* No register free: the cheapest of cur and the active intervals goes to memory */
+            I64 victim = -1;
+            double victim_cost = ic_ra_spill_cost(cur, cur->start);
+            for (I64 a = 0; a < active_count; a++) {
+                double cost = ic_ra_spill_cost(active[a], cur->start);
+                if (cost < victim_cost) {
+                    victim_cost = cost;
+                    victim = a;
+                }
+            }
+
+            if (victim < 0) {
+                ic_ra_assign_slot(ra, cur);
+                continue;
+            }
+
+            /* Split the victim: its register part ends where cur begins */
+            ICInterval *it = active[victim];
+            reg = it->reg;
+            if (it->start == cur->start) {
+                it->reg = X86_REG_NONE;
+                it->split_pos = -1;
+            } else {
+                it->split_pos = cur->start;
+            }
+            it->slot = -1;
+            ic_ra_assign_slot(ra, it);
+            active[victim] = active[--active_count];
+        }
+
+        ic_ra_give_register(ra, cur, reg);
+        active[active_count++] = cur;
+    }
+
+    free(sorted);
+    free(active);
+    return true;
+}
+
+/* Location of a value operand at pos: its register, or X86_REG_NONE when in memory */
+static X86Register ic_ra_location(ICRegAlloc *ra, CICArg *arg, I64 pos, Bool *spilled) {
+    I64 value = ic_liveness_index(ra->lv, arg);
+    if (value < 0) return X86_REG_NONE;
+    ICInterval *it = &ra->intervals[value];
+    if (it->reg != X86_REG_NONE && (it->split_pos < 0 || pos < it->split_pos)) return it->reg;
+    if (ic_ra_allocatable(ra, value) && it->end >= it->start) *spilled = true;
+    return X86_REG_NONE;
+}
+
+static void ic_ra_record(ICRegAlloc *ra, CIntermediateCode *enter) {
+    ICGenContext *ctx = ra->ctx;
+
+    for (I64 p = 0; p < ra->count; p++) {
+        CIntermediateCode *ic = ra->order[p];
+        Bool spilled = false;
+        memset(ic->reg_alloc, 0, sizeof(ic->reg_alloc));
+        ic->reg_alloc[0] = ic_ra_location(ra, &ic->res, p, &spilled);
+        ic->reg_alloc[1] = ic_ra_location(ra, &ic->arg1, p, &spilled);
+        ic->reg_alloc[2] = ic_ra_location(ra, &ic->arg2, p, &spilled);
+        ic->reg_count = 3;
+        ic->regs_allocated = true;
+        ic->regs_spilled = spilled;
+    }
+
+    for (I64 v = 0; v < ra->lv->value_count; v++) {
+        ICInterval *it = &ra->intervals[v];
+        if (it->end < it->start || !ic_ra_allocatable(ra, v)) continue;
+        ICValueLoc *loc = &ctx->value_locs[v];
+        loc->reg = it->reg;
+        loc->split_at = it->split_pos >= 0 ? ra->order[it->split_pos] : NULL;
+        loc->spill_offset = it->slot >= 0 ? it->slot * 8 : -1;
+        loc->remat = it->remat && (it->reg == X86_REG_NONE || it->split_pos >= 0);
+        loc->remat_value = it->remat_value;
+    }
+
+    /* The function's IC_ENTER lists the callee-saved registers to preserve and the spill area */
+    memset(enter->reg_alloc, 0, sizeof(enter->reg_alloc));
+    enter->reg_count = 0;
+    for (I64 r = 0; r < IC_RA_NONVOLATILE_COUNT; r++) {
+        X86Register reg = ic_ra_nonvolatile_regs[r];
+        if (ra->callee_saved_used & ((U32)1 << reg)) enter->reg_alloc[enter->reg_count++] = reg;
+    }
+    enter->regs_allocated = true;
+    enter->stack_offset = ra->slot_count * 8;
+}
+
+/*
+ * Allocate registers for every function. Results are recorded per IC in
+ * reg_alloc[0..2] (res, arg1, arg2; X86_REG_NONE = memory) and per value
+ * in ctx->value_locs.
+ */
+Bool opt_register_allocation(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    I64 value_count = ctx->temp_count + ctx->var_count;
+    free(ctx->value_locs);
+    ctx->value_locs = calloc(value_count + 1, sizeof(ICValueLoc));
+    if (!ctx->value_locs) return false;
+    for (I64 v = 0; v < value_count; v++) {
+        ctx->value_locs[v].spill_offset = -1;
+    }
+    ctx->value_loc_count = value_count;
+
+    I64 functions = 0, in_regs = 0, split = 0, slots = 0;
+
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        ICCfg *cfg = ic_cfg_build(ctx, enter);
+        if (!cfg) continue;
+
+        ICRegAlloc ra;
+        memset(&ra, 0, sizeof(ra));
+        ra.ctx = ctx;
+        ra.lv = ic_liveness_compute(ctx, cfg);
+
+        I64 ic_total = 0;
+        for (CIntermediateCode *ic = enter; ic; ic = ic->base.next) {
+            ic_total++;
+            if (ic == cfg->leave) break;
+        }
+        ra.order = malloc(sizeof(CIntermediateCode*) * (ic_total + 1));
+        ra.clobbers = malloc(sizeof(I64) * (ic_total + 1));
+        ra.intervals = ra.lv ? calloc(ra.lv->value_count + 1, sizeof(ICInterval)) : NULL;
+
+        if (ra.lv && ra.order && ra.clobbers && ra.intervals &&
+            ic_ra_build_intervals(&ra, cfg) && ic_ra_scan(&ra, false) && ic_ra_scan(&ra, true)) {
+            ic_ra_record(&ra, enter);
+            functions++;
+            slots += ra.slot_count;
+            for (I64 v = 0; v < ra.lv->value_count; v++) {
+                if (ra.intervals[v].reg != X86_REG_NONE) in_regs++;
+                if (ra.intervals[v].reg != X86_REG_NONE && ra.intervals[v].split_pos >= 0) split++;
+            }
+        }
+
+        free(ra.order);
+        free(ra.clobbers);
+        free(ra.intervals);
+        free(ra.slot_busy_until);
+        ic_liveness_free(ra.lv);
+        ic_cfg_free(cfg);
+    }
+
+    printf("DEBUG: opt_register_allocation - %lld functions, %lld values in registers, %lld split, %lld spill slots\n",
+           functions, in_regs, split, slots);
+    return true;
+}
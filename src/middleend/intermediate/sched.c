@@ -0,0 +1,451 @@
+/*
+ * Instruction Scheduling
+ * List scheduling of each basic block against a latency and throughput
+ * model of current x86-64 cores, before register allocation
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Machine Model
+ * Latencies and reciprocal throughputs are typical of Skylake and Zen 2
+ * class cores. Each operation runs on one kind of unit; a unit accepts a
+ * new operation every recip_throughput cycles, so back-to-back divisions
+ * queue on the divider while additions can issue around them.
+ */
+
+typedef enum {
+    IC_SCHED_ALU,
+    IC_SCHED_MUL,
+    IC_SCHED_DIV,
+    IC_SCHED_LOAD,
+    IC_SCHED_STORE,
+    IC_SCHED_VEC,
+    IC_SCHED_UNIT_COUNT
+} ICSchedUnit;
+
+static const I64 ic_sched_unit_count[IC_SCHED_UNIT_COUNT] = {
+    4,      /* ALU: ports 0, 1, 5, 6 */
+    1,      /* MUL: port 1 */
+    1,      /* DIV: one divider, not pipelined */
+    2,      /* LOAD: ports 2, 3 */
+    1,      /* STORE: port 4 */
+    3       /* VEC: ports 0, 1, 5 */
+};
+
+typedef struct {
+    U16 code;
+    I64 latency;                     /* Cycles until the result can be used */
+    I64 recip_throughput;            /* Cycles the unit stays busy */
+    ICSchedUnit unit;
+} ICSchedCost;
+
+static const ICSchedCost ic_sched_costs[] = {
+    {IC_MUL,        3,  1, IC_SCHED_MUL},
+    {IC_MUL_ASSIGN, 3,  1, IC_SCHED_MUL},
+    {IC_DIV,        40, 24, IC_SCHED_DIV},
+    {IC_MOD,        40, 24, IC_SCHED_DIV},
+    {IC_DIV_ASSIGN, 40, 24, IC_SCHED_DIV},
+    {IC_LOAD,       5,  1, IC_SCHED_LOAD},
+    {IC_STORE,      1,  1, IC_SCHED_STORE},
+    {IC_CALL,       5,  1, IC_SCHED_ALU},
+    {IC_MALLOC,     5,  1, IC_SCHED_ALU},
+    {IC_FREE,       5,  1, IC_SCHED_ALU},
+    {IC_PUSH,       1,  1, IC_SCHED_STORE},
+    {IC_VEC_LOAD,   6,  1, IC_SCHED_LOAD},
+    {IC_VEC_STORE,  1,  1, IC_SCHED_STORE},
+    {IC_VEC_SPLAT,  3,  1, IC_SCHED_VEC},
+    {IC_VEC_ADD,    1,  1, IC_SCHED_VEC},
+    {IC_VEC_SUB,    1,  1, IC_SCHED_VEC},
+    {IC_VEC_AND,    1,  1, IC_SCHED_VEC},
+    {IC_VEC_OR,     1,  1, IC_SCHED_VEC},
+    {IC_VEC_XOR,    1,  1, IC_SCHED_VEC},
+    {IC_VEC_REDUCE, 6,  2, IC_SCHED_VEC}
+};
+
+#define IC_SCHED_COST_COUNT     (I64)(sizeof(ic_sched_costs) / sizeof(ic_sched_costs[0]))
+#define IC_SCHED_ISSUE_WIDTH    4    /* Operations issued per cycle */
+#define IC_SCHED_PRESSURE_LIMIT 8    /* Block-local values in flight before pressure wins over latency */
+#define IC_SCHED_MAX_BLOCK      256  /* Larger blocks are left in source order */
+
+static ICSchedCost ic_sched_cost(CIntermediateCode *ic) {
+    ICSchedCost cost = {ic->base.ic_code, 1, 1, IC_SCHED_ALU};
+    for (I64 i = 0; i < IC_SCHED_COST_COUNT; i++) {
+        if (ic_sched_costs[i].code == ic->base.ic_code) {
+            cost = ic_sched_costs[i];
+            break;
+        }
+    }
+    /* pmullw for 16-bit lanes, pmulld (two uops) otherwise */
+    if (ic->base.ic_code == IC_VEC_MUL) {
+        cost.latency = ic->memory_operand_size == 2 ? 5 : 10;
+        cost.recip_throughput = ic->memory_operand_size == 2 ? 1 : 2;
+        cost.unit = IC_SCHED_VEC;
+    }
+    return cost;
+}
+
+/*
+ * Dependence Graph
+ */
+
+typedef struct {
+    I64 to;
+    I64 latency;
+} ICSchedEdge;
+
+typedef struct {
+    CIntermediateCode *ic;
+    ICSchedCost cost;
+    ICSchedEdge *succs;
+    I64 succ_count;
+    I64 succ_capacity;
+    I64 pred_left;                   /* Predecessors not yet scheduled */
+    I64 height;                      /* Latency of the longest path to the block end */
+    I64 earliest;                    /* First cycle all operands are ready */
+    I64 def;                         /* Liveness index of a block-local temp defined here, -1 if none */
+    I64 local_uses;                  /* Uses of def in the block */
+    Bool reads_memory, writes_memory;
+    Bool ordered;                    /* Side effects: keeps its place among other side effects */
+    Bool barrier;                    /* Everything before stays before, everything after stays after */
+    Bool scheduled;
+} ICSchedNode;
+
+typedef struct {
+    ICGenContext *ctx;
+    ICLiveness *lv;
+    ICBasicBlock *bb;
+    ICSchedNode *nodes;
+    I64 count;
+    I64 *uses_left;                  /* Unscheduled uses per liveness index */
+    Bool *local_live;                /* Block-local temps whose definition has issued */
+    I64 in_flight;                   /* Block-local temps defined and still to be used */
+} ICSched;
+
+static Bool ic_sched_add_edge(ICSchedNode *from, I64 to, I64 latency) {
+    for (I64 i = 0; i < from->succ_count; i++) {
+        if (from->succs[i].to == to) {
+            if (from->succs[i].latency < latency) from->succs[i].latency = latency;
+            return true;
+        }
+    }
+    if (from->succ_count == from->succ_capacity) {
+        I64 capacity = from->succ_capacity ? from->succ_capacity * 2 : 4;
+        ICSchedEdge *succs = realloc(from->succs, capacity * sizeof(ICSchedEdge));
+        if (!succs) return false;
+        from->succs = succs;
+        from->succ_capacity = capacity;
+    }
+    from->succs[from->succ_count].to = to;
+    from->succs[from->succ_count].latency = latency;
+    from->succ_count++;
+    return true;
+}
+
+/* Variables that live in memory, where loads, stores and calls can reach them */
+static Bool ic_sched_var_in_memory(ICGenContext *ctx, CICArg *arg) {
+    if (arg->type != IC_ARG_VAR) return false;
+    ICVar *var = &ctx->vars[arg->i64_val];
+    return var->is_global || var->address_taken || var->is_array || var->is_volatile;
+}
+
+static void ic_sched_classify(ICSched *s, ICSchedNode *node) {
+    CIntermediateCode *ic = node->ic;
+    CICArg *uses[2];
+    I64 use_count = ic_get_uses(ic, uses);
+    CICArg *def = ic_get_def(ic);
+
+    switch (ic->base.ic_code) {
+        case IC_LABEL: case IC_ENTER: case IC_LEAVE: case IC_PARAM: case IC_PHI:
+        case IC_ASM_INLINE:
+            node->barrier = true;
+            return;
+        default:
+            break;
+    }
+    if (ic_is_terminator(ic)) {
+        node->barrier = true;
+        return;
+    }
+
+    node->reads_memory = ic->base.ic_code == IC_LOAD || ic->base.ic_code == IC_VEC_LOAD;
+    node->writes_memory = ic->base.ic_code == IC_STORE || ic->base.ic_code == IC_VEC_STORE;
+    for (I64 u = 0; u < use_count; u++) {
+        if (ic_sched_var_in_memory(s->ctx, uses[u])) node->reads_memory = true;
+    }
+    if (def && ic_sched_var_in_memory(s->ctx, def)) node->writes_memory = true;
+    node->ordered = ic_has_side_effects(ic) && ic->base.ic_code != IC_LOAD && ic->base.ic_code != IC_STORE &&
+                    ic->base.ic_code != IC_VEC_LOAD && ic->base.ic_code != IC_VEC_STORE;
+}
+
+static Bool ic_sched_args_overlap(CICArg **a, I64 a_count, CICArg *b) {
+    if (!b) return false;
+    for (I64 i = 0; i < a_count; i++) {
+        if (ic_arg_equal(a[i], b)) return true;
+    }
+    return false;
+}
+
+/* Edge from earlier node i to later node j when j has to stay after i */
+static Bool ic_sched_depend(ICSched *s, I64 i, I64 j) {
+    ICSchedNode *a = &s->nodes[i], *b = &s->nodes[j];
+    CICArg *a_uses[2], *b_uses[2];
+    I64 a_count = ic_get_uses(a->ic, a_uses);
+    I64 b_count = ic_get_uses(b->ic, b_uses);
+    CICArg *a_def = ic_get_def(a->ic), *b_def = ic_get_def(b->ic);
+
+    if (a->barrier || b->barrier) return ic_sched_add_edge(a, j, 0);
+
+    /* Operand flow: true dependences wait for the result */
+    if (ic_sched_args_overlap(b_uses, b_count, a_def)) return ic_sched_add_edge(a, j, a->cost.latency);
+    if (ic_sched_args_overlap(a_uses, a_count, b_def) || (a_def && b_def && ic_arg_equal(a_def, b_def))) {
+        return ic_sched_add_edge(a, j, 0);
+    }
+
+    /* Memory is one location; a store feeds later loads through the store buffer */
+    if (a->writes_memory && b->reads_memory) return ic_sched_add_edge(a, j, a->cost.latency);
+    if ((a->writes_memory && b->writes_memory) || (a->reads_memory && b->writes_memory)) {
+        return ic_sched_add_edge(a, j, 0);
+    }
+
+    /* Calls, output and faulting divisions stay in order with each other and with memory */
+    if ((a->ordered && (b->ordered || b->reads_memory || b->writes_memory)) ||
+        (b->ordered && (a->reads_memory || a->writes_memory))) {
+        return ic_sched_add_edge(a, j, 0);
+    }
+    return true;
+}
+
+static Bool ic_sched_build(ICSched *s) {
+    for (I64 i = 0; i < s->count; i++) {
+        ICSchedNode *node = &s->nodes[i];
+        node->cost = ic_sched_cost(node->ic);
+        node->def = -1;
+        ic_sched_classify(s, node);
+    }
+    for (I64 i = 0; i < s->count; i++) {
+        for (I64 j = i + 1; j < s->count; j++) {
+            if (!ic_sched_depend(s, i, j)) return false;
+        }
+    }
+    for (I64 i = 0; i < s->count; i++) {
+        for (I64 e = 0; e < s->nodes[i].succ_count; e++) {
+            s->nodes[s->nodes[i].succs[e].to].pred_left++;
+        }
+    }
+
+    /* Heights, latest node first */
+    for (I64 i = s->count - 1; i >= 0; i--) {
+        ICSchedNode *node = &s->nodes[i];
+        node->height = node->cost.latency;
+        for (I64 e = 0; e < node->succ_count; e++) {
+            I64 h = node->succs[e].latency + s->nodes[node->succs[e].to].height;
+            if (h > node->height) node->height = h;
+        }
+    }
+
+    /* Temps defined and consumed here, not live out: their order decides pressure */
+    for (I64 i = 0; i < s->count; i++) {
+        ICSchedNode *node = &s->nodes[i];
+        CICArg *def = ic_get_def(node->ic);
+        if (!def || def->type != IC_ARG_TEMP) continue;
+        I64 index = ic_liveness_index(s->lv, def);
+        U64 *out = &s->lv->live_out[s->bb->id * s->lv->words];
+        if (index < 0 || (out[index >> 6] >> (index & 63) & 1)) continue;
+        node->def = index;
+    }
+    for (I64 i = 0; i < s->count; i++) {
+        CICArg *uses[2];
+        I64 use_count = ic_get_uses(s->nodes[i].ic, uses);
+        for (I64 u = 0; u < use_count; u++) {
+            I64 index = ic_liveness_index(s->lv, uses[u]);
+            if (index >= 0) s->uses_left[index]++;
+        }
+    }
+    for (I64 i = 0; i < s->count; i++) {
+        if (s->nodes[i].def >= 0) s->nodes[i].local_uses = s->uses_left[s->nodes[i].def];
+    }
+    return true;
+}
+
+/* Change in block-local values in flight if node issued now */
+static I64 ic_sched_pressure_delta(ICSched *s, ICSchedNode *node) {
+    CICArg *uses[2];
+    I64 use_count = ic_get_uses(node->ic, uses);
+    I64 delta = node->def >= 0 && node->local_uses > 0 ? 1 : 0;
+    for (I64 u = 0; u < use_count; u++) {
+        I64 index = ic_liveness_index(s->lv, uses[u]);
+        if (index < 0 || s->uses_left[index] != 1 || !s->local_live[index]) continue;
+        if (u == 1 && ic_arg_equal(uses[0], uses[1])) continue;
+        delta--;
+    }
+    return delta;
+}
+
+/* Better candidate: lower pressure when over the limit, then the longer critical path */
+static Bool ic_sched_better(ICSched *s, I64 a, I64 b) {
+    if (b < 0) return true;
+    ICSchedNode *na = &s->nodes[a], *nb = &s->nodes[b];
+    if (s->in_flight >= IC_SCHED_PRESSURE_LIMIT) {
+        I64 da = ic_sched_pressure_delta(s, na), db = ic_sched_pressure_delta(s, nb);
+        if (da != db) return da < db;
+    }
+    if (na->height != nb->height) return na->height > nb->height;
+    if (na->succ_count != nb->succ_count) return na->succ_count > nb->succ_count;
+    return a < b;
+}
+
+static void ic_sched_issue(ICSched *s, I64 n, I64 cycle) {
+    ICSchedNode *node = &s->nodes[n];
+    CICArg *uses[2];
+    I64 use_count = ic_get_uses(node->ic, uses);
+
+    s->in_flight += ic_sched_pressure_delta(s, node);
+    for (I64 u = 0; u < use_count; u++) {
+        I64 index = ic_liveness_index(s->lv, uses[u]);
+        if (index < 0 || s->uses_left[index] == 0) continue;
+        if (--s->uses_left[index] == 0) s->local_live[index] = false;
+    }
+    if (node->def >= 0 && node->local_uses > 0) s->local_live[node->def] = true;
+    node->scheduled = true;
+    for (I64 e = 0; e < node->succ_count; e++) {
+        ICSchedNode *succ = &s->nodes[node->succs[e].to];
+        succ->pred_left--;
+        if (succ->earliest < cycle + node->succs[e].latency) succ->earliest = cycle + node->succs[e].latency;
+    }
+}
+
+/* Cycle by cycle list scheduling; order receives node indices */
+static void ic_sched_list(ICSched *s, I64 *order) {
+    I64 busy_until[IC_SCHED_UNIT_COUNT][4];
+    memset(busy_until, 0, sizeof(busy_until));
+    I64 done = 0;
+
+    for (I64 cycle = 0; done < s->count; cycle++) {
+        for (I64 issued = 0; issued < IC_SCHED_ISSUE_WIDTH && done < s->count; issued++) {
+            I64 best = -1;
+            for (I64 i = 0; i < s->count; i++) {
+                ICSchedNode *node = &s->nodes[i];
+                if (node->scheduled || node->pred_left > 0 || node->earliest > cycle) continue;
+                Bool unit_free = false;
+                for (I64 u = 0; u < ic_sched_unit_count[node->cost.unit]; u++) {
+                    if (busy_until[node->cost.unit][u] <= cycle) unit_free = true;
+                }
+                if (unit_free && ic_sched_better(s, i, best)) best = i;
+            }
+            if (best < 0) break;
+
+            ICSchedNode *node = &s->nodes[best];
+            for (I64 u = 0; u < ic_sched_unit_count[node->cost.unit]; u++) {
+                if (busy_until[node->cost.unit][u] <= cycle) {
+                    busy_until[node->cost.unit][u] = cycle + node->cost.recip_throughput;
+                    break;
+                }
+            }
+            ic_sched_issue(s, best, cycle);
+            order[done++] = best;
+        }
+    }
+}
+
+/* Relink the block in schedule order; returns true if the order changed */
+static Bool ic_sched_apply(ICSched *s, I64 *order) {
+    Bool changed = false;
+    for (I64 i = 0; i < s->count; i++) {
+        if (order[i] != i) changed = true;
+    }
+    if (!changed) return false;
+
+    CIntermediateCode *before = s->bb->first->base.last;
+    CIntermediateCode *after = s->bb->last->base.next;
+    for (I64 i = 0; i < s->count; i++) {
+        CIntermediateCode *ic = s->nodes[order[i]].ic;
+        ic->base.last = i == 0 ? before : s->nodes[order[i - 1]].ic;
+        ic->base.next = i == s->count - 1 ? after : s->nodes[order[i + 1]].ic;
+    }
+    CIntermediateCode *first = s->nodes[order[0]].ic, *last = s->nodes[order[s->count - 1]].ic;
+    if (before) before->base.next = first;
+    else s->ctx->ic_head = first;
+    if (after) after->base.last = last;
+    else s->ctx->ic_tail = last;
+    s->bb->first = first;
+    s->bb->last = last;
+    return true;
+}
+
+static Bool ic_sched_block(ICGenContext *ctx, ICLiveness *lv, ICBasicBlock *bb) {
+    I64 count = 0;
+    for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+        count++;
+        if (ic == bb->last) break;
+    }
+    if (count < 3 || count > IC_SCHED_MAX_BLOCK) return false;
+
+    ICSched s;
+    memset(&s, 0, sizeof(s));
+    s.ctx = ctx;
+    s.lv = lv;
+    s.bb = bb;
+    s.count = count;
+    s.nodes = calloc(count, sizeof(ICSchedNode));
+    s.uses_left = calloc(lv->value_count + 1, sizeof(I64));
+    s.local_live = calloc(lv->value_count + 1, sizeof(Bool));
+    I64 *order = calloc(count, sizeof(I64));
+    Bool changed = false;
+
+    if (s.nodes && s.uses_left && s.local_live && order) {
+        I64 i = 0;
+        for (CIntermediateCode *ic = bb->first; i < count; ic = ic->base.next) {
+            s.nodes[i++].ic = ic;
+        }
+        if (ic_sched_build(&s)) {
+            ic_sched_list(&s, order);
+            changed = ic_sched_apply(&s, order);
+        }
+    }
+
+    if (s.nodes) {
+        for (I64 i = 0; i < count; i++) free(s.nodes[i].succs);
+    }
+    free(s.nodes);
+    free(s.uses_left);
+    free(s.local_live);
+    free(order);
+    return changed;
+}
+
+/*
+ * Reorder each basic block so long-latency loads, multiplies and divisions
+ * start as early as their operands allow and independent dependency chains
+ * interleave. Runs before register allocation; once more block-local values
+ * are in flight than IC_SCHED_PRESSURE_LIMIT, instructions that end live
+ * ranges are preferred over the critical path.
+ */
+Bool opt_instruction_scheduling(ICGenContext *ctx) {
+    if (!ctx) return false;
+    if (!ctx->instruction_scheduling) {
+        printf("DEBUG: opt_instruction_scheduling - disabled\n");
+        return true;
+    }
+
+    I64 blocks = 0;
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        ICCfg *cfg = ic_cfg_build(ctx, enter);
+        if (!cfg) continue;
+        ICLiveness *lv = ic_liveness_compute(ctx, cfg);
+        if (lv) {
+            for (I64 b = 0; b < cfg->block_count; b++) {
+                if (ic_sched_block(ctx, lv, cfg->blocks[b])) blocks++;
+            }
+            ic_liveness_free(lv);
+        }
+        ic_cfg_free(cfg);
+    }
+
+    printf("DEBUG: opt_instruction_scheduling - %lld blocks reordered\n", blocks);
+    return true;
+}
@@ -0,0 +1,946 @@
+/*
+ * SSA Form and Sparse Conditional Constant Propagation
+ * Promotes scalar locals to SSA temporaries (phi placement on iterated
+ * dominance frontiers, dominator-tree renaming), runs Wegman-Zadeck SCCP
+ * over the result and lowers the phis back to copies for code generation
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Phi Helpers
+ */
+
+static CICArg* ic_phi_args(CIntermediateCode *phi) {
+    return (CICArg*)phi->arg1.ptr_val;
+}
+
+/* Unlink ic from bb, keeping the block boundaries valid */
+static void ic_ssa_remove_from_block(ICGenContext *ctx, ICBasicBlock *bb, CIntermediateCode *ic) {
+    if (bb) {
+        if (bb->first == ic && bb->last == ic) {
+            /* Never empty a block; leave a NOP behind instead */
+            ic->base.ic_code = IC_NOP;
+            return;
+        }
+        if (bb->first == ic) bb->first = ic->base.next;
+        if (bb->last == ic) bb->last = ic->base.last;
+    }
+    ic_remove(ctx, ic);
+}
+
+/* Vars that can live in SSA temporaries: scalars nobody can reach through memory */
+Bool ic_ssa_is_promotable(ICGenContext *ctx, I64 var) {
+    if (!ctx || var < 0 || var >= ctx->var_count) return false;
+    ICVar *v = &ctx->vars[var];
+    return !v->is_global && !v->is_array && !v->address_taken && !v->is_volatile;
+}
+
+/*
+ * SSA Construction
+ */
+
+typedef struct {
+    ICBasicBlock **items;
+    I64 count;
+    I64 capacity;
+} ICBlockList;
+
+static void ic_block_list_add(ICBlockList *list, ICBasicBlock *bb) {
+    for (I64 i = 0; i < list->count; i++) {
+        if (list->items[i] == bb) return;
+    }
+    if (list->count >= list->capacity) {
+        I64 new_capacity = list->capacity ? list->capacity * 2 : 4;
+        ICBasicBlock **items = realloc(list->items, sizeof(ICBasicBlock*) * new_capacity);
+        if (!items) return;
+        list->items = items;
+        list->capacity = new_capacity;
+    }
+    list->items[list->count++] = bb;
+}
+
+typedef struct {
+    ICGenContext *ctx;
+    ICCfg *cfg;
+    I64 *stack;                      /* Per-var stacks of current SSA temps, var_count * depth */
+    I64 *stack_top;                  /* Current depth per var */
+    I64 depth;                       /* Allocated depth per var */
+} ICSsaRename;
+
+static CICArg ic_ssa_current(ICSsaRename *rn, I64 var) {
+    if (rn->stack_top[var] == 0) {
+        /* Read before any definition: HolyC leaves it unspecified, use zero */
+        return ic_arg_const(0);
+    }
+    CICArg arg;
+    arg.i64_val = rn->stack[var * rn->depth + rn->stack_top[var] - 1];
+    arg.type = IC_ARG_TEMP;
+    return arg;
+}
+
+static Bool ic_ssa_push(ICSsaRename *rn, I64 var, CICArg *def) {
+    if (rn->stack_top[var] >= rn->depth) {
+        /* Grow every stack; depth is bounded by the number of definitions */
+        I64 new_depth = rn->depth * 2;
+        I64 *stack = malloc(sizeof(I64) * rn->ctx->var_count * new_depth);
+        if (!stack) return false;
+        for (I64 v = 0; v < rn->ctx->var_count; v++) {
+            memcpy(&stack[v * new_depth], &rn->stack[v * rn->depth], sizeof(I64) * rn->stack_top[v]);
+        }
+        free(rn->stack);
+        rn->stack = stack;
+        rn->depth = new_depth;
+    }
+    *def = ic_arg_temp(rn->ctx);
+    rn->stack[var * rn->depth + rn->stack_top[var]++] = def->i64_val;
+    return true;
+}
+
+static Bool ic_ssa_rename_block(ICSsaRename *rn, ICBasicBlock *bb) {
+    ICGenContext *ctx = rn->ctx;
+    I64 *pushed = calloc(ctx->var_count, sizeof(I64));
+    if (!pushed) return false;
+
+    for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+        if (ic->base.ic_code == IC_PHI) {
+            I64 var = ic->arg2.i64_val;
+            if (!ic_ssa_push(rn, var, &ic->res)) goto fail;
+            pushed[var]++;
+        } else {
+            CICArg *uses[2];
+            I64 use_count = ic_get_uses(ic, uses);
+            for (I64 i = 0; i < use_count; i++) {
+                if (uses[i]->type == IC_ARG_VAR && ic_ssa_is_promotable(ctx, uses[i]->i64_val)) {
+                    *uses[i] = ic_ssa_current(rn, uses[i]->i64_val);
+                }
+            }
+            CICArg *def = ic_get_def(ic);
+            if (def && def->type == IC_ARG_VAR && ic_ssa_is_promotable(ctx, def->i64_val)) {
+                I64 var = def->i64_val;
+                if (!ic_ssa_push(rn, var, def)) goto fail;
+                pushed[var]++;
+            }
+        }
+        if (ic == bb->last) break;
+    }
+
+    /* Fill this block's operand slot in the phis of each successor */
+    for (I64 s = 0; s < bb->succ_count; s++) {
+        ICBasicBlock *succ = bb->succ[s];
+        for (CIntermediateCode *phi = succ->first; phi; phi = phi->base.next) {
+            if (phi->base.ic_code == IC_PHI) {
+                CICArg *args = ic_phi_args(phi);
+                for (I64 p = 0; p < succ->pred_count; p++) {
+                    if (succ->preds[p] == bb) args[p] = ic_ssa_current(rn, phi->arg2.i64_val);
+                }
+            }
+            if (phi == succ->last) break;
+        }
+    }
+
+    for (ICBasicBlock *child = bb->dom_child; child; child = child->dom_sibling) {
+        if (!ic_ssa_rename_block(rn, child)) goto fail;
+    }
+
+    for (I64 v = 0; v < ctx->var_count; v++) {
+        rn->stack_top[v] -= pushed[v];
+    }
+    free(pushed);
+    return true;
+
+fail:
+    free(pushed);
+    return false;
+}
+
+/* Insert an empty phi for var at the top of bb (after its labels) */
+static CIntermediateCode* ic_ssa_insert_phi(ICGenContext *ctx, ICBasicBlock *bb, I64 var) {
+    CIntermediateCode *phi = ic_new(IC_PHI);
+    if (!phi) return NULL;
+
+    CICArg *args = malloc(sizeof(CICArg) * (bb->pred_count > 0 ? bb->pred_count : 1));
+    if (!args) {
+        ic_free(phi);
+        return NULL;
+    }
+    for (I64 p = 0; p < bb->pred_count; p++) {
+        args[p] = ic_arg_const(0);
+    }
+    phi->arg1.ptr_val = args;
+    phi->arg1.type = IC_ARG_OWNED;
+    phi->arg2 = ic_arg_var(var);
+    phi->res = ic_arg_var(var);
+    phi->ic_data = bb->pred_count;
+    phi->ic_line = bb->first->ic_line;
+    phi->ic_block = bb;
+
+    CIntermediateCode *anchor = NULL;
+    for (CIntermediateCode *ic = bb->first; ic && ic->base.ic_code == IC_LABEL; ic = ic->base.next) {
+        anchor = ic;
+        if (ic == bb->last) break;
+    }
+    if (anchor) {
+        ic_insert_after(ctx, anchor, phi);
+        if (anchor == bb->last) bb->last = phi;
+    } else {
+        ic_insert_before(ctx, bb->first, phi);
+        bb->first = phi;
+    }
+    return phi;
+}
+
+/* Remove phis whose value never reaches a real instruction */
+static I64 ic_ssa_prune_phis(ICGenContext *ctx, ICCfg *cfg) {
+    I64 temp_count = ctx->temp_count;
+    CIntermediateCode **def_phi = calloc(temp_count + 1, sizeof(CIntermediateCode*));
+    Bool *live = calloc(temp_count + 1, sizeof(Bool));
+    I64 *work = malloc(sizeof(I64) * (temp_count + 1));
+    I64 removed = 0, sp = 0;
+
+    if (!def_phi || !live || !work) {
+        free(def_phi);
+        free(live);
+        free(work);
+        return 0;
+    }
+
+    for (I64 i = 0; i < cfg->rpo_count; i++) {
+        ICBasicBlock *bb = cfg->rpo[i];
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            if (ic->base.ic_code == IC_PHI && ic->res.type == IC_ARG_TEMP) def_phi[ic->res.i64_val] = ic;
+            if (ic == bb->last) break;
+        }
+    }
+
+    /* Values read by real instructions are live, and so is everything feeding them */
+    for (I64 i = 0; i < cfg->rpo_count; i++) {
+        ICBasicBlock *bb = cfg->rpo[i];
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            CICArg *uses[2];
+            I64 use_count = ic_get_uses(ic, uses);
+            for (I64 u = 0; u < use_count; u++) {
+                I64 t = uses[u]->i64_val;
+                if (uses[u]->type == IC_ARG_TEMP && def_phi[t] && !live[t]) {
+                    live[t] = true;
+                    work[sp++] = t;
+                }
+            }
+            if (ic == bb->last) break;
+        }
+    }
+    while (sp > 0) {
+        CIntermediateCode *phi = def_phi[work[--sp]];
+        CICArg *args = ic_phi_args(phi);
+        for (I64 p = 0; p < phi->ic_data; p++) {
+            I64 t = args[p].i64_val;
+            if (args[p].type == IC_ARG_TEMP && def_phi[t] && !live[t]) {
+                live[t] = true;
+                work[sp++] = t;
+            }
+        }
+    }
+
+    for (I64 t = 0; t < temp_count; t++) {
+        if (def_phi[t] && !live[t]) {
+            ic_ssa_remove_from_block(ctx, ic_cfg_block_of(def_phi[t]), def_phi[t]);
+            removed++;
+        }
+    }
+
+    free(def_phi);
+    free(live);
+    free(work);
+    return removed;
+}
+
+/* Rewrite the function of cfg into SSA form over its promotable variables */
+Bool ic_ssa_construct(ICGenContext *ctx, ICCfg *cfg) {
+    if (!ctx || !cfg || ctx->var_count == 0) return true;
+
+    I64 var_count = ctx->var_count;
+    ICBlockList *df = calloc(cfg->block_count, sizeof(ICBlockList));
+    ICBlockList *def_blocks = calloc(var_count, sizeof(ICBlockList));
+    if (!df || !def_blocks) {
+        free(df);
+        free(def_blocks);
+        return false;
+    }
+
+    /* Dominance frontiers */
+    for (I64 i = 0; i < cfg->rpo_count; i++) {
+        ICBasicBlock *bb = cfg->rpo[i];
+        if (bb->pred_count < 2) continue;
+        for (I64 p = 0; p < bb->pred_count; p++) {
+            ICBasicBlock *runner = bb->preds[p];
+            if (runner->rpo_number < 0) continue;
+            while (runner && runner != bb->idom) {
+                ic_block_list_add(&df[runner->id], bb);
+                runner = runner->idom;
+            }
+        }
+    }
+
+    /* Blocks defining each promotable variable */
+    for (I64 i = 0; i < cfg->rpo_count; i++) {
+        ICBasicBlock *bb = cfg->rpo[i];
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            CICArg *def = ic_get_def(ic);
+            if (def && def->type == IC_ARG_VAR && ic_ssa_is_promotable(ctx, def->i64_val)) {
+                ic_block_list_add(&def_blocks[def->i64_val], bb);
+            }
+            if (ic == bb->last) break;
+        }
+    }
+
+    /* Phis on the iterated dominance frontier of the definitions */
+    I64 phi_count = 0;
+    I64 *has_phi = malloc(sizeof(I64) * cfg->block_count);
+    ICBasicBlock *exit_block = cfg->blocks[cfg->block_count - 1];
+    for (I64 v = 0; v < var_count && has_phi; v++) {
+        if (def_blocks[v].count == 0) continue;
+        for (I64 i = 0; i < cfg->block_count; i++) has_phi[i] = 0;
+
+        ICBlockList work = {0};
+        for (I64 i = 0; i < def_blocks[v].count; i++) {
+            ic_block_list_add(&work, def_blocks[v].items[i]);
+        }
+        for (I64 w = 0; w < work.count; w++) {
+            ICBasicBlock *bb = work.items[w];
+            for (I64 f = 0; f < df[bb->id].count; f++) {
+                ICBasicBlock *frontier = df[bb->id].items[f];
+                /* Nothing reads variables at the function exit */
+                if (has_phi[frontier->id] || frontier == exit_block) continue;
+                if (ic_ssa_insert_phi(ctx, frontier, v)) phi_count++;
+                has_phi[frontier->id] = 1;
+                ic_block_list_add(&work, frontier);
+            }
+        }
+        free(work.items);
+    }
+
+    /* Rename along the dominator tree */
+    ICSsaRename rn;
+    rn.ctx = ctx;
+    rn.cfg = cfg;
+    rn.depth = 8;
+    rn.stack = malloc(sizeof(I64) * var_count * rn.depth);
+    rn.stack_top = calloc(var_count, sizeof(I64));
+    Bool ok = has_phi && rn.stack && rn.stack_top && ic_ssa_rename_block(&rn, cfg->rpo[0]);
+
+    I64 pruned = ok ? ic_ssa_prune_phis(ctx, cfg) : 0;
+    printf("DEBUG: ic_ssa_construct - placed %lld phis, %lld pruned\n", phi_count, pruned);
+
+    free(rn.stack);
+    free(rn.stack_top);
+    free(has_phi);
+    for (I64 i = 0; i < cfg->block_count; i++) free(df[i].items);
+    for (I64 v = 0; v < var_count; v++) free(def_blocks[v].items);
+    free(df);
+    free(def_blocks);
+    return ok;
+}
+
+/*
+ * SSA Destruction
+ * Phis become parallel copies on the incoming edges; critical edges are
+ * split first so a copy never runs on a path that does not enter the phi
+ */
+
+typedef struct {
+    CICArg dst;
+    CICArg src;
+} ICCopy;
+
+/* Emit a parallel copy as a sequence of IC_ASSIGNs in front of pos */
+static void ic_ssa_emit_parallel_copy(ICGenContext *ctx, ICCopy *copies, I64 count, CIntermediateCode *pos) {
+    I64 remaining = count;
+    Bool *done = calloc(count > 0 ? count : 1, sizeof(Bool));
+    if (!done) return;
+
+    for (I64 i = 0; i < count; i++) {
+        if (ic_arg_equal(&copies[i].dst, &copies[i].src)) {
+            done[i] = true;
+            remaining--;
+        }
+    }
+
+    while (remaining > 0) {
+        Bool progress = false;
+        for (I64 i = 0; i < count; i++) {
+            if (done[i]) continue;
+
+            /* Safe once no pending copy still reads the destination */
+            Bool blocked = false;
+            for (I64 j = 0; j < count; j++) {
+                if (!done[j] && j != i && ic_arg_equal(&copies[j].src, &copies[i].dst)) {
+                    blocked = true;
+                    break;
+                }
+            }
+            if (blocked) continue;
+
+            CIntermediateCode *mov = ic_new(IC_ASSIGN);
+            if (mov) {
+                mov->arg1 = copies[i].src;
+                mov->res = copies[i].dst;
+                mov->ic_line = pos->ic_line;
+                ic_insert_before(ctx, pos, mov);
+            }
+            done[i] = true;
+            remaining--;
+            progress = true;
+        }
+
+        if (!progress) {
+            /* Only cycles are left: park one destination in a fresh temp */
+            for (I64 i = 0; i < count; i++) {
+                if (done[i]) continue;
+                CICArg saved = ic_arg_temp(ctx);
+                CIntermediateCode *mov = ic_new(IC_ASSIGN);
+                if (mov) {
+                    mov->arg1 = copies[i].dst;
+                    mov->res = saved;
+                    mov->ic_line = pos->ic_line;
+                    ic_insert_before(ctx, pos, mov);
+                }
+                for (I64 j = 0; j < count; j++) {
+                    if (!done[j] && ic_arg_equal(&copies[j].src, &copies[i].dst)) copies[j].src = saved;
+                }
+                break;
+            }
+        }
+    }
+    free(done);
+}
+
+/* Place for split-edge blocks: just before IC_LEAVE, never reached by fall-through */
+static CIntermediateCode* ic_ssa_split_area(ICGenContext *ctx, ICCfg *cfg, CIntermediateCode **exit_label) {
+    if (!*exit_label) {
+        CIntermediateCode *tail = cfg->leave->base.last;
+        if (tail && !ic_is_terminator(tail)) {
+            /* Code falling into IC_LEAVE must skip the split blocks */
+            *exit_label = ic_gen_new_label(ctx);
+            if (!*exit_label) return NULL;
+            ic_insert_before(ctx, cfg->leave, *exit_label);
+            CICArg target = ic_arg_label(*exit_label);
+            CIntermediateCode *jump = ic_new(IC_JUMP);
+            if (!jump) return NULL;
+            jump->arg1 = target;
+            ic_insert_before(ctx, *exit_label, jump);
+        } else {
+            *exit_label = cfg->leave;
+        }
+    }
+    return *exit_label;
+}
+
+/* Lower every phi of cfg into copies and remove it */
+Bool ic_ssa_destruct(ICGenContext *ctx, ICCfg *cfg) {
+    if (!ctx || !cfg) return false;
+
+    CIntermediateCode *exit_label = NULL;
+    I64 copies_total = 0, split = 0;
+
+    for (I64 i = 0; i < cfg->block_count; i++) {
+        ICBasicBlock *bb = cfg->blocks[i];
+        if (!bb->first || bb->first->ic_block != bb) continue;
+
+        I64 phi_count = 0;
+        for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+            if (ic->base.ic_code == IC_PHI) phi_count++;
+            if (ic == bb->last) break;
+        }
+        if (phi_count == 0) continue;
+
+        ICCopy *copies = malloc(sizeof(ICCopy) * phi_count);
+        if (!copies) return false;
+
+        for (I64 p = 0; p < bb->pred_count; p++) {
+            ICBasicBlock *pred = bb->preds[p];
+            if (pred->rpo_number < 0) continue;
+
+            /* A predecessor listed twice reaches us on both of its edges */
+            Bool seen = false;
+            for (I64 q = 0; q < p; q++) {
+                if (bb->preds[q] == pred) seen = true;
+            }
+            if (seen) continue;
+
+            I64 count = 0;
+            for (CIntermediateCode *phi = bb->first; phi; phi = phi->base.next) {
+                if (phi->base.ic_code == IC_PHI) {
+                    copies[count].dst = phi->res;
+                    copies[count].src = ic_phi_args(phi)[p];
+                    count++;
+                }
+                if (phi == bb->last) break;
+            }
+            /* Drop self copies (the value already lives in the phi's temp) */
+            I64 kept = 0;
+            for (I64 c = 0; c < count; c++) {
+                if (!ic_arg_equal(&copies[c].dst, &copies[c].src)) copies[kept++] = copies[c];
+            }
+            count = kept;
+            if (count == 0) continue;
+            copies_total += count;
+
+            CIntermediateCode *last = pred->last;
+            U16 code = last->base.ic_code;
+            Bool conditional = code == IC_JUMP_TRUE || code == IC_JUMP_FALSE;
+
+            if (!conditional || pred->succ_count < 2 || pred->succ[0] == pred->succ[1]) {
+                /* Sole edge out of pred: copies go before its jump or at its end */
+                CIntermediateCode *pos = ic_is_branch(last) ? last : last->base.next;
+                ic_ssa_emit_parallel_copy(ctx, copies, count, pos);
+            } else if (pred->succ[0] == bb) {
+                /* Critical fall-through edge: copies run only when the branch is not taken */
+                ic_ssa_emit_parallel_copy(ctx, copies, count, last->base.next);
+            } else {
+                /* Critical taken edge: branch to a new block holding the copies */
+                CIntermediateCode *area = ic_ssa_split_area(ctx, cfg, &exit_label);
+                CIntermediateCode *label = ic_gen_new_label(ctx);
+                CIntermediateCode *jump = ic_new(IC_JUMP);
+                if (!area || !label || !jump) {
+                    free(copies);
+                    return false;
+                }
+                ic_insert_before(ctx, area, label);
+                jump->arg1 = ic_arg_label(ic_cfg_block_label(ctx, bb));
+                ic_insert_before(ctx, area, jump);
+                ic_ssa_emit_parallel_copy(ctx, copies, count, jump);
+                ic_set_branch_target(last, label);
+                split++;
+            }
+        }
+        free(copies);
+
+        /* The copies now carry the values; drop the phis */
+        CIntermediateCode *ic = bb->first;
+        while (ic) {
+            CIntermediateCode *next = ic == bb->last ? NULL : ic->base.next;
+            if (ic->base.ic_code == IC_PHI) ic_ssa_remove_from_block(ctx, bb, ic);
+            ic = next;
+        }
+    }
+
+    printf("DEBUG: ic_ssa_destruct - %lld copies, %lld critical edges split\n", copies_total, split);
+    return true;
+}
+
+/*
+ * Sparse Conditional Constant Propagation (Wegman-Zadeck)
+ * Lattice per SSA temp: TOP (no value seen yet), CONST, BOTTOM (varies)
+ */
+
+#define SCCP_TOP    0
+#define SCCP_CONST  1
+#define SCCP_BOTTOM 2
+
+typedef struct {
+    ICGenContext *ctx;
+    ICCfg *cfg;
+    I64 *kind;                       /* Lattice kind per temp */
+    I64 *value;                      /* Constant per temp when kind is SCCP_CONST */
+    I64 *use_start;                  /* Uses of temp t are uses[use_start[t]..use_start[t+1]) */
+    CIntermediateCode **uses;        /* Instructions reading each temp */
+    Bool *block_exec;                /* Executable blocks */
+    Bool *edge_exec;                 /* Executable edges, [block * 2 + successor slot] */
+    ICBasicBlock **block_work;       /* Blocks waiting for their first visit */
+    I64 block_work_count;
+    I64 *temp_work;                  /* Temps whose lattice value dropped */
+    I64 temp_work_count;
+    I64 temp_work_capacity;
+} ICSccp;
+
+static void ic_sccp_operand(ICSccp *sc, CICArg *arg, I64 *kind, I64 *value) {
+    if (arg->type == IC_ARG_CONST) {
+        *kind = SCCP_CONST;
+        *value = arg->i64_val;
+    } else if (arg->type == IC_ARG_TEMP && arg->i64_val < sc->ctx->temp_count) {
+        *kind = sc->kind[arg->i64_val];
+        *value = sc->value[arg->i64_val];
+    } else {
+        *kind = SCCP_BOTTOM;
+        *value = 0;
+    }
+}
+
+static void ic_sccp_set(ICSccp *sc, I64 temp, I64 kind, I64 value) {
+    if (sc->kind[temp] == SCCP_BOTTOM || kind == SCCP_TOP) return;
+    if (sc->kind[temp] == SCCP_CONST && (kind == SCCP_CONST && sc->value[temp] == value)) return;
+    if (sc->kind[temp] == SCCP_CONST && kind == SCCP_CONST) kind = SCCP_BOTTOM;
+
+    sc->kind[temp] = kind;
+    sc->value[temp] = value;
+
+    if (sc->temp_work_count >= sc->temp_work_capacity) {
+        I64 new_capacity = sc->temp_work_capacity ? sc->temp_work_capacity * 2 : 64;
+        I64 *work = realloc(sc->temp_work, sizeof(I64) * new_capacity);
+        if (!work) return;
+        sc->temp_work = work;
+        sc->temp_work_capacity = new_capacity;
+    }
+    sc->temp_work[sc->temp_work_count++] = temp;
+}
+
+/* Is the edge pred -> bb executable (either of pred's successor slots) */
+static Bool ic_sccp_edge_exec(ICSccp *sc, ICBasicBlock *pred, ICBasicBlock *bb) {
+    for (I64 s = 0; s < pred->succ_count; s++) {
+        if (pred->succ[s] == bb && sc->edge_exec[pred->id * 2 + s]) return true;
+    }
+    return false;
+}
+
+static void ic_sccp_visit_phi(ICSccp *sc, ICBasicBlock *bb, CIntermediateCode *phi) {
+    if (phi->res.type != IC_ARG_TEMP) return;
+
+    I64 kind = SCCP_TOP, value = 0;
+    CICArg *args = ic_phi_args(phi);
+    for (I64 p = 0; p < phi->ic_data && kind != SCCP_BOTTOM; p++) {
+        if (!ic_sccp_edge_exec(sc, bb->preds[p], bb)) continue;
+
+        I64 arg_kind, arg_value;
+        ic_sccp_operand(sc, &args[p], &arg_kind, &arg_value);
+        if (arg_kind == SCCP_TOP) continue;
+        if (arg_kind == SCCP_BOTTOM || (kind == SCCP_CONST && value != arg_value)) {
+            kind = SCCP_BOTTOM;
+        } else {
+            kind = SCCP_CONST;
+            value = arg_value;
+        }
+    }
+    ic_sccp_set(sc, phi->res.i64_val, kind, value);
+}
+
+static void ic_sccp_mark_edge(ICSccp *sc, ICBasicBlock *bb, I64 slot) {
+    if (slot >= bb->succ_count || sc->edge_exec[bb->id * 2 + slot]) return;
+    sc->edge_exec[bb->id * 2 + slot] = true;
+
+    ICBasicBlock *succ = bb->succ[slot];
+    if (!sc->block_exec[succ->id]) {
+        sc->block_exec[succ->id] = true;
+        sc->block_work[sc->block_work_count++] = succ;
+    } else {
+        /* A new way into a visited block can only change its phis */
+        for (CIntermediateCode *ic = succ->first; ic; ic = ic->base.next) {
+            if (ic->base.ic_code == IC_PHI) ic_sccp_visit_phi(sc, succ, ic);
+            if (ic == succ->last) break;
+        }
+    }
+}
+
+static void ic_sccp_visit(ICSccp *sc, ICBasicBlock *bb, CIntermediateCode *ic) {
+    U16 code = ic->base.ic_code;
+
+    if (code == IC_PHI) {
+        ic_sccp_visit_phi(sc, bb, ic);
+        return;
+    }
+    if (code == IC_JUMP) {
+        ic_sccp_mark_edge(sc, bb, 0);
+        return;
+    }
+    if (code == IC_JUMP_TRUE || code == IC_JUMP_FALSE) {
+        I64 kind, value;
+        ic_sccp_operand(sc, &ic->arg1, &kind, &value);
+        if (kind == SCCP_CONST && bb->succ_count == 2) {
+            Bool taken = (value != 0) == (code == IC_JUMP_TRUE);
+            ic_sccp_mark_edge(sc, bb, taken ? 1 : 0);
+        } else {
+            ic_sccp_mark_edge(sc, bb, 0);
+            ic_sccp_mark_edge(sc, bb, 1);
+        }
+        return;
+    }
+
+    CICArg *def = ic_get_def(ic);
+    if (!def || def->type != IC_ARG_TEMP) return;
+
+    I64 kind1, value1, kind2 = SCCP_CONST, value2 = 0;
+    ic_sccp_operand(sc, &ic->arg1, &kind1, &value1);
+    if (ic_fold_is_binary(code)) {
+        ic_sccp_operand(sc, &ic->arg2, &kind2, &value2);
+    }
+
+    if (kind1 == SCCP_BOTTOM || kind2 == SCCP_BOTTOM) {
+        ic_sccp_set(sc, def->i64_val, SCCP_BOTTOM, 0);
+    } else if (kind1 == SCCP_CONST && kind2 == SCCP_CONST) {
+        I64 result;
+        if (ic_fold_constant(code, value1, value2, &result)) {
+            ic_sccp_set(sc, def->i64_val, SCCP_CONST, result);
+        } else {
+            ic_sccp_set(sc, def->i64_val, SCCP_BOTTOM, 0);
+        }
+    }
+}
+
+static void ic_sccp_visit_block(ICSccp *sc, ICBasicBlock *bb) {
+    for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+        ic_sccp_visit(sc, bb, ic);
+        if (ic == bb->last) break;
+    }
+    if (!ic_is_branch(bb->last)) {
+        ic_sccp_mark_edge(sc, bb, 0);
+    }
+}
+
+/* Index every temp's readers (phi operands included) */
+static Bool ic_sccp_build_uses(ICSccp *sc) {
+    I64 temp_count = sc->ctx->temp_count;
+    I64 total = 0;
+
+    sc->use_start = calloc(temp_count + 2, sizeof(I64));
+    if (!sc->use_start) return false;
+
+    for (int pass = 0; pass < 2; pass++) {
+        for (I64 i = 0; i < sc->cfg->rpo_count; i++) {
+            ICBasicBlock *bb = sc->cfg->rpo[i];
+            for (CIntermediateCode *ic = bb->first; ic; ic = ic->base.next) {
+                CICArg *uses[2];
+                CICArg *args = NULL;
+                I64 count;
+                if (ic->base.ic_code == IC_PHI) {
+                    args = ic_phi_args(ic);
+                    count = ic->ic_data;
+                } else {
+                    count = ic_get_uses(ic, uses);
+                }
+                for (I64 u = 0; u < count; u++) {
+                    CICArg *arg = args ? &args[u] : uses[u];
+                    if (arg->type != IC_ARG_TEMP || arg->i64_val >= temp_count) continue;
+                    if (pass == 0) {
+                        sc->use_start[arg->i64_val + 1]++;
+                        total++;
+                    } else {
+                        sc->uses[sc->use_start[arg->i64_val + 1]++] = ic;
+                    }
+                }
+                if (ic == bb->last) break;
+            }
+        }
+        if (pass == 0) {
+            sc->uses = malloc(sizeof(CIntermediateCode*) * (total + 1));
+            if (!sc->uses) return false;
+            /* Prefix sums; the fill pass bumps use_start[t + 1] up to the end of t's range */
+            for (I64 t = 1; t <= temp_count; t++) {
+                sc->use_start[t] += sc->use_start[t - 1];
+            }
+            for (I64 t = temp_count; t >= 1; t--) {
+                sc->use_start[t] = sc->use_start[t - 1];
+            }
+            sc->use_start[0] = 0;
+        }
+    }
+    return true;
+}
+
+/* Replace reads of constant temps by the constant */
+static I64 ic_sccp_substitute(ICSccp *sc, CICArg *arg) {
+    if (arg->type != IC_ARG_TEMP || arg->i64_val >= sc->ctx->temp_count) return 0;
+    if (sc->kind[arg->i64_val] != SCCP_CONST) return 0;
+    *arg = ic_arg_const(sc->value[arg->i64_val]);
+    return 1;
+}
+
+static Bool ic_sccp_function(ICGenContext *ctx, ICCfg *cfg, I64 *propagated, I64 *folded, I64 *removed) {
+    ICSccp sc;
+    memset(&sc, 0, sizeof(ICSccp));
+    sc.ctx = ctx;
+    sc.cfg = cfg;
+
+    I64 temp_count = ctx->temp_count;
+    sc.kind = calloc(temp_count + 1, sizeof(I64));
+    sc.value = calloc(temp_count + 1, sizeof(I64));
+    sc.block_exec = calloc(cfg->block_count, sizeof(Bool));
+    sc.edge_exec = calloc(cfg->block_count * 2, sizeof(Bool));
+    sc.block_work = malloc(sizeof(ICBasicBlock*) * (cfg->block_count + 1));
+    I64 *def_count = calloc(temp_count + 1, sizeof(I64));
+
+    Bool ok = sc.kind && sc.value && sc.block_exec && sc.edge_exec && sc.block_work && def_count &&
+              ic_sccp_build_uses(&sc);
+
+    if (ok) {
+        /* Temps written more than once are outside SSA; never assume their value */
+        for (CIntermediateCode *ic = cfg->enter; ic; ic = ic->base.next) {
+            CICArg *def = ic_get_def(ic);
+            if (def && def->type == IC_ARG_TEMP && def->i64_val < temp_count) def_count[def->i64_val]++;
+            if (ic == cfg->leave) break;
+        }
+        for (I64 t = 0; t < temp_count; t++) {
+            if (def_count[t] > 1) sc.kind[t] = SCCP_BOTTOM;
+        }
+
+        ICBasicBlock *entry = cfg->rpo[0];
+        sc.block_exec[entry->id] = true;
+        sc.block_work[sc.block_work_count++] = entry;
+
+        while (sc.block_work_count > 0 || sc.temp_work_count > 0) {
+            while (sc.block_work_count > 0) {
+                ic_sccp_visit_block(&sc, sc.block_work[--sc.block_work_count]);
+            }
+            while (sc.temp_work_count > 0 && sc.block_work_count == 0) {
+                I64 temp = sc.temp_work[--sc.temp_work_count];
+                for (I64 u = sc.use_start[temp]; u < sc.use_start[temp + 1]; u++) {
+                    CIntermediateCode *use = sc.uses[u];
+                    ICBasicBlock *bb = ic_cfg_block_of(use);
+                    if (bb && sc.block_exec[bb->id]) ic_sccp_visit(&sc, bb, use);
+                }
+            }
+        }
+
+        /* Constants replace the temps that carried them */
+        for (I64 i = 0; i < cfg->rpo_count; i++) {
+            ICBasicBlock *bb = cfg->rpo[i];
+            if (!sc.block_exec[bb->id]) {
+                /* The block goes away below; its phis need no copies */
+                CIntermediateCode *ic = bb->first;
+                while (ic) {
+                    CIntermediateCode *next = ic == bb->last ? NULL : ic->base.next;
+                    if (ic->base.ic_code == IC_PHI) ic_ssa_remove_from_block(ctx, bb, ic);
+                    ic = next;
+                }
+                continue;
+            }
+            CIntermediateCode *ic = bb->first;
+            while (ic) {
+                CIntermediateCode *next = ic == bb->last ? NULL : ic->base.next;
+                CICArg *def = ic_get_def(ic);
+                Bool const_def = def && def->type == IC_ARG_TEMP && def->i64_val < temp_count &&
+                                 sc.kind[def->i64_val] == SCCP_CONST;
+
+                if (ic->base.ic_code == IC_PHI) {
+                    CICArg *args = ic_phi_args(ic);
+                    for (I64 p = 0; p < ic->ic_data; p++) {
+                        /* Values arriving on dead edges are never copied */
+                        if (!ic_sccp_edge_exec(&sc, bb->preds[p], bb)) {
+                            args[p] = ic->res;
+                        } else {
+                            *propagated += ic_sccp_substitute(&sc, &args[p]);
+                        }
+                    }
+                    if (const_def) {
+                        ic_ssa_remove_from_block(ctx, bb, ic);
+                        (*removed)++;
+                    }
+                } else {
+                    CICArg *uses[2];
+                    I64 use_count = ic_get_uses(ic, uses);
+                    for (I64 u = 0; u < use_count; u++) {
+                        *propagated += ic_sccp_substitute(&sc, uses[u]);
+                    }
+                    if (const_def && !ic_has_side_effects(ic)) {
+                        ic->base.ic_code = IC_NOP;
+                        ic->arg1 = ic_arg_const(0);
+                        ic->arg2 = ic_arg_const(0);
+                        ic->res = ic_arg_const(0);
+                        (*removed)++;
+                    } else if (!const_def && def && ic->arg1.type == IC_ARG_CONST &&
+                               (ic->arg2.type == IC_ARG_CONST || !ic_fold_is_binary(ic->base.ic_code)) &&
+                               ic->base.ic_code != IC_ASSIGN) {
+                        /* Results kept in memory variables still fold to a plain store */
+                        I64 result;
+                        if (ic_fold_constant(ic->base.ic_code, ic->arg1.i64_val, ic->arg2.i64_val, &result)) {
+                            ic->base.ic_code = IC_ASSIGN;
+                            ic->arg1 = ic_arg_const(result);
+                            ic->arg2 = ic_arg_const(0);
+                        }
+                    }
+                }
+                ic = next;
+            }
+        }
+    }
+
+    if (ok) ok = ic_ssa_destruct(ctx, cfg);
+
+    if (ok) {
+        /* Branches with a known outcome, then the arms that can never run */
+        for (I64 i = 0; i < cfg->block_count; i++) {
+            ICBasicBlock *bb = cfg->blocks[i];
+            if (!bb->first) continue;
+
+            if (sc.block_exec[bb->id]) {
+                CIntermediateCode *last = bb->last;
+                U16 code = last->base.ic_code;
+                if ((code == IC_JUMP_TRUE || code == IC_JUMP_FALSE) && last->arg1.type == IC_ARG_CONST) {
+                    Bool taken = (last->arg1.i64_val != 0) == (code == IC_JUMP_TRUE);
+                    if (taken) {
+                        last->base.ic_code = IC_JUMP;
+                        last->arg1 = last->arg2;
+                    } else {
+                        last->base.ic_code = IC_NOP;
+                        last->arg1 = ic_arg_const(0);
+                    }
+                    last->arg2 = ic_arg_const(0);
+                    (*folded)++;
+                }
+                continue;
+            }
+
+            CIntermediateCode *ic = bb->first;
+            CIntermediateCode *stop = bb->last->base.next;
+            while (ic && ic != stop) {
+                CIntermediateCode *next = ic->base.next;
+                if (ic->base.ic_code != IC_ENTER && ic->base.ic_code != IC_LEAVE) {
+                    ic_remove(ctx, ic);
+                    (*removed)++;
+                }
+                ic = next;
+            }
+            bb->first = bb->last = NULL;
+        }
+    }
+
+    free(sc.kind);
+    free(sc.value);
+    free(sc.use_start);
+    free(sc.uses);
+    free(sc.block_exec);
+    free(sc.edge_exec);
+    free(sc.block_work);
+    free(sc.temp_work);
+    free(def_count);
+    return ok;
+}
+
+/*
+ * Constant propagation: per function, build SSA, run SCCP, substitute the
+ * constants, fold decided branches, drop never-executed blocks and return
+ * to conventional form with phi copies on the incoming edges.
+ */
+Bool opt_constant_propagation(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    I64 propagated = 0, folded = 0, removed = 0;
+    Bool ok = true;
+
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        ICCfg *cfg = ic_cfg_build(ctx, enter);
+        if (!cfg) continue;
+
+        if (!ic_ssa_construct(ctx, cfg) || !ic_sccp_function(ctx, cfg, &propagated, &folded, &removed)) {
+            printf("ERROR: opt_constant_propagation - failed in function %s\n",
+                   enter->arg1.ptr_val ? (char*)enter->arg1.ptr_val : "?");
+            ok = false;
+        }
+        ic_cfg_free(cfg);
+
+        /* Sweep the NOPs left behind by folding */
+        CIntermediateCode *ic = enter->base.next;
+        while (ic && ic->base.ic_code != IC_LEAVE) {
+            CIntermediateCode *next = ic->base.next;
+            if (ic->base.ic_code == IC_NOP) ic_remove(ctx, ic);
+            ic = next;
+        }
+    }
+
+    ctx->opt_changes += propagated + folded + removed;
+    printf("DEBUG: opt_constant_propagation - %lld constants propagated, %lld branches folded, %lld instructions removed\n",
+           propagated, folded, removed);
+    return ok;
+}
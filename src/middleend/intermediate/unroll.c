@@ -0,0 +1,405 @@
+/*
+ * Loop Unrolling
+ * Full unrolling of short constant trip count loops and partial unrolling
+ * of counted loops, with the original loop left in place for the remainder
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define UNROLL_BUDGET          48    /* Cost of one unrolled main loop body */
+#define UNROLL_MAX_FACTOR      8
+#define UNROLL_FULL_BUDGET     96    /* Cost of a fully unrolled loop */
+#define UNROLL_FULL_MAX_TRIPS  16
+
+/*
+ * A counted loop in the shape the front end and the loop passes leave:
+ *
+ *   L:  cmp t = b n        header: test and exit branch only
+ *       jf t exit
+ *       ...                body: one block, b = b + step once
+ *       jmp L
+ */
+typedef struct {
+    ICGenContext *ctx;
+    ICCfg *cfg;
+    ICLiveness *lv;
+    ICLoop *loop;
+    ICBasicBlock *header;
+    ICBasicBlock *body;
+    CIntermediateCode *test;
+    CIntermediateCode *exit_branch;
+    CICArg counter;
+    CICArg bound;
+    U16 op;                          /* Test normalized to counter op bound */
+    I64 step;
+    I64 body_cost;
+} ICUnroll;
+
+static Bool ic_unroll_is_register_value(ICUnroll *u, CICArg *arg) {
+    if (ic_liveness_index(u->lv, arg) < 0) return false;
+    if (arg->type != IC_ARG_VAR) return true;
+    ICVar *var = &u->ctx->vars[arg->i64_val];
+    return !var->is_global && !var->is_volatile && ic_ssa_is_promotable(u->ctx, arg->i64_val);
+}
+
+/* Definitions of arg in the body; *last_def gets the last one */
+static I64 ic_unroll_body_defs(ICUnroll *u, CICArg *arg, CIntermediateCode *before, CIntermediateCode **last_def) {
+    I64 defs = 0;
+    for (CIntermediateCode *ic = u->body->first; ic && ic != before; ic = ic->base.next) {
+        CICArg *d = ic_get_def(ic);
+        if (d && ic_arg_equal(d, arg)) {
+            defs++;
+            if (last_def) *last_def = ic;
+        }
+        if (ic == u->body->last) break;
+    }
+    return defs;
+}
+
+/* Step of b when the body defines it once as b + c, possibly through copies */
+static Bool ic_unroll_counter_step(ICUnroll *u, CICArg *b, I64 *step) {
+    CIntermediateCode *cur = NULL;
+    if (!ic_unroll_is_register_value(u, b) || ic_unroll_body_defs(u, b, NULL, &cur) != 1) return false;
+
+    for (I64 hops = 0; cur->base.ic_code == IC_ASSIGN; hops++) {
+        CIntermediateCode *prev = NULL;
+        if (hops >= 8 || cur->arg1.type != IC_ARG_TEMP) return false;
+        if (ic_unroll_body_defs(u, &cur->arg1, NULL, NULL) != 1 ||
+            ic_unroll_body_defs(u, &cur->arg1, cur, &prev) != 1) {
+            return false;
+        }
+        cur = prev;
+    }
+
+    if (cur->base.ic_code == IC_ADD && ic_arg_equal(&cur->arg1, b) && cur->arg2.type == IC_ARG_CONST) {
+        *step = cur->arg2.i64_val;
+    } else if (cur->base.ic_code == IC_ADD && ic_arg_equal(&cur->arg2, b) && cur->arg1.type == IC_ARG_CONST) {
+        *step = cur->arg1.i64_val;
+    } else if (cur->base.ic_code == IC_SUB && ic_arg_equal(&cur->arg1, b) && cur->arg2.type == IC_ARG_CONST) {
+        *step = -cur->arg2.i64_val;
+    } else {
+        return false;
+    }
+    return *step != 0;
+}
+
+static Bool ic_unroll_match(ICUnroll *u) {
+    ICLoop *loop = u->loop;
+    if (loop->first_child || loop->block_count != 2) return false;
+
+    u->header = loop->header;
+    u->body = loop->blocks[0] == loop->header ? loop->blocks[1] : loop->blocks[0];
+
+    /* Header: label, compare, exit branch */
+    CIntermediateCode *label = u->header->first;
+    if (label->base.ic_code != IC_LABEL || (label->ic_flags & ICF_LOOP_UNROLLED)) return false;
+    u->test = label->base.next;
+    if (!u->test || u->test->base.ic_code < IC_EQU || u->test->base.ic_code > IC_GREATER_EQU) return false;
+    u->exit_branch = u->test->base.next;
+    if (!u->exit_branch || u->exit_branch != u->header->last || u->exit_branch->base.ic_code != IC_JUMP_FALSE ||
+        !ic_arg_equal(&u->exit_branch->arg1, &u->test->res) || u->test->res.type != IC_ARG_TEMP) {
+        return false;
+    }
+
+    /* Body: falls in from the header and jumps back */
+    if (u->body->first != u->exit_branch->base.next) return false;
+    if (u->body->last->base.ic_code != IC_JUMP || ic_branch_target(u->body->last) != label) return false;
+
+    u->body_cost = 0;
+    for (CIntermediateCode *ic = u->body->first; ic != u->body->last; ic = ic->base.next) {
+        switch (ic->base.ic_code) {
+            case IC_LABEL: case IC_ASM_INLINE: case IC_PARAM: case IC_ENTER: case IC_LEAVE:
+            case IC_RETURN: case IC_RETURN_VAL: case IC_PHI:
+                return false;
+            default:
+                break;
+        }
+        if (ic_is_branch(ic) || ic->arg1.type == IC_ARG_OWNED ||
+            ic->arg2.type == IC_ARG_OWNED || ic->res.type == IC_ARG_OWNED) {
+            return false;
+        }
+        /* The test result must not be read anywhere else */
+        CICArg *uses[2];
+        I64 use_count = ic_get_uses(ic, uses);
+        for (I64 n = 0; n < use_count; n++) {
+            if (ic_arg_equal(uses[n], &u->test->res)) return false;
+        }
+        u->body_cost += ic_calculate_cost(ic);
+    }
+
+    /* One side of the test counts, the other stays put */
+    U16 op = u->test->base.ic_code;
+    CICArg *counter = &u->test->arg1;
+    CICArg *bound = &u->test->arg2;
+    if (!ic_unroll_counter_step(u, counter, &u->step)) {
+        counter = &u->test->arg2;
+        bound = &u->test->arg1;
+        if (!ic_unroll_counter_step(u, counter, &u->step)) return false;
+        switch (op) {
+            case IC_LESS:        op = IC_GREATER; break;
+            case IC_GREATER:     op = IC_LESS; break;
+            case IC_LESS_EQU:    op = IC_GREATER_EQU; break;
+            case IC_GREATER_EQU: op = IC_LESS_EQU; break;
+            default: break;
+        }
+    }
+    if (bound->type != IC_ARG_CONST &&
+        (!ic_unroll_is_register_value(u, bound) || ic_unroll_body_defs(u, bound, NULL, NULL) != 0 ||
+         ic_arg_equal(bound, &u->test->res))) {
+        return false;
+    }
+    u->counter = *counter;
+    u->bound = *bound;
+    u->op = op;
+    return true;
+}
+
+static Bool ic_unroll_test(U16 op, I64 a, I64 b) {
+    switch (op) {
+        case IC_EQU:         return a == b;
+        case IC_NOT_EQU:     return a != b;
+        case IC_LESS:        return a < b;
+        case IC_GREATER:     return a > b;
+        case IC_LESS_EQU:    return a <= b;
+        case IC_GREATER_EQU: return a >= b;
+        default:             return false;
+    }
+}
+
+/* Exact trip count when the counter starts from a constant and the bound is one, else -1 */
+static I64 ic_unroll_const_trips(ICUnroll *u, I64 limit) {
+    if (u->bound.type != IC_ARG_CONST) return -1;
+
+    CIntermediateCode *start = NULL;
+    I64 defs = 0;
+    for (CIntermediateCode *ic = u->cfg->enter; ic; ic = ic->base.next) {
+        CICArg *d = ic_get_def(ic);
+        if (d && ic_arg_equal(d, &u->counter)) {
+            defs++;
+            if (!ic_loop_contains(u->loop, ic_cfg_block_of(ic))) start = ic;
+        }
+        if (ic == u->cfg->leave) break;
+    }
+    if (defs != 2 || !start || start->base.ic_code != IC_ASSIGN || start->arg1.type != IC_ARG_CONST ||
+        !ic_cfg_block_of(start) || !ic_cfg_dominates(ic_cfg_block_of(start), u->header)) {
+        return -1;
+    }
+
+    I64 value = start->arg1.i64_val;
+    I64 trips = 0;
+    while (ic_unroll_test(u->op, value, u->bound.i64_val)) {
+        if (++trips > limit) return -1;
+        value += u->step;
+    }
+    return trips;
+}
+
+/*
+ * Body Copies
+ * Temps that only live inside one iteration get fresh names in each
+ * copy; values carried between iterations keep theirs.
+ */
+static Bool ic_unroll_copy_body(ICUnroll *u, CIntermediateCode *pos, CICArg *renamed, Bool *is_renamed) {
+    ICGenContext *ctx = u->ctx;
+    U64 *body_out = &u->lv->live_out[u->body->id * u->lv->words];
+    memset(is_renamed, 0, sizeof(Bool) * (u->lv->temp_count + 1));
+
+    for (CIntermediateCode *ic = u->body->first; ic != u->body->last; ic = ic->base.next) {
+        CIntermediateCode *copy = ic_clone(ic);
+        if (!copy) return false;
+
+        CICArg *uses[2];
+        I64 use_count = ic_get_uses(copy, uses);
+        for (I64 n = 0; n < use_count; n++) {
+            if (uses[n]->type == IC_ARG_TEMP && uses[n]->i64_val < u->lv->temp_count && is_renamed[uses[n]->i64_val]) {
+                *uses[n] = renamed[uses[n]->i64_val];
+            }
+        }
+        CICArg *def = ic_get_def(copy);
+        I64 index = ic_liveness_index(u->lv, def);
+        if (def && def->type == IC_ARG_TEMP && index >= 0 && !((body_out[index >> 6] >> (index & 63)) & 1)) {
+            if (!is_renamed[index]) {
+                renamed[index] = ic_arg_temp(ctx);
+                is_renamed[index] = true;
+            }
+            *def = renamed[index];
+        }
+        ic_insert_before(ctx, pos, copy);
+    }
+    return true;
+}
+
+static CIntermediateCode* ic_unroll_new(U16 code, CICArg arg1, CICArg arg2, CICArg res, I64 line) {
+    CIntermediateCode *ic = ic_new(code);
+    if (!ic) return NULL;
+    ic->arg1 = arg1;
+    ic->arg2 = arg2;
+    ic->res = res;
+    ic->ic_line = line;
+    return ic;
+}
+
+/* Replace the loop by trips copies of its body */
+static Bool ic_unroll_full(ICUnroll *u, I64 trips, CIntermediateCode *pos, CICArg *renamed, Bool *is_renamed) {
+    ICGenContext *ctx = u->ctx;
+    CIntermediateCode *exit_label = ic_branch_target(u->exit_branch);
+    if (!exit_label) return false;
+
+    for (I64 t = 0; t < trips; t++) {
+        if (!ic_unroll_copy_body(u, pos, renamed, is_renamed)) return false;
+    }
+    CIntermediateCode *jump = ic_new(IC_JUMP);
+    if (!jump) return false;
+    jump->ic_line = u->test->ic_line;
+    ic_set_branch_target(jump, exit_label);
+    ic_insert_before(ctx, pos, jump);
+
+    /* Header and body are laid out together and only entered through pos; pass 5 drops the NOPs */
+    for (CIntermediateCode *ic = u->header->first; ic; ic = ic->base.next) {
+        ic->base.ic_code = IC_NOP;
+        if (ic == u->body->last) break;
+    }
+    return true;
+}
+
+/*
+ * Partial Unrolling
+ * The preheader computes how many whole groups of factor iterations stay
+ * within the bound; a main loop runs that many unrolled groups and then
+ * falls into the untouched original loop, which runs the remainder.
+ */
+static Bool ic_unroll_partial(ICUnroll *u, I64 factor, CIntermediateCode *pos, CICArg *renamed, Bool *is_renamed) {
+    ICGenContext *ctx = u->ctx;
+    I64 line = u->test->ic_line;
+    I64 stride = (u->step < 0 ? -u->step : u->step) * factor;
+    Bool up = u->op == IC_LESS || u->op == IC_LESS_EQU;
+    Bool inclusive = u->op == IC_LESS_EQU || u->op == IC_GREATER_EQU;
+
+    /* groups = (distance to the bound) / (step * factor) */
+    CICArg from = up ? u->bound : u->counter;
+    CICArg to = up ? u->counter : u->bound;
+    CICArg distance = from;
+    CICArg groups = ic_arg_temp(ctx);
+    if (inclusive || to.type != IC_ARG_CONST || to.i64_val != 0) {
+        distance = ic_arg_temp(ctx);
+        ic_insert_before(ctx, pos, ic_unroll_new(IC_SUB, from, to, distance, line));
+        if (inclusive) {
+            ic_insert_before(ctx, pos, ic_unroll_new(IC_ADD, distance, ic_arg_const(1), distance, line));
+        }
+    }
+    ic_insert_before(ctx, pos, ic_unroll_new(IC_DIV, distance, ic_arg_const(stride), groups, line));
+
+    CIntermediateCode *main_label = ic_gen_new_label(ctx);
+    if (!main_label) return false;
+    ic_insert_before(ctx, pos, main_label);
+
+    CICArg more = ic_arg_temp(ctx);
+    ic_insert_before(ctx, pos, ic_unroll_new(IC_GREATER, groups, ic_arg_const(0), more, line));
+    CIntermediateCode *leave = ic_unroll_new(IC_JUMP_FALSE, more, ic_arg_const(0), ic_arg_const(0), line);
+    if (!leave) return false;
+    ic_set_branch_target(leave, pos);
+    ic_insert_before(ctx, pos, leave);
+
+    for (I64 f = 0; f < factor; f++) {
+        if (!ic_unroll_copy_body(u, pos, renamed, is_renamed)) return false;
+    }
+    ic_insert_before(ctx, pos, ic_unroll_new(IC_SUB, groups, ic_arg_const(1), groups, line));
+    CIntermediateCode *back = ic_new(IC_JUMP);
+    if (!back) return false;
+    back->ic_line = line;
+    ic_set_branch_target(back, main_label);
+    ic_insert_before(ctx, pos, back);
+
+    /* The original loop now only runs the remainder */
+    u->header->first->ic_flags |= ICF_LOOP_UNROLLED;
+    main_label->ic_flags |= ICF_LOOP_UNROLLED;
+    return true;
+}
+
+static Bool ic_unroll_loop(ICUnroll *u) {
+    if (!ic_unroll_match(u)) return false;
+    I64 cost = u->body_cost > 0 ? u->body_cost : 1;
+
+    I64 full_limit = UNROLL_FULL_BUDGET / cost;
+    if (full_limit > UNROLL_FULL_MAX_TRIPS) full_limit = UNROLL_FULL_MAX_TRIPS;
+    I64 trips = ic_unroll_const_trips(u, full_limit);
+
+    I64 factor = 1;
+    while (factor * 2 <= UNROLL_MAX_FACTOR && factor * 2 * cost <= UNROLL_BUDGET) factor *= 2;
+    if (trips < 0) {
+        if (factor < 2 || u->op == IC_EQU || u->op == IC_NOT_EQU) return false;
+        if ((u->op == IC_LESS || u->op == IC_LESS_EQU) && u->step < 0) return false;
+        if ((u->op == IC_GREATER || u->op == IC_GREATER_EQU) && u->step > 0) return false;
+    }
+
+    CIntermediateCode *pos = ic_loop_preheader(u->ctx, u->loop);
+    if (!pos) return false;
+
+    I64 temp_count = u->lv->temp_count;
+    CICArg *renamed = malloc(sizeof(CICArg) * (temp_count + 1));
+    Bool *is_renamed = malloc(sizeof(Bool) * (temp_count + 1));
+    Bool done = false;
+    if (renamed && is_renamed) {
+        if (trips >= 0) {
+            done = ic_unroll_full(u, trips, pos, renamed, is_renamed);
+        } else {
+            done = ic_unroll_partial(u, factor, pos, renamed, is_renamed);
+        }
+    }
+    free(renamed);
+    free(is_renamed);
+    return done;
+}
+
+/*
+ * Unroll innermost counted loops whose body is a single block. Loops
+ * with a constant trip count that fits UNROLL_FULL_BUDGET disappear;
+ * others get a main loop of up to UNROLL_MAX_FACTOR body copies within
+ * UNROLL_BUDGET (ic_calculate_cost) ahead of the original loop.
+ */
+Bool opt_loop_unrolling(ICGenContext *ctx) {
+    if (!ctx) return false;
+
+    I64 unrolled = 0;
+
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        Bool changed = true;
+        I64 rounds = 0;
+        while (changed) {
+            changed = false;
+            rounds++;
+            if (rounds > 100) {
+                printf("ERROR: opt_loop_unrolling - infinite loop detected, breaking\n");
+                break;
+            }
+
+            ICCfg *cfg = ic_cfg_build(ctx, enter);
+            if (!cfg) break;
+            ICLiveness *lv = ic_liveness_compute(ctx, cfg);
+
+            for (I64 l = cfg->loop_count - 1; lv && l >= 0 && !changed; l--) {
+                ICUnroll u;
+                memset(&u, 0, sizeof(u));
+                u.ctx = ctx;
+                u.cfg = cfg;
+                u.lv = lv;
+                u.loop = cfg->loops[l];
+                if (ic_unroll_loop(&u)) {
+                    unrolled++;
+                    changed = true;
+                }
+            }
+
+            ic_liveness_free(lv);
+            ic_cfg_free(cfg);
+        }
+    }
+
+    ctx->opt_changes += unrolled;
+    printf("DEBUG: opt_loop_unrolling - %lld loops unrolled\n", unrolled);
+    return true;
+}
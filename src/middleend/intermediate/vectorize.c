@@ -0,0 +1,800 @@
+/*
+ * Loop Vectorization
+ * Counted loops over arrays become SSE2 (or AVX2) vector loops, entered
+ * after a scalar loop that aligns the main memory stream and followed by
+ * the original loop for the iterations that do not fill a vector
+ */
+
+#include "intermediate.h"
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define VEC_MAX_VALUES        6      /* Vector values per loop, all in volatile XMM registers */
+#define VEC_MAX_MEMORY        8      /* Loads and stores per loop */
+#define VEC_MAX_ALIAS_CHECKS  6      /* Runtime overlap tests per loop */
+#define VEC_MAX_INVARIANTS    4
+#define VEC_MAX_ACCUMULATORS  2
+#define VEC_MAX_CHAIN         16
+
+/* What a temp defined in the loop body holds */
+typedef enum {
+    VEC_KIND_NONE = 0,
+    VEC_KIND_SCALED,                 /* counter * scale */
+    VEC_KIND_ADDR,                   /* base + counter * scale */
+    VEC_KIND_VECTOR                  /* one array element per iteration */
+} ICVecKind;
+
+typedef struct {
+    ICVecKind kind;
+    I64 scale;
+    CICArg base;
+} ICVecValue;
+
+typedef struct {
+    CIntermediateCode *op;           /* acc = acc op x, the only use of acc in the body */
+    CICArg acc;
+    CICArg x;
+    CICArg vector;                   /* Partial results, one per lane */
+} ICVecAccumulator;
+
+typedef struct {
+    CIntermediateCode *ic;
+    CICArg base;
+    Bool is_store;
+} ICVecAccess;
+
+/*
+ * A counted loop in the shape unroll.c works on:
+ *
+ *   L:  cmp t = i n        header: test and exit branch only
+ *       jf t exit
+ *       ...                body: one block, i = i + 1 once
+ *       jmp L
+ */
+typedef struct {
+    ICGenContext *ctx;
+    ICCfg *cfg;
+    ICLiveness *lv;
+    ICLoop *loop;
+    ICBasicBlock *header;
+    ICBasicBlock *body;
+    CIntermediateCode *test;
+    CIntermediateCode *exit_branch;
+    CICArg counter;
+    CICArg bound;
+    Bool inclusive;                  /* i <= n rather than i < n */
+    Bool avx;
+    I64 width;                       /* Vector width in bytes */
+    I64 elem;                        /* Array element size in bytes */
+    I64 lanes;
+    ICVecValue *values;              /* Indexed by liveness index, temps only */
+    CIntermediateCode *chain[VEC_MAX_CHAIN];  /* Counter and accumulator updates */
+    I64 chain_count;
+    ICVecAccumulator accs[VEC_MAX_ACCUMULATORS];
+    I64 acc_count;
+    ICVecAccess mem[VEC_MAX_MEMORY];
+    I64 mem_count;
+    CICArg invariants[VEC_MAX_INVARIANTS];
+    CICArg splats[VEC_MAX_INVARIANTS];
+    I64 invariant_count;
+    I64 vector_count;                /* Vector values the loop body computes */
+    CICArg groups;                   /* Vector iterations left */
+} ICVec;
+
+static I64 ic_vec_log2(I64 value) {
+    I64 log = 0;
+    while (((I64)1 << log) < value) log++;
+    return log;
+}
+
+static Bool ic_vec_is_register_value(ICVec *v, CICArg *arg) {
+    if (ic_liveness_index(v->lv, arg) < 0) return false;
+    if (arg->type != IC_ARG_VAR) return true;
+    ICVar *var = &v->ctx->vars[arg->i64_val];
+    return !var->is_global && !var->is_volatile && ic_ssa_is_promotable(v->ctx, arg->i64_val);
+}
+
+/* Definitions of arg in the body; *last_def gets the last one */
+static I64 ic_vec_body_defs(ICVec *v, CICArg *arg, CIntermediateCode *before, CIntermediateCode **last_def) {
+    I64 defs = 0;
+    for (CIntermediateCode *ic = v->body->first; ic && ic != before; ic = ic->base.next) {
+        CICArg *d = ic_get_def(ic);
+        if (d && ic_arg_equal(d, arg)) {
+            defs++;
+            if (last_def) *last_def = ic;
+        }
+        if (ic == v->body->last) break;
+    }
+    return defs;
+}
+
+static Bool ic_vec_is_invariant(ICVec *v, CICArg *arg) {
+    if (arg->type == IC_ARG_CONST) return true;
+    if (!ic_vec_is_register_value(v, arg) || ic_arg_equal(arg, &v->test->res)) return false;
+    return ic_vec_body_defs(v, arg, NULL, NULL) == 0;
+}
+
+static Bool ic_vec_in_chain(ICVec *v, CIntermediateCode *ic) {
+    for (I64 c = 0; c < v->chain_count; c++) {
+        if (v->chain[c] == ic) return true;
+    }
+    return false;
+}
+
+/* The IC computing the new value of carried value b, after the copies that forward it */
+static CIntermediateCode* ic_vec_update(ICVec *v, CICArg *b) {
+    CIntermediateCode *cur = NULL;
+    if (!ic_vec_is_register_value(v, b) || ic_vec_body_defs(v, b, NULL, &cur) != 1) return NULL;
+
+    while (cur->base.ic_code == IC_ASSIGN) {
+        CIntermediateCode *prev = NULL;
+        if (v->chain_count >= VEC_MAX_CHAIN || cur->arg1.type != IC_ARG_TEMP) return NULL;
+        if (ic_vec_body_defs(v, &cur->arg1, NULL, NULL) != 1 ||
+            ic_vec_body_defs(v, &cur->arg1, cur, &prev) != 1) {
+            return NULL;
+        }
+        v->chain[v->chain_count++] = cur;
+        cur = prev;
+    }
+    return cur;
+}
+
+static ICVecValue* ic_vec_value(ICVec *v, CICArg *arg) {
+    I64 index = ic_liveness_index(v->lv, arg);
+    if (arg->type != IC_ARG_TEMP || index < 0 || index >= v->lv->temp_count) return NULL;
+    return &v->values[index];
+}
+
+/* Multiple of the counter that arg holds, 0 if none */
+static I64 ic_vec_scale_of(ICVec *v, CICArg *arg) {
+    if (ic_arg_equal(arg, &v->counter)) return 1;
+    ICVecValue *value = ic_vec_value(v, arg);
+    return value && value->kind == VEC_KIND_SCALED ? value->scale : 0;
+}
+
+static Bool ic_vec_is_vector(ICVec *v, CICArg *arg) {
+    ICVecValue *value = ic_vec_value(v, arg);
+    return value && value->kind == VEC_KIND_VECTOR;
+}
+
+static Bool ic_vec_add_invariant(ICVec *v, CICArg *arg) {
+    for (I64 i = 0; i < v->invariant_count; i++) {
+        if (ic_arg_equal(&v->invariants[i], arg)) return true;
+    }
+    if (v->invariant_count >= VEC_MAX_INVARIANTS) return false;
+    v->invariants[v->invariant_count++] = *arg;
+    return true;
+}
+
+/* A vector operand: computed from array elements or the same in every iteration */
+static Bool ic_vec_lane_operand(ICVec *v, CICArg *arg) {
+    if (ic_vec_is_vector(v, arg)) return true;
+    return ic_vec_is_invariant(v, arg) && ic_vec_add_invariant(v, arg);
+}
+
+static U16 ic_vec_opcode(U16 code) {
+    switch (code) {
+        case IC_ADD: return IC_VEC_ADD;
+        case IC_SUB: return IC_VEC_SUB;
+        case IC_MUL: return IC_VEC_MUL;
+        case IC_AND: return IC_VEC_AND;
+        case IC_OR:  return IC_VEC_OR;
+        case IC_XOR: return IC_VEC_XOR;
+        default:     return IC_NOP;
+    }
+}
+
+/* SSE2 multiplies 16-bit lanes only; AVX2 (with SSE4.1) adds 32-bit lanes */
+static Bool ic_vec_supported(ICVec *v, U16 code) {
+    if (ic_vec_opcode(code) == IC_NOP) return false;
+    if (code == IC_MUL) return v->elem == 2 || (v->elem == 4 && v->avx);
+    return true;
+}
+
+static Bool ic_vec_access(ICVec *v, CIntermediateCode *ic, Bool is_store) {
+    ICVecValue *addr = ic_vec_value(v, &ic->arg1);
+    I64 size = ic->memory_operand_size;
+    if (!addr || addr->kind != VEC_KIND_ADDR || addr->scale != size || v->mem_count >= VEC_MAX_MEMORY) return false;
+    if (size != 1 && size != 2 && size != 4 && size != 8) return false;
+    if (v->elem && v->elem != size) return false;
+    v->elem = size;
+    v->mem[v->mem_count].ic = ic;
+    v->mem[v->mem_count].base = addr->base;
+    v->mem[v->mem_count].is_store = is_store;
+    v->mem_count++;
+    return true;
+}
+
+static ICVecAccumulator* ic_vec_accumulator_of(ICVec *v, CIntermediateCode *ic) {
+    for (I64 a = 0; a < v->acc_count; a++) {
+        if (v->accs[a].op == ic) return &v->accs[a];
+    }
+    return NULL;
+}
+
+static Bool ic_vec_match_shape(ICVec *v) {
+    ICLoop *loop = v->loop;
+    if (loop->first_child || loop->block_count != 2) return false;
+
+    v->header = loop->header;
+    v->body = loop->blocks[0] == loop->header ? loop->blocks[1] : loop->blocks[0];
+
+    CIntermediateCode *label = v->header->first;
+    if (label->base.ic_code != IC_LABEL || (label->ic_flags & ICF_LOOP_UNROLLED)) return false;
+    v->test = label->base.next;
+    if (!v->test || v->test->res.type != IC_ARG_TEMP) return false;
+    v->exit_branch = v->test->base.next;
+    if (!v->exit_branch || v->exit_branch != v->header->last || v->exit_branch->base.ic_code != IC_JUMP_FALSE ||
+        !ic_arg_equal(&v->exit_branch->arg1, &v->test->res)) {
+        return false;
+    }
+    if (v->body->first != v->exit_branch->base.next) return false;
+    if (v->body->last->base.ic_code != IC_JUMP || ic_branch_target(v->body->last) != label) return false;
+
+    /* Upward count by one to an invariant bound */
+    switch (v->test->base.ic_code) {
+        case IC_LESS: case IC_LESS_EQU:
+            v->counter = v->test->arg1;
+            v->bound = v->test->arg2;
+            break;
+        case IC_GREATER: case IC_GREATER_EQU:
+            v->counter = v->test->arg2;
+            v->bound = v->test->arg1;
+            break;
+        default:
+            return false;
+    }
+    v->inclusive = v->test->base.ic_code == IC_LESS_EQU || v->test->base.ic_code == IC_GREATER_EQU;
+    if (!ic_vec_is_invariant(v, &v->bound) || ic_arg_equal(&v->bound, &v->counter)) return false;
+
+    CIntermediateCode *step = ic_vec_update(v, &v->counter);
+    if (!step || step->base.ic_code != IC_ADD || v->chain_count >= VEC_MAX_CHAIN) return false;
+    if (!(ic_arg_equal(&step->arg1, &v->counter) && step->arg2.type == IC_ARG_CONST && step->arg2.i64_val == 1) &&
+        !(ic_arg_equal(&step->arg2, &v->counter) && step->arg1.type == IC_ARG_CONST && step->arg1.i64_val == 1)) {
+        return false;
+    }
+    v->chain[v->chain_count++] = step;
+    return true;
+}
+
+/* Values carried around the loop besides the counter must be reductions */
+static Bool ic_vec_find_accumulators(ICVec *v) {
+    U64 *header_in = &v->lv->live_in[v->header->id * v->lv->words];
+
+    for (CIntermediateCode *ic = v->body->first; ic != v->body->last; ic = ic->base.next) {
+        CICArg *def = ic_get_def(ic);
+        I64 index = ic_liveness_index(v->lv, def);
+        if (index < 0 || !((header_in[index >> 6] >> (index & 63)) & 1)) continue;
+        if (ic_arg_equal(def, &v->counter)) continue;
+
+        CIntermediateCode *op = ic_vec_update(v, def);
+        if (!op || v->acc_count >= VEC_MAX_ACCUMULATORS) return false;
+        U16 code = op->base.ic_code;
+        if (code != IC_ADD && code != IC_AND && code != IC_OR && code != IC_XOR) return false;
+
+        ICVecAccumulator *acc = &v->accs[v->acc_count];
+        if (ic_arg_equal(&op->arg1, def)) {
+            acc->x = op->arg2;
+        } else if (ic_arg_equal(&op->arg2, def)) {
+            acc->x = op->arg1;
+        } else {
+            return false;
+        }
+        if (ic_arg_equal(&acc->x, def)) return false;
+
+        /* The op is the only reader of the accumulator */
+        I64 reads = 0;
+        for (CIntermediateCode *scan = v->body->first; scan != v->body->last; scan = scan->base.next) {
+            CICArg *uses[2];
+            I64 use_count = ic_get_uses(scan, uses);
+            for (I64 u = 0; u < use_count; u++) {
+                if (ic_arg_equal(uses[u], def)) reads++;
+            }
+        }
+        if (reads != 1 || ic_arg_equal(&v->bound, def)) return false;
+
+        acc->op = op;
+        acc->acc = *def;
+        v->acc_count++;
+    }
+    return true;
+}
+
+/* Pairs of a store and another access with a different base; they may overlap */
+static Bool ic_vec_may_alias(ICVec *v, I64 a, I64 b) {
+    if (!v->mem[a].is_store && !v->mem[b].is_store) return false;
+    return !ic_arg_equal(&v->mem[a].base, &v->mem[b].base);
+}
+
+/* Classify every body instruction; false when one has no vector form */
+static Bool ic_vec_classify(ICVec *v) {
+    U64 *header_in = &v->lv->live_in[v->header->id * v->lv->words];
+
+    for (CIntermediateCode *ic = v->body->first; ic != v->body->last; ic = ic->base.next) {
+        if (ic_vec_in_chain(v, ic)) continue;
+
+        U16 code = ic->base.ic_code;
+        CICArg *def = ic_get_def(ic);
+        ICVecAccumulator *acc = ic_vec_accumulator_of(v, ic);
+        if (acc) {
+            if (!ic_vec_is_vector(v, &acc->x) || !ic_vec_supported(v, code)) return false;
+            continue;
+        }
+
+        /* Everything else lives and dies within one iteration */
+        I64 index = ic_liveness_index(v->lv, def);
+        if (def && (def->type != IC_ARG_TEMP || index < 0 || ((header_in[index >> 6] >> (index & 63)) & 1))) {
+            return false;
+        }
+        ICVecValue *value = def ? &v->values[index] : NULL;
+
+        switch (code) {
+            case IC_ASSIGN: {
+                I64 scale = ic_vec_scale_of(v, &ic->arg1);
+                ICVecValue *src = ic_vec_value(v, &ic->arg1);
+                if (scale) {
+                    value->kind = VEC_KIND_SCALED;
+                    value->scale = scale;
+                } else if (src && src->kind != VEC_KIND_NONE) {
+                    *value = *src;
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case IC_MUL: case IC_SHL: {
+                if (ic_vec_is_vector(v, &ic->arg1) || ic_vec_is_vector(v, &ic->arg2)) goto lane_op;
+                CICArg *x = &ic->arg1, *c = &ic->arg2;
+                if (code == IC_MUL && ic->arg1.type == IC_ARG_CONST) {
+                    x = &ic->arg2;
+                    c = &ic->arg1;
+                }
+                I64 scale = ic_vec_scale_of(v, x);
+                if (!scale || c->type != IC_ARG_CONST || c->i64_val <= 0 || (code == IC_SHL && c->i64_val > 6)) {
+                    return false;
+                }
+                value->kind = VEC_KIND_SCALED;
+                value->scale = code == IC_MUL ? scale * c->i64_val : scale << c->i64_val;
+                break;
+            }
+            case IC_ADD: {
+                I64 scale = ic_vec_scale_of(v, &ic->arg1);
+                CICArg *base = &ic->arg2;
+                if (!scale) {
+                    scale = ic_vec_scale_of(v, &ic->arg2);
+                    base = &ic->arg1;
+                }
+                if (!scale) goto lane_op;
+                /* base + i * scale; a constant base means an offset element */
+                if (base->type == IC_ARG_CONST || !ic_vec_is_invariant(v, base)) return false;
+                value->kind = VEC_KIND_ADDR;
+                value->scale = scale;
+                value->base = *base;
+                break;
+            }
+            case IC_SUB: case IC_AND: case IC_OR: case IC_XOR:
+            lane_op:
+                if (!ic_vec_supported(v, code)) return false;
+                if (!ic_vec_is_vector(v, &ic->arg1) && !ic_vec_is_vector(v, &ic->arg2)) return false;
+                if (!ic_vec_lane_operand(v, &ic->arg1) || !ic_vec_lane_operand(v, &ic->arg2)) return false;
+                value->kind = VEC_KIND_VECTOR;
+                v->vector_count++;
+                break;
+            case IC_LOAD:
+                if (!ic_vec_access(v, ic, false)) return false;
+                value->kind = VEC_KIND_VECTOR;
+                v->vector_count++;
+                break;
+            case IC_STORE:
+                if (!ic_vec_access(v, ic, true) || !ic_vec_lane_operand(v, &ic->arg2)) return false;
+                break;
+            default:
+                return false;
+        }
+    }
+
+    if (v->mem_count == 0 || v->elem == 0) return false;
+    /* Reductions add up whole elements: lanes narrower than the accumulator would overflow */
+    if (v->acc_count > 0 && v->elem != 8) return false;
+    /* Lane operations before the element size was known */
+    for (CIntermediateCode *ic = v->body->first; ic != v->body->last; ic = ic->base.next) {
+        ICVecValue *value = ic_get_def(ic) && !ic_vec_in_chain(v, ic) ? ic_vec_value(v, ic_get_def(ic)) : NULL;
+        if (value && value->kind == VEC_KIND_VECTOR && ic->base.ic_code != IC_LOAD &&
+            ic->base.ic_code != IC_ASSIGN && !ic_vec_supported(v, ic->base.ic_code)) {
+            return false;
+        }
+    }
+    I64 checks = 0;
+    for (I64 a = 0; a < v->mem_count; a++) {
+        for (I64 b = a + 1; b < v->mem_count; b++) {
+            if (ic_vec_may_alias(v, a, b)) checks++;
+        }
+    }
+    if (checks > VEC_MAX_ALIAS_CHECKS) return false;
+
+    v->lanes = v->width / v->elem;
+    return v->vector_count + v->invariant_count + v->acc_count <= VEC_MAX_VALUES;
+}
+
+/*
+ * Code Generation
+ */
+
+static CIntermediateCode* ic_vec_emit(ICVec *v, CIntermediateCode *pos, U16 code, CICArg arg1, CICArg arg2, CICArg res) {
+    CIntermediateCode *ic = ic_new(code);
+    if (!ic) return NULL;
+    ic->arg1 = arg1;
+    ic->arg2 = arg2;
+    ic->res = res;
+    ic->ic_line = v->test->ic_line;
+    if (ic_is_vector_op(code)) {
+        ic->ic_data = v->width;
+        ic->memory_operand_size = v->elem;
+    }
+    ic_insert_before(v->ctx, pos, ic);
+    return ic;
+}
+
+static Bool ic_vec_emit_branch(ICVec *v, CIntermediateCode *pos, U16 code, CICArg cond, CIntermediateCode *label) {
+    CIntermediateCode *branch = ic_vec_emit(v, pos, code, cond, ic_arg_const(0), ic_arg_const(0));
+    if (!branch) return false;
+    if (code == IC_JUMP) branch->arg1 = ic_arg_const(0);
+    ic_set_branch_target(branch, label);
+    return true;
+}
+
+/* Iterations left: bound - counter, + 1 for an inclusive test */
+static CICArg ic_vec_emit_remaining(ICVec *v, CIntermediateCode *pos) {
+    CICArg rem = ic_arg_temp(v->ctx);
+    ic_vec_emit(v, pos, IC_SUB, v->bound, v->counter, rem);
+    if (v->inclusive) ic_vec_emit(v, pos, IC_ADD, rem, ic_arg_const(1), rem);
+    return rem;
+}
+
+/* Bases that may alias must be a vector apart, or equal */
+static Bool ic_vec_emit_alias_checks(ICVec *v, CIntermediateCode *pos, CIntermediateCode *scalar) {
+    for (I64 a = 0; a < v->mem_count; a++) {
+        for (I64 b = a + 1; b < v->mem_count; b++) {
+            if (!ic_vec_may_alias(v, a, b)) continue;
+
+            CICArg d = ic_arg_temp(v->ctx), above = ic_arg_temp(v->ctx), below = ic_arg_temp(v->ctx);
+            CICArg near = ic_arg_temp(v->ctx), apart = ic_arg_temp(v->ctx), overlap = ic_arg_temp(v->ctx);
+            ic_vec_emit(v, pos, IC_SUB, v->mem[a].base, v->mem[b].base, d);
+            ic_vec_emit(v, pos, IC_GREATER, d, ic_arg_const(-v->width), above);
+            ic_vec_emit(v, pos, IC_LESS, d, ic_arg_const(v->width), below);
+            ic_vec_emit(v, pos, IC_AND, above, below, near);
+            ic_vec_emit(v, pos, IC_NOT_EQU, d, ic_arg_const(0), apart);
+            ic_vec_emit(v, pos, IC_AND, near, apart, overlap);
+            if (!ic_vec_emit_branch(v, pos, IC_JUMP_TRUE, overlap, scalar)) return false;
+        }
+    }
+    return true;
+}
+
+/* One scalar iteration; temps that do not outlive it get fresh names */
+static Bool ic_vec_copy_body(ICVec *v, CIntermediateCode *pos, CICArg *renamed, Bool *is_renamed) {
+    U64 *body_out = &v->lv->live_out[v->body->id * v->lv->words];
+    memset(is_renamed, 0, sizeof(Bool) * (v->lv->temp_count + 1));
+
+    for (CIntermediateCode *ic = v->body->first; ic != v->body->last; ic = ic->base.next) {
+        CIntermediateCode *copy = ic_clone(ic);
+        if (!copy) return false;
+
+        CICArg *uses[2];
+        I64 use_count = ic_get_uses(copy, uses);
+        for (I64 n = 0; n < use_count; n++) {
+            if (uses[n]->type == IC_ARG_TEMP && uses[n]->i64_val < v->lv->temp_count && is_renamed[uses[n]->i64_val]) {
+                *uses[n] = renamed[uses[n]->i64_val];
+            }
+        }
+        CICArg *def = ic_get_def(copy);
+        I64 index = ic_liveness_index(v->lv, def);
+        if (def && def->type == IC_ARG_TEMP && index >= 0 && !((body_out[index >> 6] >> (index & 63)) & 1)) {
+            if (!is_renamed[index]) {
+                renamed[index] = ic_arg_temp(v->ctx);
+                is_renamed[index] = true;
+            }
+            *def = renamed[index];
+        }
+        ic_insert_before(v->ctx, pos, copy);
+    }
+    return true;
+}
+
+/*
+ * Alignment loop: runs scalar iterations until the first store (or the
+ * first load) is aligned to the vector width, and skips the vector loop
+ * altogether when fewer than one vector's worth would remain.
+ */
+static Bool ic_vec_emit_prologue(ICVec *v, CIntermediateCode *pos, CIntermediateCode *scalar,
+                                 CIntermediateCode *vector_setup, CICArg *renamed, Bool *is_renamed) {
+    ICGenContext *ctx = v->ctx;
+    ICVecAccess *lead = &v->mem[0];
+    for (I64 m = 0; m < v->mem_count; m++) {
+        if (v->mem[m].is_store) {
+            lead = &v->mem[m];
+            break;
+        }
+    }
+
+    CICArg offset = v->counter;
+    if (v->elem > 1) {
+        offset = ic_arg_temp(ctx);
+        ic_vec_emit(v, pos, IC_SHL, v->counter, ic_arg_const(ic_vec_log2(v->elem)), offset);
+    }
+    CICArg addr = ic_arg_temp(ctx), misalign = ic_arg_temp(ctx), peel = ic_arg_temp(ctx);
+    ic_vec_emit(v, pos, IC_ADD, lead->base, offset, addr);
+    ic_vec_emit(v, pos, IC_AND, addr, ic_arg_const(v->width - 1), misalign);
+    ic_vec_emit(v, pos, IC_SUB, ic_arg_const(v->width), misalign, peel);
+    ic_vec_emit(v, pos, IC_AND, peel, ic_arg_const(v->width - 1), peel);
+    if (v->elem > 1) ic_vec_emit(v, pos, IC_SHR, peel, ic_arg_const(ic_vec_log2(v->elem)), peel);
+
+    CICArg rem = ic_vec_emit_remaining(v, pos);
+    CICArg need = ic_arg_temp(ctx), few = ic_arg_temp(ctx), limit = ic_arg_temp(ctx), more = ic_arg_temp(ctx);
+    ic_vec_emit(v, pos, IC_ADD, peel, ic_arg_const(v->lanes), need);
+    ic_vec_emit(v, pos, IC_LESS, rem, need, few);
+    if (!ic_vec_emit_branch(v, pos, IC_JUMP_TRUE, few, scalar)) return false;
+    ic_vec_emit(v, pos, IC_ADD, v->counter, peel, limit);
+
+    CIntermediateCode *top = ic_gen_new_label(ctx);
+    if (!top) return false;
+    top->ic_flags |= ICF_LOOP_UNROLLED;
+    ic_insert_before(ctx, pos, top);
+    ic_vec_emit(v, pos, IC_LESS, v->counter, limit, more);
+    if (!ic_vec_emit_branch(v, pos, IC_JUMP_FALSE, more, vector_setup)) return false;
+    if (!ic_vec_copy_body(v, pos, renamed, is_renamed)) return false;
+    return ic_vec_emit_branch(v, pos, IC_JUMP, ic_arg_const(0), top);
+}
+
+static CICArg ic_vec_scalar_operand(ICVec *v, CICArg *arg, CICArg *map, Bool *mapped) {
+    I64 index = ic_liveness_index(v->lv, arg);
+    if (arg->type == IC_ARG_TEMP && index >= 0 && index < v->lv->temp_count && mapped[index]) return map[index];
+    return *arg;
+}
+
+static CICArg ic_vec_vector_operand(ICVec *v, CICArg *arg, CICArg *map, Bool *mapped) {
+    for (I64 i = 0; i < v->invariant_count; i++) {
+        if (ic_arg_equal(&v->invariants[i], arg)) return v->splats[i];
+    }
+    return ic_vec_scalar_operand(v, arg, map, mapped);
+}
+
+/* One vector iteration covering lanes scalar iterations */
+static Bool ic_vec_emit_vector_body(ICVec *v, CIntermediateCode *pos, CICArg *map, Bool *mapped) {
+    ICGenContext *ctx = v->ctx;
+    memset(mapped, 0, sizeof(Bool) * (v->lv->temp_count + 1));
+
+    for (CIntermediateCode *ic = v->body->first; ic != v->body->last; ic = ic->base.next) {
+        if (ic_vec_in_chain(v, ic)) continue;
+
+        U16 code = ic->base.ic_code;
+        ICVecAccumulator *acc = ic_vec_accumulator_of(v, ic);
+        if (acc) {
+            ic_vec_emit(v, pos, ic_vec_opcode(code), acc->vector, ic_vec_vector_operand(v, &acc->x, map, mapped),
+                        acc->vector);
+            continue;
+        }
+        if (code == IC_STORE) {
+            if (!ic_vec_emit(v, pos, IC_VEC_STORE, ic_vec_scalar_operand(v, &ic->arg1, map, mapped),
+                             ic_vec_vector_operand(v, &ic->arg2, map, mapped), ic_arg_const(0))) {
+                return false;
+            }
+            continue;
+        }
+
+        I64 index = ic_liveness_index(v->lv, &ic->res);
+        ICVecValue *value = &v->values[index];
+        if (code == IC_ASSIGN) {
+            map[index] = ic_vec_scalar_operand(v, &ic->arg1, map, mapped);
+            mapped[index] = true;
+            continue;
+        }
+
+        CICArg res = ic_arg_temp(ctx);
+        CIntermediateCode *emitted;
+        if (code == IC_LOAD) {
+            emitted = ic_vec_emit(v, pos, IC_VEC_LOAD, ic_vec_scalar_operand(v, &ic->arg1, map, mapped),
+                                  ic_arg_const(0), res);
+        } else if (value->kind == VEC_KIND_VECTOR) {
+            emitted = ic_vec_emit(v, pos, ic_vec_opcode(code), ic_vec_vector_operand(v, &ic->arg1, map, mapped),
+                                  ic_vec_vector_operand(v, &ic->arg2, map, mapped), res);
+        } else {
+            emitted = ic_vec_emit(v, pos, code, ic_vec_scalar_operand(v, &ic->arg1, map, mapped),
+                                  ic_vec_scalar_operand(v, &ic->arg2, map, mapped), res);
+        }
+        if (!emitted) return false;
+        map[index] = res;
+        mapped[index] = true;
+    }
+    return true;
+}
+
+static Bool ic_vec_transform(ICVec *v) {
+    ICGenContext *ctx = v->ctx;
+    CIntermediateCode *pos = ic_loop_preheader(ctx, v->loop);
+    if (!pos) return false;
+    CIntermediateCode *scalar = v->header->first;
+
+    I64 temp_count = v->lv->temp_count;
+    CICArg *map = malloc(sizeof(CICArg) * (temp_count + 1));
+    Bool *mapped = malloc(sizeof(Bool) * (temp_count + 1));
+    CIntermediateCode *setup = ic_gen_new_label(ctx);
+    CIntermediateCode *top = ic_gen_new_label(ctx);
+    Bool ok = map && mapped && setup && top && ic_vec_emit_alias_checks(v, pos, scalar) &&
+              ic_vec_emit_prologue(v, pos, scalar, setup, map, mapped);
+
+    if (ok) {
+        /* groups = whole vectors left; at least one after the alignment loop */
+        ic_insert_before(ctx, pos, setup);
+        CICArg rem = ic_vec_emit_remaining(v, pos);
+        v->groups = ic_arg_temp(ctx);
+        ic_vec_emit(v, pos, IC_SHR, rem, ic_arg_const(ic_vec_log2(v->lanes)), v->groups);
+
+        for (I64 i = 0; i < v->invariant_count; i++) {
+            v->splats[i] = ic_arg_temp(ctx);
+            ic_vec_emit(v, pos, IC_VEC_SPLAT, v->invariants[i], ic_arg_const(0), v->splats[i]);
+        }
+        for (I64 a = 0; a < v->acc_count; a++) {
+            /* Start every lane at the identity of the reduction */
+            v->accs[a].vector = ic_arg_temp(ctx);
+            I64 identity = v->accs[a].op->base.ic_code == IC_AND ? -1 : 0;
+            ic_vec_emit(v, pos, IC_VEC_SPLAT, ic_arg_const(identity), ic_arg_const(0), v->accs[a].vector);
+        }
+
+        top->ic_flags |= ICF_LOOP_UNROLLED;
+        ic_insert_before(ctx, pos, top);
+        ok = ic_vec_emit_vector_body(v, pos, map, mapped);
+    }
+
+    if (ok) {
+        CICArg more = ic_arg_temp(ctx);
+        ic_vec_emit(v, pos, IC_ADD, v->counter, ic_arg_const(v->lanes), v->counter);
+        ic_vec_emit(v, pos, IC_SUB, v->groups, ic_arg_const(1), v->groups);
+        ic_vec_emit(v, pos, IC_GREATER, v->groups, ic_arg_const(0), more);
+        ok = ic_vec_emit_branch(v, pos, IC_JUMP_TRUE, more, top);
+
+        for (I64 a = 0; ok && a < v->acc_count; a++) {
+            CICArg sum = ic_arg_temp(ctx);
+            U16 code = v->accs[a].op->base.ic_code;
+            ic_vec_emit(v, pos, IC_VEC_REDUCE, v->accs[a].vector, ic_arg_const(code), sum);
+            ic_vec_emit(v, pos, code, v->accs[a].acc, sum, v->accs[a].acc);
+        }
+        /* The original loop only finishes the last partial vector */
+        scalar->ic_flags |= ICF_LOOP_UNROLLED;
+    } else {
+        if (setup && !setup->base.next && !setup->base.last) ic_free(setup);
+        if (top && !top->base.next && !top->base.last) ic_free(top);
+    }
+
+    free(map);
+    free(mapped);
+    return ok;
+}
+
+static Bool ic_vec_loop(ICVec *v) {
+    if (!ic_vec_match_shape(v) || !ic_vec_find_accumulators(v)) return false;
+
+    v->values = calloc(v->lv->temp_count + 1, sizeof(ICVecValue));
+    Bool done = v->values && ic_vec_classify(v) && v->lanes >= 2 && ic_vec_transform(v);
+    free(v->values);
+    return done;
+}
+
+/*
+ * Vectorize innermost counted loops (i = i + 1 up to an invariant bound)
+ * whose single-block body does element-wise arithmetic on arrays indexed
+ * by i, fills or copies them, or sums (and, or, xor) 8-byte elements.
+ * AVX2 is used when the compiler control enables AVX, SSE2 otherwise;
+ * arrays that might overlap are checked at run time and fall back to the
+ * scalar loop.
+ */
+Bool opt_loop_vectorization(ICGenContext *ctx) {
+    if (!ctx || !ctx->cc || (!ctx->cc->use_sse_instructions && !ctx->cc->use_avx_instructions)) return false;
+
+    I64 vectorized = 0;
+
+    for (CIntermediateCode *enter = ic_next_function(ctx->ic_head); enter;
+         enter = ic_next_function(enter->base.next)) {
+        Bool changed = true;
+        I64 rounds = 0;
+        while (changed) {
+            changed = false;
+            rounds++;
+            if (rounds > 100) {
+                printf("ERROR: opt_loop_vectorization - infinite loop detected, breaking\n");
+                break;
+            }
+
+            ICCfg *cfg = ic_cfg_build(ctx, enter);
+            if (!cfg) break;
+            ICLiveness *lv = ic_liveness_compute(ctx, cfg);
+
+            for (I64 l = cfg->loop_count - 1; lv && l >= 0 && !changed; l--) {
+                ICVec v;
+                memset(&v, 0, sizeof(v));
+                v.ctx = ctx;
+                v.cfg = cfg;
+                v.lv = lv;
+                v.loop = cfg->loops[l];
+                v.avx = ctx->cc->use_avx_instructions;
+                v.width = v.avx ? 32 : 16;
+                if (ic_vec_loop(&v)) {
+                    vectorized++;
+                    changed = true;
+                }
+            }
+
+            ic_liveness_free(lv);
+            ic_cfg_free(cfg);
+        }
+    }
+
+    ctx->opt_changes += vectorized;
+    printf("DEBUG: opt_loop_vectorization - %lld loops vectorized (%s)\n", vectorized,
+           ctx->cc->use_avx_instructions ? "AVX2" : "SSE2");
+    return true;
+}
+
+/*
+ * Vector Instructions
+ */
+
+Bool ic_is_vector_op(U16 code) {
+    return code >= IC_VEC_LOAD && code <= IC_VEC_REDUCE;
+}
+
+/* Does ic leave a vector (rather than a scalar) in its result */
+Bool ic_defines_vector(CIntermediateCode *ic) {
+    return ic && ic_is_vector_op(ic->base.ic_code) &&
+           ic->base.ic_code != IC_VEC_STORE && ic->base.ic_code != IC_VEC_REDUCE;
+}
+
+/* The SSE2 or AVX2 instruction sequence an IC_VEC_* instruction stands for */
+void ic_vec_mnemonic(CIntermediateCode *ic, char *buf, I64 size) {
+    if (!buf || size <= 0) return;
+    buf[0] = '\0';
+    if (!ic || !ic_is_vector_op(ic->base.ic_code)) return;
+
+    const char *v = ic->ic_data >= 32 ? "v" : "";
+    I64 elem = ic->memory_operand_size;
+    const char *lane = elem == 1 ? "b" : elem == 2 ? "w" : elem == 4 ? "d" : "q";
+
+    switch (ic->base.ic_code) {
+        case IC_VEC_LOAD:
+        case IC_VEC_STORE:
+            snprintf(buf, size, "%smovdqu", v);
+            break;
+        case IC_VEC_SPLAT:
+            if (ic->ic_data >= 32) {
+                snprintf(buf, size, "vpbroadcast%s", lane);
+            } else {
+                snprintf(buf, size, "%s", elem == 8 ? "movq+punpcklqdq" : elem == 4 ? "movd+pshufd" :
+                         elem == 2 ? "movd+pshuflw+pshufd" : "movd+punpcklbw+pshuflw+pshufd");
+            }
+            break;
+        case IC_VEC_ADD: snprintf(buf, size, "%spadd%s", v, lane); break;
+        case IC_VEC_SUB: snprintf(buf, size, "%spsub%s", v, lane); break;
+        case IC_VEC_MUL: snprintf(buf, size, "%spmull%s", v, lane); break;
+        case IC_VEC_AND: snprintf(buf, size, "%spand", v); break;
+        case IC_VEC_OR:  snprintf(buf, size, "%spor", v); break;
+        case IC_VEC_XOR: snprintf(buf, size, "%spxor", v); break;
+        case IC_VEC_REDUCE: {
+            char op[16];
+            switch (ic->arg2.i64_val) {
+                case IC_AND: snprintf(op, sizeof(op), "pand"); break;
+                case IC_OR:  snprintf(op, sizeof(op), "por"); break;
+                case IC_XOR: snprintf(op, sizeof(op), "pxor"); break;
+                default:     snprintf(op, sizeof(op), "padd%s", lane); break;
+            }
+            if (ic->ic_data >= 32) {
+                snprintf(buf, size, "vextracti128+v%s+pshufd+%s+movq", op, op);
+            } else {
+                snprintf(buf, size, "pshufd+%s+movq", op);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
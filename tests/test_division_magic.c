@@ -0,0 +1,172 @@
+/*
+ * Division by Constants - host-side check
+ * Replays in C the instruction sequences masm_output.c emits for x / d and
+ * x % d with the magic numbers of masm_divide.c, and compares them with C
+ * division for every divisor up to 1000 in magnitude, the powers of two
+ * and their neighbours, and the extremes of each width, on edge-case and
+ * pseudo-random dividends.
+ *
+ * gcc -std=c99 -Iinclude tests/test_division_magic.c src/backend/assembly/masm_divide.c
+ */
+
+#include "masm_output.h"
+#include <stdio.h>
+
+#define RANDOM_DIVIDENDS 2000
+
+static U64 seed = 0x9E3779B97F4A7C15ULL;
+static I64 failures = 0;
+
+static U64 next_random(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return seed;
+}
+
+static U64 width_mask(I64 width) {
+    return width == 64 ? ~0ULL : 0xFFFFFFFFULL;
+}
+
+/* Sign-extend the low width bits of v */
+static I64 sign_extend(U64 v, I64 width) {
+    if (width == 64) return (I64)v;
+    v &= 0xFFFFFFFFULL;
+    return (v >> 31) ? (I64)(v | ~0xFFFFFFFFULL) : (I64)v;
+}
+
+/* High width bits of the unsigned product of two width-bit values (mul) */
+static U64 mul_high_unsigned(U64 a, U64 b, I64 width) {
+    if (width == 32) return ((a & 0xFFFFFFFFULL) * (b & 0xFFFFFFFFULL)) >> 32;
+    U64 a_lo = a & 0xFFFFFFFFULL, a_hi = a >> 32;
+    U64 b_lo = b & 0xFFFFFFFFULL, b_hi = b >> 32;
+    U64 lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi, hi_hi = a_hi * b_hi;
+    U64 middle = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFULL) + lo_hi;
+    return hi_hi + (hi_lo >> 32) + (middle >> 32);
+}
+
+/* High width bits of the signed product (imul) */
+static U64 mul_high_signed(U64 a, U64 b, I64 width) {
+    U64 mask = width_mask(width);
+    U64 high = mul_high_unsigned(a, b, width);
+    if (sign_extend(a, width) < 0) high -= b;
+    if (sign_extend(b, width) < 0) high -= a;
+    return high & mask;
+}
+
+/* Arithmetic right shift within width bits */
+static U64 sar(U64 v, I64 count, I64 width) {
+    return (U64)(sign_extend(v, width) >> count) & width_mask(width);
+}
+
+/* The quotient masm_div_multiply_high computes */
+static U64 emitted_multiply_high(U64 x, I64 d, I64 width, Bool is_signed) {
+    U64 mask = width_mask(width);
+    MASMDivMagic magic;
+    if (!is_signed) {
+        masm_div_magic_unsigned((U64)d, width, &magic);
+        U64 hi = mul_high_unsigned(x, magic.multiplier, width);
+        if (!magic.add) return hi >> magic.shift;
+        U64 q = ((((x - hi) & mask) >> 1) + hi) & mask;
+        return magic.shift > 1 ? q >> (magic.shift - 1) : q;
+    }
+
+    masm_div_magic_signed(d, width, &magic);
+    Bool top = (magic.multiplier >> (width - 1)) != 0;
+    U64 hi = mul_high_signed(x, magic.multiplier, width);
+    if ((d > 0 && top) || (d < 0 && !top)) hi = (d > 0 ? hi + x : hi - x) & mask;
+    if (magic.shift > 0) hi = sar(hi, magic.shift, width);
+    return (hi + (hi >> (width - 1))) & mask;
+}
+
+/* The quotient masm_div_power_of_two computes for d = +/-2^k */
+static U64 emitted_power_of_two(U64 x, I64 k, I64 width, Bool is_signed, Bool negate) {
+    U64 mask = width_mask(width);
+    if (!is_signed) return x >> k;
+    U64 bias = (sar(x, width - 1, width) & mask) >> (width - k);
+    U64 q = sar((x + bias) & mask, k, width);
+    return negate ? (0 - q) & mask : q;
+}
+
+static void check(U64 x, I64 d, I64 width, Bool is_signed) {
+    U64 mask = width_mask(width);
+    x &= mask;
+
+    U64 magnitude = d < 0 ? 0 - (U64)d : (U64)d;
+    I64 k = masm_div_log2(magnitude);
+    U64 q = k > 0 ? emitted_power_of_two(x, k, width, is_signed, d < 0)
+                  : emitted_multiply_high(x, d, width, is_signed);
+    U64 r = (x - q * (U64)d) & mask;
+
+    U64 want_q, want_r;
+    if (is_signed) {
+        I64 sx = sign_extend(x, width);
+        want_q = (U64)(sx / d) & mask;
+        want_r = (U64)(sx % d) & mask;
+    } else {
+        want_q = x / (U64)d;
+        want_r = x % (U64)d;
+    }
+
+    if (q != want_q || r != want_r) {
+        if (failures < 20) {
+            printf("FAIL: %s %lld-bit %llu / %lld: got %llu r %llu, want %llu r %llu\n",
+                   is_signed ? "signed" : "unsigned", (long long)width, (unsigned long long)x, (long long)d,
+                   (unsigned long long)q, (unsigned long long)r,
+                   (unsigned long long)want_q, (unsigned long long)want_r);
+        }
+        failures++;
+    }
+}
+
+static void check_divisor(I64 d, I64 width, Bool is_signed) {
+    U64 mask = width_mask(width);
+    U64 sign = 1ULL << (width - 1);
+    U64 magnitude = d < 0 ? 0 - (U64)d : (U64)d;
+    U64 edges[] = {
+        0, 1, mask, sign, sign - 1, sign + 1, mask - 1,
+        magnitude, magnitude - 1, magnitude + 1, 0 - magnitude, 0 - magnitude - 1,
+        magnitude * 2, magnitude * 2 - 1, (sign / magnitude) * magnitude, (mask / magnitude) * magnitude - 1
+    };
+    for (size_t e = 0; e < sizeof(edges) / sizeof(edges[0]); e++) check(edges[e], d, width, is_signed);
+    for (I64 i = 0; i < RANDOM_DIVIDENDS; i++) {
+        U64 x = next_random();
+        /* Small dividends as well, where the rounding fixups matter most */
+        if (i % 4 == 0) x = sign_extend(x, width) % 100000;
+        check(x, d, width, is_signed);
+    }
+}
+
+int main(void) {
+    I64 divisors = 0;
+    for (I64 width = 32; width <= 64; width += 32) {
+        I64 max = (I64)((1ULL << (width - 1)) - 1);
+        for (int s = 0; s < 2; s++) {
+            Bool is_signed = s == 0;
+            /* The extremes; the signed minimum has no magic number and keeps idiv */
+            I64 extremes[] = {max, max - 1, max / 3, is_signed ? -max : (I64)width_mask(width)};
+            for (size_t e = 0; e < sizeof(extremes) / sizeof(extremes[0]); e++) {
+                if (width == 64 && !is_signed && extremes[e] < 0) continue;
+                check_divisor(extremes[e], width, is_signed);
+                divisors++;
+            }
+            for (I64 d = is_signed ? -1000 : 2; d <= 1000; d++) {
+                if (d >= -1 && d <= 1) continue;
+                check_divisor(d, width, is_signed);
+                divisors++;
+            }
+            for (I64 k = 2; k < width - 1; k++) {
+                I64 p = (I64)1 << k;
+                I64 around[] = {p - 1, p, p + 1};
+                for (int a = 0; a < 3; a++) {
+                    check_divisor(around[a], width, is_signed);
+                    if (is_signed) check_divisor(-around[a], width, is_signed);
+                    divisors += is_signed ? 2 : 1;
+                }
+            }
+        }
+    }
+
+    printf("%lld divisors checked, %lld mismatches\n", (long long)divisors, (long long)failures);
+    return failures == 0 ? 0 : 1;
+}